@@ -38,6 +38,15 @@
 #define MCP9808_REG_CONFIG_ALERTPOL     0x0002
 #define MCP9808_REG_CONFIG_ALERTMODE    0x0001
 
+// Resolution register values (MCP9808 datasheet, Table 5-4 / 5-6).
+// Typical conversion time grows with resolution; a read issued before
+// the first conversion at a new resolution completes returns stale data.
+//-----------------------------------
+#define MCP9808_RES_0_5C                0x00       // +0.5 C,     tCONV ~30 ms
+#define MCP9808_RES_0_25C               0x01       // +0.25 C,    tCONV ~65 ms
+#define MCP9808_RES_0_125C              0x02       // +0.125 C,   tCONV ~130 ms
+#define MCP9808_RES_0_0625C             0x03       // +0.0625 C,  tCONV ~250 ms (power-up default)
+
 // Expected return values.
 //-----------------------------------
 #define MCP9808_MANID_EXPECTED          0x0054
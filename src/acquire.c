@@ -0,0 +1,579 @@
+//=========================================================================
+// acquire.c
+//
+// Acquisition sequencer for the RM3100 magnetometer.
+//
+// A POLL measurement leaves the bus idle for the whole conversion
+// (several ms at cc=200, twice that at cc=400).  The sequencer issues
+// the POLL trigger first, runs the other bus work -- the low-rate
+// temperature read, adapter telemetry and control commands queued
+// by the output reactor --
+// inside that window, and only then checks DRDY and fetches XYZ, so
+// a sample costs roughly max(conversion, I/O) instead of their sum.
+//
+// With several RM3100s on the bus (gradiometer mode) all of them are
+// triggered in one adapter batch and convert side by side; each is
+// then read as soon as its own DRDY is seen, in whatever order they
+// finish, rather than waiting on each sensor in turn.
+//
+// In CMM the sensors pace themselves at the TMRC rate.  The sequencer
+// sleeps until the next result is due, does the housekeeping first,
+// and then reads each sensor as its DRDY comes up, so every
+// conversion is fetched exactly once.
+//
+// Every sleep here is cut short by a stop request (halt.c); the
+// sample in progress is then abandoned with -ECANCELED.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <errno.h>
+#include "main.h"
+#include "acquire.h"
+#include "i2c.h"
+#include "magdata.h"
+#include "cmdmgr.h"
+#include "temperature.h"
+#include "autorange.h"
+#include "timeutil.h"
+#include "trace.h"
+#include "halt.h"
+
+//---------------------------------------------------------------
+// adapter_telemetry(pList *p)
+//
+// Low-rate adapter health probe: a device-info round trip proves the
+// adapter is still answering and gives a USB round-trip time.
+//---------------------------------------------------------------
+static void adapter_telemetry(pList *p)
+{
+    i2c_pololu_device_info info;
+    int64_t now = mono_ns();
+
+    if(p->adapterTelemetryInterval <= 0 || now < p->adapterNextProbeNs)
+    {
+        return;
+    }
+    p->adapterNextProbeNs = now + (int64_t)p->adapterTelemetryInterval * NSEC_PER_SEC;
+
+    if(i2c_pololu_get_device_info(p->adapter, &info) == 0)
+    {
+        p->adapterRttNs = mono_ns() - now;
+    }
+    else
+    {
+        p->adapterProbeFailures++;
+    }
+}
+
+//---------------------------------------------------------------
+// acq_housekeeping(pList *p)
+// Everything that may share the bus with a running conversion.
+//---------------------------------------------------------------
+static void acq_housekeeping(pList *p)
+{
+    temp_service(p);
+    adapter_telemetry(p);
+    ctl_runQueued(p, CTL_PHASE_CONVERTING);
+}
+
+//---------------------------------------------------------------
+// acq_cmmRestart(pList *p)
+// (Re)starts CMM and treats every sensor as having no result yet.
+//---------------------------------------------------------------
+static void acq_cmmRestart(pList *p)
+{
+    magStamp st;
+
+    startCMM(p);
+    p->cmmRuns++;
+    clock_pair_ns(&st.trigRealNs, &st.trigMonoNs);
+    for(int i = 0; i < p->numMags; i++)
+    {
+        p->pollStamps[i] = st;
+        p->magStamps[i].drdyMonoNs = 0;     // no gap to count across a restart
+    }
+    p->cmmNextNs = st.trigMonoNs + getCMMPeriodNs(p);
+}
+
+//---------------------------------------------------------------
+// acq_init(pList *p)
+//---------------------------------------------------------------
+int acq_init(pList *p)
+{
+    p->i2cErrors            = 0;
+    p->drdyTimeouts         = 0;
+    p->adapterRttNs         = 0;
+    p->adapterProbeFailures = 0;
+    p->adapterNextProbeNs   = mono_ns();
+    p->pollArmed            = 0;
+    p->sampleSeq            = 0;
+    p->acqMisses            = 0;
+    p->clockSteps           = 0;
+    p->cmmSkipped           = 0;
+    p->cmmRuns              = 0;
+    p->cmmNextNs            = mono_ns();
+    for(int i = 0; i < MAX_MAGS; i++)
+    {
+        p->magValid[i] = FALSE;
+    }
+    ar_init(p);
+    if(p->samplingMode == CMM)
+    {
+        acq_cmmRestart(p);
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// acq_trigger(pList *p, unsigned mask)
+// Starts a conversion on every sensor in mask with one adapter batch.
+//---------------------------------------------------------------
+static int acq_trigger(pList *p, unsigned mask)
+{
+    uint8_t addrs[MAX_MAGS];
+    int     which[MAX_MAGS];
+    int     errors[MAX_MAGS];
+    int     n = 0;
+
+    for(int i = 0; i < p->numMags; i++)
+    {
+        if(mask & (1u << i))
+        {
+            addrs[n]   = (uint8_t)p->magAddrs[i];
+            which[n++] = i;
+        }
+    }
+    magStamp st;
+    clock_pair_ns(&st.trigRealNs, &st.trigMonoNs);
+    int started = i2c_triggerMagPOLLEach(p, addrs, n, errors);
+    int64_t now = mono_ns();
+    trc_record(TRC_TRIGGER, now - st.trigMonoNs);
+    for(int k = 0; k < n; k++)
+    {
+        if(errors[k])
+        {
+            p->i2cErrors++;
+            continue;
+        }
+        p->pollStamps[which[k]]    = st;
+        p->pollTriggerNs[which[k]] = now;
+        p->pollArmed |= 1u << which[k];
+    }
+    return started;
+}
+
+//---------------------------------------------------------------
+// acq_pollSample(pList *p)
+//
+// One POLL measurement of every configured sensor: trigger,
+// housekeeping during the conversion, then DRDY and XYZ fetch per
+// sensor as each becomes ready, then any queued commands that had to
+// wait for the magnetometers to go idle.  p->magXYZ[i] and
+// p->magValid[i] hold the per-sensor results and p->XYZ mirrors the
+// primary sensor.  Returns the number of sensors read, or a negative
+// value if none could be.
+//
+// With pList.pollPipeline set, the XYZ read of conversion N is chained
+// with the POLL trigger for conversion N+1 in one adapter batch, so the
+// sensor converts while the host formats and publishes sample N.  The
+// next call then normally finds the conversion long finished and skips
+// straight to the data read.  A pending register-writing control
+// command breaks the chain for one sample so it can run while the
+// magnetometers are idle.
+//---------------------------------------------------------------
+int acq_pollSample(pList *p)
+{
+    const int max_polls = 1000; // safety cap, as in i2c_waitMagDRDY()
+    int64_t conv = getMagConversionUs(p) * NSEC_PER_USEC;
+    unsigned all = (1u << p->numMags) - 1;
+    int rv = -1;
+
+    for(int i = 0; i < p->numMags; i++)
+    {
+        p->magValid[i] = FALSE;
+    }
+    if(all & ~p->pollArmed)
+    {
+        acq_trigger(p, all & ~p->pollArmed);
+    }
+    if(!p->pollArmed)
+    {
+        return -1;
+    }
+
+    // Sleep only until the earliest conversion is due; later ones are
+    // picked up by the round-robin below.
+    int64_t ready = INT64_MAX;
+    for(int i = 0; i < p->numMags; i++)
+    {
+        if((p->pollArmed & (1u << i)) && p->pollTriggerNs[i] + conv < ready)
+        {
+            ready = p->pollTriggerNs[i] + conv;
+        }
+    }
+
+    acq_housekeeping(p);
+
+    // If the housekeeping finished early, sleep out the rest of the
+    // conversion rather than spending STATUS round trips on it.
+    int64_t now = mono_ns();
+    if(now < ready && halt_sleepUntil(ready) < 0)
+    {
+        return -ECANCELED;
+    }
+
+    int chain = p->pollPipeline && !ctl_magCommandPending();
+    unsigned pending = p->pollArmed;
+    int harvested = 0;
+    int polls = 0;
+
+    while(pending)
+    {
+        for(int i = 0; i < p->numMags; i++)
+        {
+            unsigned bit = 1u << i;
+            uint8_t  addr = (uint8_t)p->magAddrs[i];
+            if(!(pending & bit))
+            {
+                continue;
+            }
+
+            // A pipelined conversion that finished well over one
+            // conversion time ago cannot still be pending, so don't pay
+            // for the STATUS round trip.  Anything closer than that is
+            // confirmed via DRDY.
+            magStamp st = p->pollStamps[i];
+            if(!(p->pollPipeline && now >= p->pollTriggerNs[i] + 2 * conv))
+            {
+                int drdy = i2c_readMagDRDYAt(p, addr);
+                if(drdy == 0)
+                {
+                    continue;
+                }
+                if(drdy < 0)
+                {
+                    p->i2cErrors++;
+                    pending      &= ~bit;
+                    p->pollArmed &= ~bit;
+                    rv = drdy;
+                    continue;
+                }
+                clock_pair_ns(&st.drdyRealNs, &st.drdyMonoNs);
+                trc_record(TRC_DRDY, st.drdyMonoNs - st.trigMonoNs);
+            }
+            else
+            {
+                // DRDY was not observed; close the bracket at the
+                // expected end of the conversion, one conversion time
+                // after the trigger, where the polled path would have
+                // seen it.  The bound that justified skipping the poll
+                // is not the ready time, and would put the midpoint
+                // half a conversion late.
+                st.drdyMonoNs = st.trigMonoNs + conv;
+                st.drdyRealNs = st.trigRealNs + conv;
+            }
+
+            // In a chained read the next trigger follows this data read
+            // in the same batch, so the stamp taken before it bounds
+            // the start of the next conversion.
+            magStamp next;
+            if(chain)
+            {
+                clock_pair_ns(&next.trigRealNs, &next.trigMonoNs);
+            }
+            int64_t t0 = trc_now();
+            int r = chain ? i2c_readMagXYZAndTriggerAt(p, addr, p->magXYZ[i])
+                          : i2c_readMagXYZAt(p, addr, p->magXYZ[i]);
+            trc_lap(TRC_XYZ, t0);
+            pending      &= ~bit;
+            p->pollArmed &= ~bit;
+            if(r != XYZ_BUFLEN)
+            {
+                p->i2cErrors++;
+                rv = (r < 0) ? r : -1;
+                continue;
+            }
+            p->magValid[i]  = TRUE;
+            p->magStamps[i] = st;
+            harvested++;
+            if(chain)
+            {
+                p->pollStamps[i]    = next;
+                p->pollTriggerNs[i] = mono_ns();
+                p->pollArmed       |= bit;
+            }
+        }
+        if(pending && ++polls >= max_polls)
+        {
+            for(int i = 0; i < p->numMags; i++)
+            {
+                if(pending & (1u << i))
+                {
+                    fprintf(OUTPUT_ERROR, "  Timeout waiting for DRDY at 0x%02X\n", (unsigned)(p->magAddrs[i] & 0xFF));
+                    p->drdyTimeouts++;
+                }
+            }
+            p->pollArmed &= ~pending;
+            rv = -ETIMEDOUT;
+            break;
+        }
+        if(pending && halt_sleepUntil(mono_ns() + p->DRDYdelay * NSEC_PER_MSEC) < 0) // DRDYdelay in ms
+        {
+            rv = -ECANCELED;
+            break;
+        }
+    }
+
+    if(p->magValid[0])
+    {
+        p->XYZ[0] = p->magXYZ[0][0];
+        p->XYZ[1] = p->magXYZ[0][1];
+        p->XYZ[2] = p->magXYZ[0][2];
+    }
+
+    ctl_runQueued(p, p->pollArmed ? CTL_PHASE_CONVERTING : CTL_PHASE_MAG_IDLE);
+    return harvested ? harvested : rv;
+}
+
+//---------------------------------------------------------------
+// acq_cmmSample(pList *p)
+//
+// Fetches the next CMM result from every configured sensor.  The
+// results land in the same places as with acq_pollSample().  Since
+// the conversion start is not observed in CMM, each result is
+// bracketed from the last time its sensor was seen without new data,
+// less one conversion time, to the DRDY that reported it.
+// p->cmmSkipped is set to the number of conversions of the primary
+// sensor that went by unread before this one.  Returns the number of
+// sensors read, or a negative value if none could be.
+//
+// A register-writing control command stops CMM, runs and restarts
+// it, as the cycle count registers must not change mid-conversion.
+//---------------------------------------------------------------
+int acq_cmmSample(pList *p)
+{
+    const int max_polls = 1000;
+    int64_t period = getCMMPeriodNs(p);
+    int64_t conv   = getMagConversionUs(p) * NSEC_PER_USEC;
+    int64_t nap    = period / 16;
+    unsigned pending = (1u << p->numMags) - 1;
+    int64_t prevDrdy = p->magStamps[0].drdyMonoNs;
+    int harvested = 0;
+    int polls = 0;
+    int rv = -1;
+
+    for(int i = 0; i < p->numMags; i++)
+    {
+        p->magValid[i] = FALSE;
+    }
+    p->cmmSkipped = 0;
+
+    // The bus is idle until the next result is due.
+    acq_housekeeping(p);
+    if(halt_sleepUntil(p->cmmNextNs) < 0)
+    {
+        return -ECANCELED;
+    }
+
+    while(pending)
+    {
+        for(int i = 0; i < p->numMags; i++)
+        {
+            unsigned bit = 1u << i;
+            uint8_t  addr = (uint8_t)p->magAddrs[i];
+            magStamp st;
+            if(!(pending & bit))
+            {
+                continue;
+            }
+            int drdy = i2c_readMagDRDYAt(p, addr);
+            clock_pair_ns(&st.drdyRealNs, &st.drdyMonoNs);
+            if(drdy == 0)
+            {
+                p->pollStamps[i].trigRealNs = st.drdyRealNs;
+                p->pollStamps[i].trigMonoNs = st.drdyMonoNs;
+                continue;
+            }
+            pending &= ~bit;
+            if(drdy < 0)
+            {
+                p->i2cErrors++;
+                rv = drdy;
+                continue;
+            }
+            st.trigRealNs = p->pollStamps[i].trigRealNs - conv;
+            st.trigMonoNs = p->pollStamps[i].trigMonoNs - conv;
+
+            int64_t t0 = trc_now();
+            int r = i2c_readMagXYZAt(p, addr, p->magXYZ[i]);
+            trc_lap(TRC_XYZ, t0);
+            clock_pair_ns(&p->pollStamps[i].trigRealNs, &p->pollStamps[i].trigMonoNs);
+            if(r != XYZ_BUFLEN)
+            {
+                p->i2cErrors++;
+                rv = (r < 0) ? r : -1;
+                continue;
+            }
+            p->magValid[i]  = TRUE;
+            p->magStamps[i] = st;
+            harvested++;
+        }
+        if(pending && ++polls >= max_polls)
+        {
+            for(int i = 0; i < p->numMags; i++)
+            {
+                if(pending & (1u << i))
+                {
+                    fprintf(OUTPUT_ERROR, "  Timeout waiting for DRDY at 0x%02X\n", (unsigned)(p->magAddrs[i] & 0xFF));
+                    p->drdyTimeouts++;
+                }
+            }
+            rv = -ETIMEDOUT;
+            break;
+        }
+        if(pending && halt_sleepUntil(mono_ns() + nap) < 0)
+        {
+            rv = -ECANCELED;
+            break;
+        }
+    }
+
+    if(p->magValid[0])
+    {
+        p->XYZ[0] = p->magXYZ[0][0];
+        p->XYZ[1] = p->magXYZ[0][1];
+        p->XYZ[2] = p->magXYZ[0][2];
+
+        // Wake a little early for the next result rather than late.
+        int64_t drdy = p->magStamps[0].drdyMonoNs;
+        if(prevDrdy > 0 && drdy - prevDrdy > period + period / 2)
+        {
+            p->cmmSkipped = (unsigned long)((drdy - prevDrdy + period / 2) / period) - 1;
+        }
+        p->cmmNextNs = drdy + period - nap;
+    }
+    else
+    {
+        // Look again shortly: a result the failed read left behind is
+        // then seen about when it was due, so the DRDY gap above
+        // counts lost conversions and not the time lost here.
+        p->cmmNextNs = mono_ns() + nap;
+    }
+
+    if(ctl_magCommandPending())
+    {
+        stopCMM(p);
+        ctl_runQueued(p, CTL_PHASE_MAG_IDLE);
+        acq_cmmRestart(p);
+    }
+    return harvested ? harvested : rv;
+}
+
+//---------------------------------------------------------------
+// acq_cmmNext(pList *p, magSample *s)
+//
+// The next CMM result as a sample with its seq.  Seqs follow the
+// primary sensor's conversions: those that went by unread, counted
+// from the gap between its DRDYs, are skipped as misses, so a read
+// that fails or times out uses no seq of its own.  Returns the
+// number of sensors read into s, 0 if the primary was not read, or
+// a negative value as acq_cmmSample() does.
+//---------------------------------------------------------------
+int acq_cmmNext(pList *p, magSample *s)
+{
+    int rv = acq_cmmSample(p);
+
+    if(rv <= 0 || !p->magValid[0])
+    {
+        return (rv < 0) ? rv : 0;
+    }
+    p->sampleSeq += p->cmmSkipped;
+    p->acqMisses += p->cmmSkipped;
+    acq_fillSample(p, s);
+    s->seq = p->sampleSeq++;
+    return rv;
+}
+
+//---------------------------------------------------------------
+// acq_fillSample(pList *p, magSample *s)
+//
+// Snapshots the last acq_pollSample() into s.  The caller assigns
+// s->seq and, just before queueing it, s->queuedMonoNs.
+//---------------------------------------------------------------
+void acq_fillSample(pList *p, magSample *s)
+{
+    double age = 0.0;
+
+    s->numMags   = p->numMags;
+    s->validMask = 0;
+    for(int i = 0; i < p->numMags; i++)
+    {
+        if(p->magValid[i])
+        {
+            s->validMask |= 1u << i;
+        }
+        s->xyz[i][0] = p->magXYZ[i][0];
+        s->xyz[i][1] = p->magXYZ[i][1];
+        s->xyz[i][2] = p->magXYZ[i][2];
+        s->stamps[i] = p->magStamps[i];
+    }
+    s->cmmRun    = p->cmmRuns;
+    s->ppsValid  = FALSE;
+    s->ppsOffsetNs = 0;
+    s->gnssValid   = FALSE;
+    s->gnssHostNs  = 0;
+    s->clockStepNs = 0;
+    cq_latest(&s->clock);
+    s->traceStartNs = 0;
+    s->queuedMonoNs = 0;
+    for(int i = 0; i < p->numMags && trc_now() != 0; i++)
+    {
+        // The trigger is not observed in CMM; the trace starts at DRDY.
+        if(p->magValid[i])
+        {
+            s->traceStartNs = (p->samplingMode == CMM) ? p->magStamps[i].drdyMonoNs
+                                                       : p->magStamps[i].trigMonoNs;
+            break;
+        }
+    }
+    s->cc[0]     = p->cc_x;
+    s->cc[1]     = p->cc_y;
+    s->cc[2]     = p->cc_z;
+    s->gain[0]   = p->x_gain;
+    s->gain[1]   = p->y_gain;
+    s->gain[2]   = p->z_gain;
+    s->tempValid = temp_latest(p, &s->tempCelsius, &age);
+    s->tempAge   = s->tempValid ? age : -1.0;
+}
+
+//---------------------------------------------------------------
+// acq_sampleInstant(const magSample *s, int i, int64_t *real_ns,
+//                   int64_t *mono, int64_t *uncertainty_ns)
+//
+// Effective measurement instant of sensor i in sample s: the
+// midpoint of its trigger/DRDY bracket on both clocks, with the full
+// bracket width as the uncertainty.  Returns FALSE if the sensor was
+// not read on that tick.
+//---------------------------------------------------------------
+int acq_sampleInstant(const magSample *s, int i, int64_t *real_ns, int64_t *mono, int64_t *uncertainty_ns)
+{
+    if(i < 0 || i >= s->numMags || !(s->validMask & (1u << i)))
+    {
+        return FALSE;
+    }
+    const magStamp *st = &s->stamps[i];
+    if(real_ns)
+    {
+        *real_ns = st->trigRealNs + (st->drdyRealNs - st->trigRealNs) / 2;
+    }
+    if(mono)
+    {
+        *mono = st->trigMonoNs + (st->drdyMonoNs - st->trigMonoNs) / 2;
+    }
+    if(uncertainty_ns)
+    {
+        *uncertainty_ns = st->drdyMonoNs - st->trigMonoNs;
+    }
+    return TRUE;
+}
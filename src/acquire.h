@@ -0,0 +1,24 @@
+//=========================================================================
+// acquire.h
+//
+// Acquisition sequencer for the RM3100 magnetometer.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_ACQUIRE_H
+#define MAG_USB_ACQUIRE_H
+
+#include "main.h"
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int  acq_init(pList *p);
+int  acq_pollSample(pList *p);
+int  acq_cmmSample(pList *p);
+int  acq_cmmNext(pList *p, magSample *s);
+void acq_fillSample(pList *p, magSample *s);
+int  acq_sampleInstant(const magSample *s, int i, int64_t *real_ns, int64_t *mono, int64_t *uncertainty_ns);
+
+#endif // MAG_USB_ACQUIRE_H
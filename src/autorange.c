@@ -0,0 +1,287 @@
+//=========================================================================
+// autorange.c
+//
+// Optional cycle count auto-ranging.
+//
+// The cycle count trades noise against conversion time and range:
+// more cycles give a higher gain (lower noise per count) but take
+// longer and reach the 24-bit limit of the result registers at a
+// lower field.  Over each arInterval seconds the controller collects,
+// from the primary sensor,
+//
+//   noise     the spread of successive differences, sqrt(var / 2),
+//             which drops the field's own slow variation;
+//   peak      the largest raw count on any axis;
+//   deadline  the modelled (and in plain POLL the measured)
+//             conversion time against the sample period, and any
+//             missed ticks;
+//
+// and then moves the cycle count at most one rung of arLadder within
+// [arCCMin, arCCMax].  Range and deadline pressure step down; noise
+// above the target steps up if the next rung still fits both; noise
+// well below the target steps down again.  The change goes through the
+// control queue like a "cc" command, so it is applied between
+// conversions and the gains follow it.  Runs on the acquisition
+// thread.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <math.h>
+#include "main.h"
+#include "autorange.h"
+#include "cmdmgr.h"
+#include "magdata.h"
+#include "timeutil.h"
+
+#define AR_FULL_SCALE   8388608.0       // 2^23, the signed 24-bit limit
+
+static const int arLadder[] = { 50, 75, 100, 150, 200, 300, 400, 600, 800 };
+#define AR_RUNGS        ((int)(sizeof arLadder / sizeof arLadder[0]))
+
+static int      arCC;               // cycle count the window belongs to
+static long     arN;                // successive differences in the window
+static double   arMean[3];
+static double   arM2[3];
+static int32_t  arPrev[3];
+static int      arHavePrev;
+static int32_t  arPeak;
+static int64_t  arConvNs;           // longest measured POLL conversion
+static unsigned long arMissesAt;
+static int64_t  arNextNs;
+
+//---------------------------------------------------------------
+// ar_reset(pList *p)
+// Starts a new window at the current cycle count.
+//---------------------------------------------------------------
+static void ar_reset(pList *p)
+{
+    arCC       = p->cc_x;
+    arN        = 0;
+    arHavePrev = FALSE;
+    arPeak     = 0;
+    arConvNs   = 0;
+    arMissesAt = p->acqMisses;
+    arNextNs   = mono_ns() + (int64_t)p->arInterval * NSEC_PER_SEC;
+    for(int k = 0; k < 3; k++)
+    {
+        arMean[k] = 0.0;
+        arM2[k]   = 0.0;
+    }
+}
+
+//---------------------------------------------------------------
+// ar_convNs(int cc)
+// Modelled conversion time of all three axes, as getMagConversionUs().
+//---------------------------------------------------------------
+static int64_t ar_convNs(int cc)
+{
+    return 3 * (11L * cc + 70L) * NSEC_PER_USEC;
+}
+
+//---------------------------------------------------------------
+// ar_neighbour(const pList *p, int cc, int dir)
+// The next rung above (dir > 0) or below cc within the bounds, or 0.
+//---------------------------------------------------------------
+static int ar_neighbour(const pList *p, int cc, int dir)
+{
+    if(dir > 0)
+    {
+        if(cc >= p->arCCMax)
+        {
+            return 0;
+        }
+        for(int i = 0; i < AR_RUNGS; i++)
+        {
+            if(arLadder[i] > cc)
+            {
+                return (arLadder[i] < p->arCCMax) ? arLadder[i] : p->arCCMax;
+            }
+        }
+        return p->arCCMax;
+    }
+    if(cc <= p->arCCMin)
+    {
+        return 0;
+    }
+    for(int i = AR_RUNGS - 1; i >= 0; i--)
+    {
+        if(arLadder[i] < cc)
+        {
+            return (arLadder[i] > p->arCCMin) ? arLadder[i] : p->arCCMin;
+        }
+    }
+    return p->arCCMin;
+}
+
+//---------------------------------------------------------------
+// ar_decide(pList *p)
+//---------------------------------------------------------------
+static void ar_decide(pList *p)
+{
+    int64_t period  = (p->samplingMode == CMM) ? getTMRCPeriodNs(p) : p->pollPeriodNs;
+    int64_t budget  = (int64_t)(p->arDeadlineFraction * (double)period);
+    int64_t conv    = ar_convNs(arCC);
+    double  limit   = p->arHeadroom * AR_FULL_SCALE;
+    unsigned long misses = p->acqMisses - arMissesAt;
+    double  noise   = -1.0;
+    const char *reason = NULL;
+    int     to = 0;
+
+    // A measured conversion longer than the model scales the model.
+    double  slow    = (arConvNs > conv) ? (double)arConvNs / (double)conv : 1.0;
+    conv = (int64_t)((double)conv * slow);
+
+    if(arN >= 4)
+    {
+        const int gain[3] = { p->x_gain, p->y_gain, p->z_gain };
+        double sum = 0.0;
+        for(int k = 0; k < 3; k++)
+        {
+            double sd = sqrt(arM2[k] / (double)(arN - 1) / 2.0);
+            double nT = sd / (gain[k] > 0 ? gain[k] : 1) * 1000.0;
+            sum += nT * nT;
+        }
+        noise = sqrt(sum / 3.0);
+    }
+
+    int up   = ar_neighbour(p, arCC, +1);
+    int down = ar_neighbour(p, arCC, -1);
+    int upFits = up && !misses
+              && (int64_t)((double)ar_convNs(up) * slow) <= budget
+              && (double)arPeak * getCCGainEquiv((unsigned short)up) / getCCGainEquiv((unsigned short)arCC) <= limit;
+
+    if(arCC < p->arCCMin || arCC > p->arCCMax)
+    {
+        to = (arCC < p->arCCMin) ? p->arCCMin : p->arCCMax;
+        reason = "bounds";
+    }
+    else if(down && (double)arPeak > limit)
+    {
+        to = down;
+        reason = "range";
+    }
+    else if(down && conv > budget)
+    {
+        to = down;
+        reason = "deadline";
+    }
+    else if(noise < 0.0)
+    {
+        return;
+    }
+    else if(upFits && (p->arNoiseTarget <= 0.0 || noise > p->arNoiseTarget))
+    {
+        to = up;
+        reason = "noise";
+    }
+    else if(down && p->arNoiseTarget > 0.0 && noise < p->arNoiseTarget / 2.0)
+    {
+        to = down;
+        reason = "quiet";
+    }
+    if(to == 0 || to == arCC)
+    {
+        return;
+    }
+    if(!ctl_queueCycleCount(to))
+    {
+        return;
+    }
+    p->arChanges++;
+    fprintf(OUTPUT_ERROR,
+            "{ \"lastStatus\": \"autorange\", \"cc\": %d, \"from\": %d, \"reason\": \"%s\", \"noise_nT\": %.3f"
+            ", \"peak\": %ld, \"conv_us\": %ld, \"budget_us\": %ld, \"misses\": %lu }\n",
+            to, arCC, reason, noise, (long)arPeak, (long)(conv / NSEC_PER_USEC),
+            (long)(budget / NSEC_PER_USEC), misses);
+    fflush(OUTPUT_ERROR);
+}
+
+//---------------------------------------------------------------
+// ar_init(pList *p)
+//
+// The chip powers up at cycle count 200 whatever the configuration
+// says, so with auto-ranging on the configured count is written out
+// (and the gains set to match) before the first conversion.
+//---------------------------------------------------------------
+int ar_init(pList *p)
+{
+    p->arChanges = 0;
+    if(!p->arEnable)
+    {
+        return 0;
+    }
+    if(p->arCCMin > p->arCCMax)
+    {
+        int t = p->arCCMin;
+        p->arCCMin = p->arCCMax;
+        p->arCCMax = t;
+    }
+    if(p->cc_x < p->arCCMin || p->cc_x > p->arCCMax)
+    {
+        p->cc_x = (p->cc_x < p->arCCMin) ? p->arCCMin : p->arCCMax;
+    }
+    p->cc_y = p->cc_z = p->cc_x;
+    setCycleCountRegs(p);
+    ar_reset(p);
+    return 0;
+}
+
+//---------------------------------------------------------------
+// ar_feed(pList *p)
+//
+// Called after every acquisition tick, read or not.
+//---------------------------------------------------------------
+void ar_feed(pList *p)
+{
+    if(!p->arEnable)
+    {
+        return;
+    }
+    if(p->cc_x != arCC)
+    {
+        // A change (ours or a "cc" command) has been applied.
+        ar_reset(p);
+    }
+    if(p->magValid[0])
+    {
+        const int32_t *xyz = p->magXYZ[0];
+        for(int k = 0; k < 3; k++)
+        {
+            int32_t a = (xyz[k] < 0) ? -xyz[k] : xyz[k];
+            if(a > arPeak)
+            {
+                arPeak = a;
+            }
+        }
+        if(p->samplingMode != CMM && !p->pollPipeline)
+        {
+            int64_t c = p->magStamps[0].drdyMonoNs - p->magStamps[0].trigMonoNs;
+            if(c > arConvNs)
+            {
+                arConvNs = c;
+            }
+        }
+        if(arHavePrev)
+        {
+            arN++;
+            for(int k = 0; k < 3; k++)
+            {
+                double d     = (double)xyz[k] - (double)arPrev[k];
+                double delta = d - arMean[k];
+                arMean[k] += delta / (double)arN;
+                arM2[k]   += delta * (d - arMean[k]);
+            }
+        }
+        for(int k = 0; k < 3; k++)
+        {
+            arPrev[k] = xyz[k];
+        }
+        arHavePrev = TRUE;
+    }
+    if(mono_ns() >= arNextNs)
+    {
+        ar_decide(p);
+        ar_reset(p);
+    }
+}
@@ -0,0 +1,20 @@
+//=========================================================================
+// autorange.h
+//
+// Optional cycle count auto-ranging.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_AUTORANGE_H
+#define MAG_USB_AUTORANGE_H
+
+#include "main.h"
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int  ar_init(pList *p);
+void ar_feed(pList *p);
+
+#endif // MAG_USB_AUTORANGE_H
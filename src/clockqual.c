@@ -0,0 +1,405 @@
+//=========================================================================
+// clockqual.c
+//
+// Host clock quality from adjtimex() and, optionally, chronyd.
+//
+// Every record is stamped from CLOCK_REALTIME, and how far that can
+// be trusted is what the NTP daemon last told the kernel: the
+// STA_UNSYNC status bit and the estimated and maximum errors, which
+// the kernel grows by the frequency tolerance for as long as nobody
+// refreshes them.  A background thread reads them with a read-only
+// adjtimex() every cqInterval seconds and publishes the compact view
+// as one packed 64-bit word, so stamping a sample with it is a single
+// atomic load on the acquisition path.
+//
+// With [clock].chrony the thread also asks chronyd for its tracking
+// report over the command port on the loopback (the same request as
+// "chronyc tracking", which chronyd answers without authentication),
+// for the status record.  The full state sits behind a mutex, since
+// only the status command reads it.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/timex.h>
+#include "main.h"
+#include "clockqual.h"
+#include "timeutil.h"
+
+#define CQ_VALID            (1ULL << 63)
+#define CQ_SYNC             (1ULL << 62)
+#define CQ_ERR_MAX          0x7FFFFFFFu     // 31 bits each for est and max
+
+// chronyd command protocol (candm.h)
+#define CQ_CHRONY_VERSION   6
+#define CQ_PKT_REQUEST      1
+#define CQ_PKT_REPLY        2
+#define CQ_REQ_TRACKING     33
+#define CQ_RPY_TRACKING     5
+#define CQ_RPY_HEADER       28
+#define CQ_RPY_TRACKING_LEN (CQ_RPY_HEADER + 76)
+#define CQ_REQ_LEN          128             // chronyd drops requests shorter than the reply
+#define CQ_CHRONY_TIMEOUT   500             // ms
+
+typedef struct
+{
+    int64_t  readNs;                // CLOCK_REALTIME of the adjtimex() read
+    int      state;                 // adjtimex() return, TIME_OK ... TIME_ERROR
+    int      status;                // STA_* bits
+    double   offsetUs;              // kernel PLL offset
+    double   freqPpm;
+    long     estUs;
+    long     maxUs;
+    int      tai;
+
+    int      chronyValid;
+    uint32_t refId;
+    int      stratum;
+    int      leap;                  // 0 normal, 1 insert, 2 delete, 3 unsynchronised
+    double   correction;            // seconds; chronyd's offset of the clock from its estimate
+    double   lastOffset;
+    double   rmsOffset;
+    double   chronyFreqPpm;
+    double   skewPpm;
+    double   rootDelay;
+    double   rootDispersion;
+    double   updateInterval;
+} cqState;
+
+static _Atomic uint64_t cqWord;
+static cqState          cqCur;
+static pthread_mutex_t  cqLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   cqCond;
+static pthread_t        cqThread;
+static int              cqRunning = FALSE;
+static int              cqStop    = FALSE;
+static int              cqSock    = -1;
+static uint32_t         cqSeq;
+
+//---------------------------------------------------------------
+// cq_float(const uint8_t *b)
+// chronyd's 32-bit network float: 7-bit exponent, 25-bit coefficient.
+//---------------------------------------------------------------
+static double cq_float(const uint8_t *b)
+{
+    uint32_t x    = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+    int32_t  exp  = (int32_t)(x >> 25);
+    int32_t  coef = (int32_t)(x & 0x1FFFFFFu);
+
+    if(exp >= 64)
+    {
+        exp -= 128;
+    }
+    if(coef >= (1 << 24))
+    {
+        coef -= (1 << 25);
+    }
+    return ldexp((double)coef, exp - 25);
+}
+
+//---------------------------------------------------------------
+// cq_be16(const uint8_t *b), cq_be32(const uint8_t *b)
+//---------------------------------------------------------------
+static unsigned cq_be16(const uint8_t *b)
+{
+    return ((unsigned)b[0] << 8) | b[1];
+}
+
+static uint32_t cq_be32(const uint8_t *b)
+{
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+//---------------------------------------------------------------
+// cq_chrony(pList *p, cqState *st)
+//
+// One tracking request.  Returns 0 with the chrony fields of st
+// filled in, or -1 if chronyd did not answer.
+//---------------------------------------------------------------
+static int cq_chrony(pList *p, cqState *st)
+{
+    uint8_t req[CQ_REQ_LEN];
+    uint8_t rpy[512];
+    struct pollfd pfd;
+
+    if(cqSock < 0)
+    {
+        struct sockaddr_in sa;
+
+        cqSock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if(cqSock < 0)
+        {
+            return -1;
+        }
+        memset(&sa, 0, sizeof sa);
+        sa.sin_family      = AF_INET;
+        sa.sin_port        = htons((uint16_t)p->cqChronyPort);
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(connect(cqSock, (struct sockaddr *)&sa, sizeof sa) < 0)
+        {
+            close(cqSock);
+            cqSock = -1;
+            return -1;
+        }
+    }
+
+    memset(req, 0, sizeof req);
+    cqSeq++;
+    req[0]  = CQ_CHRONY_VERSION;
+    req[1]  = CQ_PKT_REQUEST;
+    req[4]  = (uint8_t)(CQ_REQ_TRACKING >> 8);
+    req[5]  = (uint8_t)CQ_REQ_TRACKING;
+    req[8]  = (uint8_t)(cqSeq >> 24);
+    req[9]  = (uint8_t)(cqSeq >> 16);
+    req[10] = (uint8_t)(cqSeq >> 8);
+    req[11] = (uint8_t)cqSeq;
+    if(send(cqSock, req, sizeof req, 0) != (ssize_t)sizeof req)
+    {
+        return -1;
+    }
+
+    // Skip stale replies to earlier requests that timed out.
+    pfd.fd     = cqSock;
+    pfd.events = POLLIN;
+    for(;;)
+    {
+        if(poll(&pfd, 1, CQ_CHRONY_TIMEOUT) <= 0)
+        {
+            return -1;
+        }
+        ssize_t n = recv(cqSock, rpy, sizeof rpy, 0);
+        if(n < 0)
+        {
+            // ECONNREFUSED: nothing is listening on the port.
+            return -1;
+        }
+        if(n >= CQ_RPY_TRACKING_LEN && rpy[0] == CQ_CHRONY_VERSION && rpy[1] == CQ_PKT_REPLY
+           && cq_be32(&rpy[16]) == cqSeq)
+        {
+            if(cq_be16(&rpy[4]) != CQ_REQ_TRACKING || cq_be16(&rpy[6]) != CQ_RPY_TRACKING
+               || cq_be16(&rpy[8]) != 0)
+            {
+                return -1;
+            }
+            break;
+        }
+    }
+
+    const uint8_t *d = rpy + CQ_RPY_HEADER;
+    st->refId          = cq_be32(&d[0]);
+    st->stratum        = (int)cq_be16(&d[24]);
+    st->leap           = (int)cq_be16(&d[26]);
+    st->correction     = cq_float(&d[40]);
+    st->lastOffset     = cq_float(&d[44]);
+    st->rmsOffset      = cq_float(&d[48]);
+    st->chronyFreqPpm  = cq_float(&d[52]);
+    st->skewPpm        = cq_float(&d[60]);
+    st->rootDelay      = cq_float(&d[64]);
+    st->rootDispersion = cq_float(&d[68]);
+    st->updateInterval = cq_float(&d[72]);
+    return 0;
+}
+
+//---------------------------------------------------------------
+// cq_sample(pList *p)
+// One read of everything, published to both views.
+//---------------------------------------------------------------
+static void cq_sample(pList *p)
+{
+    struct timex tx;
+    cqState st;
+    uint64_t w;
+
+    memset(&tx, 0, sizeof tx);
+    memset(&st, 0, sizeof st);
+    st.state  = adjtimex(&tx);
+    st.readNs = clock_ns(CLOCK_REALTIME);
+    if(st.state < 0)
+    {
+        return;
+    }
+    st.status   = tx.status;
+    st.offsetUs = (tx.status & STA_NANO) ? tx.offset / 1000.0 : (double)tx.offset;
+    st.freqPpm  = tx.freq / 65536.0;
+    st.estUs    = tx.esterror;
+    st.maxUs    = tx.maxerror;
+    st.tai      = tx.tai;
+    if(p->cqChrony)
+    {
+        st.chronyValid = (cq_chrony(p, &st) == 0);
+    }
+
+    w  = CQ_VALID;
+    w |= (tx.status & STA_UNSYNC) ? 0 : CQ_SYNC;
+    w |= (uint64_t)((tx.esterror < 0) ? 0 : (tx.esterror > CQ_ERR_MAX ? CQ_ERR_MAX : (uint32_t)tx.esterror)) << 31;
+    w |= (uint64_t)((tx.maxerror < 0) ? 0 : (tx.maxerror > CQ_ERR_MAX ? CQ_ERR_MAX : (uint32_t)tx.maxerror));
+
+    uint64_t old = atomic_exchange(&cqWord, w);
+    if(!(old & CQ_VALID) || (old & CQ_SYNC) != (w & CQ_SYNC))
+    {
+        fprintf(OUTPUT_ERROR, "{ \"lastStatus\": \"clock_sync\", \"sync\": %s, \"est_us\": %ld, \"max_us\": %ld }\n",
+                (w & CQ_SYNC) ? "true" : "false", st.estUs, st.maxUs);
+        fflush(OUTPUT_ERROR);
+    }
+
+    pthread_mutex_lock(&cqLock);
+    if(p->cqChrony && st.chronyValid != cqCur.chronyValid && cqRunning)
+    {
+        fprintf(OUTPUT_ERROR, "{ \"lastStatus\": \"%s\", \"port\": %d }\n",
+                st.chronyValid ? "chrony_found" : "chrony_lost", p->cqChronyPort);
+        fflush(OUTPUT_ERROR);
+    }
+    cqCur = st;
+    pthread_mutex_unlock(&cqLock);
+}
+
+//---------------------------------------------------------------
+// cq_thread(void *arg)
+//---------------------------------------------------------------
+static void *cq_thread(void *arg)
+{
+    pList *p = (pList *)arg;
+    int64_t next = mono_ns();
+
+    pthread_mutex_lock(&cqLock);
+    while(!cqStop)
+    {
+        next += (int64_t)p->cqInterval * NSEC_PER_SEC;
+        struct timespec until = { (time_t)(next / NSEC_PER_SEC), (long)(next % NSEC_PER_SEC) };
+        while(!cqStop && pthread_cond_timedwait(&cqCond, &cqLock, &until) != ETIMEDOUT)
+        {
+        }
+        if(cqStop)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&cqLock);
+        cq_sample(p);
+        pthread_mutex_lock(&cqLock);
+    }
+    pthread_mutex_unlock(&cqLock);
+    return NULL;
+}
+
+//---------------------------------------------------------------
+// cq_init(pList *p)
+//
+// Takes the first reading before the acquisition starts, so the
+// first records are annotated too, then starts the sampler.
+//---------------------------------------------------------------
+int cq_init(pList *p)
+{
+    pthread_condattr_t ca;
+
+    atomic_store(&cqWord, 0);
+    memset(&cqCur, 0, sizeof cqCur);
+    cq_sample(p);
+    if(p->cqChrony && !cqCur.chronyValid)
+    {
+        fprintf(OUTPUT_ERROR, "No answer from chronyd on port %d; using adjtimex() only until it does\n", p->cqChronyPort);
+    }
+
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&cqCond, &ca);
+    pthread_condattr_destroy(&ca);
+    cqStop = FALSE;
+    if(pthread_create(&cqThread, NULL, cq_thread, p) != 0)
+    {
+        perror("pthread_create clock quality");
+        pthread_cond_destroy(&cqCond);
+        return -1;
+    }
+    cqRunning = TRUE;
+    return 0;
+}
+
+//---------------------------------------------------------------
+// cq_latest(clockQuality *q)
+//---------------------------------------------------------------
+void cq_latest(clockQuality *q)
+{
+    uint64_t w = atomic_load_explicit(&cqWord, memory_order_relaxed);
+
+    q->valid = (w & CQ_VALID) != 0;
+    q->sync  = (w & CQ_SYNC) != 0;
+    q->estUs = (uint32_t)((w >> 31) & CQ_ERR_MAX);
+    q->maxUs = (uint32_t)(w & CQ_ERR_MAX);
+}
+
+//---------------------------------------------------------------
+// cq_format(char *buf, size_t len)
+//
+// JSON object with the last reading, and chronyd's tracking report
+// (or null) when that is enabled.  Returns the length snprintf() would
+// have written.
+//---------------------------------------------------------------
+int cq_format(char *buf, size_t len)
+{
+    static const char *states[] = { "ok", "ins", "del", "oop", "wait", "error" };
+    static const char *leaps[]  = { "normal", "insert", "delete", "unsynchronised" };
+    cqState st;
+    int n;
+
+    pthread_mutex_lock(&cqLock);
+    st = cqCur;
+    pthread_mutex_unlock(&cqLock);
+
+    if(st.readNs == 0)
+    {
+        return snprintf(buf, len, "null");
+    }
+    n = snprintf(buf, len,
+                 "{ \"sync\": %s, \"state\": \"%s\", \"status\": \"0x%04x\", \"offset_us\": %.3f, \"freq_ppm\": %.3f"
+                 ", \"est_us\": %ld, \"max_us\": %ld, \"tai\": %d, \"age_s\": %.1f, \"chrony\": ",
+                 (st.status & STA_UNSYNC) ? "false" : "true",
+                 (st.state >= 0 && st.state <= 5) ? states[st.state] : "?", (unsigned)st.status,
+                 st.offsetUs, st.freqPpm, st.estUs, st.maxUs, st.tai,
+                 (double)(clock_ns(CLOCK_REALTIME) - st.readNs) / 1e9);
+    if(n < 0 || (size_t)n >= len)
+    {
+        return n;
+    }
+    if(!st.chronyValid)
+    {
+        return n + snprintf(buf + n, len - (size_t)n, "null }");
+    }
+    return n + snprintf(buf + n, len - (size_t)n,
+                        "{ \"ref_id\": \"%08" PRIX32 "\", \"stratum\": %d, \"leap\": \"%s\", \"correction_us\": %.3f"
+                        ", \"last_offset_us\": %.3f, \"rms_offset_us\": %.3f, \"freq_ppm\": %.3f, \"skew_ppm\": %.3f"
+                        ", \"root_delay_us\": %.1f, \"root_dispersion_us\": %.1f, \"update_interval_s\": %.1f } }",
+                        st.refId, st.stratum, (st.leap >= 0 && st.leap <= 3) ? leaps[st.leap] : "?",
+                        st.correction * 1e6, st.lastOffset * 1e6, st.rmsOffset * 1e6, st.chronyFreqPpm, st.skewPpm,
+                        st.rootDelay * 1e6, st.rootDispersion * 1e6, st.updateInterval);
+}
+
+//---------------------------------------------------------------
+// cq_close(pList *p)
+//---------------------------------------------------------------
+void cq_close(pList *p)
+{
+    (void)p;
+    if(cqRunning)
+    {
+        pthread_mutex_lock(&cqLock);
+        cqStop = TRUE;
+        pthread_cond_signal(&cqCond);
+        pthread_mutex_unlock(&cqLock);
+        pthread_join(cqThread, NULL);
+        pthread_cond_destroy(&cqCond);
+        cqRunning = FALSE;
+    }
+    if(cqSock >= 0)
+    {
+        close(cqSock);
+        cqSock = -1;
+    }
+}
@@ -0,0 +1,38 @@
+//=========================================================================
+// clockqual.h
+//
+// Host clock quality from adjtimex() and, optionally, chronyd.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_CLOCKQUAL_H
+#define MAG_USB_CLOCKQUAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct tag_pList;
+typedef struct tag_pList pList;
+
+//------------------------------------------
+// The compact per-record view: the kernel's own idea of how good the
+// clock is, as last set by the NTP daemon.
+//------------------------------------------
+typedef struct
+{
+    int      valid;                 // FALSE until the first read
+    int      sync;                  // STA_UNSYNC clear
+    uint32_t estUs;                 // estimated error, us
+    uint32_t maxUs;                 // maximum error, us
+} clockQuality;
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int  cq_init(pList *p);
+void cq_latest(clockQuality *q);
+int  cq_format(char *buf, size_t len);
+void cq_close(pList *p);
+
+#endif // MAG_USB_CLOCKQUAL_H
@@ -10,9 +10,51 @@
 // License:     GPL 3.0
 //=========================================================================
 #include <stdio.h>
+#include <errno.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include "main.h"
 #include "magdata.h"
 #include "cmdmgr.h"
+#include "samplering.h"
+#include "products.h"
+#include "recfmt.h"
+#include "pps.h"
+#include "gnss.h"
+#include "trace.h"
+
+//------------------------------------------
+// Control FIFO command queue.
+// Filled by the output reactor (FIFO lines) and by the sampling thread
+// (auto-ranging), drained by the sampling thread; ctlLock guards the
+// indices.  The line buffer belongs to the reactor.
+//------------------------------------------
+typedef enum
+{
+    CTL_NONE = 0,
+    CTL_TEMP_NOW,           // "temp"              read the temperature in the next window
+    CTL_TEMP_INTERVAL,      // "temp_interval <s>" change the temperature cadence
+    CTL_STATUS,             // "status"            emit a status record
+    CTL_CYCLE_COUNT,        // "cc <n>"            reprogram the cycle count registers
+    CTL_LATENCY,            // "latency [reset]"   emit the per-stage latency record
+} ctlOp;
+
+typedef struct
+{
+    ctlOp op;
+    long  arg;
+} ctlCommand;
+
+#define CTL_QUEUE_LEN   16
+#define CTL_LINE_LEN    128
+
+static ctlCommand ctlQueue[CTL_QUEUE_LEN];
+static unsigned   ctlHead = 0;
+static unsigned   ctlTail = 0;
+static pthread_mutex_t ctlLock = PTHREAD_MUTEX_INITIALIZER;
+static char       ctlLine[CTL_LINE_LEN];
+static size_t     ctlLineLen = 0;
 
 //------------------------------------------
 // showSettings()
@@ -25,6 +67,8 @@ void showSettings(pList *p)
     // Node info
     fprintf(OUTPUT_PRINT, "   Maintainer:                           %s\n",  p->maintainer ? p->maintainer : "(null)");
     fprintf(OUTPUT_PRINT, "   Maintainer email:                     %s\n",  p->maintainer_email ? p->maintainer_email : "(null)");
+    fprintf(OUTPUT_PRINT, "   Station code, name:                   %s, %s\n",  p->station_code ? p->station_code : "(null)",
+            p->station_name ? p->station_name : "(null)");
 
     // Location
     fprintf(OUTPUT_PRINT, "   Latitude:                             %s\n",  p->latitude ? p->latitude : "(null)");
@@ -38,6 +82,7 @@ void showSettings(pList *p)
 #else
     fprintf(OUTPUT_PRINT, "   Linux I2C bus number:                 %d\n",  p->i2cBusNumber);
 #endif
+    fprintf(OUTPUT_PRINT, "   Adapter telemetry interval (s):       %d\n",  p->adapterTelemetryInterval);
     fprintf(OUTPUT_PRINT, "   Scan I2C bus on startup:              %s\n",  p->scanI2CBUS ? "TRUE" : "FALSE");
     fprintf(OUTPUT_PRINT, "   Verify Pololu adaptor:                %s\n",  p->checkPololuAdaptor ? "TRUE" : "FALSE");
     fprintf(OUTPUT_PRINT, "   Verify Temp sensor:                   %s\n",  p->checkTempSensor ? "TRUE" : "FALSE");
@@ -56,18 +101,115 @@ void showSettings(pList *p)
 
     // Magnetometer
     fprintf(OUTPUT_PRINT, "   Magnetometer I2C address:             0x%02X (hex)\n",  (unsigned)(p->magAddr & 0xFF));
+    if(p->numMags > 1)
+    {
+        fprintf(OUTPUT_PRINT, "   Gradiometer sensors:                 ");
+        for(int i = 0; i < p->numMags; i++)
+        {
+            fprintf(OUTPUT_PRINT, " 0x%02X", (unsigned)(p->magAddrs[i] & 0xFF));
+        }
+        fprintf(OUTPUT_PRINT, "\n");
+    }
     fprintf(OUTPUT_PRINT, "   Cycle counts (X,Y,Z):                 %d, %d, %d\n",  p->cc_x, p->cc_y, p->cc_z);
     fprintf(OUTPUT_PRINT, "   Gains (X,Y,Z):                        %d, %d, %d\n",  p->x_gain, p->y_gain, p->z_gain);
     fprintf(OUTPUT_PRINT, "   TMRC register value:                  0x%02X (hex)\n",  (unsigned)(p->TMRCRate & 0xFF));
     fprintf(OUTPUT_PRINT, "   NOS register value:                   %d\n",  p->NOSRegValue);
     fprintf(OUTPUT_PRINT, "   DRDY delay (us):                      %d\n",  p->DRDYdelay);
     fprintf(OUTPUT_PRINT, "   Sampling mode:                        %s\n",  (p->samplingMode == CMM) ? "CMM" : "POLL");
+    fprintf(OUTPUT_PRINT, "   Pipelined POLL:                       %s\n",  p->pollPipeline ? "TRUE" : "FALSE");
+    fprintf(OUTPUT_PRINT, "   POLL output rate (Hz):                %.6g (%lld ns)\n",  1e9 / (double)p->pollPeriodNs, (long long)p->pollPeriodNs);
     fprintf(OUTPUT_PRINT, "   CMM sample rate (Hz):                 %d\n",  p->CMMSampleRate);
+    fprintf(OUTPUT_PRINT, "   CMM clock fit window (conversions):   %d\n",  p->cmmClockWindow);
     fprintf(OUTPUT_PRINT, "   Read back CC registers:               %s\n",  p->readBackCCRegs ? "TRUE" : "FALSE");
     fprintf(OUTPUT_PRINT, "   Orientation translate (deg XYZ):      %d, %d, %d\n",  p->mag_translate_x, p->mag_translate_y, p->mag_translate_z);
 
     // Temperature
     fprintf(OUTPUT_PRINT, "   Remote temperature I2C address:       0x%02X (hex)\n",  (unsigned)(p->remoteTempAddr & 0xFF));
+    fprintf(OUTPUT_PRINT, "   Temperature read interval (s):        %d\n",  p->tempReadInterval);
+    fprintf(OUTPUT_PRINT, "   Temperature resolution register:      %d\n",  p->tempResolution);
+
+    // Trigger
+    if(p->trigEnable)
+    {
+        fprintf(OUTPUT_PRINT, "   Trigger |dB/dt| (nT/s over s):        %.1f over %.1f\n", p->trigDbdt, p->trigDbdtWindow);
+        fprintf(OUTPUT_PRINT, "   Trigger step (nT over s):             %.1f over %.1f\n", p->trigStep, p->trigStepWindow);
+        fprintf(OUTPUT_PRINT, "   Trigger pre/post window (s):          %.1f, %.1f\n", p->trigPre, p->trigPost);
+    }
+
+    // PPS
+    if(p->ppsSource != PPS_SRC_NONE)
+    {
+        fprintf(OUTPUT_PRINT, "   PPS source:                           %s %s\n", pps_sourceName(p->ppsSource), p->ppsDevice ? p->ppsDevice : "");
+        fprintf(OUTPUT_PRINT, "   PPS edge window (ms):                 %d\n", p->ppsWindowMs);
+    }
+
+    // GNSS time
+    if(p->gnssDevice)
+    {
+        fprintf(OUTPUT_PRINT, "   GNSS receiver:                        %s at %d baud\n", p->gnssDevice, p->gnssBaud);
+        fprintf(OUTPUT_PRINT, "   GNSS latency (ms), window, max age:   %.1f, %d, %d s\n", p->gnssLatencyMs, p->gnssWindow, p->gnssMaxAge);
+    }
+
+    // Real-time mode
+    if(p->rtEnable)
+    {
+        fprintf(OUTPUT_PRINT, "   Real-time SCHED_FIFO priority:        %d\n", p->rtPriority);
+        fprintf(OUTPUT_PRINT, "   Real-time CPUs (acquisition, output): %d, %d\n", p->rtAcqCpu, p->rtOutputCpu);
+    }
+
+    // Host clock quality
+    fprintf(OUTPUT_PRINT, "   Clock quality read every (s):         %d%s\n", p->cqInterval, p->cqAnnotate ? ", on every record" : "");
+    if(p->cqChrony)
+    {
+        fprintf(OUTPUT_PRINT, "   Chrony command port:                  %d\n", p->cqChronyPort);
+    }
+
+    // Stage latency tracing
+    if(p->trcEnable)
+    {
+        fprintf(OUTPUT_PRINT, "   Stage latency dump every (s):         %d%s\n", p->trcInterval, p->trcInterval ? "" : " (on demand)");
+    }
+    else
+    {
+        fprintf(OUTPUT_PRINT, "   Stage latency tracing:                off\n");
+    }
+
+    // Auto-ranging
+    if(p->arEnable)
+    {
+        fprintf(OUTPUT_PRINT, "   Autorange cycle counts:               %d..%d, every %d s\n", p->arCCMin, p->arCCMax, p->arInterval);
+        fprintf(OUTPUT_PRINT, "   Autorange noise target (nT RMS):      %.3f\n", p->arNoiseTarget);
+        fprintf(OUTPUT_PRINT, "   Autorange deadline/headroom fraction: %.2f, %.2f\n", p->arDeadlineFraction, p->arHeadroom);
+    }
+
+    // Output products
+    for(int i = 0; i < p->numProducts; i++)
+    {
+        const outputProduct *op = &p->products[i];
+        fprintf(OUTPUT_PRINT, "   Product %-15s               period %.3f s, %s ->",
+                op->name, (double)op->periodNs / 1e9,
+                (op->reduce == PRODUCT_AVERAGE) ? "average" : "sample");
+        for(int k = 0; k < SINK_COUNT; k++)
+        {
+            if(op->sinkMask & (1u << k))
+            {
+                fprintf(OUTPUT_PRINT, " %s", product_sinkName(k));
+                if(op->format[k] != PRODUCT_FMT_JSON)
+                {
+                    fprintf(OUTPUT_PRINT, "(%s)", product_formatName(op->format[k]));
+                }
+                else if(op->tsFormat[k] != FMT_TS_TEXT)
+                {
+                    fprintf(OUTPUT_PRINT, "(%s)", fmt_tsName(op->tsFormat[k]));
+                }
+            }
+        }
+        if((op->sinkMask & (1u << SINK_FILE)) && op->filePath)
+        {
+            fprintf(OUTPUT_PRINT, " (%s)", op->filePath);
+        }
+        fprintf(OUTPUT_PRINT, "\n");
+    }
 
     fprintf(OUTPUT_PRINT, "\n");
 }
@@ -79,7 +221,7 @@ int getCommandLine(int argc, char** argv, pList *p)
 {
     int c;
 
-    while((c = getopt(argc, argv, "h?B:c:CD:g:PMSQTVO:ui:o:Ww:a:f:A:")) != -1)
+    while((c = getopt(argc, argv, "h?B:c:CD:g:PMSQTVO:ui:o:Ww:a:f:A:R:")) != -1)
     {
         //int this_option_optind = optind ? optind : 1;
         switch(c)
@@ -88,7 +230,11 @@ int getCommandLine(int argc, char** argv, pList *p)
                 // Handled in main() for config file loading
                 break;
             case 'A':
-                p->magAddr = (int)strtol(optarg, NULL, 0);
+                if(setMagAddresses(p, optarg) < 0)
+                {
+                    fprintf(OUTPUT_ERROR, "\n ERROR Invalid: -A takes 1 to %d distinct I2C addresses, e.g. 0x20,0x21.\n\n", MAX_MAGS);
+                    exit(1);
+                }
                 break;
             case 'W':
                 p->useWebSocket = TRUE;
@@ -137,11 +283,18 @@ int getCommandLine(int argc, char** argv, pList *p)
                 p->x_gain = p->y_gain = p->z_gain = getCCGainEquiv(p->cc_x);
                 break;
             case 'D':
-                p->CMMSampleRate = (int) strtol(optarg, NULL, 10);
+                setMagSampleRate(p, (unsigned short) strtol(optarg, NULL, 10));
                 break;
             case 'g':
                 p->samplingMode = (int) strtol(optarg, NULL, 10);
                 break;
+            case 'R':
+                if(setOutputRate(p, strtod(optarg, NULL)) < 0)
+                {
+                    fprintf(OUTPUT_ERROR, "\n ERROR Invalid: -R takes a POLL rate from 1/3600 to 1000 Hz.\n\n");
+                    exit(1);
+                }
+                break;
             case 'O':
                 if(p->portpath)
                 {
@@ -172,8 +325,9 @@ int getCommandLine(int argc, char** argv, pList *p)
                 fprintf(OUTPUT_PRINT, "   -B <reg mask>          :  Do built in self test (BIST).         [ Not implemented ]\n");
                 fprintf(OUTPUT_PRINT, "   -C                     :  Read back cycle count registers before sampling.\n");
                 fprintf(OUTPUT_PRINT, "   -c <count>             :  Set cycle counts as integer.          [ default: 200 decimal]\n");
-                fprintf(OUTPUT_PRINT, "   -D <rate>              :  Set magnetometer sample rate.         [ TMRC reg 96 hex default ].\n");
+                fprintf(OUTPUT_PRINT, "   -D <rate>              :  Set CMM sample rate in Hz.            [ TMRC reg 96 hex default ].\n");
                 fprintf(OUTPUT_PRINT, "   -g <mode>              :  Device sampling mode.                 [ POLL=0 (default), CONTINUOUS=1 ]\n");
+                fprintf(OUTPUT_PRINT, "   -R <rate>              :  Set POLL output rate in Hz.           [ default: 1 ]\n");
 #if(USE_POLOLU)
                 fprintf(OUTPUT_PRINT, "   -O                     :  Path to Pololu port in /dev.          [ default: /dev/ttyMAG0 ]\n");
                 fprintf(OUTPUT_PRINT, "   -Q                     :  Verify presence of Pololu adaptor and exit.\n");
@@ -190,7 +344,7 @@ int getCommandLine(int argc, char** argv, pList *p)
                 fprintf(OUTPUT_PRINT, "   -a <addr>              :  WebSocket bind address.\n");
                 fprintf(OUTPUT_PRINT, "   -V                     :  Display software version and exit.\n");
                 fprintf(OUTPUT_PRINT, "   -f <path>              :  Path to configuration TOML file.\n");
-                fprintf(OUTPUT_PRINT, "   -A <hex>               :  Override magnetometer I2C address.\n");
+                fprintf(OUTPUT_PRINT, "   -A <hex>[,<hex>...]    :  Override magnetometer I2C address(es); several enable gradiometer mode.\n");
                 fprintf(OUTPUT_PRINT, "   -h or -?               :  Display this help.\n\n");
                 exit(0);
                 break;
@@ -210,3 +364,366 @@ int getCommandLine(int argc, char** argv, pList *p)
     }
     return 0;
 }
+
+//------------------------------------------
+// ctl_touchesMag()
+// Commands that write magnetometer registers must not run while a
+// conversion is in progress.
+//------------------------------------------
+static int ctl_touchesMag(const ctlCommand *c)
+{
+    return c->op == CTL_CYCLE_COUNT;
+}
+
+//------------------------------------------
+// ctl_magCommandPending()
+//------------------------------------------
+int ctl_magCommandPending(void)
+{
+    int pending = FALSE;
+
+    pthread_mutex_lock(&ctlLock);
+    for(unsigned i = ctlHead; i != ctlTail && !pending; i++)
+    {
+        pending = ctl_touchesMag(&ctlQueue[i % CTL_QUEUE_LEN]);
+    }
+    pthread_mutex_unlock(&ctlLock);
+    return pending;
+}
+
+//------------------------------------------
+// ctl_enqueue()
+//------------------------------------------
+static int ctl_enqueue(ctlCommand c)
+{
+    int queued = FALSE;
+
+    pthread_mutex_lock(&ctlLock);
+    if(ctlTail - ctlHead < CTL_QUEUE_LEN)
+    {
+        ctlQueue[ctlTail++ % CTL_QUEUE_LEN] = c;
+        queued = TRUE;
+    }
+    pthread_mutex_unlock(&ctlLock);
+    return queued;
+}
+
+//------------------------------------------
+// ctl_parseLine()
+//------------------------------------------
+static void ctl_parseLine(char *line)
+{
+    char *cmd = line;
+    char *arg;
+    ctlCommand c = { CTL_NONE, 0 };
+
+    while(isspace((unsigned char)*cmd))
+    {
+        cmd++;
+    }
+    if(*cmd == '\0' || *cmd == '#')
+    {
+        return;
+    }
+    arg = cmd;
+    while(*arg && !isspace((unsigned char)*arg))
+    {
+        arg++;
+    }
+    if(*arg)
+    {
+        *arg++ = '\0';
+    }
+
+    if(strcmp(cmd, "temp") == 0)
+    {
+        c.op = CTL_TEMP_NOW;
+    }
+    else if(strcmp(cmd, "temp_interval") == 0)
+    {
+        c.op  = CTL_TEMP_INTERVAL;
+        c.arg = strtol(arg, NULL, 0);
+    }
+    else if(strcmp(cmd, "status") == 0)
+    {
+        c.op = CTL_STATUS;
+    }
+    else if(strcmp(cmd, "cc") == 0)
+    {
+        c.op  = CTL_CYCLE_COUNT;
+        c.arg = strtol(arg, NULL, 0);
+    }
+    else if(strcmp(cmd, "latency") == 0)
+    {
+        c.op  = CTL_LATENCY;
+        c.arg = (strncmp(arg, "reset", 5) == 0);
+    }
+    else
+    {
+        fprintf(OUTPUT_ERROR, "Unknown control command: '%s'\n", cmd);
+        return;
+    }
+
+    if(!ctl_enqueue(c))
+    {
+        fprintf(OUTPUT_ERROR, "Control command queue full, dropping '%s'\n", cmd);
+    }
+}
+
+//------------------------------------------
+// ctl_queueCycleCount()
+// Lets the acquisition side request a cycle count change; it is
+// applied like a "cc" command, between conversions.
+//------------------------------------------
+int ctl_queueCycleCount(int cc)
+{
+    ctlCommand c = { CTL_CYCLE_COUNT, cc };
+    return ctl_enqueue(c);
+}
+
+//------------------------------------------
+// ctl_readPipe()
+// Drains whatever is waiting on the (non-blocking) control FIFO and
+// queues each complete line.  Returns the number of queued commands.
+// Called by the output reactor when the FIFO is readable.
+//------------------------------------------
+int ctl_readPipe(pList *p)
+{
+    char buf[256];
+    ssize_t n;
+    int queued;
+
+    if(p->pipeInFd < 0)
+    {
+        return 0;
+    }
+    while((n = read(p->pipeInFd, buf, sizeof buf)) > 0)
+    {
+        for(ssize_t i = 0; i < n; i++)
+        {
+            if(buf[i] == '\n' || buf[i] == '\r')
+            {
+                ctlLine[ctlLineLen] = '\0';
+                ctl_parseLine(ctlLine);
+                ctlLineLen = 0;
+            }
+            else if(ctlLineLen < CTL_LINE_LEN - 1)
+            {
+                ctlLine[ctlLineLen++] = buf[i];
+            }
+        }
+    }
+    pthread_mutex_lock(&ctlLock);
+    queued = (int)(ctlTail - ctlHead);
+    pthread_mutex_unlock(&ctlLock);
+    return queued;
+}
+
+//------------------------------------------
+// ctl_emitLine()
+// A status-type record goes to the console and the data pipe.
+//------------------------------------------
+static void ctl_emitLine(pList *p, const char *line, int len)
+{
+    fputs(line, OUTPUT_PRINT);
+    fflush(OUTPUT_PRINT);
+    if(p->usePipes && p->pipeOutFd >= 0)
+    {
+        if(write(p->pipeOutFd, line, (size_t)len) < 0 && errno != EAGAIN)
+        {
+            perror("write status to PIPE Out");
+        }
+    }
+}
+
+//------------------------------------------
+// ctl_emitLatency()
+// The per-stage latency histograms; "latency reset" clears them after
+// the record is written.
+//------------------------------------------
+static void ctl_emitLatency(pList *p, int reset)
+{
+    char line[2560];
+    int len = snprintf(line, sizeof line, "{ \"lastStatus\": \"latency\", \"enabled\": %s, \"stages\": ",
+                       p->trcEnable ? "true" : "false");
+
+    if(len > 0 && (size_t)len < sizeof line)
+    {
+        len += trc_format(line + len, sizeof line - (size_t)len);
+    }
+    if(len > 0 && (size_t)len < sizeof line)
+    {
+        len += snprintf(line + len, sizeof line - (size_t)len, " }\n");
+    }
+    if(len <= 0)
+    {
+        return;
+    }
+    if((size_t)len >= sizeof line)
+    {
+        len = (int)sizeof line - 1;
+    }
+    ctl_emitLine(p, line, len);
+    if(reset)
+    {
+        trc_reset();
+    }
+}
+
+//------------------------------------------
+// ctl_emitStatus()
+//------------------------------------------
+void ctl_emitStatus(pList *p)
+{
+    char line[4096];
+    int len = snprintf(line, sizeof line,
+                       "{ \"lastStatus\": \"status\", \"i2c_errors\": %lu, \"drdy_timeouts\": %lu, "
+                       "\"temp_errors\": %lu, \"adapter_rtt_us\": %ld, \"adapter_probe_failures\": %lu, "
+                       "\"next_seq\": %" PRIu64 ", \"acq_misses\": %lu, \"ring_overflows\": %" PRIu64
+                       ", \"trigger_events\": %" PRIu64 ", \"cc\": [%d, %d, %d], \"autorange_changes\": %lu"
+                       ", \"clock_steps\": %lu",
+                       p->i2cErrors, p->drdyTimeouts, p->tempErrors,
+                       (long)(p->adapterRttNs / 1000), p->adapterProbeFailures,
+                       p->sampleSeq, p->acqMisses, p->ring ? ring_overflows(p->ring) : 0,
+                       (uint64_t)atomic_load(&p->trigEvents), p->cc_x, p->cc_y, p->cc_z, p->arChanges,
+                       p->clockSteps);
+    if(p->ppsSource != PPS_SRC_NONE && len > 0 && (size_t)len < sizeof line)
+    {
+        len += snprintf(line + len, sizeof line - (size_t)len,
+                        ", \"pps\": { \"source\": \"%s\", \"edges\": %" PRIu64 ", \"misses\": %lu }",
+                        pps_sourceName(p->ppsSource), (uint64_t)atomic_load(&p->ppsEdges), p->ppsMisses);
+    }
+    if(p->gnssDevice && len > 0 && (size_t)len < sizeof line)
+    {
+        len += snprintf(line + len, sizeof line - (size_t)len, ", \"gnss\": ");
+        if(len > 0 && (size_t)len < sizeof line)
+        {
+            len += gnss_format(line + len, sizeof line - (size_t)len);
+        }
+    }
+    if(p->samplingMode != CMM && len > 0 && (size_t)len < sizeof line)
+    {
+        len += snprintf(line + len, sizeof line - (size_t)len, ", \"wake_latency\": ");
+        if(len > 0 && (size_t)len < sizeof line)
+        {
+            len += lat_format(&p->wakeLatency, line + len, sizeof line - (size_t)len);
+        }
+    }
+    if(p->samplingMode == CMM && len > 0 && (size_t)len < sizeof line)
+    {
+        len += snprintf(line + len, sizeof line - (size_t)len,
+                        ", \"sensor_clock\": { \"period_ns\": %.1f, \"rate_error_ppm\": %.1f }",
+                        atomic_load(&p->sclkPeriodNs), atomic_load(&p->sclkRatePpm));
+    }
+    if(len > 0 && (size_t)len < sizeof line)
+    {
+        len += snprintf(line + len, sizeof line - (size_t)len, ", \"clock\": ");
+        if(len > 0 && (size_t)len < sizeof line)
+        {
+            len += cq_format(line + len, sizeof line - (size_t)len);
+        }
+    }
+    if(len > 0 && (size_t)len < sizeof line)
+    {
+        len += snprintf(line + len, sizeof line - (size_t)len, ", \"products\": {");
+    }
+    for(int i = 0; i < p->numProducts && len > 0 && (size_t)len < sizeof line; i++)
+    {
+        outputProduct *op = &p->products[i];
+        const char *sep = "";
+        len += snprintf(line + len, sizeof line - (size_t)len, "%s \"%s\": {", i ? "," : "", op->name);
+        for(int k = 0; k < SINK_COUNT && len > 0 && (size_t)len < sizeof line; k++)
+        {
+            if(!(op->sinkMask & (1u << k)))
+            {
+                continue;
+            }
+            len += snprintf(line + len, sizeof line - (size_t)len,
+                            "%s \"%s\": { \"delivered\": %" PRIu64 ", \"dropped\": %" PRIu64 ", \"last_seq\": %" PRIu64 " }",
+                            sep, product_sinkName(k), (uint64_t)atomic_load(&op->sinks[k].delivered),
+                            (uint64_t)atomic_load(&op->sinks[k].dropped), (uint64_t)atomic_load(&op->sinks[k].lastSeq));
+            sep = ",";
+        }
+        if(len > 0 && (size_t)len < sizeof line)
+        {
+            len += snprintf(line + len, sizeof line - (size_t)len, " }");
+        }
+    }
+    if(len > 0 && (size_t)len < sizeof line)
+    {
+        len += snprintf(line + len, sizeof line - (size_t)len, " }");
+    }
+    if(len > 0 && (size_t)len < sizeof line)
+    {
+        len += snprintf(line + len, sizeof line - (size_t)len, " }\n");
+    }
+    if(len <= 0)
+    {
+        return;
+    }
+    if((size_t)len >= sizeof line)
+    {
+        len = (int)sizeof line - 1;
+    }
+    ctl_emitLine(p, line, len);
+}
+
+//------------------------------------------
+// ctl_runQueued()
+// Executes queued commands in arrival order.  During a conversion
+// (phase CTL_PHASE_CONVERTING) execution stops at the first command
+// that writes magnetometer registers; it runs once the XYZ data has
+// been fetched (phase CTL_PHASE_MAG_IDLE).
+//------------------------------------------
+int ctl_runQueued(pList *p, int phase)
+{
+    int ran = 0;
+
+    for(;;)
+    {
+        ctlCommand cmd;
+        ctlCommand *c = &cmd;
+
+        // Taken off the queue under the lock, run outside it.
+        pthread_mutex_lock(&ctlLock);
+        if(ctlHead == ctlTail ||
+           (phase == CTL_PHASE_CONVERTING && ctl_touchesMag(&ctlQueue[ctlHead % CTL_QUEUE_LEN])))
+        {
+            pthread_mutex_unlock(&ctlLock);
+            break;
+        }
+        cmd = ctlQueue[ctlHead++ % CTL_QUEUE_LEN];
+        pthread_mutex_unlock(&ctlLock);
+
+        switch(c->op)
+        {
+            case CTL_TEMP_NOW:
+                p->tempNextDueNs = 0;
+                break;
+            case CTL_TEMP_INTERVAL:
+                p->tempReadInterval = (c->arg >= 0) ? (int)c->arg : 0;
+                break;
+            case CTL_STATUS:
+                ctl_emitStatus(p);
+                break;
+            case CTL_LATENCY:
+                ctl_emitLatency(p, (int)c->arg);
+                break;
+            case CTL_CYCLE_COUNT:
+                if(c->arg > 0 && c->arg <= 0x320)
+                {
+                    p->cc_x = p->cc_y = p->cc_z = (int)c->arg;
+                    setCycleCountRegs(p);
+                }
+                else
+                {
+                    fprintf(OUTPUT_ERROR, "Control command cc: %ld out of range (1..800)\n", c->arg);
+                }
+                break;
+            default:
+                break;
+        }
+        ran++;
+    }
+    return ran;
+}
@@ -17,5 +17,17 @@
 void showSettings(pList *p);
 int getCommandLine(int argc, char** argv, pList *p);
 
+//------------------------------------------
+// Control FIFO commands
+//------------------------------------------
+#define CTL_PHASE_CONVERTING    0
+#define CTL_PHASE_MAG_IDLE      1
+
+int  ctl_readPipe(pList *p);
+int  ctl_runQueued(pList *p, int phase);
+int  ctl_magCommandPending(void);
+int  ctl_queueCycleCount(int cc);
+void ctl_emitStatus(pList *p);
+
 
 #endif // SWX3100CMDMGR_h
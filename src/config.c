@@ -5,6 +5,12 @@
 //=========================================================================
 #include "config.h"
 #include "main.h"
+#include "magdata.h"
+#include "products.h"
+#include "recfmt.h"
+#include "mseed.h"
+#include "pps.h"
+#include "gnss.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -175,6 +181,14 @@ static void process_config_value(pList *p, const char *section, const char *key,
         {
             p->maintainer_email = strdup(value);
         }
+        else if(strcmp(key, "station_code") == 0)
+        {
+            p->station_code = strdup(value);
+        }
+        else if(strcmp(key, "station_name") == 0)
+        {
+            p->station_name = strdup(value);
+        }
     }
     // [node_location] section
     else if(strcmp(section, "node_location") == 0)
@@ -222,13 +236,22 @@ static void process_config_value(pList *p, const char *section, const char *key,
         {
             p->use_I2C_converter = parse_bool(value);
         }
+        else if(strcmp(key, "telemetry_interval") == 0)
+        {
+            int v = parse_int(value);
+            p->adapterTelemetryInterval = (v >= 0) ? v : 0;
+        }
     }
     // [magnetometer] section
     else if(strcmp(section, "magnetometer") == 0)
     {
-        if(strcmp(key, "address") == 0)
+        if(strcmp(key, "address") == 0 || strcmp(key, "addresses") == 0)
         {
-            p->magAddr = parse_int(value);
+            if(setMagAddresses(p, value) < 0)
+            {
+                fprintf(OUTPUT_ERROR, "Invalid magnetometer %s \"%s\" (up to %d distinct 7-bit addresses)\n",
+                        key, value, MAX_MAGS);
+            }
         }
         else if(strcmp(key, "cc_x") == 0)
         {
@@ -279,12 +302,22 @@ static void process_config_value(pList *p, const char *section, const char *key,
         }
         else if(strcmp(key, "cmm_sample_rate") == 0)
         {
-            p->CMMSampleRate = parse_int(value);
+            // Sets tmrc_rate to match.
+            setMagSampleRate(p, (unsigned short)parse_int(value));
+        }
+        else if(strcmp(key, "cmm_clock_window") == 0)
+        {
+            int v = parse_int(value);
+            p->cmmClockWindow = (v > 0) ? v : 0;
         }
         else if(strcmp(key, "readback_cc_regs") == 0)
         {
             p->readBackCCRegs = parse_bool(value);
         }
+        else if(strcmp(key, "poll_pipeline") == 0)
+        {
+            p->pollPipeline = parse_bool(value);
+        }
     }
     // [mag_orientation] section
     else if(strcmp(section, "mag_orientation") == 0)
@@ -311,6 +344,19 @@ static void process_config_value(pList *p, const char *section, const char *key,
         {
             p->remoteTempAddr = parse_int(value);
         }
+        else if(strcmp(key, "read_interval") == 0)
+        {
+            int v = parse_int(value);
+            p->tempReadInterval = (v >= 0) ? v : 0;
+        }
+        else if(strcmp(key, "resolution") == 0)
+        {
+            int v = parse_int(value);
+            if(v >= 0 && v <= 3)
+            {
+                p->tempResolution = v;
+            }
+        }
     }
     // [output] section
     else if(strcmp(section, "output") == 0)
@@ -351,6 +397,342 @@ static void process_config_value(pList *p, const char *section, const char *key,
             }
             p->pipeOutPath = strdup(value);
         }
+        else if(strcmp(key, "output_rate_hz") == 0)
+        {
+            if(setOutputRate(p, parse_double(value)) < 0)
+            {
+                fprintf(OUTPUT_ERROR, "Invalid output_rate_hz \"%s\", keeping %.6f Hz\n", value, 1e9 / (double)p->pollPeriodNs);
+            }
+        }
+        else if(strcmp(key, "output_period_ns") == 0)
+        {
+            if(setOutputPeriodNs(p, strtoll(value, NULL, 0)) < 0)
+            {
+                fprintf(OUTPUT_ERROR, "Invalid output_period_ns \"%s\", keeping %lld ns\n", value, (long long)p->pollPeriodNs);
+            }
+        }
+    }
+    // [trigger] section
+    else if(strcmp(section, "trigger") == 0)
+    {
+        double v = parse_double(value);
+        if(strcmp(key, "enable") == 0)
+        {
+            p->trigEnable = parse_bool(value);
+        }
+        else if(strcmp(key, "dbdt_threshold") == 0)
+        {
+            p->trigDbdt = (v > 0.0) ? v : 0.0;
+        }
+        else if(strcmp(key, "dbdt_window") == 0 && v > 0.0)
+        {
+            p->trigDbdtWindow = v;
+        }
+        else if(strcmp(key, "step_threshold") == 0)
+        {
+            p->trigStep = (v > 0.0) ? v : 0.0;
+        }
+        else if(strcmp(key, "step_window") == 0 && v > 0.0)
+        {
+            p->trigStepWindow = v;
+        }
+        else if(strcmp(key, "pre_seconds") == 0 && v >= 0.0)
+        {
+            p->trigPre = v;
+        }
+        else if(strcmp(key, "post_seconds") == 0 && v >= 0.0)
+        {
+            p->trigPost = v;
+        }
+        else if(strcmp(key, "directory") == 0)
+        {
+            if(p->trigDir)
+            {
+                free(p->trigDir);
+            }
+            p->trigDir = strdup(value);
+        }
+    }
+    // [pps] section
+    else if(strcmp(section, "pps") == 0)
+    {
+        if(strcmp(key, "source") == 0)
+        {
+            int src = pps_parseSource(value);
+            if(src < 0)
+            {
+                fprintf(OUTPUT_ERROR, "Unknown PPS source '%s'\n", value);
+            }
+            else
+            {
+                p->ppsSource = src;
+            }
+        }
+        else if(strcmp(key, "device") == 0)
+        {
+            if(p->ppsDevice)
+            {
+                free(p->ppsDevice);
+            }
+            p->ppsDevice = strdup(value);
+        }
+        else if(strcmp(key, "window_ms") == 0)
+        {
+            int v = parse_int(value);
+            if(v >= 1 && v <= 400)
+            {
+                p->ppsWindowMs = v;
+            }
+        }
+        else if(strcmp(key, "sim_offset_us") == 0)
+        {
+            p->ppsSimOffsetUs = parse_int(value);
+        }
+    }
+    // [gnss] section
+    else if(strcmp(section, "gnss") == 0)
+    {
+        if(strcmp(key, "device") == 0)
+        {
+            if(p->gnssDevice)
+            {
+                free(p->gnssDevice);
+            }
+            p->gnssDevice = strdup(value);
+        }
+        else if(strcmp(key, "baud") == 0)
+        {
+            int v = parse_int(value);
+            if(v == 4800 || v == 9600 || v == 19200 || v == 38400 || v == 57600
+               || v == 115200 || v == 230400 || v == 460800)
+            {
+                p->gnssBaud = v;
+            }
+            else
+            {
+                fprintf(OUTPUT_ERROR, "Unsupported GNSS baud rate %d\n", v);
+            }
+        }
+        else if(strcmp(key, "latency_ms") == 0)
+        {
+            double v = parse_double(value);
+            if(v >= 0.0 && v <= 900.0)
+            {
+                p->gnssLatencyMs = v;
+            }
+        }
+        else if(strcmp(key, "window") == 0)
+        {
+            int v = parse_int(value);
+            if(v >= 1 && v <= GNSS_WINDOW_MAX)
+            {
+                p->gnssWindow = v;
+            }
+        }
+        else if(strcmp(key, "max_age") == 0)
+        {
+            int v = parse_int(value);
+            if(v >= 1 && v <= 3600)
+            {
+                p->gnssMaxAge = v;
+            }
+        }
+    }
+    // [realtime] section
+    else if(strcmp(section, "realtime") == 0)
+    {
+        int v = parse_int(value);
+        if(strcmp(key, "enable") == 0)
+        {
+            p->rtEnable = parse_bool(value);
+        }
+        else if(strcmp(key, "priority") == 0 && v >= 1 && v <= 98)
+        {
+            p->rtPriority = v;
+        }
+        else if(strcmp(key, "acquisition_cpu") == 0)
+        {
+            p->rtAcqCpu = (v >= 0) ? v : -1;
+        }
+        else if(strcmp(key, "output_cpu") == 0)
+        {
+            p->rtOutputCpu = (v >= 0) ? v : -1;
+        }
+    }
+    // [clock] section
+    else if(strcmp(section, "clock") == 0)
+    {
+        int v = parse_int(value);
+        if(strcmp(key, "annotate") == 0)
+        {
+            p->cqAnnotate = parse_bool(value);
+        }
+        else if(strcmp(key, "interval") == 0 && v >= 1 && v <= 3600)
+        {
+            p->cqInterval = v;
+        }
+        else if(strcmp(key, "chrony") == 0)
+        {
+            p->cqChrony = parse_bool(value);
+        }
+        else if(strcmp(key, "chrony_port") == 0 && v > 0 && v <= 65535)
+        {
+            p->cqChronyPort = v;
+        }
+    }
+    // [trace] section
+    else if(strcmp(section, "trace") == 0)
+    {
+        int v = parse_int(value);
+        if(strcmp(key, "enable") == 0)
+        {
+            p->trcEnable = parse_bool(value);
+        }
+        else if(strcmp(key, "interval") == 0 && v >= 0 && v <= 86400)
+        {
+            p->trcInterval = v;
+        }
+    }
+    // [autorange] section
+    else if(strcmp(section, "autorange") == 0)
+    {
+        double v = parse_double(value);
+        if(strcmp(key, "enable") == 0)
+        {
+            p->arEnable = parse_bool(value);
+        }
+        else if(strcmp(key, "cc_min") == 0 && v >= 1.0 && v <= 800.0)
+        {
+            p->arCCMin = (int)v;
+        }
+        else if(strcmp(key, "cc_max") == 0 && v >= 1.0 && v <= 800.0)
+        {
+            p->arCCMax = (int)v;
+        }
+        else if(strcmp(key, "noise_target") == 0 && v >= 0.0)
+        {
+            p->arNoiseTarget = v;
+        }
+        else if(strcmp(key, "deadline_fraction") == 0 && v > 0.0 && v <= 1.0)
+        {
+            p->arDeadlineFraction = v;
+        }
+        else if(strcmp(key, "headroom") == 0 && v > 0.0 && v <= 1.0)
+        {
+            p->arHeadroom = v;
+        }
+        else if(strcmp(key, "interval") == 0 && v >= 1.0)
+        {
+            p->arInterval = (int)v;
+        }
+    }
+    // [product.<name>] sections
+    else if(strncmp(section, "product.", 8) == 0)
+    {
+        outputProduct *op = product_lookup(p, section + 8);
+        if(op == NULL)
+        {
+            fprintf(OUTPUT_ERROR, "Too many output products (at most %d), ignoring [%s]\n", MAX_PRODUCTS, section);
+        }
+        else if(strcmp(key, "period") == 0)
+        {
+            double v = parse_double(value);
+            op->periodNs = (v > 0.0) ? (int64_t)(v * 1e9 + 0.5) : 0;
+        }
+        else if(strcmp(key, "reduce") == 0)
+        {
+            if(strcmp(value, "sample") == 0)
+            {
+                op->reduce = PRODUCT_SAMPLE;
+            }
+            else if(strcmp(value, "average") == 0)
+            {
+                op->reduce = PRODUCT_AVERAGE;
+            }
+            else
+            {
+                fprintf(OUTPUT_ERROR, "[%s] reduce must be \"sample\" or \"average\"\n", section);
+            }
+        }
+        else if(strcmp(key, "format") == 0 || strstr(key, "_format") != NULL)
+        {
+            int fmt = product_parseFormat(value);
+            if(fmt < 0)
+            {
+                fprintf(OUTPUT_ERROR, "[%s] %s must be \"json\", \"binary\", \"cbor\", \"msgpack\", \"iaga2002\" or \"mseed\"\n", section, key);
+            }
+            else if(product_setFormat(op, key, fmt) < 0)
+            {
+                fprintf(OUTPUT_ERROR, "[%s] unknown sink in %s (console, pipe, websocket, file)\n", section, key);
+            }
+        }
+        else if(strcmp(key, "sinks") == 0)
+        {
+            if(product_parseSinks(value, &op->sinkMask) < 0)
+            {
+                fprintf(OUTPUT_ERROR, "[%s] unknown sink in \"%s\" (console, pipe, websocket, file)\n", section, value);
+            }
+        }
+        else if(strcmp(key, "timestamp") == 0 || strstr(key, "_timestamp") != NULL)
+        {
+            int fmt = fmt_tsParse(value);
+            if(fmt < 0)
+            {
+                fprintf(OUTPUT_ERROR, "[%s] %s must be \"text\", \"iso_ms\", \"iso_us\" or \"epoch_ns\"\n", section, key);
+            }
+            else if(product_setTimestamp(op, key, fmt) < 0)
+            {
+                fprintf(OUTPUT_ERROR, "[%s] unknown sink in %s (console, pipe, websocket, file)\n", section, key);
+            }
+        }
+        else if(strcmp(key, "float_bits") == 0)
+        {
+            int v = parse_int(value);
+            if(v == 32 || v == 64)
+            {
+                op->floatBits = v;
+            }
+            else
+            {
+                fprintf(OUTPUT_ERROR, "[%s] float_bits must be 32 or 64\n", section);
+            }
+        }
+        else if(strcmp(key, "network") == 0 && mseed_setCode(op->mseedNet, sizeof op->mseedNet, value) != 0)
+        {
+            fprintf(OUTPUT_ERROR, "[%s] network must be 1 or 2 letters or digits\n", section);
+        }
+        else if(strcmp(key, "station") == 0 && mseed_setCode(op->mseedSta, sizeof op->mseedSta, value) != 0)
+        {
+            fprintf(OUTPUT_ERROR, "[%s] station must be 1 to 5 letters or digits\n", section);
+        }
+        else if(strcmp(key, "location") == 0 && mseed_setCode(op->mseedLoc, sizeof op->mseedLoc, value) != 0)
+        {
+            fprintf(OUTPUT_ERROR, "[%s] location must be up to 2 letters or digits\n", section);
+        }
+        else if(strcmp(key, "channels") == 0 && mseed_setChannels(op->mseedChan, value) != 0)
+        {
+            fprintf(OUTPUT_ERROR, "[%s] channels must be three 3-character codes, x, y and z\n", section);
+        }
+        else if(strcmp(key, "record_length") == 0)
+        {
+            int v = parse_int(value);
+            if(v == MSEED_RECORD_MIN || v == MSEED_RECORD_MAX)
+            {
+                op->mseedRecLen = v;
+            }
+            else
+            {
+                fprintf(OUTPUT_ERROR, "[%s] record_length must be 512 or 4096\n", section);
+            }
+        }
+        else if(strcmp(key, "file") == 0)
+        {
+            if(op->filePath)
+            {
+                free(op->filePath);
+            }
+            op->filePath = strdup(value);
+        }
     }
     // [websocket] section
     else if(strcmp(section, "websocket") == 0)
@@ -496,6 +878,16 @@ void free_config_strings(pList *p)
         free(p->maintainer_email);
         p->maintainer_email = NULL;
     }
+    if(p->station_code)
+    {
+        free(p->station_code);
+        p->station_code = NULL;
+    }
+    if(p->station_name)
+    {
+        free(p->station_name);
+        p->station_name = NULL;
+    }
     if(p->latitude)
     {
         free(p->latitude);
@@ -536,4 +928,27 @@ void free_config_strings(pList *p)
         free(p->webSocketBindAddr);
         p->webSocketBindAddr = NULL;
     }
+    if(p->trigDir)
+    {
+        free(p->trigDir);
+        p->trigDir = NULL;
+    }
+    if(p->ppsDevice)
+    {
+        free(p->ppsDevice);
+        p->ppsDevice = NULL;
+    }
+    if(p->gnssDevice)
+    {
+        free(p->gnssDevice);
+        p->gnssDevice = NULL;
+    }
+    for(int i = 0; i < p->numProducts; i++)
+    {
+        if(p->products[i].filePath)
+        {
+            free(p->products[i].filePath);
+            p->products[i].filePath = NULL;
+        }
+    }
 }
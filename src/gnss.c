@@ -0,0 +1,742 @@
+//=========================================================================
+// gnss.c
+//
+// GNSS receiver time source: UTC from NMEA RMC/ZDA or UBX TIM-TP on a
+// serial port, without PPS wiring.
+//
+// A receiver sends its messages for each navigation epoch as one
+// burst, starting a fixed, receiver-specific delay after the epoch.
+// The time the first byte of a burst arrives is therefore a usable
+// (if millisecond-grade) mark of the epoch the burst names, even with
+// no PPS line.  A thread reads the port into a fixed buffer and parses
+// it incrementally where it lies: NMEA sentences are checked and split
+// into fields by pointer, UBX frames are decoded in place.  A read
+// that follows a quiet gap starts a burst and is stamped on
+// CLOCK_MONOTONIC; each new epoch then yields one UTC - monotonic
+// offset, less the configured latency.  Serial and USB delays only
+// ever make a burst late, so the estimate is the largest offset of the
+// last `window` epochs.
+//
+// The sample path asks gnss_utcAt() for the UTC of a monotonic
+// instant: gnss_discipline() restamps samples with it in place of the
+// host clock, and with a PPS source it names the second of each edge
+// instead of the host's reading.
+//
+// Messages used:
+//   RMC   time and date; status V (no fix) is ignored, and also makes
+//         ZDA untrusted until an RMC says A again;
+//   ZDA   time and date;
+//   TIM-TP (UBX 0x0D 0x01) the time of the next time pulse, taken
+//         only with the UTC time base (CFG-TP5); the burst is then
+//         referred to the pulse one second before it.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include "main.h"
+#include "gnss.h"
+#include "timeutil.h"
+#include "halt.h"
+
+#define GNSS_NMEA_MAX       128             // longer than any sentence we take
+#define GNSS_UBX_MAX        64              // payload; TIM-TP is 16
+#define GNSS_GAP_NS         (20LL * NSEC_PER_MSEC)  // quiet time that ends a burst
+#define GNSS_BURST_MAX_NS   NSEC_PER_SEC    // a burst longer than this has no gap to mark it
+#define GNSS_MAX_FIELDS     20
+#define GNSS_POLL_MS        200             // how often the stop flag is looked at
+#define GNSS_RETRY_NS       NSEC_PER_SEC
+#define GNSS_GPS_EPOCH      315964800LL     // 1980-01-06, Unix seconds
+#define UBX_SYNC1           0xB5
+#define UBX_SYNC2           0x62
+
+typedef struct
+{
+    const char *s;
+    int         n;
+} gnssField;
+
+static gnssParser      gnssRx;              // touched only by the thread
+static pthread_t       gnssThread;
+static int             gnssRunning = FALSE;
+static volatile int    gnssStop    = FALSE;
+static pthread_mutex_t gnssLock    = PTHREAD_MUTEX_INITIALIZER;
+static gnssParser      gnssPub;             // published copy of the estimate and counters
+static int             gnssConnected;
+static int64_t         gnssMaxAgeNs;
+static const char     *gnssDevice;
+static int             gnssBaud;
+
+//---------------------------------------------------------------
+// gnss_days(int y, int m, int d)
+// Days since 1970-01-01 of a proleptic Gregorian date.
+//---------------------------------------------------------------
+static int64_t gnss_days(int y, int m, int d)
+{
+    y -= m <= 2;
+    int64_t  era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (unsigned)((153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1);
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+//---------------------------------------------------------------
+// gnss_num(const char *s, int n, int *v)
+// Exactly n decimal digits.
+//---------------------------------------------------------------
+static int gnss_num(const char *s, int n, int *v)
+{
+    *v = 0;
+    for(int i = 0; i < n; i++)
+    {
+        if(s[i] < '0' || s[i] > '9')
+        {
+            return FALSE;
+        }
+        *v = *v * 10 + (s[i] - '0');
+    }
+    return TRUE;
+}
+
+//---------------------------------------------------------------
+// gnss_hex(const char *s, unsigned *v)
+// Two hex digits, as in an NMEA checksum.
+//---------------------------------------------------------------
+static int gnss_hex(const char *s, unsigned *v)
+{
+    *v = 0;
+    for(int i = 0; i < 2; i++)
+    {
+        char c = s[i];
+        unsigned d;
+        if(c >= '0' && c <= '9')      d = (unsigned)(c - '0');
+        else if(c >= 'A' && c <= 'F') d = (unsigned)(c - 'A' + 10);
+        else if(c >= 'a' && c <= 'f') d = (unsigned)(c - 'a' + 10);
+        else                          return FALSE;
+        *v = *v << 4 | d;
+    }
+    return TRUE;
+}
+
+//---------------------------------------------------------------
+// gnss_hms(const gnssField *f, int64_t *ns)
+// hhmmss[.fff...] as nanoseconds into the day.
+//---------------------------------------------------------------
+static int gnss_hms(const gnssField *f, int64_t *ns)
+{
+    int h, m, s;
+    int64_t frac = 0, scale = NSEC_PER_SEC;
+
+    if(f->n < 6 || !gnss_num(f->s, 2, &h) || !gnss_num(f->s + 2, 2, &m) || !gnss_num(f->s + 4, 2, &s)
+       || h > 23 || m > 59 || s > 60)
+    {
+        return FALSE;
+    }
+    if(f->n > 6)
+    {
+        if(f->s[6] != '.')
+        {
+            return FALSE;
+        }
+        for(int i = 7; i < f->n; i++)
+        {
+            if(f->s[i] < '0' || f->s[i] > '9')
+            {
+                return FALSE;
+            }
+            if(scale > 1)
+            {
+                scale /= 10;
+                frac += (f->s[i] - '0') * scale;
+            }
+        }
+    }
+    *ns = ((int64_t)h * 3600 + m * 60 + s) * NSEC_PER_SEC + frac;
+    return TRUE;
+}
+
+//---------------------------------------------------------------
+// gnss_split(const char *s, const char *end, gnssField *f)
+// Fields of a sentence body, by pointer into it.
+//---------------------------------------------------------------
+static int gnss_split(const char *s, const char *end, gnssField *f)
+{
+    int nf = 0;
+
+    f[0].s = s;
+    for(const char *c = s; c < end; c++)
+    {
+        if(*c == ',')
+        {
+            f[nf].n = (int)(c - f[nf].s);
+            if(++nf == GNSS_MAX_FIELDS)
+            {
+                return nf;
+            }
+            f[nf].s = c + 1;
+        }
+    }
+    f[nf].n = (int)(end - f[nf].s);
+    return nf + 1;
+}
+
+//---------------------------------------------------------------
+// gnss_fix(gnssParser *g, int64_t utcNs)
+//
+// One epoch's UTC, marked by the start of the current burst.  Further
+// messages for the same epoch add nothing.  An offset more than half
+// a second from the estimate (a receiver reset, a leap second)
+// restarts the window.
+//---------------------------------------------------------------
+static int gnss_fix(gnssParser *g, int64_t utcNs)
+{
+    if(g->fixes > 0 && utcNs == g->fixUtcNs)
+    {
+        return 0;
+    }
+    if(g->lastMonoNs - g->burstMonoNs > GNSS_BURST_MAX_NS)
+    {
+        g->rejected++;
+        return 0;
+    }
+
+    int64_t off = utcNs + g->latencyNs - g->burstMonoNs;
+    if(g->count > 0 && llabs(off - g->offsetNs) > NSEC_PER_SEC / 2)
+    {
+        g->count = 0;
+    }
+    if(g->count == 0)
+    {
+        g->head = 0;
+    }
+    g->win[g->head] = off;
+    g->head = (g->head + 1) % g->window;
+    if(g->count < g->window)
+    {
+        g->count++;
+    }
+
+    int64_t hi = g->win[0], lo = g->win[0];
+    for(int i = 1; i < g->count; i++)
+    {
+        hi = (g->win[i] > hi) ? g->win[i] : hi;
+        lo = (g->win[i] < lo) ? g->win[i] : lo;
+    }
+    g->offsetNs  = hi;
+    g->spreadNs  = hi - lo;
+    g->fixUtcNs  = utcNs;
+    g->fixMonoNs = g->burstMonoNs;
+    g->fixes++;
+    return 1;
+}
+
+//---------------------------------------------------------------
+// gnss_nmea(gnssParser *g, const char *s, const char *nl)
+// One sentence, '$' to the newline.
+//---------------------------------------------------------------
+static int gnss_nmea(gnssParser *g, const char *s, const char *nl)
+{
+    gnssField f[GNSS_MAX_FIELDS];
+    const char *star = NULL;
+    unsigned sum = 0, want;
+    int nf, day, mon, year;
+    int64_t tod;
+
+    for(const char *c = s + 1; c < nl; c++)
+    {
+        if(*c == '*')
+        {
+            star = c;
+            break;
+        }
+        sum ^= (unsigned char)*c;
+    }
+    if(star == NULL || nl - star < 3 || !gnss_hex(star + 1, &want) || want != sum)
+    {
+        g->rejected++;
+        return 0;
+    }
+    g->messages++;
+
+    nf = gnss_split(s + 1, star, f);
+    if(f[0].n != 5)
+    {
+        return 0;
+    }
+    if(memcmp(f[0].s + 2, "RMC", 3) == 0 && nf >= 10)
+    {
+        if(f[2].n != 1 || (f[2].s[0] != 'A' && f[2].s[0] != 'V'))
+        {
+            g->rejected++;
+            return 0;
+        }
+        g->rmcStatus = f[2].s[0];
+        if(g->rmcStatus != 'A')
+        {
+            return 0;
+        }
+        if(!gnss_hms(&f[1], &tod) || f[9].n != 6 || !gnss_num(f[9].s, 2, &day)
+           || !gnss_num(f[9].s + 2, 2, &mon) || !gnss_num(f[9].s + 4, 2, &year))
+        {
+            g->rejected++;
+            return 0;
+        }
+        year += 2000;
+    }
+    else if(memcmp(f[0].s + 2, "ZDA", 3) == 0 && nf >= 5)
+    {
+        if(g->rmcStatus == 'V')
+        {
+            return 0;
+        }
+        if(!gnss_hms(&f[1], &tod) || f[2].n != 2 || !gnss_num(f[2].s, 2, &day)
+           || f[3].n != 2 || !gnss_num(f[3].s, 2, &mon) || f[4].n != 4 || !gnss_num(f[4].s, 4, &year))
+        {
+            g->rejected++;
+            return 0;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+    if(mon < 1 || mon > 12 || day < 1 || day > 31)
+    {
+        g->rejected++;
+        return 0;
+    }
+    return gnss_fix(g, gnss_days(year, mon, day) * 86400 * NSEC_PER_SEC + tod);
+}
+
+//---------------------------------------------------------------
+// gnss_le32(const uint8_t *b)
+//---------------------------------------------------------------
+static uint32_t gnss_le32(const uint8_t *b)
+{
+    return (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+//---------------------------------------------------------------
+// gnss_ubx(gnssParser *g, const uint8_t *m, size_t plen)
+//
+// One frame with a good length.  Returns -1 on a bad checksum, so the
+// caller resyncs on the next byte rather than skipping the frame.
+//---------------------------------------------------------------
+static int gnss_ubx(gnssParser *g, const uint8_t *m, size_t plen)
+{
+    uint8_t ck_a = 0, ck_b = 0;
+    const uint8_t *pl = m + 6;
+
+    for(size_t i = 2; i < plen + 6; i++)
+    {
+        ck_a = (uint8_t)(ck_a + m[i]);
+        ck_b = (uint8_t)(ck_b + ck_a);
+    }
+    if(ck_a != m[plen + 6] || ck_b != m[plen + 7])
+    {
+        g->rejected++;
+        return -1;
+    }
+    g->messages++;
+    if(m[2] != 0x0D || m[3] != 0x01 || plen != 16)
+    {
+        return 0;
+    }
+    // TIM-TP: towMS, towSubMS (2^-32 ms), qErr, week, flags, refInfo
+    if(!(pl[14] & 0x01))
+    {
+        g->rejected++;
+        return 0;
+    }
+    uint32_t towMs  = gnss_le32(pl);
+    uint32_t towSub = gnss_le32(pl + 4);
+    unsigned week   = (unsigned)pl[12] | (unsigned)pl[13] << 8;
+    int64_t  pulse  = (GNSS_GPS_EPOCH + (int64_t)week * 604800) * NSEC_PER_SEC + (int64_t)towMs * NSEC_PER_MSEC
+                      + (int64_t)(((uint64_t)towSub * 1000000u) >> 32);
+
+    return gnss_fix(g, pulse - NSEC_PER_SEC);
+}
+
+//---------------------------------------------------------------
+// gnss_reset(gnssParser *g, int window, int64_t latencyNs)
+//---------------------------------------------------------------
+void gnss_reset(gnssParser *g, int window, int64_t latencyNs)
+{
+    memset(g, 0, sizeof *g);
+    g->window    = (window >= 1 && window <= GNSS_WINDOW_MAX) ? window : 1;
+    g->latencyNs = latencyNs;
+}
+
+//---------------------------------------------------------------
+// gnss_scan(gnssParser *g, size_t n, int64_t monoNs)
+//
+// Takes n bytes just placed at g->buf + g->len, which arrived at
+// monoNs, and parses every complete message.  Returns the number of
+// new epochs taken into the estimate.
+//---------------------------------------------------------------
+int gnss_scan(gnssParser *g, size_t n, int64_t monoNs)
+{
+    size_t i = 0;
+    int fixes = 0;
+
+    if(g->lastMonoNs == 0 || monoNs - g->lastMonoNs > GNSS_GAP_NS)
+    {
+        g->burstMonoNs = monoNs;
+    }
+    g->lastMonoNs = monoNs;
+    g->len += n;
+
+    while(i < g->len)
+    {
+        const uint8_t *m = g->buf + i;
+        size_t left = g->len - i;
+
+        if(m[0] == '$')
+        {
+            // A sentence is printable up to its CR LF; anything else
+            // (a UBX frame, line noise) means this '$' starts nothing.
+            size_t k = 1, lim = (left < GNSS_NMEA_MAX) ? left : GNSS_NMEA_MAX;
+            while(k < lim && m[k] != '\n' && m[k] != '$' && (m[k] == '\r' || (m[k] >= 0x20 && m[k] < 0x7F)))
+            {
+                k++;
+            }
+            if(k == lim && lim == left)
+            {
+                break;
+            }
+            if(k == lim || m[k] != '\n')
+            {
+                i++;
+                continue;
+            }
+            fixes += gnss_nmea(g, (const char *)m, (const char *)m + k);
+            i += k + 1;
+        }
+        else if(m[0] == UBX_SYNC1)
+        {
+            if(left < 6)
+            {
+                break;
+            }
+            size_t plen = (size_t)m[4] | (size_t)m[5] << 8;
+            if(m[1] != UBX_SYNC2 || plen > GNSS_UBX_MAX)
+            {
+                i++;
+                continue;
+            }
+            if(left < plen + 8)
+            {
+                break;
+            }
+            int rv = gnss_ubx(g, m, plen);
+            if(rv < 0)
+            {
+                i++;
+                continue;
+            }
+            fixes += rv;
+            i += plen + 8;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    if(i > 0)
+    {
+        memmove(g->buf, g->buf + i, g->len - i);
+        g->len -= i;
+    }
+    return fixes;
+}
+
+//---------------------------------------------------------------
+// gnss_read(gnssParser *g, int fd)
+//
+// One read() into the parser's buffer, stamped as it returns.
+// Returns the new epochs, or -1 on end of file or an error other
+// than EAGAIN/EINTR.
+//---------------------------------------------------------------
+int gnss_read(gnssParser *g, int fd)
+{
+    if(g->len == GNSS_BUF_LEN)
+    {
+        g->len = 0;                     // cannot happen with the size limits above
+    }
+    ssize_t n = read(fd, g->buf + g->len, GNSS_BUF_LEN - g->len);
+    int64_t now = mono_ns();
+
+    if(n < 0)
+    {
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    if(n == 0)
+    {
+        return -1;
+    }
+    return gnss_scan(g, (size_t)n, now);
+}
+
+//---------------------------------------------------------------
+// gnss_open(const char *device, int baud)
+// The receiver's port, raw, non-blocking.
+//---------------------------------------------------------------
+int gnss_open(const char *device, int baud)
+{
+    struct termios tty;
+    speed_t speed;
+    int fd;
+
+    switch(baud)
+    {
+        case 4800:   speed = B4800;   break;
+        case 19200:  speed = B19200;  break;
+        case 38400:  speed = B38400;  break;
+        case 57600:  speed = B57600;  break;
+        case 115200: speed = B115200; break;
+        case 230400: speed = B230400; break;
+        case 460800: speed = B460800; break;
+        default:     speed = B9600;   break;
+    }
+    fd = open(device, O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    if(tcgetattr(fd, &tty) == 0)
+    {
+        cfmakeraw(&tty);
+        cfsetispeed(&tty, speed);
+        cfsetospeed(&tty, speed);
+        tty.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+    tcflush(fd, TCIFLUSH);
+    return fd;
+}
+
+//---------------------------------------------------------------
+// gnss_publish(int connected)
+//---------------------------------------------------------------
+static void gnss_publish(int connected)
+{
+    pthread_mutex_lock(&gnssLock);
+    gnssPub       = gnssRx;
+    gnssConnected = connected;
+    pthread_mutex_unlock(&gnssLock);
+}
+
+//---------------------------------------------------------------
+// gnss_log(const char *what)
+//---------------------------------------------------------------
+static void gnss_log(const char *what)
+{
+    fprintf(OUTPUT_ERROR, "{ \"lastStatus\": \"%s\", \"device\": \"%s\" }\n", what, gnssDevice);
+    fflush(OUTPUT_ERROR);
+}
+
+//---------------------------------------------------------------
+// gnss_thread(void *arg)
+//
+// Reads the receiver until stopped, reopening the port a second after
+// it fails (a USB receiver unplugged and plugged back in).
+//---------------------------------------------------------------
+static void *gnss_thread(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    int locked = FALSE;
+
+    while(!gnssStop && !halt_pending())
+    {
+        if(fd < 0)
+        {
+            if(halt_sleepUntil(mono_ns() + GNSS_RETRY_NS) < 0 || (fd = gnss_open(gnssDevice, gnssBaud)) < 0)
+            {
+                continue;
+            }
+            gnss_log("gnss_connected");
+        }
+
+        struct pollfd fds[2] =
+        {
+            { .fd = fd,         .events = POLLIN, .revents = 0 },
+            { .fd = halt_fd(),  .events = POLLIN, .revents = 0 }
+        };
+        if(poll(fds, 2, GNSS_POLL_MS) > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+           && gnss_read(&gnssRx, fd) < 0)
+        {
+            close(fd);
+            fd = -1;
+            gnss_log("gnss_disconnected");
+            gnss_publish(FALSE);
+            continue;
+        }
+
+        int fresh = gnssRx.fixes > 0 && mono_ns() - gnssRx.fixMonoNs <= gnssMaxAgeNs;
+        if(fresh != locked)
+        {
+            gnss_log(fresh ? "gnss_locked" : "gnss_lost");
+            locked = fresh;
+        }
+        gnss_publish(TRUE);
+    }
+    if(fd >= 0)
+    {
+        close(fd);
+    }
+    return NULL;
+}
+
+//---------------------------------------------------------------
+// gnss_init(pList *p)
+//
+// Opens the configured receiver and starts its reader.  Without one
+// the records are stamped on the host clock (or PPS) as before.
+//---------------------------------------------------------------
+int gnss_init(pList *p)
+{
+    int fd;
+
+    if(p->gnssDevice == NULL || p->gnssDevice[0] == '\0')
+    {
+        return 0;
+    }
+    gnssDevice   = p->gnssDevice;
+    gnssBaud     = p->gnssBaud;
+    gnssMaxAgeNs = (int64_t)p->gnssMaxAge * NSEC_PER_SEC;
+    gnss_reset(&gnssRx, p->gnssWindow, (int64_t)(p->gnssLatencyMs * NSEC_PER_MSEC));
+    gnssPub = gnssRx;
+
+    fd = gnss_open(gnssDevice, gnssBaud);
+    if(fd < 0)
+    {
+        fprintf(OUTPUT_ERROR, "Unable to open GNSS receiver %s: %s; retrying in the background\n",
+                gnssDevice, strerror(errno));
+    }
+    gnssConnected = (fd >= 0);
+    gnssStop      = FALSE;
+    if(pthread_create(&gnssThread, NULL, gnss_thread, (void *)(intptr_t)fd) != 0)
+    {
+        perror("pthread_create gnss");
+        if(fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    gnssRunning = TRUE;
+    return 0;
+}
+
+//---------------------------------------------------------------
+// gnss_utcAt(int64_t monoNs, int64_t *utcNs)
+//
+// UTC of a CLOCK_MONOTONIC instant, if there is an estimate no older
+// than max_age at that instant.  utcNs is left alone otherwise.
+//---------------------------------------------------------------
+int gnss_utcAt(int64_t monoNs, int64_t *utcNs)
+{
+    int got;
+
+    if(!gnssRunning)
+    {
+        return FALSE;
+    }
+    pthread_mutex_lock(&gnssLock);
+    got = gnssPub.fixes > 0 && llabs(monoNs - gnssPub.fixMonoNs) <= gnssMaxAgeNs;
+    if(got)
+    {
+        *utcNs = monoNs + gnssPub.offsetNs;
+    }
+    pthread_mutex_unlock(&gnssLock);
+    return got;
+}
+
+//---------------------------------------------------------------
+// gnss_discipline(magSample *s)
+//
+// Restamps the realtime side of every bracket in s from the receiver
+// and records how far the host clock was off at the primary trigger.
+// Leaves s alone without a fresh estimate.
+//---------------------------------------------------------------
+void gnss_discipline(magSample *s)
+{
+    int first = TRUE;
+
+    for(int i = 0; i < s->numMags; i++)
+    {
+        if(!(s->validMask & (1u << i)))
+        {
+            continue;
+        }
+        magStamp *st = &s->stamps[i];
+        int64_t trig, drdy;
+        if(!gnss_utcAt(st->trigMonoNs, &trig) || !gnss_utcAt(st->drdyMonoNs, &drdy))
+        {
+            return;
+        }
+        if(first)
+        {
+            s->gnssValid  = TRUE;
+            s->gnssHostNs = st->trigRealNs - trig;
+            first = FALSE;
+        }
+        st->trigRealNs = trig;
+        st->drdyRealNs = drdy;
+    }
+}
+
+//---------------------------------------------------------------
+// gnss_format(char *buf, size_t len)
+//
+// JSON object for the status record.  Returns the length snprintf()
+// would have written.
+//---------------------------------------------------------------
+int gnss_format(char *buf, size_t len)
+{
+    gnssParser g;
+    int connected;
+    int64_t real, mono;
+
+    pthread_mutex_lock(&gnssLock);
+    g         = gnssPub;
+    connected = gnssConnected;
+    pthread_mutex_unlock(&gnssLock);
+
+    clock_pair_ns(&real, &mono);
+    if(g.fixes == 0)
+    {
+        return snprintf(buf, len,
+                        "{ \"device\": \"%s\", \"connected\": %s, \"messages\": %" PRIu64 ", \"rejected\": %" PRIu64
+                        ", \"fixes\": 0 }",
+                        gnssDevice ? gnssDevice : "", connected ? "true" : "false", g.messages, g.rejected);
+    }
+    return snprintf(buf, len,
+                    "{ \"device\": \"%s\", \"connected\": %s, \"messages\": %" PRIu64 ", \"rejected\": %" PRIu64
+                    ", \"fixes\": %" PRIu64 ", \"age_s\": %.1f, \"spread_us\": %.0f, \"host_minus_gnss_us\": %.0f }",
+                    gnssDevice ? gnssDevice : "", connected ? "true" : "false", g.messages, g.rejected, g.fixes,
+                    (double)(mono - g.fixMonoNs) / 1e9, (double)g.spreadNs / 1e3,
+                    (double)(real - mono - g.offsetNs) / 1e3);
+}
+
+//---------------------------------------------------------------
+// gnss_close(pList *p)
+//---------------------------------------------------------------
+void gnss_close(pList *p)
+{
+    (void)p;
+    if(!gnssRunning)
+    {
+        return;
+    }
+    gnssStop = TRUE;
+    pthread_join(gnssThread, NULL);
+    gnssRunning = FALSE;
+}
@@ -0,0 +1,60 @@
+//=========================================================================
+// gnss.h
+//
+// GNSS receiver time source: UTC from NMEA RMC/ZDA or UBX TIM-TP on a
+// serial port, without PPS wiring.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_GNSS_H
+#define MAG_USB_GNSS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "main.h"
+
+#define GNSS_BUF_LEN        512
+#define GNSS_WINDOW_MAX     64
+
+//------------------------------------------
+// Incremental receiver parser and the UTC - CLOCK_MONOTONIC estimate
+// it keeps.  Bytes are read straight into buf and messages are
+// parsed where they lie; only a partial message is moved to the front.
+//------------------------------------------
+typedef struct
+{
+    uint8_t  buf[GNSS_BUF_LEN];
+    size_t   len;                   // bytes held
+    int64_t  burstMonoNs;           // arrival of the first read after a quiet gap
+    int64_t  lastMonoNs;            // arrival of the last read
+    int      rmcStatus;             // status of the last RMC, 'A' or 'V' (0: none yet)
+    int64_t  latencyNs;             // receiver epoch to the start of its burst
+    int      window;                // epochs the estimate is taken over
+    int64_t  win[GNSS_WINDOW_MAX];  // UTC - monotonic, one per epoch
+    int      count;
+    int      head;
+    int64_t  fixUtcNs;              // UTC epoch of the last fix
+    int64_t  fixMonoNs;             // CLOCK_MONOTONIC arrival of its burst
+    int64_t  offsetNs;              // UTC - CLOCK_MONOTONIC (valid once count > 0)
+    int64_t  spreadNs;              // of the offsets in the window
+    uint64_t messages;              // well-formed messages
+    uint64_t rejected;              // bad checksums, untrusted or unpaced fixes
+    uint64_t fixes;                 // epochs taken into the estimate
+} gnssParser;
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+void gnss_reset(gnssParser *g, int window, int64_t latencyNs);
+int  gnss_scan(gnssParser *g, size_t n, int64_t monoNs);
+int  gnss_read(gnssParser *g, int fd);
+int  gnss_open(const char *device, int baud);
+
+int  gnss_init(pList *p);
+int  gnss_utcAt(int64_t monoNs, int64_t *utcNs);
+void gnss_discipline(magSample *s);
+int  gnss_format(char *buf, size_t len);
+void gnss_close(pList *p);
+
+#endif // MAG_USB_GNSS_H
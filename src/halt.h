@@ -0,0 +1,25 @@
+//=========================================================================
+// halt.h
+//
+// Process-wide shutdown notification on an eventfd, so blocking waits
+// can watch for it next to whatever else they wait on.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_HALT_H
+#define MAG_USB_HALT_H
+
+#include <stdint.h>
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int  halt_init(void);
+void halt_request(void);
+int  halt_pending(void);
+int  halt_fd(void);
+int  halt_sleepUntil(int64_t monoNs);
+void halt_close(void);
+
+#endif // MAG_USB_HALT_H
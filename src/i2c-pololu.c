@@ -18,8 +18,11 @@
 #include <time.h>
 #include <stdbool.h>
 #include <sys/types.h>
+#include <poll.h>
 #include "i2c-pololu.h"
 
+#define I2C_POLOLU_READ_TIMEOUT_MS  100     // as the port's VTIME
+
 //------------------------------------------
 // i2c_pololu_check_device_available()
 //------------------------------------------
@@ -114,6 +117,70 @@ static int check_response( const uint8_t *response, size_t expected_len, size_t
     return 0; // Success
 }
 
+//------------------------------------------
+// adapter_read()
+// read() from the adapter.  With a cancel fd set, the wait for data is
+// a poll() on both, so a readable cancel fd ends it at once.
+//------------------------------------------
+static ssize_t adapter_read( i2c_pololu_adapter *adapter, void *buf, size_t len )
+{
+    if(adapter->cancel_fd >= 0)
+    {
+        struct pollfd fds[2] =
+        {
+            { .fd = adapter->fd,        .events = POLLIN, .revents = 0 },
+            { .fd = adapter->cancel_fd, .events = POLLIN, .revents = 0 }
+        };
+        int rv;
+        while((rv = poll(fds, 2, I2C_POLOLU_READ_TIMEOUT_MS)) < 0 && errno == EINTR)
+        {
+        }
+        if(rv < 0)
+        {
+            return -1;
+        }
+        if(rv == 0)
+        {
+            return 0;
+        }
+        if(!(fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            errno = ECANCELED;
+            return -1;
+        }
+    }
+    return read(adapter->fd, buf, len);
+}
+
+//------------------------------------------
+// read_exact()
+// Collects a multi-response batch.  The adapter may return the
+// responses in separate USB packets, so keep reading until all bytes
+// are in or the port's VTIME read timeout expires.
+//------------------------------------------
+static ssize_t read_exact( i2c_pololu_adapter *adapter, uint8_t *buf, size_t len )
+{
+    size_t got = 0;
+    while(got < len)
+    {
+        ssize_t n = adapter_read(adapter, buf + got, len - got);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if(n == 0)
+        {
+            break;
+        }
+        got += (size_t)n;
+    }
+    return (ssize_t)got;
+}
+
 //------------------------------------------
 // i2c_pololu_init()
 // This just initialixes the dile descriptor.  not much use, really.
@@ -123,6 +190,7 @@ int i2c_pololu_init( i2c_pololu_adapter *adapter )
     if(adapter)
     {
         adapter->fd = -1;
+        adapter->cancel_fd = -1;
         return 0;
     }
     return 1;
@@ -152,6 +220,7 @@ int i2c_pololu_connect( i2c_pololu_adapter *adapter, const char *port_name )
         fprintf(OUTPUT_ERROR, "Error opening port device may not exist or may be in use: %s. %s\n", port_name, eBuf);
         return -1;
     }
+    adapter->cancel_fd = -1;
     adapter->fd = open(port_name, O_RDWR | O_NOCTTY | O_EXCL);
     if(adapter->fd < 0)
     {
@@ -205,6 +274,17 @@ int i2c_pololu_connect( i2c_pololu_adapter *adapter, const char *port_name )
     return 0;
 }
 
+//------------------------------------------
+// i2c_pololu_set_cancel_fd()
+//------------------------------------------
+void i2c_pololu_set_cancel_fd( i2c_pololu_adapter *adapter, int fd )
+{
+    if(adapter)
+    {
+        adapter->cancel_fd = fd;
+    }
+}
+
 //------------------------------------------
 // i2c_pololu_disconnect()
 //------------------------------------------
@@ -258,7 +338,7 @@ int i2c_pololu_write_to( i2c_pololu_adapter *adapter, uint8_t address, uint8_t r
         return -1;
     }
     uint8_t response[1];
-    ssize_t len = read(adapter->fd, response, 1);
+    ssize_t len = adapter_read(adapter, response, 1);
     int error = check_response(response, 1, len);
     if(error)
     {
@@ -293,7 +373,7 @@ int i2c_pololu_read_from( i2c_pololu_adapter *adapter, uint8_t address, uint8_t
     
     // Read the write response
     uint8_t write_response[1];
-    ssize_t len = read(adapter->fd, write_response, 1);
+    ssize_t len = adapter_read(adapter, write_response, 1);
     int error = check_response(write_response, 1, len);
     if(error)
     {
@@ -314,7 +394,7 @@ int i2c_pololu_read_from( i2c_pololu_adapter *adapter, uint8_t address, uint8_t
     }
 
     uint8_t response[256];
-    len = read(adapter->fd, response, 1 + size);  // Error byte + data
+    len = adapter_read(adapter, response, 1 + size);  // Error byte + data
     error = check_response(response, 1 + size, len);
     if(error)
     {
@@ -349,7 +429,7 @@ int i2c_pololu_write_and_read_from( i2c_pololu_adapter *adapter, uint8_t address
     }
     
     uint8_t response[256];
-    ssize_t len = read(adapter->fd, response, 1 + size);  // Error byte + data
+    ssize_t len = adapter_read(adapter, response, 1 + size);  // Error byte + data
     int error = check_response(response, 1 + size, len);
     if(error)
     {
@@ -361,6 +441,122 @@ int i2c_pololu_write_and_read_from( i2c_pololu_adapter *adapter, uint8_t address
     return size;
 }
 
+//------------------------------------------
+// i2c_pololu_read_then_write()
+//------------------------------------------
+int i2c_pololu_read_then_write( i2c_pololu_adapter *adapter, uint8_t address, uint8_t read_reg, uint8_t *data, uint8_t size,
+                                uint8_t write_reg, const uint8_t *wdata, uint8_t wsize )
+{
+    if(!i2c_pololu_is_connected(adapter))
+    {
+        return -1;
+    }
+    if(wsize > 250)
+    {
+        return -ERROR_PROTOCOL;
+    }
+
+    // Both commands go out in one write(): a write-and-read of the
+    // result registers followed by a plain register write.  The adapter
+    // executes them back to back, so the second transaction costs no
+    // extra USB round trip.
+    uint8_t cmd[5 + 4 + 250];
+    size_t  n = 0;
+    cmd[n++] = CMD_I2C_WRITE_AND_READ;
+    cmd[n++] = address;
+    cmd[n++] = 1;           // Write 1 byte (register address)
+    cmd[n++] = size;        // Read 'size' bytes
+    cmd[n++] = read_reg;
+    cmd[n++] = CMD_I2C_WRITE;
+    cmd[n++] = address;
+    cmd[n++] = 1 + wsize;   // Length includes register byte + data
+    cmd[n++] = write_reg;
+    if(wsize > 0 && wdata != NULL)
+    {
+        memcpy(&cmd[n], wdata, wsize);
+        n += wsize;
+    }
+    if(write(adapter->fd, cmd, n) != (ssize_t)n)
+    {
+        perror("Failed to write batch to adapter");
+        return -1;
+    }
+
+    // Responses: error byte + data for the read, then one error byte
+    // for the write.
+    uint8_t response[1 + 255 + 1];
+    ssize_t len = read_exact(adapter, response, (size_t)size + 2);
+    int error = check_response(response, (size_t)size + 1, len < 0 ? 0 : (size_t)len);
+    if(error)
+    {
+        fprintf(OUTPUT_ERROR, "Error in batched read: %s\n", i2c_pololu_error_string(error));
+        return error;
+    }
+    memcpy(data, &response[1], size);
+    error = check_response(&response[size + 1], 1, (size_t)len - (size_t)size - 1);
+    if(error)
+    {
+        fprintf(OUTPUT_ERROR, "Error in batched write: %s\n", i2c_pololu_error_string(error));
+        return error;
+    }
+    return size;
+}
+
+//------------------------------------------
+// i2c_pololu_write_each()
+//------------------------------------------
+int i2c_pololu_write_each( i2c_pololu_adapter *adapter, const uint8_t *addresses, int count, uint8_t reg,
+                           const uint8_t *data, uint8_t size, int *errors )
+{
+    if(!i2c_pololu_is_connected(adapter))
+    {
+        return -1;
+    }
+    if(count < 1 || count > I2C_POLOLU_MAX_BATCH || size > 16)
+    {
+        return -ERROR_PROTOCOL;
+    }
+
+    // One CMD_I2C_WRITE per target, all in a single write(); the
+    // adapter answers with one status byte per command, in order.
+    uint8_t cmd[I2C_POLOLU_MAX_BATCH * (4 + 16)];
+    size_t  n = 0;
+    for(int i = 0; i < count; i++)
+    {
+        cmd[n++] = CMD_I2C_WRITE;
+        cmd[n++] = addresses[i];
+        cmd[n++] = 1 + size;    // Length includes register byte + data
+        cmd[n++] = reg;
+        if(size > 0 && data != NULL)
+        {
+            memcpy(&cmd[n], data, size);
+            n += size;
+        }
+    }
+    if(write(adapter->fd, cmd, n) != (ssize_t)n)
+    {
+        perror("Failed to write batch to adapter");
+        return -1;
+    }
+
+    uint8_t response[I2C_POLOLU_MAX_BATCH];
+    ssize_t len = read_exact(adapter, response, (size_t)count);
+    int acked = 0;
+    for(int i = 0; i < count; i++)
+    {
+        int error = check_response(&response[i], 1, (len > i) ? 1 : 0);
+        if(errors)
+        {
+            errors[i] = error;
+        }
+        if(!error)
+        {
+            acked++;
+        }
+    }
+    return acked;
+}
+
 /*
 Minor functions currently not implemented.
 
@@ -483,7 +679,7 @@ int i2c_pololu_get_device_info( i2c_pololu_adapter *adapter, i2c_pololu_device_i
         return -1;
     }
     uint8_t length;
-    if(read(adapter->fd, &length, 1) != 1)
+    if(adapter_read(adapter, &length, 1) != 1)
     {
         fprintf(OUTPUT_ERROR, "Failed to read Pololu device info length.\n");
 //        perror("Failed to read Pololu device info length.\n");
@@ -498,7 +694,7 @@ int i2c_pololu_get_device_info( i2c_pololu_adapter *adapter, i2c_pololu_device_i
     }
     uint8_t raw_info[28];
     raw_info[0] = length;
-    if(read(adapter->fd, &raw_info[1], length - 1) != length - 1)
+    if(adapter_read(adapter, &raw_info[1], length - 1) != length - 1)
     {
         fprintf(OUTPUT_ERROR, "Failed to read device info payload\n");
 //        perror("Failed to read device info payload\n");
@@ -581,7 +777,7 @@ int i2c_pololu_scan( i2c_pololu_adapter *adapter, uint8_t *found_addresses, int
     uint8_t rPtr = 0;
     uint8_t responses[128];
     uint8_t bytes_left = sizeof(responses);
-    ssize_t bytes_read = read(adapter->fd, &responses[rPtr], bytes_left);
+    ssize_t bytes_read = adapter_read(adapter, &responses[rPtr], bytes_left);
     if(bytes_read == -1)
     {
         perror("Failed to read scan responses");
@@ -596,7 +792,7 @@ int i2c_pololu_scan( i2c_pololu_adapter *adapter, uint8_t *found_addresses, int
         }
         rPtr += bytes_read;
         bytes_left -= bytes_read;
-        bytes_read = read(adapter->fd, &responses[rPtr], bytes_left);
+        bytes_read = adapter_read(adapter, &responses[rPtr], bytes_left);
     }
 
     int found_count = 0;
@@ -48,6 +48,9 @@
 #define I2C_FAST_MODE_PLUS 2
 #define I2C_10_KHZ 3
 
+// Most commands i2c_pololu_write_each() sends in one batch.
+#define I2C_POLOLU_MAX_BATCH 8
+
 #define OUTPUT_PRINT        stdout
 #define OUTPUT_ERROR        stderr
 
@@ -55,6 +58,7 @@
 typedef struct
 {
     int fd; // File descriptor for the serial port
+    int cancel_fd; // Readable fd that abandons a pending read (-1 = none)
 } i2c_pololu_adapter;
 
 /**
@@ -106,6 +110,14 @@ int i2c_pololu_init( i2c_pololu_adapter *adapter );
  */
 int i2c_pololu_connect( i2c_pololu_adapter *adapter, const char *port_name );
 
+/**
+ * @brief Sets an fd that, once readable, makes reads waiting on the adapter
+ *        give up (errno ECANCELED) instead of running out their timeout.
+ * @param adapter A pointer to the i2c_pololu_adapter struct.
+ * @param fd The fd to watch, e.g. a shutdown eventfd, or -1 for none.
+ */
+void i2c_pololu_set_cancel_fd( i2c_pololu_adapter *adapter, int fd );
+
 /**
  * @brief Disconnects the adapter from the serial port.
  * @param adapter A pointer to the i2c_pololu_adapter struct.
@@ -150,6 +162,37 @@ int i2c_pololu_read_from( i2c_pololu_adapter *adapter, uint8_t address, uint8_t
  */
 int i2c_pololu_write_and_read_from( i2c_pololu_adapter *adapter, uint8_t address, uint8_t reg, uint8_t *data, uint8_t size );
 
+/**
+ * @brief Reads a register block and then writes a register on the same target in one adapter batch.
+ *        Used to fetch a conversion result and start the next conversion without an extra USB round trip.
+ * @param adapter A pointer to the i2c_pololu_adapter struct.
+ * @param address The 7-bit I2C address.
+ * @param read_reg First register to read.
+ * @param data A buffer to store the read data.
+ * @param size The number of bytes to read.
+ * @param write_reg Register to write after the read.
+ * @param wdata Data to write to write_reg.
+ * @param wsize The number of bytes to write (at most 250).
+ * @return The number of bytes read, or a negative error code on failure of either transaction.
+ */
+int i2c_pololu_read_then_write( i2c_pololu_adapter *adapter, uint8_t address, uint8_t read_reg, uint8_t *data, uint8_t size,
+                                uint8_t write_reg, const uint8_t *wdata, uint8_t wsize );
+
+/**
+ * @brief Writes the same register on several targets in one adapter batch.
+ *        Used to start conversions on every magnetometer of a gradiometer at once.
+ * @param adapter A pointer to the i2c_pololu_adapter struct.
+ * @param addresses The 7-bit I2C addresses, one per target.
+ * @param count Number of targets (1 to I2C_POLOLU_MAX_BATCH).
+ * @param reg Register to write on each target.
+ * @param data Data to write to reg.
+ * @param size The number of bytes to write (at most 16).
+ * @param errors Optional array of count entries; receives 0 or a negative error code per target.
+ * @return The number of targets that acknowledged, or a negative error code if the batch could not be sent.
+ */
+int i2c_pololu_write_each( i2c_pololu_adapter *adapter, const uint8_t *addresses, int count, uint8_t reg,
+                           const uint8_t *data, uint8_t size, int *errors );
+
 /**
  * @brief Sets the I2C frequency.
  * @param adapter A pointer to the i2c_pololu_adapter struct.
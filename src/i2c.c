@@ -33,59 +33,127 @@
 //  them altogether.  Currently there is a NASTY mix.
 //=========================================================================
 #include <stdint.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "main.h"
 #include "i2c.h"
 #include "i2c-pololu.h" // your Pololu API headers
 #include "rm3100.h"
+#include "halt.h"
+#include "timeutil.h"
 
 
 //------------------------------------------
-// readMagPOLL()
+// assembleXYZ()
+// 24-bit big-endian signed values with sign extension.
 //------------------------------------------
-int i2c_readMagPOLL(pList *p)
+static void assembleXYZ(int32_t *xyz, const uint8_t *xyzBuf)
 {
-    int rv = 0;
-    int bytes_read = 0;
-    uint8_t xyzBuf[XYZ_BUFLEN] = {0};
+    xyz[0] = ((int32_t)(int8_t)xyzBuf[0] << 16) | ((int32_t)xyzBuf[1] << 8) | (int32_t)xyzBuf[2];
+    xyz[1] = ((int32_t)(int8_t)xyzBuf[3] << 16) | ((int32_t)xyzBuf[4] << 8) | (int32_t)xyzBuf[5];
+    xyz[2] = ((int32_t)(int8_t)xyzBuf[6] << 16) | ((int32_t)xyzBuf[7] << 8) | (int32_t)xyzBuf[8];
+}
 
-    // 1) Trigger a single XYZ measurement by writing to POLL register
+//------------------------------------------
+// i2c_triggerMagPOLL()
+// Starts a single XYZ conversion by writing to the POLL register.
+//------------------------------------------
+int i2c_triggerMagPOLL(pList *p)
+{
     uint8_t poll_cmd = RM3100I2C_POLLXYZ;
-    rv = i2c_pololu_write_to(p->adapter, (uint8_t)p->magAddr, (uint8_t)RM3100_MAG_POLL, &poll_cmd, 1);
+    int rv = i2c_pololu_write_to(p->adapter, (uint8_t)p->magAddr, (uint8_t)RM3100_MAG_POLL, &poll_cmd, 1);
     if (rv < 0)
     {
         fprintf(OUTPUT_ERROR, "  POLL write failed: %s\n", i2c_pololu_error_string(-rv));
+    }
+    return rv;
+}
+
+//------------------------------------------
+// i2c_triggerMagPOLLEach()
+// Starts a conversion on several magnetometers with one adapter
+// batch, so they convert side by side.  errors[i] receives 0 or a
+// negative adapter error for addrs[i].  Returns the number started.
+//------------------------------------------
+int i2c_triggerMagPOLLEach(pList *p, const uint8_t *addrs, int count, int *errors)
+{
+    uint8_t poll_cmd = RM3100I2C_POLLXYZ;
+    int rv = i2c_pololu_write_each(p->adapter, addrs, count, (uint8_t)RM3100_MAG_POLL, &poll_cmd, 1, errors);
+    if (rv < 0)
+    {
+        fprintf(OUTPUT_ERROR, "  POLL batch failed: %s\n", i2c_pololu_error_string(-rv));
+        for (int i = 0; i < count; i++)
+        {
+            errors[i] = rv;
+        }
+        return 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (errors[i])
+        {
+            fprintf(OUTPUT_ERROR, "  POLL write to 0x%02X failed: %s\n", addrs[i], i2c_pololu_error_string(-errors[i]));
+        }
+    }
+    return rv;
+}
+
+//------------------------------------------
+// i2c_readMagDRDYAt()
+// One STATUS read.  Returns 1 if DRDY is set, 0 if the conversion is
+// still running, or a negative adapter error.
+//------------------------------------------
+int i2c_readMagDRDYAt(pList *p, uint8_t addr)
+{
+    uint8_t status = 0;
+    int rv = i2c_pololu_read_from(p->adapter, addr, (uint8_t)RM3100I2C_STATUS, &status, 1);
+    if (rv < 0)
+    {
+        fprintf(OUTPUT_ERROR, "  STATUS read failed: %s\n", i2c_pololu_error_string(-rv));
         return rv;
     }
+    return ((status & RM3100I2C_READMASK) == RM3100I2C_READMASK) ? 1 : 0;
+}
 
-    // 2) Wait for DRDY in STATUS register with a timeout
+//------------------------------------------
+// i2c_waitMagDRDY()
+// Polls the STATUS register until DRDY is set.  Returns 0 when data
+// is ready, -ETIMEDOUT on timeout, -ECANCELED if a stop is requested,
+// or a negative adapter error.
+//------------------------------------------
+int i2c_waitMagDRDY(pList *p)
+{
     const int max_tries = 1000; // safety cap
     int tries = 0;
-    uint8_t status = 0;
+    int rv = 0;
     do
     {
-        rv = i2c_pololu_read_from(p->adapter, (uint8_t)p->magAddr, (uint8_t)RM3100I2C_STATUS, &status, 1);
+        rv = i2c_readMagDRDYAt(p, (uint8_t)p->magAddr);
         if (rv < 0)
-        {
-            fprintf(OUTPUT_ERROR, "  STATUS read failed: %s\n", i2c_pololu_error_string(-rv));
             return rv;
-        }
-        if ((status & RM3100I2C_READMASK) == RM3100I2C_READMASK)
-            break;
-        if (p->DRDYdelay > 0)
-            usleep((useconds_t)(p->DRDYdelay * 1000)); // DRDYdelay in ms
+        if (rv == 1)
+            return 0;
+        if (halt_sleepUntil(mono_ns() + p->DRDYdelay * NSEC_PER_MSEC) < 0) // DRDYdelay in ms
+            return -ECANCELED;
         ++tries;
     } while (tries < max_tries);
 
-    if (tries >= max_tries)
-    {
-        fprintf(OUTPUT_ERROR, "  Timeout waiting for DRDY (status=0x%02X)\n", status);
-        return -1;
-    }
+    fprintf(OUTPUT_ERROR, "  Timeout waiting for DRDY\n");
+    return -ETIMEDOUT;
+}
+
+//------------------------------------------
+// i2c_readMagXYZAt()
+// Reads the 9 result bytes of the magnetometer at addr and stores the
+// sign-extended counts in xyz[3].  Returns XYZ_BUFLEN on success.
+//------------------------------------------
+int i2c_readMagXYZAt(pList *p, uint8_t addr, int32_t *xyz)
+{
+    uint8_t xyzBuf[XYZ_BUFLEN] = {0};
 
-    // 3) Read the 9 data bytes starting at MX register (0x24)
-    rv = i2c_pololu_read_from(p->adapter, (uint8_t)p->magAddr, (uint8_t)RM3100I2C_XYZ, xyzBuf, (uint8_t)XYZ_BUFLEN);
+    // Read the 9 data bytes starting at MX register (0x24)
+    int rv = i2c_pololu_read_from(p->adapter, addr, (uint8_t)RM3100I2C_XYZ, xyzBuf, (uint8_t)XYZ_BUFLEN);
     if (rv < 0)
     {
         fprintf(OUTPUT_ERROR, "  Data read failed: %s\n", i2c_pololu_error_string(-rv));
@@ -97,17 +165,72 @@ int i2c_readMagPOLL(pList *p)
         return rv;
     }
 
-    // 4) Assemble 24-bit big-endian signed values with sign extension
-    int32_t x = ((int32_t)(int8_t)xyzBuf[0] << 16) | ((int32_t)xyzBuf[1] << 8) | (int32_t)xyzBuf[2];
-    int32_t y = ((int32_t)(int8_t)xyzBuf[3] << 16) | ((int32_t)xyzBuf[4] << 8) | (int32_t)xyzBuf[5];
-    int32_t z = ((int32_t)(int8_t)xyzBuf[6] << 16) | ((int32_t)xyzBuf[7] << 8) | (int32_t)xyzBuf[8];
+    assembleXYZ(xyz, xyzBuf);
+    return XYZ_BUFLEN;
+}
+
+//------------------------------------------
+// i2c_readMagXYZ()
+// Reads the primary magnetometer into p->XYZ.
+//------------------------------------------
+int i2c_readMagXYZ(pList *p)
+{
+    return i2c_readMagXYZAt(p, (uint8_t)p->magAddr, p->XYZ);
+}
+
+//------------------------------------------
+// i2c_readMagXYZAndTriggerAt()
+// Pipelined POLL: reads the 9 result bytes of the finished conversion
+// and writes the POLL trigger for the next one in a single adapter
+// batch, so the sensor is converting again while the host processes
+// this sample.
+//------------------------------------------
+int i2c_readMagXYZAndTriggerAt(pList *p, uint8_t addr, int32_t *xyz)
+{
+    uint8_t xyzBuf[XYZ_BUFLEN] = {0};
+    uint8_t poll_cmd = RM3100I2C_POLLXYZ;
+
+    int rv = i2c_pololu_read_then_write(p->adapter, addr, (uint8_t)RM3100I2C_XYZ, xyzBuf,
+                                        (uint8_t)XYZ_BUFLEN, (uint8_t)RM3100_MAG_POLL, &poll_cmd, 1);
+    if (rv < 0)
+    {
+        fprintf(OUTPUT_ERROR, "  Pipelined data read failed: %s\n", i2c_pololu_error_string(-rv));
+        return rv;
+    }
+    assembleXYZ(xyz, xyzBuf);
+    return XYZ_BUFLEN;
+}
+
+//------------------------------------------
+// i2c_readMagXYZAndTrigger()
+//------------------------------------------
+int i2c_readMagXYZAndTrigger(pList *p)
+{
+    return i2c_readMagXYZAndTriggerAt(p, (uint8_t)p->magAddr, p->XYZ);
+}
 
-    p->XYZ[0] = x;
-    p->XYZ[1] = y;
-    p->XYZ[2] = z;
+//------------------------------------------
+// readMagPOLL()
+// Synchronous trigger -> DRDY -> read.  The sampling loop uses the
+// sequencer in acquire.c instead, which overlaps other bus work with
+// the conversion.
+//------------------------------------------
+int i2c_readMagPOLL(pList *p)
+{
+    int rv = 0;
 
-    bytes_read = XYZ_BUFLEN;
-    return bytes_read;
+    // 1) Trigger a single XYZ measurement by writing to POLL register
+    if ((rv = i2c_triggerMagPOLL(p)) < 0)
+    {
+        return rv;
+    }
+    // 2) Wait for DRDY in STATUS register with a timeout
+    if ((rv = i2c_waitMagDRDY(p)) < 0)
+    {
+        return rv;
+    }
+    // 3) Read and assemble the XYZ counts
+    return i2c_readMagXYZ(p);
 }
 
 
@@ -131,6 +254,11 @@ int i2c_open(pList *p)
     if(!stat(p->portpath, &sb))
     {
         int rv = i2c_pololu_connect(p->adapter, p->portpath);
+        if(rv == 0)
+        {
+            // A stop request abandons a read the adapter is slow to answer.
+            i2c_pololu_set_cancel_fd(p->adapter, halt_fd());
+        }
         return rv;
     }
     else
@@ -298,14 +426,28 @@ int i2c_initMagSensor(pList *p)
 {
     int rv = 0;
     int command = PMMODE_ALL;
-    // Setup the Mag sensor register initial state here.
-    if(p->samplingMode == POLL)                                         // (p->samplingMode == POLL [default])
+    uint8_t off = 0;
+    // A CMM run a previous process left going would keep converting
+    // under the POLL requests, so stop it on every sensor first.
+    for(int i = 0; i < p->numMags; i++)
     {
-        rv = i2c_pololu_write_to(p->adapter, p->magAddr, RM3100_MAG_POLL, (uint8_t *) &command, 1);       //(XYZ_BUFLEN + 1)
+        rv = i2c_pololu_write_to(p->adapter, p->magAddrs[i], RM3100I2C_CMM, &off, 1);
         if(rv < 0)
         {
             showErrorMsg(rv);
         }
+    }
+    // Setup the Mag sensor register initial state here.
+    if(p->samplingMode == POLL)                                         // (p->samplingMode == POLL [default])
+    {
+        for(int i = 0; i < p->numMags; i++)
+        {
+            rv = i2c_pololu_write_to(p->adapter, p->magAddrs[i], RM3100_MAG_POLL, (uint8_t *) &command, 1);       //(XYZ_BUFLEN + 1)
+            if(rv < 0)
+            {
+                showErrorMsg(rv);
+            }
+        }
         return true;
     }
     return FALSE;
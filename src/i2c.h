@@ -26,6 +26,14 @@ int i2c_initMagSensor(pList *p);
 int  i2c_readRemoteTemp(pList *p);
 //int  readMagCMM(volatile pList *p);
 int  i2c_readMagPOLL(pList *p);
+int  i2c_triggerMagPOLL(pList *p);
+int  i2c_triggerMagPOLLEach(pList *p, const uint8_t *addrs, int count, int *errors);
+int  i2c_waitMagDRDY(pList *p);
+int  i2c_readMagDRDYAt(pList *p, uint8_t addr);
+int  i2c_readMagXYZ(pList *p);
+int  i2c_readMagXYZAt(pList *p, uint8_t addr, int32_t *xyz);
+int  i2c_readMagXYZAndTrigger(pList *p);
+int  i2c_readMagXYZAndTriggerAt(pList *p, uint8_t addr, int32_t *xyz);
 
 int i2c_write_mag(pList *p,     uint8_t reg, uint8_t value);
 uint8_t i2c_read_mag(pList *p,  uint8_t reg);
@@ -0,0 +1,407 @@
+//=========================================================================
+// iaga.c
+//
+// IAGA-2002 day files for 1-second and 1-minute products.
+//
+// A product whose file sink has format = "iaga2002" writes one file per
+// UTC day, named as INTERMAGNET names them (bou20261018vmin.min), into
+// its file directory.  The header comes from [node_information] and
+// [node_location].  Every interval of the day gets a line, stamped with
+// the start of the interval: when a record arrives after a gap, the
+// intervals it skipped are written first with 99999.00 in every
+// column, and a day file is completed the same way when the next day's
+// first record arrives.  After a restart the file of the day is
+// appended to, from the interval after its last line; a partial line
+// left by a crash is cut off first, and a file whose last line is not
+// one of ours is not touched.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <linux/limits.h>
+#include <time.h>
+#include <unistd.h>
+#include "main.h"
+#include "iaga.h"
+#include "timeutil.h"
+
+#define IAGA_DAY_NS         (86400LL * NSEC_PER_SEC)
+#define IAGA_FILL_BLOCK     64          // missing lines per write
+#define IAGA_REFUSED        INT64_MAX   // iagaNextNs: the day's file is not ours to append to
+
+//---------------------------------------------------------------
+// iaga_floor(int64_t t, int64_t unit)
+//---------------------------------------------------------------
+static int64_t iaga_floor(int64_t t, int64_t unit)
+{
+    int64_t q = t / unit;
+    return (t % unit < 0) ? q - 1 : q;
+}
+
+//---------------------------------------------------------------
+// iaga_check(const pList *p, outputProduct *op, int64_t sampleNs)
+//
+// 0 if op can write IAGA-2002 files: a period of 1 or 60 seconds.
+// Warns about a missing station code, which the files can do without.
+// sampleNs is the acquisition period, for the headers.
+//---------------------------------------------------------------
+int iaga_check(const pList *p, outputProduct *op, int64_t sampleNs)
+{
+    if(op->periodNs != NSEC_PER_SEC && op->periodNs != 60 * NSEC_PER_SEC)
+    {
+        fprintf(OUTPUT_ERROR, "Product '%s': IAGA-2002 files need period = 1 or 60\n", op->name);
+        return -1;
+    }
+    if(!p->station_code || !*p->station_code)
+    {
+        fprintf(OUTPUT_ERROR, "Product '%s': no [node_information].station_code, IAGA-2002 files use XXX\n", op->name);
+    }
+    op->iagaSampleNs = sampleNs;
+    return 0;
+}
+
+//---------------------------------------------------------------
+// iaga_line(char *buf, int64_t tNs, const double *xyz)
+//
+// The data line for the interval starting at tNs, with F computed from
+// xyz, or all 99999.00 if xyz is NULL.  buf takes IAGA_LINE_LEN + 1
+// bytes; returns IAGA_LINE_LEN.
+//---------------------------------------------------------------
+size_t iaga_line(char *buf, int64_t tNs, const double *xyz)
+{
+    time_t    sec = (time_t)iaga_floor(tNs, NSEC_PER_SEC);
+    int       ms  = (int)((tNs - (int64_t)sec * NSEC_PER_SEC) / 1000000);
+    double    v[4] = { IAGA_MISSING, IAGA_MISSING, IAGA_MISSING, IAGA_MISSING };
+    struct tm tm;
+    char      line[1400];
+
+    if(xyz)
+    {
+        v[0] = xyz[0];
+        v[1] = xyz[1];
+        v[2] = xyz[2];
+        v[3] = sqrt(xyz[0] * xyz[0] + xyz[1] * xyz[1] + xyz[2] * xyz[2]);
+        for(int k = 0; k < 4; k++)
+        {
+            // Anything that would not fit its 10 columns is not data.
+            if(!isfinite(v[k]) || fabs(v[k]) >= 1e7)
+            {
+                v[k] = IAGA_MISSING;
+            }
+        }
+    }
+    gmtime_r(&sec, &tm);
+    // Sized for any double so the compiler can see nothing is cut; the
+    // clamp above keeps the line at IAGA_LINE_LEN.
+    snprintf(line, sizeof line, "%04d-%02d-%02d %02d:%02d:%02d.%03d %03d   %10.2f%10.2f%10.2f%10.2f\n",
+             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, ms,
+             tm.tm_yday + 1, v[0], v[1], v[2], v[3]);
+    memcpy(buf, line, IAGA_LINE_LEN + 1);
+    return IAGA_LINE_LEN;
+}
+
+//---------------------------------------------------------------
+// iaga_field(FILE *fp, const char *label, const char *value)
+// One header line: label and value in their columns, then '|'.
+//---------------------------------------------------------------
+static void iaga_field(FILE *fp, const char *label, const char *value)
+{
+    fprintf(fp, " %-23.23s%-45.45s|\n", label, value);
+}
+
+//---------------------------------------------------------------
+// iaga_comment(FILE *fp, const char *text)
+// A header comment line, "# text" across both columns.
+//---------------------------------------------------------------
+static void iaga_comment(FILE *fp, const char *text)
+{
+    fprintf(fp, " # %-66.66s|\n", text);
+}
+
+//---------------------------------------------------------------
+// iaga_header(FILE *fp, pList *p, const outputProduct *op,
+//             const char *code)
+//---------------------------------------------------------------
+static void iaga_header(FILE *fp, pList *p, const outputProduct *op, const char *code)
+{
+    static const char comp[] = "XYZF";
+    char   v[64];
+    char   cols[4][8];
+    int    minute = (op->periodNs == 60 * NSEC_PER_SEC);
+    double lon    = p->longitude ? atof(p->longitude) : 0.0;
+
+    iaga_field(fp, "Format", "IAGA-2002");
+    iaga_field(fp, "Source of Data", p->maintainer ? p->maintainer : "");
+    iaga_field(fp, "Station Name", (p->station_name && *p->station_name) ? p->station_name : code);
+    iaga_field(fp, "IAGA Code", code);
+    snprintf(v, sizeof v, "%.3f", p->latitude ? atof(p->latitude) : 0.0);
+    iaga_field(fp, "Geodetic Latitude", v);
+    snprintf(v, sizeof v, "%.3f", (lon < 0.0) ? lon + 360.0 : lon);       // degrees east, 0-360
+    iaga_field(fp, "Geodetic Longitude", v);
+    snprintf(v, sizeof v, "%.0f", p->elevation ? atof(p->elevation) : 0.0);
+    iaga_field(fp, "Elevation", v);
+    iaga_field(fp, "Reported", "XYZF");
+    iaga_field(fp, "Sensor Orientation", "XYZ");
+    snprintf(v, sizeof v, "%g second", (double)op->iagaSampleNs / 1e9);
+    iaga_field(fp, "Digital Sampling", v);
+    if(op->reduce == PRODUCT_AVERAGE)
+    {
+        iaga_field(fp, "Data Interval Type", minute ? "Average 1-Minute (00:00-01:00)" : "Average 1-Second");
+    }
+    else
+    {
+        iaga_field(fp, "Data Interval Type", minute ? "1-minute spot" : "1-second spot");
+    }
+    iaga_field(fp, "Data Type", "variation");
+    snprintf(v, sizeof v, "mag-usb %s, PNI RM3100 magnetometer.", p->Version ? p->Version : "");
+    iaga_comment(fp, v);
+    iaga_comment(fp, "F computed from X, Y and Z.");
+    iaga_comment(fp, "99999.00: no data for the interval.");
+    for(int k = 0; k < 4; k++)
+    {
+        snprintf(cols[k], sizeof cols[k], "%s%c", code, comp[k]);
+    }
+    fprintf(fp, "DATE       TIME         DOY     %-10s%-10s%-10s%-7s|\n", cols[0], cols[1], cols[2], cols[3]);
+}
+
+//---------------------------------------------------------------
+// iaga_tail(FILE *fp, int64_t day, int64_t periodNs, int64_t *tNs)
+//
+// Where a file of ours for day left off.  A partial last line, as a
+// crash mid-write leaves, is cut off first.  Returns 1 with the time of
+// the last data line in *tNs, 0 if the file holds no data lines yet
+// (nothing, or the header alone, cut back to nothing if incomplete),
+// or -1 if its last line is neither:
+// not a file this writer can append to.
+//---------------------------------------------------------------
+static int iaga_tail(FILE *fp, int64_t day, int64_t periodNs, int64_t *tNs)
+{
+    char      buf[4 * IAGA_LINE_LEN];
+    long      size, start;
+    size_t    n;
+    char     *end, *line;
+    struct tm tm;
+    int       ms, len;
+
+    if(fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0)
+    {
+        return -1;
+    }
+    start = (size > (long)sizeof buf) ? size - (long)sizeof buf : 0;
+    if(fseek(fp, start, SEEK_SET) != 0 || (n = fread(buf, 1, (size_t)(size - start), fp)) != (size_t)(size - start))
+    {
+        return -1;
+    }
+
+    // Cut back to the end of the last complete line.
+    end = memrchr(buf, '\n', n);
+    if(!end && start > 0)
+    {
+        return -1;
+    }
+    long keep = end ? start + (long)(end - buf) + 1 : 0;
+    if(keep < size && (fflush(fp) != 0 || ftruncate(fileno(fp), keep) != 0))
+    {
+        return -1;
+    }
+    if(!end)
+    {
+        return 0;                   // a header cut short: nothing kept
+    }
+
+    line = memrchr(buf, '\n', (size_t)(end - buf));
+    if(!line && start > 0)
+    {
+        return -1;
+    }
+    line = line ? line + 1 : buf;
+    len  = (int)(end - line) + 1;
+    if(strncmp(line, "DATE ", 5) == 0)
+    {
+        return 0;
+    }
+    if(len > 2 && end[-1] == '|')
+    {
+        // A header line but not the last one: the header was cut
+        // short, and is written again from scratch.
+        return (fflush(fp) == 0 && ftruncate(fileno(fp), 0) == 0) ? 0 : -1;
+    }
+
+    memset(&tm, 0, sizeof tm);
+    if(len != IAGA_LINE_LEN || sscanf(line, "%4d-%2d-%2d %2d:%2d:%2d.%3d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                                      &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &ms) != 7)
+    {
+        return -1;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon  -= 1;
+    *tNs = (int64_t)timegm(&tm) * NSEC_PER_SEC + (int64_t)ms * 1000000;
+    if(iaga_floor(*tNs, IAGA_DAY_NS) != day || *tNs % periodNs != 0)
+    {
+        return -1;
+    }
+    return 1;
+}
+
+//---------------------------------------------------------------
+// iaga_open(pList *p, outputProduct *op, int64_t day)
+//
+// Opens, or creates with its header, the file for UTC day number day.
+// Returns 0, or -1 with op->fp NULL.  A file that cannot be resumed is
+// left alone and the day is not written, with one error.
+//---------------------------------------------------------------
+static int iaga_open(pList *p, outputProduct *op, int64_t day)
+{
+    char   path[PATH_MAX];    char   code[4] = "XXX";
+    char   lower[4];
+    int    minute = (op->periodNs == 60 * NSEC_PER_SEC);
+    time_t t = (time_t)(day * 86400);
+    struct tm tm;
+    const char *dir = (op->filePath && *op->filePath) ? op->filePath
+                    : (p->log_output_path && *p->log_output_path) ? p->log_output_path : ".";
+
+    if(p->station_code && *p->station_code)
+    {
+        snprintf(code, sizeof code, "%s", p->station_code);
+    }
+    for(int k = 0; k < 4; k++)
+    {
+        code[k]  = (char)toupper((unsigned char)code[k]);
+        lower[k] = (char)tolower((unsigned char)code[k]);
+    }
+    if(p->create_log_path_if_empty && mkdir(dir, 0755) < 0 && errno != EEXIST)
+    {
+        fprintf(OUTPUT_ERROR, "Unable to create %s: %s\n", dir, strerror(errno));
+    }
+    gmtime_r(&t, &tm);
+    snprintf(path, sizeof path, "%s/%s%04d%02d%02dv%s.%s", dir, lower, tm.tm_year + 1900, tm.tm_mon + 1,
+             tm.tm_mday, minute ? "min" : "sec", minute ? "min" : "sec");
+
+    op->fp = fopen(path, "a+");
+    if(!op->fp)
+    {
+        fprintf(OUTPUT_ERROR, "Product '%s': unable to open %s: %s\n", op->name, path, strerror(errno));
+        return -1;
+    }
+    op->iagaDay    = day;
+    op->iagaNextNs = day * IAGA_DAY_NS;
+
+    int64_t last;
+    int     rc = iaga_tail(op->fp, day, op->periodNs, &last);
+    if(rc < 0)
+    {
+        fprintf(OUTPUT_ERROR, "Product '%s': %s does not end in a line this writer can follow, not appending to it\n",
+                op->name, path);
+        fclose(op->fp);
+        op->fp = NULL;
+        op->iagaNextNs = IAGA_REFUSED;
+        return -1;
+    }
+    fseek(op->fp, 0, SEEK_END);                 // from reading back to writing
+    if(rc > 0)
+    {
+        op->iagaNextNs = last + op->periodNs;
+    }
+    else if(ftell(op->fp) == 0)
+    {
+        iaga_header(op->fp, p, op, code);
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// iaga_fill(outputProduct *op, int64_t untilNs)
+//
+// 99999.00 lines for the intervals from iagaNextNs up to untilNs, all
+// in iagaDay.  Up to a whole day of them can be due when a file is
+// started or resumed, on the output thread, so only the first is
+// formatted; the rest are copies with the time of day rewritten, and
+// go out a block at a time.
+//---------------------------------------------------------------
+static int iaga_fill(outputProduct *op, int64_t untilNs)
+{
+    char    block[IAGA_FILL_BLOCK * IAGA_LINE_LEN];
+    char    line[IAGA_LINE_LEN + 1];
+    size_t  n = 0;
+    int64_t dayNs = op->iagaDay * IAGA_DAY_NS;
+
+    if(op->iagaNextNs >= untilNs)
+    {
+        return 0;
+    }
+    iaga_line(line, op->iagaNextNs, NULL);
+    for(; op->iagaNextNs < untilNs; op->iagaNextNs += op->periodNs)
+    {
+        int sod = (int)((op->iagaNextNs - dayNs) / NSEC_PER_SEC);
+        char *l = block + n * IAGA_LINE_LEN;
+
+        memcpy(l, line, IAGA_LINE_LEN);
+        l[11] = (char)('0' + sod / 36000);
+        l[12] = (char)('0' + sod / 3600 % 10);
+        l[14] = (char)('0' + sod / 600 % 6);
+        l[15] = (char)('0' + sod / 60 % 10);
+        l[17] = (char)('0' + sod / 10 % 6);
+        l[18] = (char)('0' + sod % 10);
+        if(++n == IAGA_FILL_BLOCK)
+        {
+            if(fwrite(block, IAGA_LINE_LEN, n, op->fp) != n)
+            {
+                return -1;
+            }
+            n = 0;
+        }
+    }
+    return (n == 0 || fwrite(block, IAGA_LINE_LEN, n, op->fp) == n) ? 0 : -1;
+}
+
+//---------------------------------------------------------------
+// iaga_write(pList *p, outputProduct *op, const magRecord *r)
+//
+// The line for r's interval, with any gap before it, in the file of
+// its day.  Returns 0, or -1 if it was not written: a write error, or
+// an interval at or before the last one written, as after the host
+// clock stepped back.
+//---------------------------------------------------------------
+int iaga_write(pList *p, outputProduct *op, const magRecord *r)
+{
+    char    line[IAGA_LINE_LEN + 1];
+    int64_t t   = iaga_floor(r->tNs, op->periodNs) * op->periodNs;
+    int64_t day = iaga_floor(t, IAGA_DAY_NS);
+
+    if(op->fp && day != op->iagaDay)
+    {
+        if(day > op->iagaDay)
+        {
+            iaga_fill(op, (op->iagaDay + 1) * IAGA_DAY_NS);
+        }
+        fclose(op->fp);
+        op->fp = NULL;
+    }
+    if(!op->fp && op->iagaDay == day && op->iagaNextNs == IAGA_REFUSED)
+    {
+        return -1;
+    }
+    if(!op->fp && iaga_open(p, op, day) != 0)
+    {
+        return -1;
+    }
+    if(t < op->iagaNextNs)
+    {
+        return -1;
+    }
+    if(iaga_fill(op, t) != 0)
+    {
+        return -1;
+    }
+    iaga_line(line, t, (r->validMask & 1u) ? r->nT[0] : NULL);
+    if(fwrite(line, 1, IAGA_LINE_LEN, op->fp) != IAGA_LINE_LEN)
+    {
+        return -1;
+    }
+    op->iagaNextNs = t + op->periodNs;
+    return 0;
+}
@@ -0,0 +1,26 @@
+//=========================================================================
+// iaga.h
+//
+// IAGA-2002 day files for 1-second and 1-minute products.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_IAGA_H
+#define MAG_USB_IAGA_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "main.h"
+
+#define IAGA_MISSING        99999.00    // no data for the interval
+#define IAGA_LINE_LEN       71          // 70 columns and the newline
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int    iaga_check(const pList *p, outputProduct *op, int64_t sampleNs);
+int    iaga_write(pList *p, outputProduct *op, const magRecord *r);
+size_t iaga_line(char *buf, int64_t tNs, const double *xyz);
+
+#endif // MAG_USB_IAGA_H
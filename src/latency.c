@@ -0,0 +1,218 @@
+//=========================================================================
+// latency.c
+//
+// Fixed log2-bucket and log-linear latency histograms.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <stdio.h>
+#include <math.h>
+#include <inttypes.h>
+#include "latency.h"
+
+//---------------------------------------------------------------
+// lat_reset(latHist *h)
+//---------------------------------------------------------------
+void lat_reset(latHist *h)
+{
+    for(int i = 0; i < LAT_BUCKETS; i++)
+    {
+        atomic_store_explicit(&h->bucket[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->sumNs, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->maxNs, 0, memory_order_relaxed);
+}
+
+//---------------------------------------------------------------
+// lat_record(latHist *h, int64_t ns)
+// Negative latencies (an early wakeup) count as zero.
+//---------------------------------------------------------------
+void lat_record(latHist *h, int64_t ns)
+{
+    int b = 0;
+
+    if(ns < 0)
+    {
+        ns = 0;
+    }
+    for(uint64_t us = (uint64_t)ns / 1000; us > 0 && b < LAT_BUCKETS - 1; us >>= 1)
+    {
+        b++;
+    }
+    atomic_fetch_add_explicit(&h->bucket[b], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sumNs, ns, memory_order_relaxed);
+
+    int64_t max = atomic_load_explicit(&h->maxNs, memory_order_relaxed);
+    while(ns > max && !atomic_compare_exchange_weak_explicit(&h->maxNs, &max, ns,
+                                                             memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+//---------------------------------------------------------------
+// lat_format(latHist *h, char *buf, size_t len)
+//
+// JSON object with the count, mean and maximum in microseconds and
+// the bucket counts up to the last non-empty one.  Returns the length
+// snprintf() would have written.
+//---------------------------------------------------------------
+int lat_format(latHist *h, char *buf, size_t len)
+{
+    uint64_t counts[LAT_BUCKETS];
+    uint64_t n = atomic_load_explicit(&h->count, memory_order_relaxed);
+    int64_t sum = atomic_load_explicit(&h->sumNs, memory_order_relaxed);
+    int last = 0;
+    int used;
+
+    for(int i = 0; i < LAT_BUCKETS; i++)
+    {
+        counts[i] = atomic_load_explicit(&h->bucket[i], memory_order_relaxed);
+        if(counts[i])
+        {
+            last = i;
+        }
+    }
+    used = snprintf(buf, len, "{ \"count\": %" PRIu64 ", \"mean_us\": %.1f, \"max_us\": %.1f, \"log2_us\": [",
+                    n, n ? (double)sum / (double)n / 1000.0 : 0.0,
+                    (double)atomic_load_explicit(&h->maxNs, memory_order_relaxed) / 1000.0);
+    for(int i = 0; i <= last && used >= 0; i++)
+    {
+        used += snprintf(buf + ((size_t)used < len ? (size_t)used : len),
+                         (size_t)used < len ? len - (size_t)used : 0,
+                         "%s%" PRIu64, i ? ", " : "", counts[i]);
+    }
+    if(used >= 0)
+    {
+        used += snprintf(buf + ((size_t)used < len ? (size_t)used : len),
+                         (size_t)used < len ? len - (size_t)used : 0, "] }");
+    }
+    return used;
+}
+
+//---------------------------------------------------------------
+// lat_hdrIndex(uint64_t ns)
+//---------------------------------------------------------------
+static int lat_hdrIndex(uint64_t ns)
+{
+    if(ns < LAT_HDR_SUB)
+    {
+        return (int)ns;
+    }
+    int e = 63 - __builtin_clzll(ns);
+    if(e >= LAT_HDR_MAX_EXP)
+    {
+        return LAT_HDR_BUCKETS - 1;
+    }
+    return (e - LAT_HDR_SUB_BITS + 1) * LAT_HDR_SUB
+           + (int)((ns >> (e - LAT_HDR_SUB_BITS)) & (LAT_HDR_SUB - 1));
+}
+
+//---------------------------------------------------------------
+// lat_hdrHighest(int b)
+// The largest value that lands in bucket b.
+//---------------------------------------------------------------
+static int64_t lat_hdrHighest(int b)
+{
+    if(b < LAT_HDR_SUB)
+    {
+        return b;
+    }
+    int e   = b / LAT_HDR_SUB + LAT_HDR_SUB_BITS - 1;
+    int sub = b % LAT_HDR_SUB;
+    int64_t width = INT64_C(1) << (e - LAT_HDR_SUB_BITS);
+    return (int64_t)(LAT_HDR_SUB + sub) * width + width - 1;
+}
+
+//---------------------------------------------------------------
+// lat_hdrReset(latHdr *h)
+//---------------------------------------------------------------
+void lat_hdrReset(latHdr *h)
+{
+    for(int i = 0; i < LAT_HDR_BUCKETS; i++)
+    {
+        atomic_store_explicit(&h->bucket[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->maxNs, 0, memory_order_relaxed);
+}
+
+//---------------------------------------------------------------
+// lat_hdrRecord(latHdr *h, int64_t ns)
+// Negative latencies count as zero.
+//---------------------------------------------------------------
+void lat_hdrRecord(latHdr *h, int64_t ns)
+{
+    if(ns < 0)
+    {
+        ns = 0;
+    }
+    atomic_fetch_add_explicit(&h->bucket[lat_hdrIndex((uint64_t)ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+
+    int64_t max = atomic_load_explicit(&h->maxNs, memory_order_relaxed);
+    while(ns > max && !atomic_compare_exchange_weak_explicit(&h->maxNs, &max, ns,
+                                                             memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+//---------------------------------------------------------------
+// lat_hdrPercentile(latHdr *h, double q)
+//
+// The value at or below which a fraction q (0..1) of the recorded
+// latencies fall, reported as the top of its bucket but never above
+// the maximum seen.  Returns 0 for an empty histogram.
+//---------------------------------------------------------------
+int64_t lat_hdrPercentile(latHdr *h, double q)
+{
+    uint64_t counts[LAT_HDR_BUCKETS];
+    uint64_t n = 0, seen = 0;
+    int64_t  max = atomic_load_explicit(&h->maxNs, memory_order_relaxed);
+
+    // The buckets are summed rather than taken from h->count, so a
+    // record landing during the walk cannot leave the target unreached.
+    for(int i = 0; i < LAT_HDR_BUCKETS; i++)
+    {
+        counts[i] = atomic_load_explicit(&h->bucket[i], memory_order_relaxed);
+        n += counts[i];
+    }
+    if(n == 0)
+    {
+        return 0;
+    }
+    uint64_t target = (uint64_t)ceil(q * (double)n);
+    if(target < 1)
+    {
+        target = 1;
+    }
+    for(int i = 0; i < LAT_HDR_BUCKETS - 1; i++)
+    {
+        seen += counts[i];
+        if(seen >= target)
+        {
+            int64_t v = lat_hdrHighest(i);
+            return (v < max) ? v : max;
+        }
+    }
+    return max;
+}
+
+//---------------------------------------------------------------
+// lat_hdrFormat(latHdr *h, char *buf, size_t len)
+//
+// JSON object with the count and the p50, p99, p99.9 and maximum in
+// microseconds.  Returns the length snprintf() would have written.
+//---------------------------------------------------------------
+int lat_hdrFormat(latHdr *h, char *buf, size_t len)
+{
+    return snprintf(buf, len,
+                    "{ \"count\": %" PRIu64 ", \"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, \"max_us\": %.1f }",
+                    (uint64_t)atomic_load_explicit(&h->count, memory_order_relaxed),
+                    (double)lat_hdrPercentile(h, 0.50) / 1000.0,
+                    (double)lat_hdrPercentile(h, 0.99) / 1000.0,
+                    (double)lat_hdrPercentile(h, 0.999) / 1000.0,
+                    (double)atomic_load_explicit(&h->maxNs, memory_order_relaxed) / 1000.0);
+}
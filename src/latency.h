@@ -0,0 +1,62 @@
+//=========================================================================
+// latency.h
+//
+// Fixed log2-bucket latency histograms, and log-linear ones for
+// percentiles.
+//
+// latHist: bucket 0 counts latencies under 1 us, bucket k those in
+// [2^(k-1), 2^k) us, and the last bucket everything longer.
+//
+// latHdr: HDR-style, in ns.  Values under 16 ns have a bucket each;
+// above that every power of two is split into 16 linear sub-buckets,
+// so a percentile read back is within 1/16 (6.25 %) of the true value
+// from 16 ns up to about 68 s, and the last bucket takes the rest.
+//
+// Recording into either is a handful of relaxed atomic operations, so
+// one thread can record while another reports.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_LATENCY_H
+#define MAG_USB_LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define LAT_BUCKETS     22              // up to ~1 s, then overflow
+
+typedef struct
+{
+    _Atomic uint64_t bucket[LAT_BUCKETS];
+    _Atomic uint64_t count;
+    _Atomic int64_t  sumNs;
+    _Atomic int64_t  maxNs;
+} latHist;
+
+#define LAT_HDR_SUB_BITS    4
+#define LAT_HDR_SUB         (1 << LAT_HDR_SUB_BITS)
+#define LAT_HDR_MAX_EXP     36          // 2^36 ns, ~68.7 s
+#define LAT_HDR_BUCKETS     ((LAT_HDR_MAX_EXP - LAT_HDR_SUB_BITS + 1) * LAT_HDR_SUB + 1)
+
+typedef struct
+{
+    _Atomic uint64_t bucket[LAT_HDR_BUCKETS];
+    _Atomic uint64_t count;
+    _Atomic int64_t  maxNs;
+} latHdr;
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+void lat_reset(latHist *h);
+void lat_record(latHist *h, int64_t ns);
+int  lat_format(latHist *h, char *buf, size_t len);
+
+void    lat_hdrReset(latHdr *h);
+void    lat_hdrRecord(latHdr *h, int64_t ns);
+int64_t lat_hdrPercentile(latHdr *h, double q);
+int     lat_hdrFormat(latHdr *h, char *buf, size_t len);
+
+#endif // MAG_USB_LATENCY_H
@@ -7,10 +7,13 @@
 // Date:        December 18, 2023
 // License:     GPL 3.0
 //=========================================================================
+#include <ctype.h>
+#include <math.h>
 #include "main.h"
 #include "magdata.h"
 #include "i2c.h"
 #include "rm3100.h"
+#include "timeutil.h"
 
 //------------------------------------------
 // Static variables
@@ -19,33 +22,21 @@ extern char *Version;
 
 //------------------------------------------
 // setMagSampleRate()
+//   Picks the TMRC setting for a CMM rate in Hz.  TMRC 0x92 is ~600 Hz
+//   and each step up halves it, down to 0x9F at ~0.075 Hz; the slowest
+//   setting that still reaches the requested rate wins.  Returns the
+//   rate actually selected (0 below 1 Hz).
 //------------------------------------------
 unsigned short setMagSampleRate(pList *p, unsigned short sample_rate)
 {
-    size_t i;
-    const unsigned short int supported_rates[][2] = 
-    {
-        /* [Hz], register value */
-        {   2,  0x0A},   // up to 2Hz
-        {   4,  0x09},   // up to 4Hz
-        {   8,  0x08},   // up to 8Hz
-        {  16,  0x07},   // up to 16Hz
-        {  31,  0x06},   // up to 31Hz
-        {  62,  0x05},   // up to 62Hz
-        { 125,  0x04},   // up to 125Hz
-        { 220,  0x03}    // up to 250Hz
-    };
-    const size_t count = sizeof(supported_rates) / sizeof(supported_rates[0]);
-    for(i = 0; i + 1 < count; i++)
+    int tmrc = TMRC_VAL_600;
+
+    while(tmrc < TMRC_VAL_0p07 && (600 >> (tmrc + 1 - TMRC_VAL_600)) >= sample_rate)
     {
-        if(sample_rate <= supported_rates[i][0])
-        {
-            break;
-        }
+        tmrc++;
     }
-    if (i >= count) { i = count - 1; }
-    p->CMMSampleRate = supported_rates[i][0];
-    // i2c_write(p->pi, RM3100I2C_TMRC, p->CMMSampleRate);
+    p->TMRCRate      = tmrc;
+    p->CMMSampleRate = 600 >> (tmrc - TMRC_VAL_600);
     return p->CMMSampleRate;
 }
 
@@ -58,6 +49,60 @@ unsigned short getMagSampleRate(pList *p)
     return p->CMMSampleRate;
 }
 
+//------------------------------------------
+// getTMRCPeriodNs()
+//   The CMM interval the TMRC register asks for.
+//------------------------------------------
+int64_t getTMRCPeriodNs(pList *p)
+{
+    int tmrc = p->TMRCRate;
+    if(tmrc < TMRC_VAL_600 || tmrc > TMRC_VAL_0p07)
+    {
+        tmrc = TMRC_VAL_37;
+    }
+    return (NSEC_PER_SEC / 600) << (tmrc - TMRC_VAL_600);
+}
+
+//------------------------------------------
+// getCMMPeriodNs()
+//   Time between CMM results: the TMRC interval, or the conversion
+//   time if the cycle counts are too high for TMRC to be met.
+//------------------------------------------
+int64_t getCMMPeriodNs(pList *p)
+{
+    int64_t period = getTMRCPeriodNs(p);
+    int64_t conv   = getMagConversionUs(p) * NSEC_PER_USEC;
+    return (conv > period) ? conv : period;
+}
+
+//------------------------------------------
+// setOutputPeriodNs()
+//   The POLL tick period.  Returns -1, leaving it unchanged, outside
+//   OUTPUT_PERIOD_MIN_NS..OUTPUT_PERIOD_MAX_NS.
+//------------------------------------------
+int setOutputPeriodNs(pList *p, int64_t period)
+{
+    if(period < OUTPUT_PERIOD_MIN_NS || period > OUTPUT_PERIOD_MAX_NS)
+    {
+        return -1;
+    }
+    p->pollPeriodNs = period;
+    return 0;
+}
+
+//------------------------------------------
+// setOutputRate()
+//   The POLL tick rate in Hz, as the nearest whole-ns period.
+//------------------------------------------
+int setOutputRate(pList *p, double hz)
+{
+    if(!(hz > 0.0) || 1e9 / hz > (double)OUTPUT_PERIOD_MAX_NS)
+    {
+        return -1;
+    }
+    return setOutputPeriodNs(p, llround(1e9 / hz));
+}
+
 //---------------------------------------------------------------
 // void termGPIO(volatile pList p)
 //---------------------------------------------------------------
@@ -108,7 +153,14 @@ int setNOSReg(pList *p)
 {
     int rv = 0;
     uint8_t val = (uint8_t)p->NOSRegValue;
-    rv = i2c_pololu_write_to(p->adapter, (uint8_t)p->magAddr, RM3100I2C_NOS, &val, 1);
+    for(int i = 0; i < p->numMags; i++)
+    {
+        int r = i2c_pololu_write_to(p->adapter, (uint8_t)p->magAddrs[i], RM3100I2C_NOS, &val, 1);
+        if(i == 0 || r < 1)
+        {
+            rv = r;
+        }
+    }
 #if __DEBUG
     if (rv < 1) {
         fprintf(OUTPUT_ERROR, "    [Child]: Error setting NOS register: %s\n", i2c_pololu_error_string(rv));
@@ -132,17 +184,49 @@ int runBIST(pList *p)
 
 //------------------------------------------
 // startCMM()
-// Starts Continuous Measurement Mode
+// Starts Continuous Measurement Mode on every sensor at the TMRC
+// rate in p->TMRCRate.  Returns the number of sensors started.
 //------------------------------------------
 int startCMM(pList *p)
 {
-    (void)p;
-    int rv = 0;
-//    short cmmMode = (CMMMODE_ALL);   // 71 d
-//    rv = i2c_write(p->pi, RM3100I2C_CMM, cmmMode);
+    uint8_t addrs[MAX_MAGS];
+    int     errors[MAX_MAGS];
+    uint8_t tmrc = (uint8_t)p->TMRCRate;
+    uint8_t cmm  = CMMMODE_ALL;
+
+    for(int i = 0; i < p->numMags; i++)
+    {
+        addrs[i] = (uint8_t)p->magAddrs[i];
+    }
+    i2c_pololu_write_each(p->adapter, addrs, p->numMags, RM3100I2C_TMRC, &tmrc, 1, errors);
+    int rv = i2c_pololu_write_each(p->adapter, addrs, p->numMags, RM3100I2C_CMM, &cmm, 1, errors);
+    for(int i = 0; i < p->numMags; i++)
+    {
+        if(errors[i])
+        {
+            fprintf(OUTPUT_ERROR, "Unable to start CMM at 0x%02X: %s\n",
+                    (unsigned)addrs[i], i2c_pololu_error_string(errors[i]));
+        }
+    }
     return rv;
 }
 
+//------------------------------------------
+// stopCMM()
+//------------------------------------------
+int stopCMM(pList *p)
+{
+    uint8_t addrs[MAX_MAGS];
+    int     errors[MAX_MAGS];
+    uint8_t off = 0;
+
+    for(int i = 0; i < p->numMags; i++)
+    {
+        addrs[i] = (uint8_t)p->magAddrs[i];
+    }
+    return i2c_pololu_write_each(p->adapter, addrs, p->numMags, RM3100I2C_CMM, &off, 1, errors);
+}
+
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // Dave,
 //
@@ -168,37 +252,101 @@ unsigned short getCCGainEquiv(unsigned short CCVal)
     return gain;
 }
 
+//------------------------------------------
+// getMagConversionUs()
+//   Approximate time for one POLL conversion of all three axes.
+//   Fitted to the single-axis maximum data rates in the RM3100 user
+//   manual (CC 50: ~1600 Hz, CC 100: ~850 Hz, CC 200: ~440 Hz), i.e.
+//   roughly 11 us per cycle count plus ~70 us fixed overhead per axis.
+//------------------------------------------
+long getMagConversionUs(pList *p)
+{
+    return (11L * p->cc_x + 70L) + (11L * p->cc_y + 70L) + (11L * p->cc_z + 70L);
+}
+
+//------------------------------------------
+// setMagAddresses()
+//   Parses a list of RM3100 addresses: "0x20,0x21", "0x20 0x22" or a
+//   TOML array "[0x20, 0x21]".  The first entry becomes the primary
+//   sensor, the one the x/y/z output fields report.  Returns the
+//   number of sensors, or -1 on a malformed, duplicate or over-long
+//   list, in which case p is left unchanged.
+//------------------------------------------
+int setMagAddresses(pList *p, const char *list)
+{
+    int addrs[MAX_MAGS];
+    int n = 0;
+    const char *s = list;
+
+    while(*s)
+    {
+        if(*s == ',' || *s == '[' || *s == ']' || isspace((unsigned char)*s))
+        {
+            s++;
+            continue;
+        }
+        char *end;
+        long v = strtol(s, &end, 0);
+        if(end == s || v < 0x08 || v > 0x77 || n == MAX_MAGS)
+        {
+            return -1;
+        }
+        for(int j = 0; j < n; j++)
+        {
+            if(addrs[j] == (int)v)
+            {
+                return -1;
+            }
+        }
+        addrs[n++] = (int)v;
+        s = end;
+    }
+    if(n == 0)
+    {
+        return -1;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        p->magAddrs[i] = addrs[i];
+    }
+    p->numMags = n;
+    p->magAddr = addrs[0];
+    return n;
+}
+
 //------------------------------------------
 // setCycleCountRegs()
 //------------------------------------------
 void setCycleCountRegs(pList *p)
 {
-    uint8_t data[2];
+    uint8_t data[6];
     int rv;
 
+    // CCX, CCY and CCZ are consecutive 16-bit registers, so one write
+    // covers all three.  Every sensor of a gradiometer gets the same
+    // settings so their counts share one gain.
     data[0] = (uint8_t)(p->cc_x >> 8);
     data[1] = (uint8_t)(p->cc_x & 0xff);
-    rv = i2c_pololu_write_to(p->adapter, (uint8_t)p->magAddr, RM3100I2C_CCX_1, data, 2);
-    if (rv < 2) fprintf(OUTPUT_ERROR, "Error writing CCX: %s\n", i2c_pololu_error_string(rv));
-    p->x_gain = getCCGainEquiv(p->cc_x);
+    data[2] = (uint8_t)(p->cc_y >> 8);
+    data[3] = (uint8_t)(p->cc_y & 0xff);
+    data[4] = (uint8_t)(p->cc_z >> 8);
+    data[5] = (uint8_t)(p->cc_z & 0xff);
+    uint8_t nos = (uint8_t)p->NOSRegValue;
 
-    data[0] = (uint8_t)(p->cc_y >> 8);
-    data[1] = (uint8_t)(p->cc_y & 0xff);
-    rv = i2c_pololu_write_to(p->adapter, (uint8_t)p->magAddr, RM3100I2C_CCY_1, data, 2);
-    if (rv < 2) fprintf(OUTPUT_ERROR, "Error writing CCY: %s\n", i2c_pololu_error_string(rv));
-    p->y_gain = getCCGainEquiv(p->cc_y);
+    for(int i = 0; i < p->numMags; i++)
+    {
+        uint8_t addr = (uint8_t)p->magAddrs[i];
+        rv = i2c_pololu_write_to(p->adapter, addr, RM3100I2C_CCX_1, data, 6);
+        if (rv < 6) fprintf(OUTPUT_ERROR, "Error writing CC registers at 0x%02X: %s\n", addr, i2c_pololu_error_string(rv));
 
-    data[0] = (uint8_t)(p->cc_z >> 8);
-    data[1] = (uint8_t)(p->cc_z & 0xff);
-    rv = i2c_pololu_write_to(p->adapter, (uint8_t)p->magAddr, RM3100I2C_CCZ_1, data, 2);
-    if (rv < 2) fprintf(OUTPUT_ERROR, "Error writing CCZ: %s\n", i2c_pololu_error_string(rv));
+        // Write NOSRegValue to register 0A
+        rv = i2c_pololu_write_to(p->adapter, addr, RM3100I2C_NOS, &nos, 1);
+        if (rv < 1) fprintf(OUTPUT_ERROR, "Error writing NOS at 0x%02X: %s\n", addr, i2c_pololu_error_string(rv));
+    }
+    p->x_gain = getCCGainEquiv(p->cc_x);
+    p->y_gain = getCCGainEquiv(p->cc_y);
     p->z_gain = getCCGainEquiv(p->cc_z);
 
-    // Write NOSRegValue to register 0A
-    uint8_t nos = (uint8_t)p->NOSRegValue;
-    rv = i2c_pololu_write_to(p->adapter, (uint8_t)p->magAddr, RM3100I2C_NOS, &nos, 1);
-    if (rv < 1) fprintf(OUTPUT_ERROR, "Error writing NOS: %s\n", i2c_pololu_error_string(rv));
-
 #if __DEBUG
     fprintf(OUTPUT_PRINT, "\nIn setCycleCountRegs():: Setting NOS register to value: %02X\n", p->NOSRegValue);
     fprintf(OUTPUT_PRINT, "CycleCounts  - X: %u, Y: %u, Z: %u.\n", p->cc_x, p->cc_y, p->cc_z);
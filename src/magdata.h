@@ -10,6 +10,11 @@
 #ifndef MAGDATA_H
 #define MAGDATA_H
 
+#include <stdint.h>
+
+#define OUTPUT_PERIOD_MIN_NS    1000000LL               // 1 kHz
+#define OUTPUT_PERIOD_MAX_NS    3600000000000LL         // one hour
+
 struct tag_pList;
 typedef struct tag_pList pList;
 
@@ -26,10 +31,17 @@ void readCycleCountRegs(pList *p);
 int  setNOSReg(pList *p);
 void termGPIO(pList *p);
 int  startCMM(pList *p);
+int  stopCMM(pList *p);
 
 unsigned short setMagSampleRate(pList *p, unsigned short sample_rate);
 unsigned short getMagSampleRate(pList *p);
 unsigned short getCCGainEquiv(unsigned short CCVal);
+long getMagConversionUs(pList *p);
+int64_t getTMRCPeriodNs(pList *p);
+int64_t getCMMPeriodNs(pList *p);
+int  setOutputPeriodNs(pList *p, int64_t period);
+int  setOutputRate(pList *p, double hz);
+int  setMagAddresses(pList *p, const char *list);
 
 void showErrorMsg(int rv);
 
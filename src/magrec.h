@@ -0,0 +1,58 @@
+//=========================================================================
+// magrec.h
+//
+// Binary sample record, as written to a product sink with
+// format = "binary".  This header stands alone so that consumers can
+// include it directly; see docs/Data-Format.md for the field meanings.
+//
+// Records are MAGREC_SIZE bytes, little-endian, and start with a magic
+// and a version.  A reader should check both, and use size to step to
+// the next record: later versions only ever append fields.  On a
+// little-endian host a record can be read straight into magRec.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_MAGREC_H
+#define MAG_USB_MAGREC_H
+
+#include <stdint.h>
+
+#define MAGREC_MAGIC        0x4345524Du // "MREC" as stored
+#define MAGREC_VERSION      1
+#define MAGREC_SIZE         208         // bytes per version 1 record
+#define MAGREC_SENSORS      4           // sensor slots, used or not
+
+// flags
+#define MAGREC_AVERAGED     0x0001u     // a period mean; counts are 0
+#define MAGREC_TEMP_VALID   0x0002u     // rt holds a reading
+#define MAGREC_PPS          0x0004u     // t_ns was disciplined by a PPS edge
+#define MAGREC_GNSS         0x0008u     // t_ns was taken from GNSS time
+#define MAGREC_CLOCK_SYNC   0x0010u     // the host clock was synchronised
+#define MAGREC_CLOCK_STEP   0x0020u     // the host clock stepped since the last record
+
+typedef struct
+{
+    uint32_t magic;                     // MAGREC_MAGIC
+    uint16_t version;                   // MAGREC_VERSION
+    uint16_t size;                      // bytes in this record
+    uint64_t seq;
+    int64_t  t_ns;                      // ns since the Unix epoch, UTC
+    int64_t  t_unc_ns;                  // -1 if unknown
+    uint32_t count;                     // samples in the record
+    uint32_t flags;                     // MAGREC_*
+    uint8_t  num_mags;
+    uint8_t  valid_mask;                // bit i: sensor i was read
+    uint16_t cc[3];                     // cycle counts, x y z
+    uint16_t gain[3];                   // counts per uT, x y z
+    uint16_t reserved;                  // 0
+    double   rt;                        // remote temperature, degrees C; NaN if not valid
+    int32_t  counts[MAGREC_SENSORS][3]; // sensor x y z counts, before orientation
+    double   nT[MAGREC_SENSORS][3];     // x y z in nT, oriented; NaN if not valid
+} magRec;
+
+#ifndef __cplusplus
+_Static_assert(sizeof(magRec) == MAGREC_SIZE, "magRec layout");
+#endif
+
+#endif // MAG_USB_MAGREC_H
@@ -10,6 +10,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <linux/limits.h>
 #include "main.h"
@@ -18,6 +19,22 @@
 #include "cmdmgr.h"
 #include "config.h"
 #include "sensor_tests.h"
+#include "temperature.h"
+#include "acquire.h"
+#include "magdata.h"
+#include "timeutil.h"
+#include "samplering.h"
+#include "products.h"
+#include "trigger.h"
+#include "autorange.h"
+#include "sensorclock.h"
+#include "pps.h"
+#include "gnss.h"
+#include "rt.h"
+#include "ticker.h"
+#include "trace.h"
+#include "halt.h"
+#include "reactor.h"
 #include "i2c-pololu.h"
 #ifdef USE_WEBSOCKET
 #include "ws_bridge.h"
@@ -27,13 +44,19 @@
 #include <signal.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 
 //------------------------------------------
 // Static and Global variables
 //------------------------------------------
 char Version[32];
 int volatile killflag;
-static char outBuf[256];
+static sampleRing sampleQueue;
+#ifdef USE_WEBSOCKET
+static int wsFds[WS_MAX_CONNS + 1];     // WebSocket sockets in the reactor
+static int wsFdCount;
+#endif
 // Default device path matches install/99-PololuI2C.rules, which symlinks
 // any Pololu USB-to-I2C adapter (PID 0x2502 or 0x2503) to /dev/ttyMAG0.
 // Use -O /dev/ttyACMn to override when the udev rule is not installed.
@@ -72,6 +95,9 @@ volatile sig_atomic_t shutdown_requested = 0;   // Signal-safe flag
 pthread_mutex_t data_mutex = PTHREAD_MUTEX_INITIALIZER; // Protect shared data
 int sensor_data = 0;                            // Simulated sensor data
 
+static void drain_samples(pList *p);
+static void run_output(pList *p);
+
 //---------------------------------------------------------------
 //  main()
 //---------------------------------------------------------------
@@ -96,6 +122,7 @@ int main(int argc, char** argv)
 #else
     p->i2cBusNumber         = RASPI_I2C_BUS1;
 #endif
+    halt_init();
 
     //-----------------------------------------
     //  Load configuration from TOML file
@@ -273,27 +300,47 @@ int main(int argc, char** argv)
     //-----------------------------------------
     i2c_initMagSensor(p);
 
+    //-----------------------------------------
+    //  Program the temperature sensor resolution.
+    //-----------------------------------------
+    temp_init(p);
+    acq_init(p);
+
+    //-----------------------------------------
+    //  Queue between the acquisition and output threads.
+    //-----------------------------------------
+    if(ring_init(&sampleQueue) != 0)
+    {
+        fprintf(OUTPUT_ERROR, "Unable to create the sample queue.\n");
+        exit(1);
+    }
+    p->ring = &sampleQueue;
+    products_init(p);
+    trig_init(p);
+    sclk_init(p);
+
     //-----------------------------------------------------
     //  Main program loop.
     //-----------------------------------------------------
 #if(USE_PTHREADS)
-    pthread_t sensor_thread, print_thread, signal_thread;
+    pthread_t sensor_thread;
     fprintf(OUTPUT_PRINT, "\n");
 
-    // Block SIGHUP/SIGABRT/SIGINT in the calling thread *before* any
+    // Block SIGHUP/SIGABRT/SIGINT/SIGTERM in the calling thread *before* any
     // pthread_create.  Newly created threads inherit this mask, so
-    // these signals are blocked in every thread except the dedicated
-    // signal_handler thread that calls sigwait().  Without this, the
-    // kernel delivers an arriving signal to whichever thread does not
-    // have it masked -- typically the print or sensor thread -- where
-    // there is no handler, so the process terminates instead of going
-    // through the graceful shutdown_requested path.
+    // these signals are blocked in every thread and are only ever
+    // taken from the signalfd of the output reactor (run_output()).
+    // Without this, the kernel delivers an arriving signal to whichever
+    // thread does not have it masked -- typically the sensor thread --
+    // where there is no handler, so the process terminates instead of
+    // going through the graceful shutdown_requested path.
     {
         sigset_t blocked;
         sigemptyset(&blocked);
         sigaddset(&blocked, SIGHUP);
         sigaddset(&blocked, SIGABRT);
         sigaddset(&blocked, SIGINT);
+        sigaddset(&blocked, SIGTERM);
         if (pthread_sigmask(SIG_BLOCK, &blocked, NULL) != 0)
         {
             perror("pthread_sigmask(SIG_BLOCK)");
@@ -301,27 +348,45 @@ int main(int argc, char** argv)
         }
     }
 
-    // Create threads
+    // A pipe reader that goes away must count as a sink drop, not
+    // kill the process.
+    signal(SIGPIPE, SIG_IGN);
+
+    // Started only now so the PPS thread inherits the signal mask.
+    rt_init(p);
+    pps_init(p);
+    gnss_init(p);
+    cq_init(p);
+    trc_init(p);
+
+    // The acquisition thread owns the bus; this thread becomes the
+    // output reactor until a stop is requested.
     if (pthread_create(&sensor_thread, NULL, read_sensors, (void *) p) != 0)
     {
         perror("pthread_create sensor");
         exit(1);
     }
-    if (pthread_create(&print_thread, NULL, print_data, (void *) p) != 0)
+    run_output(p);
+    pthread_join(sensor_thread, NULL);
+    // Whatever the acquisition thread queued before it stopped still
+    // goes out, so a restart loses nothing that was acquired.
+    drain_samples(p);
+    pps_close(p);
+    gnss_close(p);
+    cq_close(p);
+    if (p->samplingMode != CMM)
     {
-        perror("pthread_create print");
-        exit(1);
+        char hist[512];
+        lat_format(&p->wakeLatency, hist, sizeof hist);
+        fprintf(OUTPUT_ERROR, "{ \"lastStatus\": \"wake_latency\", \"realtime\": %s, \"histogram\": %s }\n",
+                p->rtEnable ? "true" : "false", hist);
     }
-    if (pthread_create(&signal_thread, NULL, signal_handler_thread, NULL) != 0)
+    if (p->trcEnable)
     {
-        perror("pthread_create signal");
-        exit(1);
+        char stages[2048];
+        trc_format(stages, sizeof stages);
+        fprintf(OUTPUT_ERROR, "{ \"lastStatus\": \"latency\", \"stages\": %s }\n", stages);
     }
-    // Wait for signal handler thread to complete (it will only return on signal)
-    pthread_join(signal_thread, NULL);
-    // Signal handler has set shutdown_requested, so wait for other threads to finish
-    pthread_join(sensor_thread, NULL);
-    pthread_join(print_thread, NULL);
     // Clean up
     pthread_mutex_destroy(&data_mutex);
 #else
@@ -371,6 +436,10 @@ int main(int argc, char** argv)
     #endif
 #endif // USE_PTHREADS
     // Free any allocated config strings before exit
+    trig_close(p);
+    products_close(p);
+    ring_close(&sampleQueue);
+    halt_close();
     if(p->pipeInFd >= 0) close(p->pipeInFd);
     if(p->pipeOutFd >= 0) close(p->pipeOutFd);
 #ifdef USE_WEBSOCKET
@@ -381,37 +450,118 @@ int main(int argc, char** argv)
     return 0;
 }
 
-// Forward declaration for local helper used below
-static double mcp9808_decode_celsius(uint8_t msb, uint8_t lsb);
+//---------------------------------------------------------------
+// log_clockStep(pList *p, int64_t step)
+//
+// A step of the host clock, as seen by the acquisition thread.  The
+// next sample carries it as clock_step_ns, so a jump in t_ns can be
+// told apart from a gap.
+//---------------------------------------------------------------
+static void log_clockStep(pList *p, int64_t step)
+{
+    p->clockSteps++;
+    fprintf(OUTPUT_ERROR, "{ \"lastStatus\": \"clock_step\", \"step_ns\": %" PRId64 ", \"seq\": %" PRIu64 " }\n",
+            step, p->sampleSeq);
+    fflush(OUTPUT_ERROR);
+}
 
 //---------------------------------------------------------------
-// Function to simulate reading sensor data
+// acquire_cmm(pList *p)
+//
+// CMM acquisition: the sensors set the pace, and every conversion
+// they produce is queued.  Conversions that went by unread still
+// consume their seqs (see acq_cmmNext()), so they show up as gaps
+// like missed POLL ticks.
 //---------------------------------------------------------------
-void* read_sensors(void* arg)
+static void acquire_cmm(pList *p)
 {
-    (void)arg;
+    magSample s;
+    ppsEdge edge;
+    clockWatch watch;
+    int64_t step = 0, stepped;
+
+    tick_watchInit(&watch);
     while (!shutdown_requested)
     {
-        // Sleep for 1000 ms (1 second)
-        usleep(1000000);
-
-        // Check for shutdown request
-        if (shutdown_requested)
+        int rv = acq_cmmNext(p, &s);
+        if (tick_watchCheck(&watch, &stepped))
         {
-            break;
+            log_clockStep(p, stepped);
+            step += stepped;
         }
+        if (rv > 0)
+        {
+            // Look back from a sensor that was read; the stamps of the
+            // others are left over from earlier conversions.
+            int64_t readNs = 0;
+            for (int i = 0; i < s.numMags; i++)
+            {
+                if (s.validMask & (1u << i))
+                {
+                    readNs = s.stamps[i].drdyMonoNs;
+                    break;
+                }
+            }
+            if (pps_latest(p, readNs - PPS_LOOKBACK_NS, &edge))
+            {
+                gnss_utcAt(edge.monoNs, &edge.realNs);
+                pps_discipline(&edge, &s);
+            }
+            else
+            {
+                gnss_discipline(&s);
+            }
+            s.clockStepNs = step;
+            step = 0;
+            s.queuedMonoNs = trc_now();
+            ring_push(p->ring, &s);
+        }
+        ar_feed(p);
     }
-    return NULL;
+    tick_watchClose(&watch);
+}
+
+//---------------------------------------------------------------
+// log_missed(pList *p, int64_t deadline, uint64_t count)
+//
+// One line for a run of count ticks lost to an overrun, the first of
+// them due at deadline (CLOCK_REALTIME).  At high rates a slow stretch
+// can lose ticks on every iteration, so lines are held to one a
+// second; the ticks of the runs left out are carried as "suppressed"
+// on the next line that is written.
+//---------------------------------------------------------------
+static void log_missed(pList *p, int64_t deadline, uint64_t count)
+{
+    static int64_t  nextLogNs;
+    static uint64_t suppressed;
+    int64_t now = mono_ns();
+
+    if (now < nextLogNs)
+    {
+        suppressed += count;
+        return;
+    }
+    fprintf(OUTPUT_ERROR,
+            "{ \"lastStatus\": \"missed_sample\", \"deadline\": %ld.%09ld, \"seq\": %" PRIu64
+            ", \"count\": %" PRIu64 ", \"suppressed\": %" PRIu64 " }\n",
+            (long)(deadline / NSEC_PER_SEC), (long)(deadline % NSEC_PER_SEC), p->sampleSeq, count, suppressed);
+    fflush(OUTPUT_ERROR);
+    suppressed = 0;
+    nextLogNs  = now + NSEC_PER_SEC;
 }
 
 //---------------------------------------------------------------
-// Function to print sensor data once per UTC second.
+// Acquisition thread: one sample per POLL period (1 s unless
+// output_rate_hz says otherwise), or every conversion in CMM.
 //
-// The cadence is anchored at the next whole CLOCK_REALTIME second
-// and advanced by exactly +1 s each iteration, using
-// clock_nanosleep() with TIMER_ABSTIME so the wakeup is aligned to
-// the wall clock rather than relative to whenever the previous
-// formatOutput() call finished.
+// The cadence is anchored on the period grid of CLOCK_REALTIME and
+// advanced by exactly one period each iteration, on an absolute timerfd
+// (ticker.c) so the wakeup is aligned to the wall clock rather than
+// relative to whenever the previous acquisition finished.  The timer
+// runs on CLOCK_MONOTONIC and follows the wall clock through its
+// offset, so a step of the host clock re-anchors the grid (logged as
+// clock_step and carried on the next sample) instead of bursting
+// through or stalling on the ticks in between.
 //
 // The previous implementation (nanosleep(1 s) after each read) drifted
 // by however long the synchronous I2C POLL + DRDY + 9-byte XYZ read
@@ -420,119 +570,341 @@ void* read_sensors(void* arg)
 // "occasional missed sample" Dave Witten reports against the
 // pre-rewrite code path.  Aligning to an absolute deadline removes
 // both the drift and the silent skip; the loop also explicitly
-// detects and logs a missed sample whenever formatOutput overruns,
+// logs the deadlines that went by before the one being served
+// (log_missed(), at most a line a second however fast the ticks),
 // so the operator can see *why* a tick disappeared instead of just
 // noticing a gap after the fact.
+//
+// Every tick consumes one sequence number whether or not it yields a
+// sample, so a tick lost here shows up downstream as a seq gap that
+// is counted in acqMisses, distinct from ring and sink losses.
 //---------------------------------------------------------------
-void* print_data(void* arg)
+void* read_sensors(void* arg)
 {
     pList * p = (pList *) arg;
+    magSample s;
+    ppsEdge edge;
+    int ppsLocked = FALSE;
 
-    // Anchor on the next whole UTC second.
-    struct timespec deadline;
-    clock_gettime(CLOCK_REALTIME, &deadline);
-    deadline.tv_sec  += 1;
-    deadline.tv_nsec  = 0;
+    rt_thread(p, RT_THREAD_ACQUISITION);
+
+    if (p->samplingMode == CMM)
+    {
+        acquire_cmm(p);
+        // Leave the sensors idle rather than converting after exit.
+        stopCMM(p);
+        return NULL;
+    }
+
+    // Ticks fall on whole multiples of the period since the epoch, so
+    // any period that divides one second puts a tick on every whole
+    // second (10 Hz: .0, .1, .2, ...).  When the period is whole
+    // seconds, a PPS source triggers the sample on its edge and each
+    // tick comes early enough to catch it; at other periods the
+    // samples are restamped from the latest edge instead.
+    int64_t period   = p->pollPeriodNs;
+    int     ppsOn    = (p->ppsSource != PPS_SRC_NONE);
+    int64_t window   = (int64_t)p->ppsWindowMs * NSEC_PER_MSEC;
+    int     edgeTrig = ppsOn && period % NSEC_PER_SEC == 0;
+    int64_t lead     = edgeTrig ? window : 0;
+    int64_t first    = (clock_ns(CLOCK_REALTIME) / period + 1) * period - lead;
+    int64_t stepped  = 0;
+    tickTimer tick;
+
+    if (tick_init(&tick, first, period, &p->wakeLatency) < 0)
+    {
+        return NULL;
+    }
 
     while (!shutdown_requested)
     {
-#ifdef USE_WEBSOCKET
-        if (p->useWebSocket)
-        {
-            ws_server_poll();
-        }
-#endif
+        int64_t  due, step;
+        uint64_t missed;
 
-        // Sleep until the absolute deadline.  Retry on EINTR so a
-        // stray signal does not cost us a sample; honour shutdown
-        // between retries so SIGTERM still exits promptly.
-        int rc;
-        do
+        if (tick_wait(&tick, &due, &missed, &step) < 0)
         {
-            rc = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &deadline, NULL);
-        } while (rc == EINTR && !shutdown_requested);
-
+            if (shutdown_requested || errno == ECANCELED)
+            {
+                break;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("timerfd read");
+            break;
+        }
         if (shutdown_requested)
         {
             break;
         }
-        if (rc != 0)
+        if (step != 0)
         {
-            fprintf(OUTPUT_ERROR,
-                    "clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME) failed: %d\n",
-                    rc);
-            break;
+            log_clockStep(p, step);
+            stepped += step;
         }
 
-        formatOutput(p);
+        // Ticks that went by while the previous one overran (slow I2C
+        // reads, scheduler preemption, clock steps, etc.) each cost a
+        // seq; log them so an operator can correlate the gaps.
+        if (missed > 0)
+        {
+            log_missed(p, due + lead - (int64_t)missed * period, missed);
+            p->sampleSeq += missed;
+            p->acqMisses += missed;
+        }
 
-        // Advance to the next tick.  If formatOutput overran by one
-        // or more whole seconds, skip-advance and log each missed
-        // tick so an operator can correlate gaps with their causes
-        // (slow I2C reads, scheduler preemption, clock steps, etc.).
-        deadline.tv_sec += 1;
+        // Trigger on the edge itself; if it does not come within the
+        // window, sample on the host clock as usual.  Between seconds,
+        // take the time from the last edge.
+        int locked = FALSE;
+        if (edgeTrig)
+        {
+            int64_t now = mono_ns();
+            locked = pps_waitEdge(p, now - window, now + 2 * window, &edge);
+        }
+        else if (ppsOn)
+        {
+            locked = pps_latest(p, mono_ns() - NSEC_PER_SEC - window, &edge);
+        }
+        if (ppsOn)
+        {
+            if (locked != ppsLocked)
+            {
+                fprintf(OUTPUT_ERROR, "{ \"lastStatus\": \"%s\", \"seq\": %" PRIu64 " }\n",
+                        locked ? "pps_locked" : "pps_lost", p->sampleSeq);
+                fflush(OUTPUT_ERROR);
+                ppsLocked = locked;
+            }
+            if (!locked)
+            {
+                p->ppsMisses++;
+            }
+        }
 
-        struct timespec now;
-        clock_gettime(CLOCK_REALTIME, &now);
-        while (now.tv_sec  > deadline.tv_sec ||
-              (now.tv_sec == deadline.tv_sec && now.tv_nsec > deadline.tv_nsec))
+        uint64_t seq = p->sampleSeq++;
+        if (acq_pollSample(p) > 0)
+        {
+            acq_fillSample(p, &s);
+            // With a receiver, it names the second of the edge and
+            // stamps the samples taken without one.
+            if (locked)
+            {
+                gnss_utcAt(edge.monoNs, &edge.realNs);
+                pps_discipline(&edge, &s);
+            }
+            else
+            {
+                gnss_discipline(&s);
+            }
+            s.clockStepNs = stepped;
+            stepped = 0;
+            s.seq = seq;
+            s.queuedMonoNs = trc_now();
+            ring_push(p->ring, &s);
+        }
+        else
         {
-            fprintf(OUTPUT_ERROR,
-                    "{ \"lastStatus\": \"missed_sample\", \"deadline\": %ld.%09ld }\n",
-                    (long)deadline.tv_sec, (long)deadline.tv_nsec);
-            fflush(OUTPUT_ERROR);
-            deadline.tv_sec += 1;
+            p->acqMisses++;
         }
+        ar_feed(p);
     }
+    tick_close(&tick);
     return NULL;
 }
 
 //---------------------------------------------------------------
-// Signal handler thread function
+// drain_samples(pList *p)
+// Everything queued so far, through the products and the trigger.
 //---------------------------------------------------------------
-void* signal_handler_thread(void* arg)
+static void drain_samples(pList *p)
 {
-    (void)arg;
-    sigset_t sigset;
-    int signum;
+    magSample s;
+    magRecord r;
 
-    // Block SIGHUP, SIGABRT, and SIGINT in this thread
-    sigemptyset(&sigset);
-    sigaddset(&sigset, SIGHUP);
-    sigaddset(&sigset, SIGABRT);
-    sigaddset(&sigset, SIGINT);
-    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+    while (ring_pop(p->ring, &s))
+    {
+        trc_lap(TRC_QUEUE, s.queuedMonoNs);
+        product_record(p, &s, &r);
+        sclk_stamp(p, &s, &r);
+        products_feed(p, &r);
+        trig_feed(p, &r);
+        trc_lap(TRC_TOTAL, s.traceStartNs);
+    }
+    products_flush(p);
+}
+
+//---------------------------------------------------------------
+// on_signal(void *ctx, uint32_t events)
+// SIGHUP, SIGABRT, SIGINT or SIGTERM, from the signalfd.
+//---------------------------------------------------------------
+static void on_signal(void *ctx, uint32_t events)
+{
+    int fd = *(int *) ctx;
+    struct signalfd_siginfo si;
 
-    // Wait for any of the blocked signals
-    while (1)
+    (void)events;
+    if (read(fd, &si, sizeof si) != (ssize_t) sizeof si)
     {
-        if (sigwait(&sigset, &signum) == 0)
-        {
-            switch (signum)
-            {
-                case SIGHUP:
-                    printf("Received SIGHUP. Shutting down gracefully.\n");
-                    break;
-                case SIGABRT:
-                    printf("Received SIGABRT. Shutting down gracefully.\n");
-                    break;
-                case SIGINT:
-                    printf("Received SIGINT. Shutting down gracefully.\n");
-                    break;
-                default:
-                    printf("Received unexpected signal %d.\n", signum);
-                    break;
-            }
-            // Set shutdown flag
-            shutdown_requested = 1;
+        return;
+    }
+    switch (si.ssi_signo)
+    {
+        case SIGHUP:
+            printf("Received SIGHUP. Shutting down gracefully.\n");
+            break;
+        case SIGABRT:
+            printf("Received SIGABRT. Shutting down gracefully.\n");
+            break;
+        case SIGINT:
+            printf("Received SIGINT. Shutting down gracefully.\n");
+            break;
+        case SIGTERM:
+            printf("Received SIGTERM. Shutting down gracefully.\n");
+            break;
+        default:
+            printf("Received unexpected signal %u.\n", si.ssi_signo);
             break;
-        }
     }
-    return NULL;
+    // Set shutdown flag and wake every wait that watches it
+    shutdown_requested = 1;
+    halt_request();
+    pps_interrupt();
+}
+
+//---------------------------------------------------------------
+// on_halt(void *ctx, uint32_t events)
+//---------------------------------------------------------------
+static void on_halt(void *ctx, uint32_t events)
+{
+    (void)events;
+    rx_stop((reactor *) ctx);
+}
+
+//---------------------------------------------------------------
+// on_samples(void *ctx, uint32_t events)
+//---------------------------------------------------------------
+static void on_samples(void *ctx, uint32_t events)
+{
+    pList *p = (pList *) ctx;
+
+    (void)events;
+    ring_ack(p->ring);
+    drain_samples(p);
+}
+
+//---------------------------------------------------------------
+// on_control(void *ctx, uint32_t events)
+// Commands are parsed here and run by the acquisition thread.
+//---------------------------------------------------------------
+static void on_control(void *ctx, uint32_t events)
+{
+    (void)events;
+    ctl_readPipe((pList *) ctx);
+}
+
+//---------------------------------------------------------------
+// on_housekeeping(void *ctx, uint32_t events)
+//---------------------------------------------------------------
+static void on_housekeeping(void *ctx, uint32_t events)
+{
+    (void)events;
+    trc_service((pList *) ctx);
+}
+
+#ifdef USE_WEBSOCKET
+static void on_websocket(void *ctx, uint32_t events);
+
+//---------------------------------------------------------------
+// ws_watch(reactor *rx)
+//
+// Replaces the reactor's WebSocket watches with the sockets the
+// server has work on now.  A socket the server closed has already
+// left the epoll set, and its number may be back as a new
+// connection, so the watches are rebuilt rather than diffed.
+//---------------------------------------------------------------
+static void ws_watch(reactor *rx)
+{
+    for(int i = 0; i < wsFdCount; i++)
+    {
+        rx_remove(rx, wsFds[i]);
+    }
+    wsFdCount = ws_server_fds(wsFds, WS_MAX_CONNS + 1);
+    for(int i = 0; i < wsFdCount; i++)
+    {
+        rx_add(rx, wsFds[i], EPOLLIN, on_websocket, rx);
+    }
 }
 
 //---------------------------------------------------------------
-// formatOutput(volatile pList *p)
+// on_websocket(void *ctx, uint32_t events)
+// Accepts, handshakes and reads clients when the listening socket or
+// a connection is readable, then watches the sockets that are left.
+//---------------------------------------------------------------
+static void on_websocket(void *ctx, uint32_t events)
+{
+    (void)events;
+    ws_server_poll();
+    ws_watch((reactor *) ctx);
+}
+#endif
+
+//---------------------------------------------------------------
+// run_output(pList *p)
+//
+// The output side, as an epoll reactor on the main thread: queued
+// samples go to the output products and the event trigger, control
+// FIFO lines are queued for the acquisition thread, signals arrive on
+// a signalfd, and periodic work runs off timerfds.  Returns once a
+// stop is requested.
+//
+// Sinks run here, off the acquisition thread, so a stalled pipe
+// reader or WebSocket client delays only this thread; if it falls far
+// enough behind, the ring overflows and the lost seqs are counted
+// there rather than as missed acquisition ticks.
+//---------------------------------------------------------------
+static void run_output(pList *p)
+{
+    reactor rx;
+    sigset_t sigs;
+    int sigFd;
+
+    rt_thread(p, RT_THREAD_OUTPUT);
+
+    // Already blocked in every thread; see main().
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGHUP);
+    sigaddset(&sigs, SIGABRT);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigFd = signalfd(-1, &sigs, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (sigFd < 0 || rx_init(&rx) < 0)
+    {
+        perror("signalfd");
+        exit(1);
+    }
+    rx_add(&rx, sigFd, EPOLLIN, on_signal, &sigFd);
+    rx_add(&rx, halt_fd(), EPOLLIN, on_halt, &rx);
+    rx_add(&rx, p->ring->eventFd, EPOLLIN, on_samples, p);
+    if (p->pipeInFd >= 0)
+    {
+        rx_add(&rx, p->pipeInFd, EPOLLIN, on_control, p);
+    }
+    rx_addTimer(&rx, NSEC_PER_SEC, on_housekeeping, p);
+#ifdef USE_WEBSOCKET
+    if (p->useWebSocket)
+    {
+        ws_watch(&rx);
+    }
+#endif
+
+    rx_run(&rx);
+    rx_close(&rx);
+    close(sigFd);
+}
+
+//---------------------------------------------------------------
+// norm_angle(int a)
 //---------------------------------------------------------------
 static int norm_angle(int a)
 {
@@ -609,149 +981,21 @@ static void apply_orientation(const pList *p, double *x, double *y, double *z)
 }
 
 //---------------------------------------------------------------
-// formatOutput(volatile pList *p)
+// countsToNT(const pList *p, const int *gain, const int32_t *counts, double *xyz)
+//
+// Raw counts to nanoTeslas in the station frame, using the gains in
+// effect when the sample was taken.  Every sensor of a gradiometer
+// shares the cycle counts, so one gain and orientation apply to all
+// of them.
 //---------------------------------------------------------------
-char *formatOutput(pList *p)
+void countsToNT(const pList *p, const int *gain, const int32_t *counts, double *xyz)
 {
-#define FMTBUFLEN  200
-    char fmtBuf[FMTBUFLEN + 1] ="";
-    int fmtBuf_len      = sizeof fmtBuf;
-    struct tm *utcTime  = getUTC();
-    char utcStr[128]    ="";
-    double xyz[3];
-    double rcRemoteTemp;
-
-    outBuf[0] = '\0';
-
-    i2c_readMagPOLL(p);
-
-    xyz[0] = ((double)p->XYZ[0] / p->x_gain) * 1000; // make microTeslas -> nanoTeslas
-    xyz[1] = ((double)p->XYZ[1] / p->y_gain) * 1000; // make microTeslas -> nanoTeslas
-    xyz[2] = ((double)p->XYZ[2] / p->z_gain) * 1000; // make microTeslas -> nanoTeslas
+    xyz[0] = ((double)counts[0] / gain[0]) * 1000; // make microTeslas -> nanoTeslas
+    xyz[1] = ((double)counts[1] / gain[1]) * 1000; // make microTeslas -> nanoTeslas
+    xyz[2] = ((double)counts[2] / gain[2]) * 1000; // make microTeslas -> nanoTeslas
 
     // Apply orientation translations (rotations) from config
     apply_orientation(p, &xyz[0], &xyz[1], &xyz[2]);
-
-    // xyz[0] = ((double)p->XYZ[0] / p->x_gain);
-    // xyz[1] = ((double)p->XYZ[1] / p->y_gain);
-    // xyz[2] = ((double)p->XYZ[2] / p->z_gain);
-
-#if(FOR_GRAPE2)
-    strftime(utcStr, UTCBUFLEN, "%Y%m%e%y%M%S", utcTime);              // YYYYMMDDHHMMSS  (Gaak!)
-    snprintf(fmtBuf, fmtBuf_len, "\"ts\":%s", utcStr);
-#else
-    strftime(utcStr, UTCBUFLEN, "%d %b %Y %T", utcTime);                // RFC 2822: "%a, %d %b %Y %T %z"
-    snprintf(fmtBuf, fmtBuf_len, "\"ts\":\"%s\"", utcStr);
-#endif
-
-    rcRemoteTemp = readTemp(p);
-
-    utcTime = getUTC();
-    strftime(utcStr, UTCBUFLEN, "%d %b %Y %T", utcTime);                // RFC 2822: "%a, %d %b %Y %T %z"
-    snprintf(fmtBuf, fmtBuf_len, "{ \"ts\":\"%s\"", utcStr);
-    {
-        size_t used = strlen(outBuf);
-        snprintf(outBuf + used, sizeof(outBuf) - used, "%s", fmtBuf);
-    }
-
-    if(rcRemoteTemp < -100.0)
-    {
-        snprintf(fmtBuf, fmtBuf_len, ", \"rt\":0.0");
-        {
-            size_t used = strlen(outBuf);
-            snprintf(outBuf + used, sizeof(outBuf) - used, "%s", fmtBuf);
-        }
-    }
-    else
-    {
-        snprintf(fmtBuf, fmtBuf_len, ", \"rt\":%.2f",  rcRemoteTemp);
-        {
-            size_t used = strlen(outBuf);
-            snprintf(outBuf + used, sizeof(outBuf) - used, "%s", fmtBuf);
-        }
-    }
-
-    snprintf(fmtBuf, fmtBuf_len, ", \"x\":%.3f", xyz[0]);
-    {
-        size_t used = strlen(outBuf);
-        snprintf(outBuf + used, sizeof(outBuf) - used, "%s", fmtBuf);
-    }
-    snprintf(fmtBuf, fmtBuf_len, ", \"y\":%.3f", xyz[1]);
-    {
-        size_t used = strlen(outBuf);
-        snprintf(outBuf + used, sizeof(outBuf) - used, "%s", fmtBuf);
-    }
-    snprintf(fmtBuf, fmtBuf_len, ", \"z\":%.3f", xyz[2]);
-    {
-        size_t used = strlen(outBuf);
-        snprintf(outBuf + used, sizeof(outBuf) - used, "%s", fmtBuf);
-    }
-
-    snprintf(fmtBuf, fmtBuf_len, " }\n");
-    {
-        size_t used = strlen(outBuf);
-        snprintf(outBuf + used, sizeof(outBuf) - used, "%s", fmtBuf);
-    }
-
-#if(CONSOLE_OUTPUT)
-    fprintf(OUTPUT_PRINT, " %s", outBuf);
-    fflush(OUTPUT_PRINT);
-#endif
-    if(p->usePipes && p->pipeOutFd >= 0)
-    {
-        write(p->pipeOutFd, outBuf, strlen(outBuf));
-    }
-#ifdef USE_WEBSOCKET
-    if(p->useWebSocket)
-    {
-        ws_server_broadcast(outBuf, strlen(outBuf));
-    }
-#endif
-    return outBuf;
-}
-
-//---------------------------------------------------------------
-// readTemp(pList *p)
-//---------------------------------------------------------------
-double readTemp(pList *p)
-{
-    uint8_t temp_buf[2] = {0xFF, 0xFF};
-
-    int rv = i2c_pololu_read_from(p->adapter, p->remoteTempAddr, MCP9808_REG_AMBIENT_TEMP, temp_buf, 2);
-    if (rv < 2)
-    {
-        char usingcall[256] = "i2c_pololu_read_from";
-        char ebuf[300] = "";
-        snprintf(ebuf,sizeof(ebuf),"Read with: %s() ", usingcall);
-        perror(ebuf);
-    }
-    double celsius = mcp9808_decode_celsius(temp_buf[0], temp_buf[1]);
-    return celsius;
-}
-
-//------------------------------------------
-//  mcp9808_decode_celsius()
-//------------------------------------------
-static double mcp9808_decode_celsius(uint8_t msb, uint8_t lsb)
-{
-    uint16_t raw = ((uint16_t)msb << 8) | lsb;
-    // First, clear alert flag bits (15, 14, 13)
-    raw &= 0x1FFF;  // Keep only bits 12-0
-
-    double c;
-    if (raw & 0x1000)
-    {
-        // Bit 12 (sign bit) is set - negative temperature
-        // For two's complement of a 13-bit signed value:
-        // Treat bits 12-0 as signed, or manually compute
-        c = -(double)(raw & 0x0FFF) / 16.0 - 256.0;
-    }
-    else
-    {
-        // Positive temperature
-        c = (double)(raw & 0x0FFF) / 16.0;
-    }
-    return c;
 }
 
 //------------------------------------------
@@ -835,7 +1079,10 @@ int setupPipes(pList *p)
          }
 
          // Open for reading from the dashboard (in)
-         p->pipeInFd = open(p->pipeInPath, O_RDONLY | O_NONBLOCK);
+         // Read-write, so the FIFO always has a writer: a dashboard
+         // that closes its end leaves it empty rather than at EOF, which
+         // epoll would otherwise report as ready forever.
+         p->pipeInFd = open(p->pipeInPath, O_RDWR | O_NONBLOCK);
          if(p->pipeInFd < 0)
          {
              perror("Open PIPE In failed");
@@ -881,15 +1128,51 @@ void setProgramDefaults(pList *p)
     p->Version              = Version;
     p->samplingMode         = POLL;
     p->readBackCCRegs       = FALSE;
-    p->CMMSampleRate        = 400;
+    p->pollPipeline         = FALSE;
+    p->pollPeriodNs         = NSEC_PER_SEC;
+    p->CMMSampleRate        = 37;
+    p->cmmClockWindow       = 256;
+    p->ppsSource            = PPS_SRC_NONE;
+    p->ppsWindowMs          = 100;
+    p->gnssBaud             = 9600;
+    p->gnssLatencyMs        = 0.0;
+    p->gnssWindow           = 8;
+    p->gnssMaxAge           = 3;
+    p->rtEnable             = FALSE;
+    p->rtPriority           = 50;
+    p->rtAcqCpu             = -1;
+    p->rtOutputCpu          = -1;
+    p->cqAnnotate           = FALSE;
+    p->cqInterval           = 16;
+    p->cqChrony             = FALSE;
+    p->cqChronyPort         = 323;
+    p->trcEnable            = TRUE;
+    p->trcInterval          = 0;
     p->NOSRegValue          = 60;
     p->DRDYdelay            = 10;
     p->magRevId             = 0x0;
     p->remoteTempAddr       = 0x1F;
+    p->tempReadInterval     = 30;
+    p->tempResolution       = MCP9808_RES_0_0625C;
+    p->adapterTelemetryInterval = 60;
+    p->trigEnable           = FALSE;
+    p->trigDbdtWindow       = 1.0;
+    p->trigStepWindow       = 1.0;
+    p->trigPre              = 10.0;
+    p->trigPost             = 30.0;
+    p->arEnable             = FALSE;
+    p->arCCMin              = 50;
+    p->arCCMax              = 400;
+    p->arNoiseTarget        = 0.0;
+    p->arDeadlineFraction   = 0.5;
+    p->arHeadroom           = 0.5;
+    p->arInterval           = 10;
     p->mag_translate_x      = 0;
     p->mag_translate_y      = 0;
     p->mag_translate_z      = 0;
     p->magAddr              = RM3100_I2C_ADDRESS;
+    p->numMags              = 1;
+    p->magAddrs[0]          = RM3100_I2C_ADDRESS;
     p->usePipes             = FALSE;
     p->useWebSocket         = FALSE;
     p->webSocketPort        = 8765;
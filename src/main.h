@@ -23,7 +23,10 @@
 #include <signal.h>
 #include <sys/time.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include "MCP9808.h"
+#include "latency.h"
+#include "clockqual.h"
 
 #ifndef TRUE
     #define TRUE  1
@@ -80,10 +83,157 @@
 #define UTCBUFLEN           64
 #define MAXPATHBUFLEN       PATH_MAX
 #define XYZ_BUFLEN          9
+#define MAX_MAGS            4           // RM3100 straps allow 0x20 - 0x23
 
 #define POLL                0
 #define CMM                 1
 
+//------------------------------------------
+// Acquisition-instant stamps for one raw sample, in integer
+// nanoseconds.  The trigger pair is taken just before the POLL
+// command goes to the adapter and the DRDY pair just after DRDY is
+// seen, so the conversion lies inside [trig, drdy].
+//------------------------------------------
+typedef struct
+{
+    int64_t trigRealNs;
+    int64_t trigMonoNs;
+    int64_t drdyRealNs;
+    int64_t drdyMonoNs;
+} magStamp;
+
+//------------------------------------------
+// One raw acquisition, as handed from the acquisition thread to the
+// output thread.  Everything needed to format the record travels with
+// it, so a control command changing the gains cannot skew a sample
+// that is still queued.
+//------------------------------------------
+typedef struct
+{
+    uint64_t seq;                   // acquisition tick number, never reused
+    int      numMags;
+    unsigned validMask;             // bit i: xyz[i] was read on this tick
+    int32_t  xyz[MAX_MAGS][3];
+    magStamp stamps[MAX_MAGS];
+    uint32_t cmmRun;                // CMM start the sample belongs to
+    int      ppsValid;              // stamps were disciplined by a PPS edge
+    int64_t  ppsOffsetNs;           // primary trigger minus that edge, CLOCK_MONOTONIC
+    int      gnssValid;             // stamps were taken from the GNSS receiver's time
+    int64_t  gnssHostNs;            // host clock minus GNSS time at the primary trigger
+    int64_t  clockStepNs;           // host clock step just before this sample (0 = none)
+    clockQuality clock;             // host clock quality at acquisition
+    int64_t  traceStartNs;          // CLOCK_MONOTONIC start of the trace (0 = tracing off)
+    int64_t  queuedMonoNs;          // CLOCK_MONOTONIC ring push (0 = tracing off)
+    int      cc[3];                 // cycle counts the sample was converted with
+    int      gain[3];
+    int      tempValid;
+    double   tempCelsius;
+    double   tempAge;               // seconds, at acquisition
+} magSample;
+
+//------------------------------------------
+// Per-sink delivery accounting.  Updated by the output thread and read
+// by the status command, hence atomic.
+//------------------------------------------
+#define SINK_CONSOLE        0
+#define SINK_PIPE           1
+#define SINK_WEBSOCKET      2
+#define SINK_FILE           3
+#define SINK_COUNT          4
+
+typedef struct
+{
+    _Atomic uint64_t delivered;     // records written in full
+    _Atomic uint64_t dropped;       // records the sink could not take
+    _Atomic uint64_t lastSeq;       // seq of the last record delivered
+} sinkStats;
+
+//------------------------------------------
+// One output record, in nanoTeslas in the station frame.  A product
+// either passes acquired samples through one by one or reduces a
+// period's worth of them into a single record.
+//------------------------------------------
+typedef struct
+{
+    uint64_t seq;                   // seq of the first sample in the record
+    uint32_t count;                 // samples combined into it
+    int      averaged;              // TRUE: a period mean stamped at the period start
+    int64_t  tNs;                   // CLOCK_REALTIME, ns since the epoch
+    int64_t  tUncNs;                // -1 if unknown
+    int      numMags;
+    unsigned validMask;             // bit i: nT[i] is valid
+    double   nT[MAX_MAGS][3];
+    int32_t  xyz[MAX_MAGS][3];      // raw counts; not set on averaged records
+    int      ppsValid;
+    int64_t  ppsOffsetNs;           // trigger minus PPS edge of the (last) sample
+    int      gnssValid;
+    int64_t  gnssHostNs;            // host clock minus GNSS time of the (last) sample
+    int64_t  clockStepNs;           // host clock steps since the product's last record
+    clockQuality clock;             // of the (last) sample
+    int      cc[3];                 // cycle counts and gains of the (last) sample
+    int      gain[3];
+    int      tempValid;
+    double   tempCelsius;
+    double   tempAge;
+} magRecord;
+
+//------------------------------------------
+// Output products.  Every product is fed the same acquisition stream
+// and has its own period, reduction, format and set of sinks.
+//------------------------------------------
+#define MAX_PRODUCTS        4
+#define PRODUCT_NAMELEN     16
+
+#define PRODUCT_FMT_JSON    0
+#define PRODUCT_FMT_BINARY  1           // magrec.h records
+#define PRODUCT_FMT_CBOR    2
+#define PRODUCT_FMT_MSGPACK 3
+#define PRODUCT_FMT_IAGA2002 4          // day files, file sink only
+#define PRODUCT_FMT_MSEED   5           // miniSEED records, file sink only
+#define PRODUCT_FMT_COUNT   6
+
+#define PRODUCT_SAMPLE      0           // first sample of each period
+#define PRODUCT_AVERAGE     1           // mean of each period
+
+struct tag_mseedState;
+
+typedef struct
+{
+    char     name[PRODUCT_NAMELEN];
+    int64_t  periodNs;              // 0 = every acquired sample
+    int      reduce;                // PRODUCT_SAMPLE or PRODUCT_AVERAGE
+    unsigned sinkMask;              // bit SINK_*
+    int      format[SINK_COUNT];    // PRODUCT_FMT_* of each sink
+    unsigned formatSetMask;         // sinks with their own <sink>_format
+    int      floatBits;             // 32 or 64: CBOR and MessagePack floats
+    int64_t  iagaDay;               // UTC day number of the open IAGA-2002 file
+    int64_t  iagaNextNs;            // interval of the next line due in it
+    int64_t  iagaSampleNs;          // acquisition period, for the IAGA-2002 header
+    char     mseedNet[3];           // miniSEED codes ("" = default)
+    char     mseedSta[6];
+    char     mseedLoc[3];
+    char     mseedChan[3][4];       // of x, y and z
+    int      mseedRecLen;           // 512 or 4096 bytes
+    struct tag_mseedState *mseed;   // open records, touched only by the output thread
+    int      tsFormat[SINK_COUNT];  // FMT_TS_* of each sink's JSON "ts"
+    unsigned tsSetMask;             // sinks with their own <sink>_timestamp
+    char    *filePath;              // SINK_FILE target
+    FILE    *fp;
+
+    // Reduction state, touched only by the output thread.
+    int64_t  bin;                   // period index of the open record
+    uint64_t firstSeq;
+    uint32_t count;
+    uint32_t magCount[MAX_MAGS];
+    double   sum[MAX_MAGS][3];
+    magRecord acc;                  // latest sample of the open record
+    int64_t  clockStepNs;           // host clock steps not yet on a written record
+
+    sinkStats sinks[SINK_COUNT];
+} outputProduct;
+
+struct tag_sampleRing;
+
 //------------------------------------------
 // Control Parameter List struct
 //------------------------------------------
@@ -106,7 +256,12 @@ typedef struct tag_pList
     unsigned edge_cb_id;
     
     unsigned magHandle;
-    int  magAddr;
+    int  magAddr;                   // primary sensor, always magAddrs[0]
+    int  numMags;                   // RM3100s sharing the bus (1..MAX_MAGS)
+    int  magAddrs[MAX_MAGS];
+    int32_t magXYZ[MAX_MAGS][3];    // latest counts per sensor
+    int  magValid[MAX_MAGS];        // magXYZ[i] was read in the last cycle
+    magStamp magStamps[MAX_MAGS];   // acquisition bracket of magXYZ[i]
     uint8_t magRevId;
     int mag_translate_x;
     int mag_translate_y;
@@ -114,6 +269,14 @@ typedef struct tag_pList
 
     unsigned remoteTempHandle;
     int  remoteTempAddr;
+    int  tempReadInterval;          // seconds between MCP9808 reads (0 = every sample)
+    int  tempResolution;            // MCP9808 resolution register value (0..3)
+    int  tempValid;                 // TRUE once a reading has succeeded
+    double tempCelsius;             // most recent good reading
+    int64_t tempReadNs;             // CLOCK_MONOTONIC time of tempCelsius
+    int64_t tempNextDueNs;          // CLOCK_MONOTONIC time the next read is due
+    unsigned long tempErrors;       // total failed reads
+    unsigned long tempFailures;     // consecutive failed reads
 
     int  doBistMask;
 
@@ -133,6 +296,71 @@ typedef struct tag_pList
     int  NOSRegValue;
     int  DRDYdelay;
     int  readBackCCRegs;
+    int  pollPipeline;              // chain XYZ read N with POLL trigger N+1
+    int64_t pollPeriodNs;           // POLL tick period (output_rate_hz)
+    unsigned pollArmed;             // bit i: sensor i has a POLL conversion in flight
+    int64_t pollTriggerNs[MAX_MAGS];// CLOCK_MONOTONIC time of each in-flight trigger
+    magStamp pollStamps[MAX_MAGS];  // trigger stamps of the in-flight conversions;
+                                    // in CMM, the last instant each sensor had no new data
+
+    uint64_t sampleSeq;             // seq the next acquisition tick will get
+    unsigned long acqMisses;        // ticks that produced no sample (overrun or failed read)
+    unsigned long clockSteps;       // host clock steps seen by the acquisition thread
+    struct tag_sampleRing *ring;    // acquisition -> output queue
+    int  numProducts;
+    outputProduct products[MAX_PRODUCTS];
+    int  trigEnable;                // burst capture around field events
+    double trigDbdt;                // |dB/dt| threshold in nT/s (0 = off)
+    double trigDbdtWindow;          // seconds the slope is taken over
+    double trigStep;                // per-axis step threshold in nT (0 = off)
+    double trigStepWindow;          // seconds averaged either side of a step
+    double trigPre;                 // seconds of history written before a trigger
+    double trigPost;                // seconds written after the last trigger
+    char *trigDir;                  // event file directory (default log_output_path)
+    _Atomic uint64_t trigEvents;    // event files started
+    int64_t cmmNextNs;              // CLOCK_MONOTONIC time the next CMM result is due
+    unsigned long cmmSkipped;       // CMM conversions lost before the last one read
+    uint32_t cmmRuns;               // CMM (re)starts; each restarts the sensor clock
+    int  cmmClockWindow;            // conversions in the sensor clock fit (0 = off)
+    _Atomic double sclkPeriodNs;    // fitted CMM conversion period (0 = no fit yet)
+    _Atomic double sclkRatePpm;     // sensor oscillator rate against its nominal period
+    int  ppsSource;                 // PPS_SRC_* (pps.h)
+    char *ppsDevice;                // /dev/ppsN, or the serial port for DCD
+    int  ppsWindowMs;               // how far either side of the second to look for the edge
+    int  ppsSimOffsetUs;            // simulated source: pulse lag behind the host second
+    _Atomic uint64_t ppsEdges;      // edges seen by the PPS thread
+    unsigned long ppsMisses;        // POLL ticks that found no edge
+    char *gnssDevice;               // GNSS receiver serial port (NULL = no GNSS time)
+    int  gnssBaud;
+    double gnssLatencyMs;           // receiver epoch to the first byte of its messages
+    int  gnssWindow;                // epochs the receiver time estimate is taken over
+    int  gnssMaxAge;                // seconds an estimate is used without a new epoch
+    int  rtEnable;                  // real-time mode: locked memory, SCHED_FIFO, pinning
+    int  rtPriority;                // SCHED_FIFO priority of the acquisition thread
+    int  rtAcqCpu;                  // CPU for the acquisition and PPS threads (-1 = any)
+    int  rtOutputCpu;               // CPU for the output thread (-1 = any)
+    latHist wakeLatency;            // POLL tick expiry to wakeup
+    int  cqAnnotate;                // attach the host clock quality to every record
+    int  cqInterval;                // seconds between clock quality reads
+    int  cqChrony;                  // also query chronyd's tracking report
+    int  cqChronyPort;              // chronyd command port on the loopback
+    int  trcEnable;                 // per-stage latency histograms (trace.c)
+    int  trcInterval;               // seconds between latency dumps (0 = on demand only)
+    int  arEnable;                  // retune the cycle count from noise, deadline and range
+    int  arCCMin;                   // cycle count bounds
+    int  arCCMax;
+    double arNoiseTarget;           // nT RMS the controller aims below (0 = highest CC that fits)
+    double arDeadlineFraction;      // of the sample period a conversion may take
+    double arHeadroom;              // of the 24-bit range the peak count may reach
+    int  arInterval;                // seconds between decisions
+    unsigned long arChanges;        // cycle count changes made
+
+    unsigned long i2cErrors;        // failed adapter transactions in the sampling loop
+    unsigned long drdyTimeouts;     // conversions that never raised DRDY
+    int  adapterTelemetryInterval;  // seconds between adapter health probes (0 = off)
+    int64_t adapterNextProbeNs;     // CLOCK_MONOTONIC time of the next probe
+    int64_t adapterRttNs;           // round trip of the last successful probe
+    unsigned long adapterProbeFailures;
 
     int  tsMilliseconds;
     int  usePipes;
@@ -143,6 +371,8 @@ typedef struct tag_pList
 
     char *maintainer;
     char *maintainer_email;
+    char *station_code;             // IAGA code, e.g. "BOU"
+    char *station_name;
     char *Version;
     char *pipeInPath;
     char *pipeOutPath;
@@ -163,11 +393,8 @@ typedef struct tag_pList
 // Prototypes
 //------------------------------------------
 int  main(int argc, char** argv);
-char *formatOutput(pList *p);
+void countsToNT(const pList *p, const int *gain, const int32_t *counts, double *xyz);
 void* read_sensors(void* arg);
-void* print_data(void* arg);
-void* signal_handler_thread(void* arg);
-double readTemp(pList *p);
 void showErrorMsg(int temp);
 void setProgramDefaults(pList *p);
 void showSettings(pList *p);
@@ -0,0 +1,584 @@
+//=========================================================================
+// mseed.c
+//
+// miniSEED 2 records of raw counts, Steim-2 compressed.
+//
+// A product whose file sink has format = "mseed" writes the x, y and z
+// counts of the primary sensor, as read, as three channels of
+// big-endian data records: a 48-byte fixed header, blockettes 1000 and
+// 1001, then 64-byte Steim-2 frames up to the record length.  Each
+// channel packs its differences into 32-bit words as they come, seven
+// samples at a time, and a record is written as soon as its last frame
+// is full.  A record holds contiguous samples only: one that arrives
+// more than half a sample period away from where the previous one said
+// it would, a host clock step, or a sample without valid counts closes
+// the open records of all three channels, partly filled as they may
+// be, and so does shutdown.
+//
+// The start time of a record is the timestamp of its first sample,
+// rounded to the 100 us of the fixed header with the rest in
+// blockette 1001, so the time of every record is corrected afresh and
+// drift between the sample clock and the nominal rate never builds up
+// past one record.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include "main.h"
+#include "mseed.h"
+#include "timeutil.h"
+
+#define MSEED_DATA_OFFSET   64          // header and blockettes 1000 and 1001
+#define MSEED_FRAME         64          // 16 words: a control word and 15 data words
+#define MSEED_WORDS         16
+#define MSEED_PENDING       7           // most differences one word takes
+#define MSEED_DIFF_LIMIT    (1 << 29)   // a difference must fit in 30 bits
+
+// Timing quality of blockette 1001, by the best time source of the
+// record's first sample.
+#define MSEED_TQ_PPS        100
+#define MSEED_TQ_GNSS       90
+#define MSEED_TQ_SYNC       50
+
+typedef struct
+{
+    uint8_t  rec[MSEED_RECORD_MAX]; // record being filled
+    int      frame;                 // frame and word the next data word goes to
+    int      word;
+    int      nSamples;              // samples in rec
+    int32_t  last;                  // last sample in rec
+    int64_t  startNs;               // time of rec's first sample
+    uint8_t  tq;                    // timing quality of that sample
+    int      nPend;                 // samples waiting for their word
+    int32_t  pend[MSEED_PENDING];
+    int32_t  diff[MSEED_PENDING];
+    int64_t  pendNs[MSEED_PENDING];
+    uint8_t  pendTq[MSEED_PENDING];
+} mseedChannel;
+
+struct tag_mseedState
+{
+    char     net[3];
+    char     sta[6];
+    char     loc[3];
+    char     chan[3][4];
+    int      recLen;
+    int      nFrames;
+    int16_t  rateFact;              // SEED sample rate factor and multiplier
+    int16_t  rateMult;
+    int64_t  periodNs;
+    int      contiguous;            // prev[] and nextNs hold the previous sample
+    int32_t  prev[3];
+    int64_t  nextNs;
+    unsigned seqNo;                 // of the last record written
+    mseedChannel ch[3];
+};
+
+// Steim-2 data words, widest packing first: differences per word, bits
+// per difference, control nibble and the 2-bit dnib atop the word.
+static const struct
+{
+    int      n;
+    int      bits;
+    uint32_t nib;
+    uint32_t dnib;
+} steim2[] =
+{
+    { 7,  4, 3, 2 },
+    { 6,  5, 3, 1 },
+    { 5,  6, 3, 0 },
+    { 4,  8, 1, 0 },
+    { 3, 10, 2, 3 },
+    { 2, 15, 2, 2 },
+    { 1, 30, 2, 1 },
+};
+
+//---------------------------------------------------------------
+// put_be16() / put_be32()
+//---------------------------------------------------------------
+static void put_be16(uint8_t *b, uint16_t v)
+{
+    b[0] = (uint8_t)(v >> 8);
+    b[1] = (uint8_t)v;
+}
+
+static void put_be32(uint8_t *b, uint32_t v)
+{
+    b[0] = (uint8_t)(v >> 24);
+    b[1] = (uint8_t)(v >> 16);
+    b[2] = (uint8_t)(v >> 8);
+    b[3] = (uint8_t)v;
+}
+
+//---------------------------------------------------------------
+// mseed_floor(int64_t t, int64_t unit)
+//---------------------------------------------------------------
+static int64_t mseed_floor(int64_t t, int64_t unit)
+{
+    int64_t q = t / unit;
+    return (t % unit < 0) ? q - 1 : q;
+}
+
+//---------------------------------------------------------------
+// mseed_setCode(char *dst, size_t size, const char *value)
+//
+// A network, station or location code: up to size - 1 letters and
+// digits, kept in upper case.  Returns 0, or -1 with dst unchanged.
+//---------------------------------------------------------------
+int mseed_setCode(char *dst, size_t size, const char *value)
+{
+    size_t n = strlen(value);
+
+    if(n >= size)
+    {
+        return -1;
+    }
+    for(size_t i = 0; i < n; i++)
+    {
+        if(!isalnum((unsigned char)value[i]))
+        {
+            return -1;
+        }
+    }
+    for(size_t i = 0; i <= n; i++)
+    {
+        dst[i] = (char)toupper((unsigned char)value[i]);
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// mseed_setChannels(char chan[3][4], const char *list)
+//
+// "LFX,LFY,LFZ", or the same separated by spaces or as a TOML array:
+// the channel codes of x, y and z.  Returns 0, or -1 with chan
+// unchanged.
+//---------------------------------------------------------------
+int mseed_setChannels(char chan[3][4], const char *list)
+{
+    char        codes[3][4];
+    int         n = 0;
+    const char *c = list;
+
+    while(*c)
+    {
+        while(*c == ' ' || *c == ',' || *c == '[' || *c == ']' || *c == '"' || *c == '\t')
+        {
+            c++;
+        }
+        if(!*c)
+        {
+            break;
+        }
+        size_t len = strcspn(c, " ,[]\"\t");
+        if(n == 3 || len != 3)
+        {
+            return -1;
+        }
+        char code[4];
+        memcpy(code, c, 3);
+        code[3] = '\0';
+        if(mseed_setCode(codes[n], sizeof codes[n], code) != 0)
+        {
+            return -1;
+        }
+        n++;
+        c += len;
+    }
+    if(n != 3)
+    {
+        return -1;
+    }
+    memcpy(chan, codes, sizeof codes);
+    return 0;
+}
+
+//---------------------------------------------------------------
+// mseed_rate(int64_t periodNs, int16_t *fact, int16_t *mult)
+//
+// The SEED sample rate factor and multiplier for periodNs: whole
+// seconds as a negative factor, otherwise a rate that some multiple up
+// to 1024 of makes whole, as 75 / 2 for 37.5 Hz.  Returns 0, or -1 if
+// there is none.
+//---------------------------------------------------------------
+static int mseed_rate(int64_t periodNs, int16_t *fact, int16_t *mult)
+{
+    if(periodNs % NSEC_PER_SEC == 0 && periodNs / NSEC_PER_SEC <= INT16_MAX)
+    {
+        *fact = (int16_t)-(periodNs / NSEC_PER_SEC);
+        *mult = 1;
+        return 0;
+    }
+
+    // Nominal periods are whole nanoseconds, so 600 Hz comes in as
+    // 1666666 ns; a relative tolerance of 1e-5 takes that back to 600.
+    double rate = 1e9 / (double)periodNs;
+    for(int m = 1; m <= 1024 && rate * m <= INT16_MAX; m++)
+    {
+        double f = rate * m;
+        if(fabs(f - round(f)) <= 1e-5 * f)
+        {
+            *fact = (int16_t)round(f);
+            *mult = (int16_t)((m == 1) ? 1 : -m);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+//---------------------------------------------------------------
+// mseed_band(int64_t periodNs)
+// SEED band code for the sample rate, as for a long-period sensor.
+//---------------------------------------------------------------
+static char mseed_band(int64_t periodNs)
+{
+    double rate = 1e9 / (double)periodNs;
+
+    if(rate >= 1000.0)
+    {
+        return 'F';
+    }
+    if(rate >= 250.0)
+    {
+        return 'C';
+    }
+    if(rate >= 80.0)
+    {
+        return 'H';
+    }
+    if(rate >= 10.0)
+    {
+        return 'B';
+    }
+    if(rate > 1.0)
+    {
+        return 'M';
+    }
+    if(rate >= 0.5)
+    {
+        return 'L';
+    }
+    return (rate >= 0.05) ? 'V' : 'U';
+}
+
+//---------------------------------------------------------------
+// mseed_open(outputProduct *op, const char *stationCode,
+//            int64_t periodNs)
+//
+// Sets op up to write miniSEED to op->fp, one sample every periodNs.
+// The station defaults to stationCode, then "XXX"; the channels to the
+// band code of the rate, F for magnetometer, and X, Y and Z.  Returns
+// 0, or -1 if op cannot: averaged records have no counts, and the rate
+// must be one SEED can express.
+//---------------------------------------------------------------
+int mseed_open(outputProduct *op, const char *stationCode, int64_t periodNs)
+{
+    struct tag_mseedState *s;
+    int16_t fact, mult;
+
+    if(op->reduce == PRODUCT_AVERAGE)
+    {
+        fprintf(OUTPUT_ERROR, "Product '%s': miniSEED carries raw counts, which averaged records do not have\n",
+                op->name);
+        return -1;
+    }
+    if(periodNs <= 0 || mseed_rate(periodNs, &fact, &mult) != 0)
+    {
+        fprintf(OUTPUT_ERROR, "Product '%s': miniSEED cannot express a sample period of %lld ns\n",
+                op->name, (long long)periodNs);
+        return -1;
+    }
+    s = calloc(1, sizeof *s);
+    if(!s)
+    {
+        fprintf(OUTPUT_ERROR, "Product '%s': out of memory for miniSEED records\n", op->name);
+        return -1;
+    }
+    s->recLen   = op->mseedRecLen ? op->mseedRecLen : MSEED_RECORD_MAX;
+    s->nFrames  = (s->recLen - MSEED_DATA_OFFSET) / MSEED_FRAME;
+    s->rateFact = fact;
+    s->rateMult = mult;
+    s->periodNs = periodNs;
+    snprintf(s->net, sizeof s->net, "%s", op->mseedNet[0] ? op->mseedNet : "XX");
+    snprintf(s->loc, sizeof s->loc, "%s", op->mseedLoc);
+    if(op->mseedSta[0])
+    {
+        snprintf(s->sta, sizeof s->sta, "%s", op->mseedSta);
+    }
+    else if(!stationCode || mseed_setCode(s->sta, sizeof s->sta, stationCode) != 0 || !s->sta[0])
+    {
+        snprintf(s->sta, sizeof s->sta, "XXX");
+    }
+    for(int k = 0; k < 3; k++)
+    {
+        if(op->mseedChan[k][0])
+        {
+            snprintf(s->chan[k], sizeof s->chan[k], "%s", op->mseedChan[k]);
+        }
+        else
+        {
+            snprintf(s->chan[k], sizeof s->chan[k], "%cF%c", mseed_band(periodNs), "XYZ"[k]);
+        }
+    }
+    op->mseed = s;
+    return 0;
+}
+
+//---------------------------------------------------------------
+// mseed_record(struct tag_mseedState *s, outputProduct *op, int k)
+//
+// Writes channel k's record, if it has any samples, and empties it.
+// Returns 0, or -1 on a write error.
+//---------------------------------------------------------------
+static int mseed_record(struct tag_mseedState *s, outputProduct *op, int k)
+{
+    mseedChannel *c = &s->ch[k];
+    uint8_t      *h = c->rec;
+    char          id[21];
+    struct tm     tm;
+
+    if(c->nSamples == 0)
+    {
+        return 0;
+    }
+    s->seqNo = (s->seqNo % 999999) + 1;
+
+    // The start time to the nearest 100 us, and the rest in us.
+    int64_t t100 = mseed_floor(c->startNs + 50000, 100000);
+    time_t  sec  = (time_t)mseed_floor(t100, 10000);
+    gmtime_r(&sec, &tm);
+
+    snprintf(id, sizeof id, "%06uD %-5.5s%-2.2s%-3.3s%-2.2s", s->seqNo, s->sta, s->loc, s->chan[k], s->net);
+    memcpy(h, id, 20);
+    put_be16(h + 20, (uint16_t)(tm.tm_year + 1900));
+    put_be16(h + 22, (uint16_t)(tm.tm_yday + 1));
+    h[24] = (uint8_t)tm.tm_hour;
+    h[25] = (uint8_t)tm.tm_min;
+    h[26] = (uint8_t)tm.tm_sec;
+    h[27] = 0;
+    put_be16(h + 28, (uint16_t)(t100 - (int64_t)sec * 10000));
+    put_be16(h + 30, (uint16_t)c->nSamples);
+    put_be16(h + 32, (uint16_t)s->rateFact);
+    put_be16(h + 34, (uint16_t)s->rateMult);
+    h[36] = 0x02;                               // time correction applied: the start time is final
+    h[37] = (c->tq >= MSEED_TQ_GNSS) ? 0x20 : 0;    // clock locked
+    h[38] = (c->tq == 0) ? 0x80 : 0;            // time tag questionable
+    h[39] = 2;                                  // blockettes
+    put_be32(h + 40, 0);                        // time correction
+    put_be16(h + 44, MSEED_DATA_OFFSET);
+    put_be16(h + 46, 48);
+
+    put_be16(h + 48, 1000);
+    put_be16(h + 50, 56);
+    h[52] = 11;                                 // Steim-2
+    h[53] = 1;                                  // big-endian
+    h[54] = (uint8_t)((s->recLen == MSEED_RECORD_MIN) ? 9 : 12);
+    h[55] = 0;
+
+    put_be16(h + 56, 1001);
+    put_be16(h + 58, 0);
+    h[60] = c->tq;
+    h[61] = (uint8_t)(int8_t)((c->startNs - t100 * 100000) / 1000);
+    h[62] = 0;
+    h[63] = (uint8_t)(c->frame + (c->word > 1));
+
+    put_be32(h + MSEED_DATA_OFFSET + 8, (uint32_t)c->last);        // reverse integration constant
+    c->nSamples = 0;
+    return (fwrite(c->rec, 1, s->recLen, op->fp) == (size_t)s->recLen) ? 0 : -1;
+}
+
+//---------------------------------------------------------------
+// mseed_pack(struct tag_mseedState *s, outputProduct *op, int k)
+//
+// Packs channel k's pending differences into one word, as many as the
+// widest packing they fit takes, writing the record out if that was
+// its last word.  Returns 0, or -1 on a write error.
+//---------------------------------------------------------------
+static int mseed_pack(struct tag_mseedState *s, outputProduct *op, int k)
+{
+    mseedChannel *c = &s->ch[k];
+    uint32_t      w = 0;
+    int           t;
+
+    for(t = 0; t < (int)(sizeof steim2 / sizeof steim2[0]) - 1; t++)
+    {
+        int32_t lim = 1 << (steim2[t].bits - 1);
+        int     i   = 0;
+
+        if(steim2[t].n > c->nPend)
+        {
+            continue;
+        }
+        while(i < steim2[t].n && c->diff[i] >= -lim && c->diff[i] < lim)
+        {
+            i++;
+        }
+        if(i == steim2[t].n)
+        {
+            break;
+        }
+    }
+    for(int i = 0; i < steim2[t].n; i++)
+    {
+        w |= ((uint32_t)c->diff[i] & ((1u << steim2[t].bits) - 1)) << ((steim2[t].n - 1 - i) * steim2[t].bits);
+    }
+    if(steim2[t].nib != 1)
+    {
+        w |= steim2[t].dnib << 30;
+    }
+
+    if(c->nSamples == 0)
+    {
+        memset(c->rec, 0, s->recLen);
+        c->frame   = 0;
+        c->word    = 3;                 // after the integration constants
+        c->startNs = c->pendNs[0];
+        c->tq      = c->pendTq[0];
+        put_be32(c->rec + MSEED_DATA_OFFSET + 4, (uint32_t)c->pend[0]);     // forward integration constant
+    }
+    uint8_t *f = c->rec + MSEED_DATA_OFFSET + c->frame * MSEED_FRAME;
+    put_be32(f + c->word * 4, w);
+    f[c->word / 4] |= (uint8_t)(steim2[t].nib << (6 - 2 * (c->word % 4)));
+
+    c->nSamples += steim2[t].n;
+    c->last      = c->pend[steim2[t].n - 1];
+    c->nPend    -= steim2[t].n;
+    memmove(c->pend, c->pend + steim2[t].n, c->nPend * sizeof c->pend[0]);
+    memmove(c->diff, c->diff + steim2[t].n, c->nPend * sizeof c->diff[0]);
+    memmove(c->pendNs, c->pendNs + steim2[t].n, c->nPend * sizeof c->pendNs[0]);
+    memmove(c->pendTq, c->pendTq + steim2[t].n, c->nPend * sizeof c->pendTq[0]);
+
+    if(++c->word == MSEED_WORDS)
+    {
+        c->word = 1;
+        if(++c->frame == s->nFrames)
+        {
+            return mseed_record(s, op, k);
+        }
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// mseed_flush(struct tag_mseedState *s, outputProduct *op)
+//
+// Packs what is pending and writes every open record: the end of a
+// contiguous run.  Returns 0, or -1 on a write error.
+//---------------------------------------------------------------
+static int mseed_flush(struct tag_mseedState *s, outputProduct *op)
+{
+    int rc = 0;
+
+    for(int k = 0; k < 3; k++)
+    {
+        while(s->ch[k].nPend > 0)
+        {
+            rc |= mseed_pack(s, op, k);
+        }
+        rc |= mseed_record(s, op, k);
+    }
+    s->contiguous = FALSE;
+    return rc;
+}
+
+//---------------------------------------------------------------
+// mseed_write(outputProduct *op, const magRecord *r)
+//
+// Adds the primary sensor's counts of r to the three channels.
+// Returns 0, or -1 if r has no valid counts or a record could not be
+// written.
+//---------------------------------------------------------------
+int mseed_write(outputProduct *op, const magRecord *r)
+{
+    struct tag_mseedState *s = op->mseed;
+    int     rc = 0;
+    uint8_t tq = 0;
+
+    if(!s || !op->fp)
+    {
+        return -1;
+    }
+    if(!(r->validMask & 1u))
+    {
+        if(s->contiguous)
+        {
+            mseed_flush(s, op);
+        }
+        return -1;
+    }
+
+    if(s->contiguous)
+    {
+        int64_t off = r->tNs - s->nextNs;
+        int     gap = r->clockStepNs != 0 || off > s->periodNs / 2 || off < -s->periodNs / 2;
+
+        for(int k = 0; k < 3 && !gap; k++)
+        {
+            int64_t d = (int64_t)r->xyz[0][k] - s->prev[k];
+            gap = (d >= MSEED_DIFF_LIMIT || d < -MSEED_DIFF_LIMIT);
+        }
+        if(gap)
+        {
+            rc = mseed_flush(s, op);
+        }
+    }
+
+    if(r->ppsValid)
+    {
+        tq = MSEED_TQ_PPS;
+    }
+    else if(r->gnssValid)
+    {
+        tq = MSEED_TQ_GNSS;
+    }
+    else if(r->clock.valid && r->clock.sync)
+    {
+        tq = MSEED_TQ_SYNC;
+    }
+
+    for(int k = 0; k < 3; k++)
+    {
+        mseedChannel *c = &s->ch[k];
+
+        // The first difference of a run is 0; readers start a record
+        // from its forward integration constant anyway.
+        c->pend[c->nPend]   = r->xyz[0][k];
+        c->diff[c->nPend]   = s->contiguous ? r->xyz[0][k] - s->prev[k] : 0;
+        c->pendNs[c->nPend] = r->tNs;
+        c->pendTq[c->nPend] = tq;
+        s->prev[k] = r->xyz[0][k];
+        if(++c->nPend == MSEED_PENDING)
+        {
+            rc |= mseed_pack(s, op, k);
+        }
+    }
+    s->contiguous = TRUE;
+    s->nextNs     = r->tNs + s->periodNs;
+    return rc;
+}
+
+//---------------------------------------------------------------
+// mseed_close(outputProduct *op)
+//
+// Writes the open records, partly filled as they are, and frees the
+// state.  Returns 0, or -1 on a write error.
+//---------------------------------------------------------------
+int mseed_close(outputProduct *op)
+{
+    int rc = 0;
+
+    if(op->mseed)
+    {
+        if(op->fp)
+        {
+            rc = mseed_flush(op->mseed, op);
+        }
+        free(op->mseed);
+        op->mseed = NULL;
+    }
+    return rc;
+}
@@ -0,0 +1,28 @@
+//=========================================================================
+// mseed.h
+//
+// miniSEED 2 records of raw counts, Steim-2 compressed, for archiving
+// full-rate data with seismic tools.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_MSEED_H
+#define MAG_USB_MSEED_H
+
+#include <stdint.h>
+#include "main.h"
+
+#define MSEED_RECORD_MIN    512
+#define MSEED_RECORD_MAX    4096
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int  mseed_setCode(char *dst, size_t size, const char *value);
+int  mseed_setChannels(char chan[3][4], const char *list);
+int  mseed_open(outputProduct *op, const char *stationCode, int64_t periodNs);
+int  mseed_write(outputProduct *op, const magRecord *r);
+int  mseed_close(outputProduct *op);
+
+#endif // MAG_USB_MSEED_H
@@ -0,0 +1,471 @@
+//=========================================================================
+// pps.c
+//
+// Pulse-per-second sources for disciplined sampling.
+//
+// A PPS source marks the true start of every UTC second far more
+// closely than NTP can set the host clock.  Three sources share one
+// small interface (ppsSource):
+//
+//   kernel  the Linux PPS API on /dev/ppsN; the edge is stamped in
+//           the kernel's interrupt handler (PPS_FETCH, the ioctl
+//           behind time_pps_fetch());
+//   dcd     the DCD line of a GNSS receiver's serial port, waited
+//           for with TIOCMIWAIT and stamped when the wait returns;
+//   sim     an edge at every whole host second plus sim_offset_us,
+//           standing in for a receiver in tests.
+//
+// A thread waits on the source and publishes the latest edge.  The
+// POLL loop waits for the edge due at each tick and triggers on it;
+// pps_discipline() then restamps the sample on CLOCK_REALTIME from
+// the edge: the edge is taken to be the whole second nearest the
+// host's reading of it, and every stamp is placed by its distance
+// from the edge on CLOCK_MONOTONIC.  Host clock errors up to half a
+// second drop out.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <linux/pps.h>
+#include <sys/ioctl.h>
+#include "main.h"
+#include "pps.h"
+#include "timeutil.h"
+#include "rt.h"
+#include "halt.h"
+
+#define PPS_STOP_RETRY_NS   (10 * NSEC_PER_MSEC)
+
+static ppsSource       ppsSrc;
+static pthread_t       ppsThread;
+static int             ppsRunning = FALSE;
+static volatile int    ppsStop    = FALSE;
+static pthread_mutex_t ppsLock    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  ppsCond;
+static ppsEdge         ppsLast;             // seq 0: no edge yet
+static uint64_t        ppsConsumed;
+
+//---------------------------------------------------------------
+// pps_edgeAt(ppsEdge *e, int64_t realNs)
+// Fills e for an edge the host clock read as realNs.
+//---------------------------------------------------------------
+static void pps_edgeAt(ppsEdge *e, int64_t realNs)
+{
+    int64_t nowReal, nowMono;
+
+    clock_pair_ns(&nowReal, &nowMono);
+    e->realNs = realNs;
+    e->monoNs = nowMono - (nowReal - realNs);
+}
+
+//---------------------------------------------------------------
+// Kernel PPS API
+//---------------------------------------------------------------
+static int pps_kernelOpen(ppsSource *src, const char *device)
+{
+    int caps = 0;
+    struct pps_kparams params;
+
+    src->fd = open(device, O_RDWR | O_CLOEXEC);
+    if(src->fd < 0)
+    {
+        fprintf(OUTPUT_ERROR, "Unable to open PPS device %s: %s\n", device, strerror(errno));
+        return -1;
+    }
+    if(ioctl(src->fd, PPS_GETCAP, &caps) < 0 || !(caps & PPS_CAPTUREASSERT))
+    {
+        fprintf(OUTPUT_ERROR, "%s does not capture PPS assert edges\n", device);
+        close(src->fd);
+        src->fd = -1;
+        return -1;
+    }
+    if(ioctl(src->fd, PPS_GETPARAMS, &params) == 0)
+    {
+        params.mode |= PPS_CAPTUREASSERT | PPS_TSFMT_TSPEC;
+        if(ioctl(src->fd, PPS_SETPARAMS, &params) < 0)
+        {
+            fprintf(OUTPUT_ERROR, "Unable to enable assert capture on %s: %s\n", device, strerror(errno));
+        }
+    }
+    return 0;
+}
+
+static int pps_kernelWait(ppsSource *src, ppsEdge *e)
+{
+    struct pps_fdata fdata;
+
+    memset(&fdata, 0, sizeof fdata);
+    fdata.timeout.sec   = (int64_t)PPS_TIMEOUTSECS;
+    fdata.timeout.flags = 0;
+    if(ioctl(src->fd, PPS_FETCH, &fdata) < 0)
+    {
+        return -1;
+    }
+    if(fdata.info.assert_sequence == src->seq)
+    {
+        return -1;
+    }
+    src->seq = fdata.info.assert_sequence;
+    pps_edgeAt(e, fdata.info.assert_tu.sec * NSEC_PER_SEC + fdata.info.assert_tu.nsec);
+    return 0;
+}
+
+//---------------------------------------------------------------
+// Serial DCD
+//---------------------------------------------------------------
+static int pps_dcdOpen(ppsSource *src, const char *device)
+{
+    src->fd = open(device, O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(src->fd < 0)
+    {
+        fprintf(OUTPUT_ERROR, "Unable to open PPS serial port %s: %s\n", device, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int pps_dcdWait(ppsSource *src, ppsEdge *e)
+{
+    for(;;)
+    {
+        int64_t real, mono;
+        int lines = 0;
+
+        if(ioctl(src->fd, TIOCMIWAIT, TIOCM_CD) < 0)
+        {
+            return -1;
+        }
+        clock_pair_ns(&real, &mono);
+        if(ioctl(src->fd, TIOCMGET, &lines) < 0)
+        {
+            return -1;
+        }
+        if(lines & TIOCM_CD)
+        {
+            src->seq++;
+            e->realNs = real;
+            e->monoNs = mono;
+            return 0;
+        }
+    }
+}
+
+//---------------------------------------------------------------
+// Simulated
+//---------------------------------------------------------------
+static int pps_simOpen(ppsSource *src, const char *device)
+{
+    (void)device;
+    src->fd = -1;
+    return 0;
+}
+
+static int pps_simWait(ppsSource *src, ppsEdge *e)
+{
+    int64_t now  = clock_ns(CLOCK_REALTIME);
+    int64_t next = ((now - src->simOffsetNs) / NSEC_PER_SEC + 1) * NSEC_PER_SEC + src->simOffsetNs;
+    struct timespec ts = { (time_t)(next / NSEC_PER_SEC), (long)(next % NSEC_PER_SEC) };
+
+    if(clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL) != 0)
+    {
+        return -1;
+    }
+    src->seq++;
+    pps_edgeAt(e, next);
+    return 0;
+}
+
+static void pps_fdClose(ppsSource *src)
+{
+    if(src->fd >= 0)
+    {
+        close(src->fd);
+        src->fd = -1;
+    }
+}
+
+//---------------------------------------------------------------
+// pps_parseSource(const char *name)
+// Returns PPS_SRC_*, or -1 for an unknown name.
+//---------------------------------------------------------------
+int pps_parseSource(const char *name)
+{
+    if(strcmp(name, "none") == 0)   return PPS_SRC_NONE;
+    if(strcmp(name, "kernel") == 0) return PPS_SRC_KERNEL;
+    if(strcmp(name, "dcd") == 0)    return PPS_SRC_DCD;
+    if(strcmp(name, "sim") == 0)    return PPS_SRC_SIM;
+    return -1;
+}
+
+//---------------------------------------------------------------
+// pps_sourceName(int source)
+//---------------------------------------------------------------
+const char *pps_sourceName(int source)
+{
+    static const char *names[] = { "none", "kernel", "dcd", "sim" };
+    return (source >= PPS_SRC_NONE && source <= PPS_SRC_SIM) ? names[source] : "?";
+}
+
+//---------------------------------------------------------------
+// pps_wake(int sig)
+// Only there to interrupt a blocking wait at shutdown.
+//---------------------------------------------------------------
+static void pps_wake(int sig)
+{
+    (void)sig;
+}
+
+//---------------------------------------------------------------
+// pps_thread(void *arg)
+//---------------------------------------------------------------
+static void *pps_thread(void *arg)
+{
+    pList *p = (pList *)arg;
+    ppsEdge e;
+
+    rt_thread(p, RT_THREAD_PPS);
+
+    while(!ppsStop)
+    {
+        if(ppsSrc.wait(&ppsSrc, &e) < 0)
+        {
+            if(errno != EINTR && errno != ETIMEDOUT && !ppsStop)
+            {
+                // A source that fails outright must not spin.
+                usleep(100000);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&ppsLock);
+        e.seq   = ppsLast.seq + 1;
+        ppsLast = e;
+        pthread_cond_broadcast(&ppsCond);
+        pthread_mutex_unlock(&ppsLock);
+        atomic_fetch_add(&p->ppsEdges, 1);
+    }
+    return NULL;
+}
+
+//---------------------------------------------------------------
+// pps_init(pList *p)
+//
+// Opens the configured source and starts its thread.  Without a
+// working source acquisition runs on the host clock alone.  Must be
+// called after the main thread has blocked the shutdown signals, so
+// the PPS thread inherits the mask.
+//---------------------------------------------------------------
+int pps_init(pList *p)
+{
+    pthread_condattr_t ca;
+    struct sigaction sa;
+
+    atomic_init(&p->ppsEdges, 0);
+    p->ppsMisses = 0;
+    if(p->ppsSource == PPS_SRC_NONE)
+    {
+        return 0;
+    }
+
+    memset(&ppsSrc, 0, sizeof ppsSrc);
+    ppsSrc.fd          = -1;
+    ppsSrc.close       = pps_fdClose;
+    ppsSrc.simOffsetNs = (int64_t)p->ppsSimOffsetUs * NSEC_PER_USEC;
+    switch(p->ppsSource)
+    {
+        case PPS_SRC_KERNEL:
+            ppsSrc.open = pps_kernelOpen;
+            ppsSrc.wait = pps_kernelWait;
+            break;
+        case PPS_SRC_DCD:
+            ppsSrc.open = pps_dcdOpen;
+            ppsSrc.wait = pps_dcdWait;
+            break;
+        default:
+            ppsSrc.open = pps_simOpen;
+            ppsSrc.wait = pps_simWait;
+            break;
+    }
+    ppsSrc.name = pps_sourceName(p->ppsSource);
+    if(p->ppsSource != PPS_SRC_SIM && p->ppsDevice == NULL)
+    {
+        fprintf(OUTPUT_ERROR, "PPS source %s needs a device; sampling on the host clock\n", ppsSrc.name);
+        p->ppsSource = PPS_SRC_NONE;
+        return -1;
+    }
+    if(ppsSrc.open(&ppsSrc, p->ppsDevice) < 0)
+    {
+        fprintf(OUTPUT_ERROR, "No PPS; sampling on the host clock\n");
+        p->ppsSource = PPS_SRC_NONE;
+        return -1;
+    }
+    if(p->pollPipeline && p->pollPeriodNs % NSEC_PER_SEC == 0)
+    {
+        fprintf(OUTPUT_ERROR, "PPS triggers every conversion on the edge; poll_pipeline is off\n");
+        p->pollPipeline = FALSE;
+    }
+
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = pps_wake;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&ppsCond, &ca);
+    pthread_condattr_destroy(&ca);
+    memset(&ppsLast, 0, sizeof ppsLast);
+    ppsConsumed = 0;
+    ppsStop     = FALSE;
+    if(pthread_create(&ppsThread, NULL, pps_thread, p) != 0)
+    {
+        perror("pthread_create pps");
+        ppsSrc.close(&ppsSrc);
+        p->ppsSource = PPS_SRC_NONE;
+        return -1;
+    }
+    ppsRunning = TRUE;
+    return 0;
+}
+
+//---------------------------------------------------------------
+// pps_waitEdge(pList *p, int64_t sinceMonoNs, int64_t untilMonoNs,
+//              ppsEdge *e)
+//
+// Waits until CLOCK_MONOTONIC untilMonoNs for an edge at or after
+// sinceMonoNs that has not been returned before.  Returns TRUE with
+// the edge in e.  A stop request (see pps_interrupt()) ends the wait
+// early.
+//---------------------------------------------------------------
+int pps_waitEdge(pList *p, int64_t sinceMonoNs, int64_t untilMonoNs, ppsEdge *e)
+{
+    struct timespec until = { (time_t)(untilMonoNs / NSEC_PER_SEC), (long)(untilMonoNs % NSEC_PER_SEC) };
+    int got = FALSE;
+
+    if(!ppsRunning || p->ppsSource == PPS_SRC_NONE)
+    {
+        return FALSE;
+    }
+    pthread_mutex_lock(&ppsLock);
+    for(;;)
+    {
+        if(ppsLast.seq != ppsConsumed && ppsLast.monoNs >= sinceMonoNs)
+        {
+            *e = ppsLast;
+            ppsConsumed = ppsLast.seq;
+            got = TRUE;
+            break;
+        }
+        if(halt_pending())
+        {
+            break;
+        }
+        if(pthread_cond_timedwait(&ppsCond, &ppsLock, &until) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ppsLock);
+    return got;
+}
+
+//---------------------------------------------------------------
+// pps_latest(pList *p, int64_t sinceMonoNs, ppsEdge *e)
+// The last edge, if there is one at or after sinceMonoNs.
+//---------------------------------------------------------------
+int pps_latest(pList *p, int64_t sinceMonoNs, ppsEdge *e)
+{
+    int got;
+
+    if(!ppsRunning || p->ppsSource == PPS_SRC_NONE)
+    {
+        return FALSE;
+    }
+    pthread_mutex_lock(&ppsLock);
+    got = (ppsLast.seq != 0 && ppsLast.monoNs >= sinceMonoNs);
+    if(got)
+    {
+        *e = ppsLast;
+    }
+    pthread_mutex_unlock(&ppsLock);
+    return got;
+}
+
+//---------------------------------------------------------------
+// pps_discipline(const ppsEdge *e, magSample *s)
+//
+// Restamps the realtime side of every bracket in s from the edge and
+// records the primary trigger's offset from it.
+//---------------------------------------------------------------
+void pps_discipline(const ppsEdge *e, magSample *s)
+{
+    int64_t second = (e->realNs + NSEC_PER_SEC / 2) / NSEC_PER_SEC * NSEC_PER_SEC;
+    int first = TRUE;
+
+    for(int i = 0; i < s->numMags; i++)
+    {
+        if(!(s->validMask & (1u << i)))
+        {
+            continue;
+        }
+        magStamp *st = &s->stamps[i];
+        st->trigRealNs = second + (st->trigMonoNs - e->monoNs);
+        st->drdyRealNs = second + (st->drdyMonoNs - e->monoNs);
+        if(first)
+        {
+            s->ppsValid    = TRUE;
+            s->ppsOffsetNs = st->trigMonoNs - e->monoNs;
+            first = FALSE;
+        }
+    }
+}
+
+//---------------------------------------------------------------
+// pps_interrupt()
+// Wakes a pps_waitEdge() in progress so it sees the stop request.
+//---------------------------------------------------------------
+void pps_interrupt(void)
+{
+    if(!ppsRunning)
+    {
+        return;
+    }
+    pthread_mutex_lock(&ppsLock);
+    pthread_cond_broadcast(&ppsCond);
+    pthread_mutex_unlock(&ppsLock);
+}
+
+//---------------------------------------------------------------
+// pps_close(pList *p)
+//
+// SIGUSR1 cuts the source's wait short, but one that lands after the
+// thread checked ppsStop and before it blocked again is lost, and a
+// TIOCMIWAIT with no DCD edges coming never returns.  So the signal
+// is sent again every PPS_STOP_RETRY_NS until the thread is gone.
+//---------------------------------------------------------------
+void pps_close(pList *p)
+{
+    (void)p;
+    if(!ppsRunning)
+    {
+        return;
+    }
+    ppsStop = TRUE;
+    for(;;)
+    {
+        int64_t until = clock_ns(CLOCK_REALTIME) + PPS_STOP_RETRY_NS;
+        struct timespec ts = { (time_t)(until / NSEC_PER_SEC), (long)(until % NSEC_PER_SEC) };
+
+        pthread_kill(ppsThread, SIGUSR1);
+        if(pthread_timedjoin_np(ppsThread, NULL, &ts) != ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    ppsSrc.close(&ppsSrc);
+    pthread_cond_destroy(&ppsCond);
+    ppsRunning = FALSE;
+}
@@ -0,0 +1,60 @@
+//=========================================================================
+// pps.h
+//
+// Pulse-per-second sources for disciplined sampling.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_PPS_H
+#define MAG_USB_PPS_H
+
+#include "main.h"
+
+#define PPS_SRC_NONE        0
+#define PPS_SRC_KERNEL      1       // Linux PPS API, /dev/ppsN
+#define PPS_SRC_DCD         2       // DCD line of a serial port
+#define PPS_SRC_SIM         3       // whole host seconds, for tests
+
+// How long before a sample the edge it is restamped from may be.
+#define PPS_LOOKBACK_NS     (2 * NSEC_PER_SEC)
+
+//------------------------------------------
+// One PPS edge, on both clocks.  realNs is the host's reading of the
+// edge, so it is only trusted to the nearest second.
+//------------------------------------------
+typedef struct
+{
+    uint64_t seq;
+    int64_t  realNs;
+    int64_t  monoNs;
+} ppsEdge;
+
+//------------------------------------------
+// A PPS source.  wait() blocks until the next edge and returns 0, or
+// returns -1 on a timeout, an error or an interrupting signal.
+//------------------------------------------
+typedef struct tag_ppsSource
+{
+    const char *name;
+    int  (*open)(struct tag_ppsSource *src, const char *device);
+    int  (*wait)(struct tag_ppsSource *src, ppsEdge *e);
+    void (*close)(struct tag_ppsSource *src);
+    int      fd;
+    uint64_t seq;
+    int64_t  simOffsetNs;
+} ppsSource;
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int         pps_parseSource(const char *name);
+const char *pps_sourceName(int source);
+int         pps_init(pList *p);
+int         pps_waitEdge(pList *p, int64_t sinceMonoNs, int64_t untilMonoNs, ppsEdge *e);
+int         pps_latest(pList *p, int64_t sinceMonoNs, ppsEdge *e);
+void        pps_discipline(const ppsEdge *e, magSample *s);
+void        pps_interrupt(void);
+void        pps_close(pList *p);
+
+#endif // MAG_USB_PPS_H
@@ -0,0 +1,653 @@
+//=========================================================================
+// products.c
+//
+// Output products: several record streams derived from the one
+// acquisition stream, each with its own period, reduction, format and
+// sinks.
+//
+// Acquisition and count conversion happen once per sample; every
+// product sees the same converted record and either passes it on,
+// keeps the first one of each period, or averages the period into a
+// single record.  Periods are aligned to the UTC epoch, so a 60 s
+// product closes on whole minutes.  All of this runs on the output
+// thread.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <errno.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <linux/limits.h>
+#include "main.h"
+#include "products.h"
+#include "acquire.h"
+#include "timeutil.h"
+#include "trace.h"
+#include "recfmt.h"
+#include "recenc.h"
+#include "iaga.h"
+#include "mseed.h"
+#include "magdata.h"
+#ifdef USE_WEBSOCKET
+#include "ws_bridge.h"
+#endif
+
+static const char *sinkNames[SINK_COUNT] = { "console", "pipe", "websocket", "file" };
+static const char *formatNames[PRODUCT_FMT_COUNT] = { "json", "binary", "cbor", "msgpack", "iaga2002", "mseed" };
+
+//---------------------------------------------------------------
+// product_sinkName(int sink)
+//---------------------------------------------------------------
+const char *product_sinkName(int sink)
+{
+    return (sink >= 0 && sink < SINK_COUNT) ? sinkNames[sink] : "?";
+}
+
+//---------------------------------------------------------------
+// product_formatName(int format)
+//---------------------------------------------------------------
+const char *product_formatName(int format)
+{
+    return (format >= 0 && format < PRODUCT_FMT_COUNT) ? formatNames[format] : "?";
+}
+
+//---------------------------------------------------------------
+// product_parseFormat(const char *name)
+// PRODUCT_FMT_* for a configured name, or -1.
+//---------------------------------------------------------------
+int product_parseFormat(const char *name)
+{
+    for(int k = 0; k < PRODUCT_FMT_COUNT; k++)
+    {
+        if(strcmp(name, formatNames[k]) == 0)
+        {
+            return k;
+        }
+    }
+    return -1;
+}
+
+//---------------------------------------------------------------
+// product_setPerSink(const char *key, const char *option, int value,
+//                    int *perSink, unsigned *setMask)
+//
+// option itself sets every sink not named on its own; "<sink>_<option>"
+// sets that sink, whatever the order of the keys.  Returns -1 if key
+// is neither.
+//---------------------------------------------------------------
+static int product_setPerSink(const char *key, const char *option, int value, int *perSink, unsigned *setMask)
+{
+    if(strcmp(key, option) == 0)
+    {
+        for(int k = 0; k < SINK_COUNT; k++)
+        {
+            if(!(*setMask & (1u << k)))
+            {
+                perSink[k] = value;
+            }
+        }
+        return 0;
+    }
+    for(int k = 0; k < SINK_COUNT; k++)
+    {
+        size_t n = strlen(sinkNames[k]);
+        if(strncmp(key, sinkNames[k], n) == 0 && key[n] == '_' && strcmp(key + n + 1, option) == 0)
+        {
+            perSink[k] = value;
+            *setMask  |= 1u << k;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+//---------------------------------------------------------------
+// product_setTimestamp(outputProduct *op, const char *key, int format)
+// "timestamp" or "<sink>_timestamp"; -1 for an unknown sink.
+//---------------------------------------------------------------
+int product_setTimestamp(outputProduct *op, const char *key, int format)
+{
+    return product_setPerSink(key, "timestamp", format, op->tsFormat, &op->tsSetMask);
+}
+
+//---------------------------------------------------------------
+// product_setFormat(outputProduct *op, const char *key, int format)
+// "format" or "<sink>_format"; -1 for an unknown sink.
+//---------------------------------------------------------------
+int product_setFormat(outputProduct *op, const char *key, int format)
+{
+    return product_setPerSink(key, "format", format, op->format, &op->formatSetMask);
+}
+
+//---------------------------------------------------------------
+// product_lookup(pList *p, const char *name)
+//
+// Returns the product called name, adding it with no sinks if it is
+// new, or NULL if MAX_PRODUCTS are already configured.
+//---------------------------------------------------------------
+outputProduct *product_lookup(pList *p, const char *name)
+{
+    for(int i = 0; i < p->numProducts; i++)
+    {
+        if(strcmp(p->products[i].name, name) == 0)
+        {
+            return &p->products[i];
+        }
+    }
+    if(p->numProducts >= MAX_PRODUCTS)
+    {
+        return NULL;
+    }
+    outputProduct *op = &p->products[p->numProducts++];
+    memset(op, 0, sizeof *op);
+    snprintf(op->name, sizeof op->name, "%s", name);
+    op->reduce = PRODUCT_SAMPLE;
+    op->floatBits = 64;
+    return op;
+}
+
+//---------------------------------------------------------------
+// product_parseSinks(const char *list, unsigned *mask)
+//
+// "console,pipe", "file websocket" or a TOML array of the same.
+// Returns 0, or -1 on an unknown sink name with *mask unchanged.
+//---------------------------------------------------------------
+int product_parseSinks(const char *list, unsigned *mask)
+{
+    unsigned m = 0;
+    const char *c = list;
+
+    while(*c)
+    {
+        while(*c == ' ' || *c == ',' || *c == '[' || *c == ']' || *c == '"' || *c == '\t')
+        {
+            c++;
+        }
+        if(!*c)
+        {
+            break;
+        }
+        size_t n = 0;
+        while(c[n] && c[n] != ' ' && c[n] != ',' && c[n] != ']' && c[n] != '"' && c[n] != '\t')
+        {
+            n++;
+        }
+        int sink = -1;
+        for(int i = 0; i < SINK_COUNT; i++)
+        {
+            if(strlen(sinkNames[i]) == n && strncmp(c, sinkNames[i], n) == 0)
+            {
+                sink = i;
+            }
+        }
+        if(sink < 0)
+        {
+            return -1;
+        }
+        m |= 1u << sink;
+        c += n;
+    }
+    *mask = m;
+    return 0;
+}
+
+//---------------------------------------------------------------
+// product_openFile(pList *p, outputProduct *op)
+//
+// Relative paths are taken from [output].log_output_path.
+//---------------------------------------------------------------
+static int product_openFile(pList *p, outputProduct *op)
+{
+    char path[PATH_MAX];
+
+    if(!op->filePath || !*op->filePath)
+    {
+        fprintf(OUTPUT_ERROR, "Product '%s': file sink without a file path\n", op->name);
+        return -1;
+    }
+    if(op->filePath[0] != '/' && p->log_output_path && *p->log_output_path)
+    {
+        if(p->create_log_path_if_empty && mkdir(p->log_output_path, 0755) < 0 && errno != EEXIST)
+        {
+            fprintf(OUTPUT_ERROR, "Unable to create %s: %s\n", p->log_output_path, strerror(errno));
+        }
+        snprintf(path, sizeof path, "%s/%s", p->log_output_path, op->filePath);
+    }
+    else
+    {
+        snprintf(path, sizeof path, "%s", op->filePath);
+    }
+    op->fp = fopen(path, (op->format[SINK_FILE] == PRODUCT_FMT_JSON) ? "a" : "ab");
+    if(!op->fp)
+    {
+        fprintf(OUTPUT_ERROR, "Product '%s': unable to open %s: %s\n", op->name, path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// product_sampleNs(pList *p)
+// Nominal time between acquired samples.
+//---------------------------------------------------------------
+static int64_t product_sampleNs(pList *p)
+{
+    return (p->samplingMode == CMM) ? getCMMPeriodNs(p) : p->pollPeriodNs;
+}
+
+//---------------------------------------------------------------
+// products_init(pList *p)
+//
+// Without any [product.*] section the output is what it has always
+// been: every sample as JSON to the console, pipe and WebSocket.
+// A console given binary records is dropped with a warning, as is any
+// other sink given IAGA-2002 or miniSEED, and a file sink whose file
+// will not open.  IAGA-2002 files are opened as records for their day
+// arrive.
+//---------------------------------------------------------------
+int products_init(pList *p)
+{
+    if(p->numProducts == 0)
+    {
+        outputProduct *op = product_lookup(p, "default");
+        op->sinkMask = (1u << SINK_CONSOLE) | (1u << SINK_PIPE) | (1u << SINK_WEBSOCKET);
+    }
+    for(int i = 0; i < p->numProducts; i++)
+    {
+        outputProduct *op = &p->products[i];
+        if(op->format[SINK_CONSOLE] != PRODUCT_FMT_JSON && (op->sinkMask & (1u << SINK_CONSOLE)))
+        {
+            fprintf(OUTPUT_ERROR, "Product '%s': %s records cannot go to the console\n", op->name,
+                    product_formatName(op->format[SINK_CONSOLE]));
+            op->sinkMask &= ~(1u << SINK_CONSOLE);
+        }
+        for(int k = 0; k < SINK_COUNT; k++)
+        {
+            if(k != SINK_FILE && (op->format[k] == PRODUCT_FMT_IAGA2002 || op->format[k] == PRODUCT_FMT_MSEED) &&
+               (op->sinkMask & (1u << k)))
+            {
+                fprintf(OUTPUT_ERROR, "Product '%s': %s records go to the file sink only, not %s\n",
+                        op->name, product_formatName(op->format[k]), sinkNames[k]);
+                op->sinkMask &= ~(1u << k);
+            }
+        }
+        if(op->format[SINK_FILE] == PRODUCT_FMT_IAGA2002)
+        {
+            if((op->sinkMask & (1u << SINK_FILE)) && iaga_check(p, op, product_sampleNs(p)) != 0)
+            {
+                op->sinkMask &= ~(1u << SINK_FILE);
+            }
+        }
+        else if((op->sinkMask & (1u << SINK_FILE)) && product_openFile(p, op) != 0)
+        {
+            op->sinkMask &= ~(1u << SINK_FILE);
+        }
+        if(op->format[SINK_FILE] == PRODUCT_FMT_MSEED && (op->sinkMask & (1u << SINK_FILE)))
+        {
+            if(mseed_open(op, p->station_code, op->periodNs ? op->periodNs : product_sampleNs(p)) != 0)
+            {
+                fclose(op->fp);
+                op->fp = NULL;
+                op->sinkMask &= ~(1u << SINK_FILE);
+            }
+        }
+        if(!op->sinkMask)
+        {
+            fprintf(OUTPUT_ERROR, "Product '%s' has no usable sink\n", op->name);
+        }
+        op->count = 0;
+        for(int k = 0; k < SINK_COUNT; k++)
+        {
+            atomic_init(&op->sinks[k].delivered, 0);
+            atomic_init(&op->sinks[k].dropped, 0);
+            atomic_init(&op->sinks[k].lastSeq, 0);
+        }
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// sinkDelivered() / sinkDropped()
+//---------------------------------------------------------------
+static void sinkDelivered(outputProduct *op, int sink, uint64_t seq)
+{
+    atomic_fetch_add(&op->sinks[sink].delivered, 1);
+    atomic_store(&op->sinks[sink].lastSeq, seq);
+}
+
+static void sinkDropped(outputProduct *op, int sink)
+{
+    atomic_fetch_add(&op->sinks[sink].dropped, 1);
+}
+
+//---------------------------------------------------------------
+// product_encode(const pList *p, const outputProduct *op,
+//                const magRecord *r, int sink, char *buf, int *held,
+//                size_t len)
+//
+// Length of the record for sink in buf, encoding it again only if buf
+// holds another format or timestamp rendering than the sink's.  *held
+// identifies what buf holds, -1 for nothing yet.
+//---------------------------------------------------------------
+static size_t product_encode(const pList *p, const outputProduct *op, const magRecord *r, int sink,
+                             char *buf, int *held, size_t len)
+{
+    int format = op->format[sink];
+    int want   = (format == PRODUCT_FMT_JSON) ? op->tsFormat[sink] : FMT_TS_COUNT + format;
+
+    if(want == *held)
+    {
+        return len;
+    }
+    *held = want;
+    switch(format)
+    {
+        case PRODUCT_FMT_BINARY:
+            return fmt_binary(r, (uint8_t *)buf);
+        case PRODUCT_FMT_CBOR:
+            return enc_record(p, r, ENC_CBOR, op->floatBits, (uint8_t *)buf, FMT_RECORD_MAX);
+        case PRODUCT_FMT_MSGPACK:
+            return enc_record(p, r, ENC_MSGPACK, op->floatBits, (uint8_t *)buf, FMT_RECORD_MAX);
+        case PRODUCT_FMT_IAGA2002:
+        case PRODUCT_FMT_MSEED:
+            return 0;                   // written by iaga_write() and mseed_write()
+        default:
+            return fmt_record(p, r, op->tsFormat[sink], buf, FMT_RECORD_MAX);
+    }
+}
+
+//---------------------------------------------------------------
+// product_publish(pList *p, outputProduct *op, const magRecord *r)
+//
+// Formats one record and hands it to each of the product's sinks,
+// recording per sink whether it got through and how long it took.
+// The record is encoded once, and again only for a sink that wants a
+// different format or timestamp rendering.
+//---------------------------------------------------------------
+static void product_publish(pList *p, outputProduct *op, const magRecord *r)
+{
+    char data[FMT_RECORD_MAX];
+    size_t len = 0;
+    int held = -1;
+    int first = 0;
+    int64_t t = trc_now();
+
+    while(first < SINK_COUNT - 1 && !(op->sinkMask & (1u << first)))
+    {
+        first++;
+    }
+    len = product_encode(p, op, r, first, data, &held, len);
+    t = trc_lap(TRC_FORMAT, t);
+
+#if(CONSOLE_OUTPUT)
+    if(op->sinkMask & (1u << SINK_CONSOLE))
+    {
+        len = product_encode(p, op, r, SINK_CONSOLE, data, &held, len);
+        if(fprintf(OUTPUT_PRINT, " %s", data) < 0 || fflush(OUTPUT_PRINT) != 0)
+        {
+            sinkDropped(op, SINK_CONSOLE);
+        }
+        else
+        {
+            sinkDelivered(op, SINK_CONSOLE, r->seq);
+        }
+        t = trc_lap(TRC_CONSOLE, t);
+    }
+#endif
+    if((op->sinkMask & (1u << SINK_PIPE)) && p->usePipes && p->pipeOutFd >= 0)
+    {
+        // Records are shorter than PIPE_BUF, so a write is all or
+        // nothing; EAGAIN means the reader is not keeping up.
+        len = product_encode(p, op, r, SINK_PIPE, data, &held, len);
+        if(write(p->pipeOutFd, data, len) == (ssize_t)len)
+        {
+            sinkDelivered(op, SINK_PIPE, r->seq);
+        }
+        else
+        {
+            sinkDropped(op, SINK_PIPE);
+        }
+        t = trc_lap(TRC_PIPE, t);
+    }
+#ifdef USE_WEBSOCKET
+    if((op->sinkMask & (1u << SINK_WEBSOCKET)) && p->useWebSocket)
+    {
+        int failed = 0;
+        len = product_encode(p, op, r, SINK_WEBSOCKET, data, &held, len);
+        int sent = (op->format[SINK_WEBSOCKET] == PRODUCT_FMT_JSON) ? ws_server_broadcast(data, len, &failed)
+                                                                    : ws_server_broadcast_binary(data, len, &failed);
+        if(sent > 0)
+        {
+            sinkDelivered(op, SINK_WEBSOCKET, r->seq);
+        }
+        if(failed > 0)
+        {
+            sinkDropped(op, SINK_WEBSOCKET);
+        }
+        t = trc_lap(TRC_WEBSOCKET, t);
+    }
+#endif
+    if((op->sinkMask & (1u << SINK_FILE)) && (op->fp || op->format[SINK_FILE] == PRODUCT_FMT_IAGA2002))
+    {
+        int written;
+
+        // Buffered; products_flush() pushes it out once the queue is
+        // drained.
+        if(op->format[SINK_FILE] == PRODUCT_FMT_IAGA2002)
+        {
+            written = (iaga_write(p, op, r) == 0);
+        }
+        else if(op->format[SINK_FILE] == PRODUCT_FMT_MSEED)
+        {
+            written = (mseed_write(op, r) == 0);
+        }
+        else
+        {
+            len = product_encode(p, op, r, SINK_FILE, data, &held, len);
+            written = (fwrite(data, 1, len, op->fp) == len);
+        }
+        if(written)
+        {
+            sinkDelivered(op, SINK_FILE, r->seq);
+        }
+        else
+        {
+            sinkDropped(op, SINK_FILE);
+        }
+        trc_lap(TRC_FILE, t);
+    }
+}
+
+//---------------------------------------------------------------
+// product_record(const pList *p, const magSample *s, magRecord *r)
+//
+// Converts a raw sample once for all products and the trigger engine.  The record takes
+// the acquisition instant of the primary sensor, or of the first
+// sensor read if the primary missed this cycle.
+//---------------------------------------------------------------
+void product_record(const pList *p, const magSample *s, magRecord *r)
+{
+    r->seq         = s->seq;
+    r->count       = 1;
+    r->averaged    = FALSE;
+    r->numMags     = s->numMags;
+    r->validMask   = s->validMask;
+    r->tempValid   = s->tempValid;
+    r->tempCelsius = s->tempCelsius;
+    r->tempAge     = s->tempAge;
+    r->tNs         = 0;
+    r->tUncNs      = -1;
+    r->ppsValid    = s->ppsValid;
+    r->ppsOffsetNs = s->ppsOffsetNs;
+    r->gnssValid   = s->gnssValid;
+    r->gnssHostNs  = s->gnssHostNs;
+    r->clockStepNs = s->clockStepNs;
+    r->clock       = s->clock;
+    for(int k = 0; k < 3; k++)
+    {
+        r->cc[k]   = s->cc[k];
+        r->gain[k] = s->gain[k];
+    }
+    for(int i = 0; i < s->numMags; i++)
+    {
+        countsToNT(p, s->gain, s->xyz[i], r->nT[i]);
+        memcpy(r->xyz[i], s->xyz[i], sizeof r->xyz[i]);
+    }
+    for(int i = 0; i < s->numMags; i++)
+    {
+        if(acq_sampleInstant(s, i, &r->tNs, NULL, &r->tUncNs))
+        {
+            return;
+        }
+    }
+    r->tNs    = clock_ns(CLOCK_REALTIME);
+    r->tUncNs = -1;
+}
+
+//---------------------------------------------------------------
+// product_emitMean(pList *p, outputProduct *op)
+//
+// Closes the open averaging period.  The mean is stamped with the
+// start of its period and carries the seq of its first sample and
+// the number of samples averaged.
+//---------------------------------------------------------------
+static void product_emitMean(pList *p, outputProduct *op)
+{
+    magRecord m = op->acc;
+
+    m.seq       = op->firstSeq;
+    m.count     = op->count;
+    m.averaged  = TRUE;
+    m.tNs       = op->bin * op->periodNs;
+    m.tUncNs    = -1;
+    m.clockStepNs = op->clockStepNs;
+    m.validMask = 0;
+    for(int i = 0; i < m.numMags; i++)
+    {
+        if(op->magCount[i])
+        {
+            m.validMask |= 1u << i;
+            for(int k = 0; k < 3; k++)
+            {
+                m.nT[i][k] = op->sum[i][k] / op->magCount[i];
+            }
+        }
+    }
+    op->count = 0;
+    op->clockStepNs = 0;
+    product_publish(p, op, &m);
+}
+
+//---------------------------------------------------------------
+// product_feed(pList *p, outputProduct *op, const magRecord *r)
+//---------------------------------------------------------------
+static void product_feed(pList *p, outputProduct *op, const magRecord *r)
+{
+    if(op->periodNs <= 0)
+    {
+        product_publish(p, op, r);
+        return;
+    }
+
+    // Floor division, so periods stay aligned before the epoch too.
+    int64_t bin = r->tNs / op->periodNs;
+    if(r->tNs < 0 && r->tNs % op->periodNs)
+    {
+        bin--;
+    }
+
+    if(op->reduce == PRODUCT_SAMPLE)
+    {
+        // A step between written records goes out on the next one.
+        op->clockStepNs += r->clockStepNs;
+        if(op->count == 0 || bin != op->bin)
+        {
+            magRecord m = *r;
+
+            m.clockStepNs   = op->clockStepNs;
+            op->clockStepNs = 0;
+            op->bin   = bin;
+            op->count = 1;
+            product_publish(p, op, &m);
+        }
+        return;
+    }
+
+    if(op->count > 0 && bin != op->bin)
+    {
+        product_emitMean(p, op);
+    }
+    op->clockStepNs += r->clockStepNs;
+    if(op->count == 0)
+    {
+        op->bin      = bin;
+        op->firstSeq = r->seq;
+        memset(op->magCount, 0, sizeof op->magCount);
+        memset(op->sum, 0, sizeof op->sum);
+    }
+    for(int i = 0; i < r->numMags; i++)
+    {
+        if(r->validMask & (1u << i))
+        {
+            op->magCount[i]++;
+            op->sum[i][0] += r->nT[i][0];
+            op->sum[i][1] += r->nT[i][1];
+            op->sum[i][2] += r->nT[i][2];
+        }
+    }
+    op->acc = *r;
+    op->count++;
+}
+
+//---------------------------------------------------------------
+// products_feed(pList *p, const magRecord *r)
+//---------------------------------------------------------------
+void products_feed(pList *p, const magRecord *r)
+{
+    for(int i = 0; i < p->numProducts; i++)
+    {
+        product_feed(p, &p->products[i], r);
+    }
+}
+
+//---------------------------------------------------------------
+// products_flush(pList *p)
+//---------------------------------------------------------------
+void products_flush(pList *p)
+{
+    int64_t t = trc_now();
+    int files = 0;
+
+    for(int i = 0; i < p->numProducts; i++)
+    {
+        if(p->products[i].fp)
+        {
+            fflush(p->products[i].fp);
+            files++;
+        }
+    }
+    if(files)
+    {
+        trc_lap(TRC_FLUSH, t);
+    }
+}
+
+//---------------------------------------------------------------
+// products_close(pList *p)
+//
+// A partly filled averaging period is discarded, not written out as
+// if it were complete; partly filled miniSEED records are written.
+//---------------------------------------------------------------
+void products_close(pList *p)
+{
+    for(int i = 0; i < p->numProducts; i++)
+    {
+        mseed_close(&p->products[i]);
+        if(p->products[i].fp)
+        {
+            fclose(p->products[i].fp);
+            p->products[i].fp = NULL;
+        }
+    }
+}
@@ -0,0 +1,32 @@
+//=========================================================================
+// products.h
+//
+// Output products: several record streams derived from the one
+// acquisition stream, each with its own period, reduction, format and
+// sinks.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_PRODUCTS_H
+#define MAG_USB_PRODUCTS_H
+
+#include "main.h"
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+outputProduct *product_lookup(pList *p, const char *name);
+int         product_parseSinks(const char *list, unsigned *mask);
+const char *product_sinkName(int sink);
+const char *product_formatName(int format);
+int         product_parseFormat(const char *name);
+int         product_setTimestamp(outputProduct *op, const char *key, int format);
+int         product_setFormat(outputProduct *op, const char *key, int format);
+int         products_init(pList *p);
+void        product_record(const pList *p, const magSample *s, magRecord *r);
+void        products_feed(pList *p, const magRecord *r);
+void        products_flush(pList *p);
+void        products_close(pList *p);
+
+#endif // MAG_USB_PRODUCTS_H
@@ -0,0 +1,223 @@
+//=========================================================================
+// reactor.c
+//
+// Single-threaded epoll event loop.
+//
+// Everything the output side waits on is an fd: the sample ring's
+// eventfd, the shutdown eventfd, a signalfd, the control FIFO and
+// timerfds for periodic work.  One epoll set watches them all and
+// calls each fd's handler when it is ready, so adding an I/O channel
+// means registering one more fd rather than another thread or another
+// poll timeout.  Handlers run to completion and must not block; the
+// bus, with its synchronous adapter transactions and tick deadlines,
+// stays on the acquisition thread.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "main.h"
+#include "reactor.h"
+#include "timeutil.h"
+
+//---------------------------------------------------------------
+// rx_init(reactor *rx)
+//---------------------------------------------------------------
+int rx_init(reactor *rx)
+{
+    rx->running = FALSE;
+    for(int i = 0; i < RX_MAX_WATCHES; i++)
+    {
+        rx->watches[i].fd = -1;
+    }
+    rx->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(rx->epfd < 0)
+    {
+        perror("epoll_create1");
+        return -1;
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// rx_slot(reactor *rx, int fd)
+// Index of the watch for fd, or -1.
+//---------------------------------------------------------------
+static int rx_slot(reactor *rx, int fd)
+{
+    for(int i = 0; i < RX_MAX_WATCHES; i++)
+    {
+        if(rx->watches[i].fd == fd)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//---------------------------------------------------------------
+// rx_watch(reactor *rx, int fd, uint32_t events, int timer,
+//          rxHandler fn, void *ctx)
+//---------------------------------------------------------------
+static int rx_watch(reactor *rx, int fd, uint32_t events, int timer, rxHandler fn, void *ctx)
+{
+    struct epoll_event ev;
+    int i = rx_slot(rx, -1);
+
+    if(fd < 0 || i < 0)
+    {
+        return -1;
+    }
+    rx->watches[i].fd    = fd;
+    rx->watches[i].timer = timer;
+    rx->watches[i].fn    = fn;
+    rx->watches[i].ctx   = ctx;
+    ev.events   = events;
+    ev.data.ptr = &rx->watches[i];
+    if(epoll_ctl(rx->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        perror("epoll_ctl");
+        rx->watches[i].fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// rx_add(reactor *rx, int fd, uint32_t events, rxHandler fn,
+//        void *ctx)
+//
+// Level-triggered, so a handler that leaves data unread is called
+// again on the next pass.  Returns 0, or -1 if fd is invalid or the
+// table is full.
+//---------------------------------------------------------------
+int rx_add(reactor *rx, int fd, uint32_t events, rxHandler fn, void *ctx)
+{
+    return rx_watch(rx, fd, events, FALSE, fn, ctx);
+}
+
+//---------------------------------------------------------------
+// rx_addTimer(reactor *rx, int64_t periodNs, rxHandler fn, void *ctx)
+//
+// A periodic CLOCK_MONOTONIC timer, first due one period from now.
+// Returns its fd (closed by rx_remove() or rx_close()), or -1.
+//---------------------------------------------------------------
+int rx_addTimer(reactor *rx, int64_t periodNs, rxHandler fn, void *ctx)
+{
+    struct itimerspec its;
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+    if(fd < 0)
+    {
+        perror("timerfd_create (reactor)");
+        return -1;
+    }
+    its.it_interval.tv_sec  = (time_t)(periodNs / NSEC_PER_SEC);
+    its.it_interval.tv_nsec = (long)(periodNs % NSEC_PER_SEC);
+    its.it_value = its.it_interval;
+    if(timerfd_settime(fd, 0, &its, NULL) < 0 || rx_watch(rx, fd, EPOLLIN, TRUE, fn, ctx) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//---------------------------------------------------------------
+// rx_remove(reactor *rx, int fd)
+//---------------------------------------------------------------
+int rx_remove(reactor *rx, int fd)
+{
+    int i = rx_slot(rx, fd);
+
+    if(fd < 0 || i < 0)
+    {
+        return -1;
+    }
+    epoll_ctl(rx->epfd, EPOLL_CTL_DEL, fd, NULL);
+    if(rx->watches[i].timer)
+    {
+        close(fd);
+    }
+    rx->watches[i].fd = -1;
+    return 0;
+}
+
+//---------------------------------------------------------------
+// rx_run(reactor *rx)
+//
+// Dispatches until rx_stop() is called from a handler.  Returns 0,
+// or -1 if epoll_wait() fails.
+//---------------------------------------------------------------
+int rx_run(reactor *rx)
+{
+    struct epoll_event ev[RX_MAX_WATCHES];
+
+    rx->running = TRUE;
+    while(rx->running)
+    {
+        int n = epoll_wait(rx->epfd, ev, RX_MAX_WATCHES, -1);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            return -1;
+        }
+        for(int i = 0; i < n && rx->running; i++)
+        {
+            rxWatch *w = ev[i].data.ptr;
+            if(w->fd < 0)
+            {
+                continue;       // removed by an earlier handler in this batch
+            }
+            if(w->timer)
+            {
+                uint64_t expired;
+                if(read(w->fd, &expired, sizeof expired) != (ssize_t)sizeof expired)
+                {
+                    continue;
+                }
+            }
+            w->fn(w->ctx, ev[i].events);
+        }
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// rx_stop(reactor *rx)
+// Ends rx_run() after the current handler.
+//---------------------------------------------------------------
+void rx_stop(reactor *rx)
+{
+    rx->running = FALSE;
+}
+
+//---------------------------------------------------------------
+// rx_close(reactor *rx)
+// Closes the epoll set and the reactor's timers; other fds belong to
+// whoever registered them.
+//---------------------------------------------------------------
+void rx_close(reactor *rx)
+{
+    for(int i = 0; i < RX_MAX_WATCHES; i++)
+    {
+        if(rx->watches[i].fd >= 0 && rx->watches[i].timer)
+        {
+            close(rx->watches[i].fd);
+        }
+        rx->watches[i].fd = -1;
+    }
+    if(rx->epfd >= 0)
+    {
+        close(rx->epfd);
+        rx->epfd = -1;
+    }
+}
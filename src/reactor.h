@@ -0,0 +1,49 @@
+//=========================================================================
+// reactor.h
+//
+// Single-threaded epoll event loop.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_REACTOR_H
+#define MAG_USB_REACTOR_H
+
+#include <stdint.h>
+
+#define RX_MAX_WATCHES      32
+
+//------------------------------------------
+// A handler runs on the reactor thread with the epoll events of its
+// fd; it must not block.  For a timer the expirations have already
+// been read.
+//------------------------------------------
+typedef void (*rxHandler)(void *ctx, uint32_t events);
+
+typedef struct
+{
+    int       fd;                   // -1 = free slot
+    int       timer;                // fd is a timerfd owned by the reactor
+    rxHandler fn;
+    void     *ctx;
+} rxWatch;
+
+typedef struct
+{
+    int      epfd;
+    int      running;
+    rxWatch  watches[RX_MAX_WATCHES];
+} reactor;
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int  rx_init(reactor *rx);
+int  rx_add(reactor *rx, int fd, uint32_t events, rxHandler fn, void *ctx);
+int  rx_addTimer(reactor *rx, int64_t periodNs, rxHandler fn, void *ctx);
+int  rx_remove(reactor *rx, int fd);
+int  rx_run(reactor *rx);
+void rx_stop(reactor *rx);
+void rx_close(reactor *rx);
+
+#endif // MAG_USB_REACTOR_H
@@ -0,0 +1,450 @@
+//=========================================================================
+// recenc.c
+//
+// CBOR (RFC 8949) and MessagePack encodings of the JSON record, for
+// consumers that want self-describing data without parsing text.
+//
+// Both encoders write straight into the caller's buffer in one pass,
+// with no intermediate tree.  The map carries the same keys as the
+// JSON line, in the same order; the keys are stored already encoded,
+// text-string header included, and copied in whole.  Values are the
+// unrounded doubles, as float64 or, to save space, float32.  "ts" is
+// the full-precision instant: CBOR tag 1 (epoch seconds, as float64)
+// or the MessagePack timestamp extension (-1).  Records are written
+// back to back, which both formats delimit on their own.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <math.h>
+#include "main.h"
+#include "recenc.h"
+#include "pps.h"
+#include "timeutil.h"
+
+typedef struct
+{
+    const char *cbor;
+    const char *msgpack;
+    size_t      len;                    // header byte and text
+} encKey;
+
+// Separate literals, so the text cannot run on into the hex escape.
+#define ENC_KEY(c, m, s)    { c s, m s, sizeof(s) }
+
+enum
+{
+    K_TS, K_SEQ, K_TNS, K_TUNC, K_N, K_RT, K_RTAGE, K_X, K_Y, K_Z, K_PPS, K_GNSS, K_STEP,
+    K_CLOCK, K_SYNC, K_EST, K_MAX, K_CC, K_GAIN, K_MAGS, K_GRAD
+};
+
+static const encKey encKeys[] =
+{
+    [K_TS]    = ENC_KEY("\x62", "\xa2", "ts"),
+    [K_SEQ]   = ENC_KEY("\x63", "\xa3", "seq"),
+    [K_TNS]   = ENC_KEY("\x64", "\xa4", "t_ns"),
+    [K_TUNC]  = ENC_KEY("\x68", "\xa8", "t_unc_ns"),
+    [K_N]     = ENC_KEY("\x61", "\xa1", "n"),
+    [K_RT]    = ENC_KEY("\x62", "\xa2", "rt"),
+    [K_RTAGE] = ENC_KEY("\x66", "\xa6", "rt_age"),
+    [K_X]     = ENC_KEY("\x61", "\xa1", "x"),
+    [K_Y]     = ENC_KEY("\x61", "\xa1", "y"),
+    [K_Z]     = ENC_KEY("\x61", "\xa1", "z"),
+    [K_PPS]   = ENC_KEY("\x6d", "\xad", "pps_offset_ns"),
+    [K_GNSS]  = ENC_KEY("\x6c", "\xac", "gnss_host_ns"),
+    [K_STEP]  = ENC_KEY("\x6d", "\xad", "clock_step_ns"),
+    [K_CLOCK] = ENC_KEY("\x65", "\xa5", "clock"),
+    [K_SYNC]  = ENC_KEY("\x64", "\xa4", "sync"),
+    [K_EST]   = ENC_KEY("\x66", "\xa6", "est_us"),
+    [K_MAX]   = ENC_KEY("\x66", "\xa6", "max_us"),
+    [K_CC]    = ENC_KEY("\x62", "\xa2", "cc"),
+    [K_GAIN]  = ENC_KEY("\x64", "\xa4", "gain"),
+    [K_MAGS]  = ENC_KEY("\x64", "\xa4", "mags"),
+    [K_GRAD]  = ENC_KEY("\x64", "\xa4", "grad"),
+};
+
+//---------------------------------------------------------------
+// put_be(uint8_t *o, uint64_t v, int n)
+// The low n bytes of v, big-endian as both formats want them.
+//---------------------------------------------------------------
+static uint8_t *put_be(uint8_t *o, uint64_t v, int n)
+{
+    for(int i = n - 1; i >= 0; i--)
+    {
+        o[i] = (uint8_t)v;
+        v >>= 8;
+    }
+    return o + n;
+}
+
+//---------------------------------------------------------------
+// cbor_head(uint8_t *o, unsigned major, uint64_t v)
+// CBOR initial byte for major type and argument v, in the shortest form.
+//---------------------------------------------------------------
+static uint8_t *cbor_head(uint8_t *o, unsigned major, uint64_t v)
+{
+    major <<= 5;
+    if(v < 24)
+    {
+        *o++ = (uint8_t)(major | v);
+    }
+    else if(v <= 0xFF)
+    {
+        *o++ = (uint8_t)(major | 24);
+        *o++ = (uint8_t)v;
+    }
+    else if(v <= 0xFFFF)
+    {
+        *o++ = (uint8_t)(major | 25);
+        o = put_be(o, v, 2);
+    }
+    else if(v <= 0xFFFFFFFFu)
+    {
+        *o++ = (uint8_t)(major | 26);
+        o = put_be(o, v, 4);
+    }
+    else
+    {
+        *o++ = (uint8_t)(major | 27);
+        o = put_be(o, v, 8);
+    }
+    return o;
+}
+
+//---------------------------------------------------------------
+// enc_uint() / enc_int()
+// Integers in the shortest form each format has.
+//---------------------------------------------------------------
+static uint8_t *enc_uint(int kind, uint8_t *o, uint64_t v)
+{
+    if(kind == ENC_CBOR)
+    {
+        return cbor_head(o, 0, v);
+    }
+    if(v < 128)
+    {
+        *o++ = (uint8_t)v;
+    }
+    else if(v <= 0xFF)
+    {
+        *o++ = 0xcc;
+        *o++ = (uint8_t)v;
+    }
+    else if(v <= 0xFFFF)
+    {
+        *o++ = 0xcd;
+        o = put_be(o, v, 2);
+    }
+    else if(v <= 0xFFFFFFFFu)
+    {
+        *o++ = 0xce;
+        o = put_be(o, v, 4);
+    }
+    else
+    {
+        *o++ = 0xcf;
+        o = put_be(o, v, 8);
+    }
+    return o;
+}
+
+static uint8_t *enc_int(int kind, uint8_t *o, int64_t v)
+{
+    if(v >= 0)
+    {
+        return enc_uint(kind, o, (uint64_t)v);
+    }
+    if(kind == ENC_CBOR)
+    {
+        return cbor_head(o, 1, (uint64_t)(-1 - v));
+    }
+    if(v >= -32)
+    {
+        *o++ = (uint8_t)v;
+    }
+    else if(v >= INT8_MIN)
+    {
+        *o++ = 0xd0;
+        *o++ = (uint8_t)v;
+    }
+    else if(v >= INT16_MIN)
+    {
+        *o++ = 0xd1;
+        o = put_be(o, (uint64_t)v, 2);
+    }
+    else if(v >= INT32_MIN)
+    {
+        *o++ = 0xd2;
+        o = put_be(o, (uint64_t)v, 4);
+    }
+    else
+    {
+        *o++ = 0xd3;
+        o = put_be(o, (uint64_t)v, 8);
+    }
+    return o;
+}
+
+//---------------------------------------------------------------
+// enc_null() / enc_bool()
+//---------------------------------------------------------------
+static uint8_t *enc_null(int kind, uint8_t *o)
+{
+    *o++ = (kind == ENC_CBOR) ? 0xf6 : 0xc0;
+    return o;
+}
+
+static uint8_t *enc_bool(int kind, uint8_t *o, int v)
+{
+    if(kind == ENC_CBOR)
+    {
+        *o++ = v ? 0xf5 : 0xf4;
+    }
+    else
+    {
+        *o++ = v ? 0xc3 : 0xc2;
+    }
+    return o;
+}
+
+//---------------------------------------------------------------
+// enc_float(int kind, uint8_t *o, double v, int floatBits)
+// v as float32 or float64; null, as in the JSON, if not finite.
+//---------------------------------------------------------------
+static uint8_t *enc_float(int kind, uint8_t *o, double v, int floatBits)
+{
+    if(!isfinite(v))
+    {
+        return enc_null(kind, o);
+    }
+    if(floatBits == 32)
+    {
+        float    f = (float)v;
+        uint32_t bits;
+
+        memcpy(&bits, &f, sizeof bits);
+        *o++ = (kind == ENC_CBOR) ? 0xfa : 0xca;
+        return put_be(o, bits, 4);
+    }
+
+    uint64_t bits;
+
+    memcpy(&bits, &v, sizeof bits);
+    *o++ = (kind == ENC_CBOR) ? 0xfb : 0xcb;
+    return put_be(o, bits, 8);
+}
+
+//---------------------------------------------------------------
+// enc_map() / enc_array()
+// Definite-length headers for n pairs or n items.
+//---------------------------------------------------------------
+static uint8_t *enc_map(int kind, uint8_t *o, unsigned n)
+{
+    if(kind == ENC_CBOR)
+    {
+        return cbor_head(o, 5, n);
+    }
+    if(n < 16)
+    {
+        *o++ = (uint8_t)(0x80 | n);
+        return o;
+    }
+    *o++ = 0xde;
+    return put_be(o, n, 2);
+}
+
+static uint8_t *enc_array(int kind, uint8_t *o, unsigned n)
+{
+    if(kind == ENC_CBOR)
+    {
+        return cbor_head(o, 4, n);
+    }
+    if(n < 16)
+    {
+        *o++ = (uint8_t)(0x90 | n);
+        return o;
+    }
+    *o++ = 0xdc;
+    return put_be(o, n, 2);
+}
+
+//---------------------------------------------------------------
+// enc_key(int kind, uint8_t *o, int key)
+//---------------------------------------------------------------
+static uint8_t *enc_key(int kind, uint8_t *o, int key)
+{
+    const encKey *k = &encKeys[key];
+
+    memcpy(o, (kind == ENC_CBOR) ? k->cbor : k->msgpack, k->len);
+    return o + k->len;
+}
+
+//---------------------------------------------------------------
+// enc_time(int kind, uint8_t *o, int64_t tNs)
+//
+// CBOR: tag 1 on float64 epoch seconds, good to a quarter of a
+// microsecond today.  MessagePack: timestamp 64 (30-bit ns, 34-bit
+// seconds), or timestamp 96 outside 1970-2514.
+//---------------------------------------------------------------
+static uint8_t *enc_time(int kind, uint8_t *o, int64_t tNs)
+{
+    if(kind == ENC_CBOR)
+    {
+        *o++ = 0xc1;
+        return enc_float(kind, o, (double)tNs / 1e9, 64);
+    }
+
+    int64_t sec = tNs / NSEC_PER_SEC;
+    int64_t ns  = tNs % NSEC_PER_SEC;
+    if(ns < 0)
+    {
+        ns += NSEC_PER_SEC;
+        sec--;
+    }
+    if(sec >= 0 && (sec >> 34) == 0)
+    {
+        *o++ = 0xd7;
+        *o++ = 0xff;
+        return put_be(o, ((uint64_t)ns << 34) | (uint64_t)sec, 8);
+    }
+    *o++ = 0xc7;
+    *o++ = 12;
+    *o++ = 0xff;
+    o = put_be(o, (uint64_t)ns, 4);
+    return put_be(o, (uint64_t)sec, 8);
+}
+
+//---------------------------------------------------------------
+// enc_vector(int kind, uint8_t *o, double x, double y, double z,
+//            int floatBits)
+//---------------------------------------------------------------
+static uint8_t *enc_vector(int kind, uint8_t *o, double x, double y, double z, int floatBits)
+{
+    o = enc_array(kind, o, 3);
+    o = enc_float(kind, o, x, floatBits);
+    o = enc_float(kind, o, y, floatBits);
+    return enc_float(kind, o, z, floatBits);
+}
+
+//---------------------------------------------------------------
+// enc_record(const pList *p, const magRecord *r, int kind,
+//            int floatBits, uint8_t *buf, size_t len)
+//
+// One record as a CBOR or MessagePack map (kind ENC_*) with the keys
+// and presence rules of fmt_record().  Returns its length, or 0 if buf
+// is shorter than ENC_RECORD_MAX.
+//---------------------------------------------------------------
+size_t enc_record(const pList *p, const magRecord *r, int kind, int floatBits, uint8_t *buf, size_t len)
+{
+    uint8_t *o = buf;
+    int tempOk = r->tempValid && r->tempCelsius >= -100.0;
+
+    if(len < ENC_RECORD_MAX)
+    {
+        return 0;
+    }
+
+    unsigned pairs = 9;
+    pairs += r->averaged ? 1 : 0;
+    pairs += (p->ppsSource != PPS_SRC_NONE) ? 1 : 0;
+    pairs += p->gnssDevice ? 1 : 0;
+    pairs += (r->clockStepNs != 0) ? 1 : 0;
+    pairs += p->cqAnnotate ? 1 : 0;
+    pairs += p->arEnable ? 2 : 0;
+    pairs += (r->numMags > 1) ? 2 : 0;
+    o = enc_map(kind, o, pairs);
+
+    o = enc_key(kind, o, K_TS);
+    o = enc_time(kind, o, r->tNs);
+    o = enc_key(kind, o, K_SEQ);
+    o = enc_uint(kind, o, r->seq);
+    o = enc_key(kind, o, K_TNS);
+    o = enc_int(kind, o, r->tNs);
+    o = enc_key(kind, o, K_TUNC);
+    o = enc_int(kind, o, r->tUncNs);
+    if(r->averaged)
+    {
+        o = enc_key(kind, o, K_N);
+        o = enc_uint(kind, o, r->count);
+    }
+    o = enc_key(kind, o, K_RT);
+    o = enc_float(kind, o, tempOk ? r->tempCelsius : 0.0, floatBits);
+    o = enc_key(kind, o, K_RTAGE);
+    o = enc_float(kind, o, tempOk ? r->tempAge : -1.0, floatBits);
+    o = enc_key(kind, o, K_X);
+    o = enc_float(kind, o, r->nT[0][0], floatBits);
+    o = enc_key(kind, o, K_Y);
+    o = enc_float(kind, o, r->nT[0][1], floatBits);
+    o = enc_key(kind, o, K_Z);
+    o = enc_float(kind, o, r->nT[0][2], floatBits);
+
+    if(p->ppsSource != PPS_SRC_NONE)
+    {
+        o = enc_key(kind, o, K_PPS);
+        o = r->ppsValid ? enc_int(kind, o, r->ppsOffsetNs) : enc_null(kind, o);
+    }
+    if(p->gnssDevice)
+    {
+        o = enc_key(kind, o, K_GNSS);
+        o = r->gnssValid ? enc_int(kind, o, r->gnssHostNs) : enc_null(kind, o);
+    }
+    if(r->clockStepNs != 0)
+    {
+        o = enc_key(kind, o, K_STEP);
+        o = enc_int(kind, o, r->clockStepNs);
+    }
+    if(p->cqAnnotate)
+    {
+        o = enc_key(kind, o, K_CLOCK);
+        if(r->clock.valid)
+        {
+            o = enc_map(kind, o, 3);
+            o = enc_key(kind, o, K_SYNC);
+            o = enc_bool(kind, o, r->clock.sync);
+            o = enc_key(kind, o, K_EST);
+            o = enc_uint(kind, o, r->clock.estUs);
+            o = enc_key(kind, o, K_MAX);
+            o = enc_uint(kind, o, r->clock.maxUs);
+        }
+        else
+        {
+            o = enc_null(kind, o);
+        }
+    }
+    if(p->arEnable)
+    {
+        o = enc_key(kind, o, K_CC);
+        o = enc_array(kind, o, 3);
+        for(int k = 0; k < 3; k++)
+        {
+            o = enc_int(kind, o, r->cc[k]);
+        }
+        o = enc_key(kind, o, K_GAIN);
+        o = enc_array(kind, o, 3);
+        for(int k = 0; k < 3; k++)
+        {
+            o = enc_int(kind, o, r->gain[k]);
+        }
+    }
+    if(r->numMags > 1)
+    {
+        const double (*v)[3] = r->nT;
+
+        o = enc_key(kind, o, K_MAGS);
+        o = enc_array(kind, o, (unsigned)r->numMags);
+        for(int i = 0; i < r->numMags; i++)
+        {
+            o = (r->validMask & (1u << i)) ? enc_vector(kind, o, v[i][0], v[i][1], v[i][2], floatBits)
+                                           : enc_null(kind, o);
+        }
+        o = enc_key(kind, o, K_GRAD);
+        o = enc_array(kind, o, (unsigned)(r->numMags - 1));
+        for(int i = 1; i < r->numMags; i++)
+        {
+            o = ((r->validMask & 1u) && (r->validMask & (1u << i)))
+                ? enc_vector(kind, o, v[i][0] - v[0][0], v[i][1] - v[0][1], v[i][2] - v[0][2], floatBits)
+                : enc_null(kind, o);
+        }
+    }
+    return (size_t)(o - buf);
+}
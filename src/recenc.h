@@ -0,0 +1,27 @@
+//=========================================================================
+// recenc.h
+//
+// CBOR (RFC 8949) and MessagePack encodings of the JSON record, for
+// consumers that want self-describing data without parsing text.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_RECENC_H
+#define MAG_USB_RECENC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "main.h"
+
+#define ENC_CBOR            0
+#define ENC_MSGPACK         1
+
+#define ENC_RECORD_MAX      640         // room for the longest record, gradiometer included
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+size_t enc_record(const pList *p, const magRecord *r, int kind, int floatBits, uint8_t *buf, size_t len);
+
+#endif // MAG_USB_RECENC_H
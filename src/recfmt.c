@@ -0,0 +1,520 @@
+//=========================================================================
+// recfmt.c
+//
+// JSON record formatting in one forward pass, with fixed-point number
+// printing instead of printf, and the binary record of magrec.h.
+//
+// At several hundred records a second, each going to several sinks,
+// building a line from a string of snprintf() calls, each followed by
+// a strlen() of everything so far, is a measurable share of a Pi's
+// output thread.  fmt_record() instead writes the line front to back
+// into the caller's buffer and returns its length.  Integers go out
+// two digits at a time from a lookup table; the nT and temperature
+// values are rounded once to a scaled integer and printed the same
+// way.  The output is the same as printf's %.Nf: the rare value whose
+// scaling lands within rounding error of a tie in the last digit is
+// handed to snprintf(), which rounds the exact binary value.
+//
+// The date and time of day change once a second, so each thread keeps
+// the rendered "ts" prefix of the last second it saw and only the
+// sub-second digits are written per record.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <math.h>
+#include <time.h>
+#include "main.h"
+#include "recfmt.h"
+#include "pps.h"
+#include "timeutil.h"
+
+// Every single field, and one gradiometer vector, fits in this much.
+#define FMT_FIELD_MAX       80
+
+#define FMT_LIT(o, s)       (memcpy((o), (s), sizeof(s) - 1), (o) + sizeof(s) - 1)
+
+static const char fmtDigits[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint64_t fmtPow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+static const char *tsNames[FMT_TS_COUNT] = { "text", "iso_ms", "iso_us", "epoch_ns" };
+
+// Rendered prefix of one second: [0] text, [1] ISO-8601.
+typedef struct
+{
+    int64_t sec;
+    size_t  len;                        // 0 = nothing cached yet
+    char    text[40];
+} tsPrefix;
+
+static _Thread_local tsPrefix tsCache[2];
+
+//---------------------------------------------------------------
+// fmt_u64(char *out, uint64_t v)
+// Decimal digits of v at out; returns the end.
+//---------------------------------------------------------------
+char *fmt_u64(char *out, uint64_t v)
+{
+    char tmp[20];
+    char *t = tmp + sizeof tmp;
+
+    while(v >= 100)
+    {
+        unsigned d = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--t = fmtDigits[d + 1];
+        *--t = fmtDigits[d];
+    }
+    if(v >= 10)
+    {
+        unsigned d = (unsigned)v * 2;
+        *--t = fmtDigits[d + 1];
+        *--t = fmtDigits[d];
+    }
+    else
+    {
+        *--t = (char)('0' + v);
+    }
+    size_t n = (size_t)(tmp + sizeof tmp - t);
+    memcpy(out, t, n);
+    return out + n;
+}
+
+//---------------------------------------------------------------
+// fmt_i64(char *out, int64_t v)
+//---------------------------------------------------------------
+char *fmt_i64(char *out, int64_t v)
+{
+    if(v < 0)
+    {
+        *out++ = '-';
+        return fmt_u64(out, (uint64_t)0 - (uint64_t)v);
+    }
+    return fmt_u64(out, (uint64_t)v);
+}
+
+//---------------------------------------------------------------
+// fmt_fixed(char *out, double v, int decimals)
+//
+// v with 0..6 decimals, as printf's %.Nf would print it.  Values that
+// are not finite or not below FMT_FIXED_LIMIT print as null.
+//---------------------------------------------------------------
+char *fmt_fixed(char *out, double v, int decimals)
+{
+    if(!isfinite(v) || fabs(v) >= FMT_FIXED_LIMIT || decimals < 0 || decimals > 6)
+    {
+        return FMT_LIT(out, "null");
+    }
+
+    double   a = fabs(v) * (double)fmtPow10[decimals];
+    double   t = a - floor(a) - 0.5;
+    uint64_t q = (uint64_t)(a + 0.5);
+
+    // The scaling is off by up to half an ulp of a; near a tie that
+    // can flip the rounding.
+    if(fabs(t) <= a * 0x1p-52)
+    {
+        return out + snprintf(out, FMT_FIXED_LEN, "%.*f", decimals, v);
+    }
+    if(signbit(v))
+    {
+        *out++ = '-';
+    }
+    out = fmt_u64(out, q / fmtPow10[decimals]);
+    if(decimals > 0)
+    {
+        uint64_t f = q % fmtPow10[decimals];
+        *out = '.';
+        for(int k = decimals; k > 0; k--)
+        {
+            out[k] = (char)('0' + f % 10);
+            f /= 10;
+        }
+        out += decimals + 1;
+    }
+    return out;
+}
+
+//---------------------------------------------------------------
+// fmt_digits(char *out, uint32_t v, int n)
+// The low n digits of v, zero padded; returns the end.
+//---------------------------------------------------------------
+static char *fmt_digits(char *out, uint32_t v, int n)
+{
+    char *o = out + n;
+
+    while(o - out >= 2)
+    {
+        unsigned d = (v % 100) * 2;
+        v /= 100;
+        *--o = fmtDigits[d + 1];
+        *--o = fmtDigits[d];
+    }
+    if(o > out)
+    {
+        *--o = (char)('0' + v % 10);
+    }
+    return out + n;
+}
+
+//---------------------------------------------------------------
+// fmt_timestamp(char *out, int64_t tNs, int format)
+//
+// The "ts" value for tNs in a FMT_TS_* format, quoted unless it is
+// FMT_TS_EPOCH_NS; returns the end.  At most 32 characters.
+//---------------------------------------------------------------
+char *fmt_timestamp(char *out, int64_t tNs, int format)
+{
+    if(format == FMT_TS_EPOCH_NS)
+    {
+        return fmt_i64(out, tNs);
+    }
+
+    // Floor division, so a time before the epoch shows its own second.
+    int64_t sec  = tNs / NSEC_PER_SEC;
+    int64_t frac = tNs % NSEC_PER_SEC;
+    if(frac < 0)
+    {
+        frac += NSEC_PER_SEC;
+        sec--;
+    }
+
+    tsPrefix *c = &tsCache[format != FMT_TS_TEXT];
+    if(c->len == 0 || c->sec != sec)
+    {
+        time_t t = (time_t)sec;
+        struct tm tm;
+
+        gmtime_r(&t, &tm);
+        c->text[0] = '"';
+        c->len = 1 + strftime(c->text + 1, sizeof c->text - 1,
+                              (format == FMT_TS_TEXT) ? "%d %b %Y %T" : "%Y-%m-%dT%T", &tm);   // RFC 2822: "%a, %d %b %Y %T %z"
+        c->sec = sec;
+    }
+    memcpy(out, c->text, c->len);
+    out += c->len;
+
+    if(format == FMT_TS_ISO_MS)
+    {
+        *out++ = '.';
+        out = fmt_digits(out, (uint32_t)(frac / 1000000), 3);
+        *out++ = 'Z';
+    }
+    else if(format == FMT_TS_ISO_US)
+    {
+        *out++ = '.';
+        out = fmt_digits(out, (uint32_t)(frac / 1000), 6);
+        *out++ = 'Z';
+    }
+    *out++ = '"';
+    return out;
+}
+
+//---------------------------------------------------------------
+// fmt_tsParse(const char *name)
+// FMT_TS_* for a configured name, or -1.
+//---------------------------------------------------------------
+int fmt_tsParse(const char *name)
+{
+    for(int k = 0; k < FMT_TS_COUNT; k++)
+    {
+        if(strcmp(name, tsNames[k]) == 0)
+        {
+            return k;
+        }
+    }
+    return -1;
+}
+
+//---------------------------------------------------------------
+// fmt_tsName(int format)
+//---------------------------------------------------------------
+const char *fmt_tsName(int format)
+{
+    return (format >= 0 && format < FMT_TS_COUNT) ? tsNames[format] : "?";
+}
+
+//---------------------------------------------------------------
+// fmt_vector(char *o, double x, double y, double z)
+// [x,y,z] to 3 decimals.
+//---------------------------------------------------------------
+static char *fmt_vector(char *o, double x, double y, double z)
+{
+    *o++ = '[';
+    o = fmt_fixed(o, x, 3);
+    *o++ = ',';
+    o = fmt_fixed(o, y, 3);
+    *o++ = ',';
+    o = fmt_fixed(o, z, 3);
+    *o++ = ']';
+    return o;
+}
+
+//---------------------------------------------------------------
+// fmt_record(const pList *p, const magRecord *r, int tsFormat,
+//            char *buf, size_t len)
+//
+// One record as a JSON line, NUL-terminated, with "ts" rendered in
+// tsFormat (FMT_TS_*).  Returns its length, or
+// 0 if buf is too short (FMT_RECORD_MAX always suffices).
+//
+// For a gradiometer, "mags" lists every sensor's vector in
+// configuration order and "grad" the difference of each further
+// sensor from the primary one (mags[k+1] - mags[0]).  A sensor that
+// missed this cycle shows as null, as does any gradient that depends
+// on it.
+//---------------------------------------------------------------
+size_t fmt_record(const pList *p, const magRecord *r, int tsFormat, char *buf, size_t len)
+{
+    char *o = buf;
+    char *end = buf + len;
+
+#define FMT_ROOM()  do { if(end - o < FMT_FIELD_MAX) goto full; } while(0)
+
+    // The record is stamped with its acquisition instant, not with
+    // whenever formatting finished.
+    FMT_ROOM();
+    o = FMT_LIT(o, "{ \"ts\":");
+    o = fmt_timestamp(o, r->tNs, tsFormat);
+    FMT_ROOM();
+    o = FMT_LIT(o, ", \"seq\":");
+    o = fmt_u64(o, r->seq);
+    FMT_ROOM();
+    o = FMT_LIT(o, ", \"t_ns\":");
+    o = fmt_i64(o, r->tNs);
+    o = FMT_LIT(o, ", \"t_unc_ns\":");
+    o = fmt_i64(o, r->tUncNs);
+    FMT_ROOM();
+    if(r->averaged)
+    {
+        o = FMT_LIT(o, ", \"n\":");
+        o = fmt_u64(o, r->count);
+    }
+
+    FMT_ROOM();
+    if(!r->tempValid || r->tempCelsius < -100.0)
+    {
+        o = FMT_LIT(o, ", \"rt\":0.0, \"rt_age\":-1");
+    }
+    else
+    {
+        o = FMT_LIT(o, ", \"rt\":");
+        o = fmt_fixed(o, r->tempCelsius, 2);
+        o = FMT_LIT(o, ", \"rt_age\":");
+        o = fmt_fixed(o, r->tempAge, 1);
+    }
+
+    FMT_ROOM();
+    o = FMT_LIT(o, ", \"x\":");
+    o = fmt_fixed(o, r->nT[0][0], 3);
+    o = FMT_LIT(o, ", \"y\":");
+    o = fmt_fixed(o, r->nT[0][1], 3);
+    FMT_ROOM();
+    o = FMT_LIT(o, ", \"z\":");
+    o = fmt_fixed(o, r->nT[0][2], 3);
+
+    FMT_ROOM();
+    if(p->ppsSource != PPS_SRC_NONE)
+    {
+        o = FMT_LIT(o, ", \"pps_offset_ns\":");
+        o = r->ppsValid ? fmt_i64(o, r->ppsOffsetNs) : FMT_LIT(o, "null");
+    }
+    FMT_ROOM();
+    if(p->gnssDevice)
+    {
+        o = FMT_LIT(o, ", \"gnss_host_ns\":");
+        o = r->gnssValid ? fmt_i64(o, r->gnssHostNs) : FMT_LIT(o, "null");
+    }
+    FMT_ROOM();
+    if(r->clockStepNs != 0)
+    {
+        o = FMT_LIT(o, ", \"clock_step_ns\":");
+        o = fmt_i64(o, r->clockStepNs);
+    }
+    FMT_ROOM();
+    if(p->cqAnnotate)
+    {
+        if(r->clock.valid)
+        {
+            o = r->clock.sync ? FMT_LIT(o, ", \"clock\":{\"sync\":true,\"est_us\":")
+                              : FMT_LIT(o, ", \"clock\":{\"sync\":false,\"est_us\":");
+            o = fmt_u64(o, r->clock.estUs);
+            o = FMT_LIT(o, ",\"max_us\":");
+            o = fmt_u64(o, r->clock.maxUs);
+            *o++ = '}';
+        }
+        else
+        {
+            o = FMT_LIT(o, ", \"clock\":null");
+        }
+    }
+    FMT_ROOM();
+    if(p->arEnable)
+    {
+        o = FMT_LIT(o, ", \"cc\":[");
+        for(int k = 0; k < 3; k++)
+        {
+            o = fmt_i64(o, r->cc[k]);
+            *o++ = (k < 2) ? ',' : ']';
+        }
+        FMT_ROOM();
+        o = FMT_LIT(o, ", \"gain\":[");
+        for(int k = 0; k < 3; k++)
+        {
+            o = fmt_i64(o, r->gain[k]);
+            *o++ = (k < 2) ? ',' : ']';
+        }
+    }
+    if(r->numMags > 1)
+    {
+        const double (*v)[3] = r->nT;
+
+        FMT_ROOM();
+        o = FMT_LIT(o, ", \"mags\":[");
+        for(int i = 0; i < r->numMags; i++)
+        {
+            FMT_ROOM();
+            if(i)
+            {
+                *o++ = ',';
+            }
+            o = (r->validMask & (1u << i)) ? fmt_vector(o, v[i][0], v[i][1], v[i][2]) : FMT_LIT(o, "null");
+        }
+        FMT_ROOM();
+        o = FMT_LIT(o, "], \"grad\":[");
+        for(int i = 1; i < r->numMags; i++)
+        {
+            FMT_ROOM();
+            if(i > 1)
+            {
+                *o++ = ',';
+            }
+            o = ((r->validMask & 1u) && (r->validMask & (1u << i)))
+                ? fmt_vector(o, v[i][0] - v[0][0], v[i][1] - v[0][1], v[i][2] - v[0][2])
+                : FMT_LIT(o, "null");
+        }
+        *o++ = ']';
+    }
+
+    FMT_ROOM();
+    o = FMT_LIT(o, " }\n");
+    *o = '\0';
+    return (size_t)(o - buf);
+
+full:
+    if(len > 0)
+    {
+        buf[0] = '\0';
+    }
+    return 0;
+#undef FMT_ROOM
+}
+
+//---------------------------------------------------------------
+// put_le16() / put_le32() / put_le64() / put_f64()
+//---------------------------------------------------------------
+static void put_le16(uint8_t *b, uint16_t v)
+{
+    b[0] = (uint8_t)v;
+    b[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *b, uint32_t v)
+{
+    for(int i = 0; i < 4; i++)
+    {
+        b[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static void put_le64(uint8_t *b, uint64_t v)
+{
+    for(int i = 0; i < 8; i++)
+    {
+        b[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static void put_f64(uint8_t *b, double v)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &v, sizeof bits);
+    put_le64(b, bits);
+}
+
+//---------------------------------------------------------------
+// fmt_binary(const magRecord *r, uint8_t *buf)
+//
+// One record in the MAGREC_SIZE-byte layout of magrec.h, byte by byte
+// so the output is little-endian whatever the host.  Returns
+// MAGREC_SIZE.
+//---------------------------------------------------------------
+size_t fmt_binary(const magRecord *r, uint8_t *buf)
+{
+    uint32_t flags = 0;
+
+    if(r->averaged)
+    {
+        flags |= MAGREC_AVERAGED;
+    }
+    if(r->tempValid)
+    {
+        flags |= MAGREC_TEMP_VALID;
+    }
+    if(r->ppsValid)
+    {
+        flags |= MAGREC_PPS;
+    }
+    if(r->gnssValid)
+    {
+        flags |= MAGREC_GNSS;
+    }
+    if(r->clock.valid && r->clock.sync)
+    {
+        flags |= MAGREC_CLOCK_SYNC;
+    }
+    if(r->clockStepNs != 0)
+    {
+        flags |= MAGREC_CLOCK_STEP;
+    }
+
+    put_le32(buf + 0,  MAGREC_MAGIC);
+    put_le16(buf + 4,  MAGREC_VERSION);
+    put_le16(buf + 6,  MAGREC_SIZE);
+    put_le64(buf + 8,  r->seq);
+    put_le64(buf + 16, (uint64_t)r->tNs);
+    put_le64(buf + 24, (uint64_t)r->tUncNs);
+    put_le32(buf + 32, r->count);
+    put_le32(buf + 36, flags);
+    buf[40] = (uint8_t)r->numMags;
+    buf[41] = (uint8_t)r->validMask;
+    for(int k = 0; k < 3; k++)
+    {
+        put_le16(buf + 42 + 2 * k, (uint16_t)r->cc[k]);
+        put_le16(buf + 48 + 2 * k, (uint16_t)r->gain[k]);
+    }
+    put_le16(buf + 54, 0);
+    put_f64(buf + 56, r->tempValid ? r->tempCelsius : NAN);
+    for(int i = 0; i < MAGREC_SENSORS; i++)
+    {
+        int valid = i < r->numMags && (r->validMask & (1u << i));
+        for(int k = 0; k < 3; k++)
+        {
+            put_le32(buf + 64 + 4 * (3 * i + k), (uint32_t)((valid && !r->averaged) ? r->xyz[i][k] : 0));
+            put_f64(buf + 112 + 8 * (3 * i + k), valid ? r->nT[i][k] : NAN);
+        }
+    }
+    return MAGREC_SIZE;
+}
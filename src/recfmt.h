@@ -0,0 +1,41 @@
+//=========================================================================
+// recfmt.h
+//
+// JSON record formatting in one forward pass, with fixed-point number
+// printing instead of printf, and the binary record of magrec.h.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_RECFMT_H
+#define MAG_USB_RECFMT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "main.h"
+#include "magrec.h"
+
+#define FMT_RECORD_MAX      1024        // room for the longest record, gradiometer included
+#define FMT_FIXED_LIMIT     1e12        // larger magnitudes print as null
+#define FMT_FIXED_LEN       21          // longest fmt_fixed() output, with its NUL
+
+// "ts" renderings, chosen per product sink
+#define FMT_TS_TEXT         0           // "18 Oct 2026 19:29:54"
+#define FMT_TS_ISO_MS       1           // "2026-10-18T19:29:54.123Z"
+#define FMT_TS_ISO_US       2           // "2026-10-18T19:29:54.123456Z"
+#define FMT_TS_EPOCH_NS     3           // 1792351794123456789
+#define FMT_TS_COUNT        4
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+size_t fmt_record(const pList *p, const magRecord *r, int tsFormat, char *buf, size_t len);
+size_t fmt_binary(const magRecord *r, uint8_t *buf);
+char  *fmt_timestamp(char *out, int64_t tNs, int format);
+int    fmt_tsParse(const char *name);
+const char *fmt_tsName(int format);
+char  *fmt_u64(char *out, uint64_t v);
+char  *fmt_i64(char *out, int64_t v);
+char  *fmt_fixed(char *out, double v, int decimals);
+
+#endif // MAG_USB_RECFMT_H
@@ -0,0 +1,26 @@
+//=========================================================================
+// rt.h
+//
+// Opt-in real-time mode.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_RT_H
+#define MAG_USB_RT_H
+
+#include "main.h"
+
+#define RT_THREAD_ACQUISITION   0
+#define RT_THREAD_OUTPUT        1
+#define RT_THREAD_PPS           2
+
+#define RT_STACK_PREFAULT       (64 * 1024)     // bytes of stack touched per thread
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int  rt_init(pList *p);
+void rt_thread(pList *p, int role);
+
+#endif // MAG_USB_RT_H
@@ -0,0 +1,138 @@
+//=========================================================================
+// samplering.c
+//
+// Single-producer / single-consumer queue of raw samples between the
+// acquisition thread and the output thread.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include "main.h"
+#include "samplering.h"
+
+//---------------------------------------------------------------
+// ring_init(sampleRing *r)
+//---------------------------------------------------------------
+int ring_init(sampleRing *r)
+{
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->overflows, 0);
+    r->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(r->eventFd < 0)
+    {
+        perror("eventfd");
+        return -1;
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// ring_close(sampleRing *r)
+//---------------------------------------------------------------
+void ring_close(sampleRing *r)
+{
+    if(r->eventFd >= 0)
+    {
+        close(r->eventFd);
+        r->eventFd = -1;
+    }
+}
+
+//---------------------------------------------------------------
+// ring_push(sampleRing *r, const magSample *s)
+//
+// Producer side.  Returns TRUE if queued, FALSE if the ring was full
+// (the sample is dropped and counted).
+//---------------------------------------------------------------
+int ring_push(sampleRing *r, const magSample *s)
+{
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    if(head - tail >= SAMPLE_RING_LEN)
+    {
+        atomic_fetch_add_explicit(&r->overflows, 1, memory_order_relaxed);
+        return FALSE;
+    }
+    r->slots[head & (SAMPLE_RING_LEN - 1)] = *s;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+    uint64_t one = 1;
+    if(write(r->eventFd, &one, sizeof one) < 0 && errno != EAGAIN)
+    {
+        perror("ring eventfd write");
+    }
+    return TRUE;
+}
+
+//---------------------------------------------------------------
+// ring_pop(sampleRing *r, magSample *s)
+//
+// Consumer side.  Returns TRUE with the oldest sample, FALSE if empty.
+//---------------------------------------------------------------
+int ring_pop(sampleRing *r, magSample *s)
+{
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    if(tail == head)
+    {
+        return FALSE;
+    }
+    *s = r->slots[tail & (SAMPLE_RING_LEN - 1)];
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    return TRUE;
+}
+
+//---------------------------------------------------------------
+// ring_wait(sampleRing *r, int timeout_ms)
+//
+// Consumer side.  Waits up to timeout_ms for the producer to queue
+// something.  Returns 1 if samples may be available, 0 on timeout,
+// -1 on error.  The caller drains with ring_pop() until it is empty.
+//---------------------------------------------------------------
+int ring_wait(sampleRing *r, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = r->eventFd, .events = POLLIN, .revents = 0 };
+
+    int rv = poll(&pfd, 1, timeout_ms);
+    if(rv <= 0)
+    {
+        return (rv < 0 && errno != EINTR) ? -1 : 0;
+    }
+    uint64_t count;
+    if(read(r->eventFd, &count, sizeof count) < 0 && errno != EAGAIN)
+    {
+        return -1;
+    }
+    return 1;
+}
+
+//---------------------------------------------------------------
+// ring_ack(sampleRing *r)
+//
+// Consumer side, for a caller that waits on r->eventFd itself (e.g.
+// in an epoll set): clears the wakeup.  Call it before draining, so a
+// sample pushed during the drain raises it again.
+//---------------------------------------------------------------
+void ring_ack(sampleRing *r)
+{
+    uint64_t count;
+
+    if(read(r->eventFd, &count, sizeof count) < 0 && errno != EAGAIN)
+    {
+        perror("ring eventfd read");
+    }
+}
+
+//---------------------------------------------------------------
+// ring_overflows(sampleRing *r)
+//---------------------------------------------------------------
+uint64_t ring_overflows(sampleRing *r)
+{
+    return atomic_load_explicit(&r->overflows, memory_order_relaxed);
+}
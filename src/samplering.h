@@ -0,0 +1,43 @@
+//=========================================================================
+// samplering.h
+//
+// Single-producer / single-consumer queue of raw samples between the
+// acquisition thread and the output thread.
+//
+// The acquisition thread never waits on a sink: when the output side
+// falls behind and the ring is full, the new sample is dropped and
+// counted as a ring overflow, and its sequence number shows up as a
+// gap downstream.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_SAMPLERING_H
+#define MAG_USB_SAMPLERING_H
+
+#include <stdatomic.h>
+#include "main.h"
+
+#define SAMPLE_RING_LEN     512         // power of two; ~3 s of CMM at 150 Hz
+
+typedef struct tag_sampleRing
+{
+    magSample slots[SAMPLE_RING_LEN];
+    _Atomic uint64_t head;              // next slot the producer fills
+    _Atomic uint64_t tail;              // next slot the consumer reads
+    _Atomic uint64_t overflows;         // samples dropped because the ring was full
+    int eventFd;                        // readable while samples are queued
+} sampleRing;
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int      ring_init(sampleRing *r);
+void     ring_close(sampleRing *r);
+int      ring_push(sampleRing *r, const magSample *s);
+int      ring_pop(sampleRing *r, magSample *s);
+int      ring_wait(sampleRing *r, int timeout_ms);
+void     ring_ack(sampleRing *r);
+uint64_t ring_overflows(sampleRing *r);
+
+#endif // MAG_USB_SAMPLERING_H
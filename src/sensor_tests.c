@@ -153,21 +153,10 @@ int i2c_verifyTempSensor(pList *p)
 }
 
 //---------------------------------------------------------------
-// int i2c_verifyMagSensor(pList *p)
-//
-// Reads the RM3100 REVID register and compares against the
-// expected value.  Returns 0 on success; non-zero on any failure.
+// static int verifyMagAt(pList *p, uint8_t addr)
 //---------------------------------------------------------------
-int i2c_verifyMagSensor(pList *p)
+static int verifyMagAt(pList *p, uint8_t addr)
 {
-    fprintf(OUTPUT_PRINT, "\nVerifying Magnetometer Status & Version...\n");
-
-    i2c_pololu_clear_bus(p->adapter);
-
-    // Use the configured I2C address, not a hardcoded 0x23.  A user
-    // who changes [magnetometer].address in config.toml expects -M
-    // to talk to the same device the main loop uses.
-    const uint8_t addr = (uint8_t)p->magAddr;
     // RM3100 REVID register lives at 0x36 (see rm3100.h
     // RM3100I2C_REVID).  We don't include rm3100.h here because the
     // header defines the const symbols at file scope with external
@@ -203,3 +192,36 @@ int i2c_verifyMagSensor(pList *p)
     return 2;
 }
 
+//---------------------------------------------------------------
+// int i2c_verifyMagSensor(pList *p)
+//
+// Reads the RM3100 REVID register of every configured magnetometer
+// and compares against the expected value.  Returns 0 on success;
+// the first non-zero result otherwise.
+//---------------------------------------------------------------
+int i2c_verifyMagSensor(pList *p)
+{
+    int rv = 0;
+
+    fprintf(OUTPUT_PRINT, "\nVerifying Magnetometer Status & Version...\n");
+
+    i2c_pololu_clear_bus(p->adapter);
+
+    // Use the configured I2C addresses, not a hardcoded 0x23.  A user
+    // who changes [magnetometer].address in config.toml expects -M
+    // to talk to the same devices the main loop uses.
+    for(int i = 0; i < p->numMags; i++)
+    {
+        if(p->numMags > 1)
+        {
+            fprintf(OUTPUT_PRINT, "  Magnetometer %d at 0x%02X:\n", i, (unsigned)(p->magAddrs[i] & 0xFF));
+        }
+        int r = verifyMagAt(p, (uint8_t)p->magAddrs[i]);
+        if(r && !rv)
+        {
+            rv = r;
+        }
+    }
+    return rv;
+}
+
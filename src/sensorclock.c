@@ -0,0 +1,228 @@
+//=========================================================================
+// sensorclock.c
+//
+// Sensor clock model for CMM timestamps.
+//
+// In CMM the RM3100's own oscillator paces the conversions, so the
+// conversion instants lie on a straight line in the conversion index
+// (the sample seq) with a slope that is the true sensor period, while
+// every host-side stamp adds USB latency and scheduling jitter on top.
+// The model keeps the bracket midpoints of the last cmmClockWindow
+// conversions of the primary sensor and fits
+//
+//      mono = a + b * seq
+//
+// by least squares, refitted without the points more than 2.5 RMS off
+// the first fit so late reads do not pull the line.  Each record then
+// gets the fitted instant instead of its own bracket, mapped to
+// CLOCK_REALTIME with the sample's own realtime/monotonic pair.  b
+// against the nominal CMM period is the oscillator's rate error.
+//
+// A CMM restart starts the line over, as does a run of points that no
+// longer fit (a miscounted skip shifts the index by whole periods).
+// Runs on the output thread.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <inttypes.h>
+#include <math.h>
+#include "main.h"
+#include "sensorclock.h"
+#include "acquire.h"
+#include "magdata.h"
+
+#define SCLK_MIN_POINTS     16      // fallback to the bracket until then
+#define SCLK_MAX_OUTLIERS   8       // consecutive misfits that restart the fit
+
+typedef struct
+{
+    uint64_t seq;
+    int64_t  mono;                  // bracket midpoint, CLOCK_MONOTONIC
+} sclkPoint;
+
+static sclkPoint sclkWin[SCLK_WINDOW_MAX];
+static unsigned  sclkHead;          // next slot
+static unsigned  sclkCount;
+static uint32_t  sclkRun;
+static int       sclkOutliers;
+
+//---------------------------------------------------------------
+// sclk_restart(pList *p, uint32_t run)
+//---------------------------------------------------------------
+static void sclk_restart(pList *p, uint32_t run)
+{
+    sclkHead     = 0;
+    sclkCount    = 0;
+    sclkRun      = run;
+    sclkOutliers = 0;
+    atomic_store(&p->sclkPeriodNs, 0.0);
+    atomic_store(&p->sclkRatePpm, 0.0);
+}
+
+//---------------------------------------------------------------
+// sclk_fit(double limit, double *a, double *b, double *xm, double *sxx,
+//          double *rms, int *used)
+//
+// Least squares over the window, relative to its oldest point, using
+// only points whose residual from the previous fit (a, b) is within
+// limit; limit < 0 takes them all.
+//---------------------------------------------------------------
+static int sclk_fit(double limit, double *a, double *b, double *xm, double *sxx, double *rms, int *used)
+{
+    const sclkPoint *o = &sclkWin[(sclkHead + SCLK_WINDOW_MAX - sclkCount) % SCLK_WINDOW_MAX];
+    double sx = 0.0, sy = 0.0, n = 0.0;
+    double a0 = *a, b0 = *b;
+
+    for(unsigned i = 0; i < sclkCount; i++)
+    {
+        const sclkPoint *q = &sclkWin[(sclkHead + SCLK_WINDOW_MAX - sclkCount + i) % SCLK_WINDOW_MAX];
+        double x = (double)(q->seq - o->seq);
+        double y = (double)(q->mono - o->mono);
+        if(limit >= 0.0 && fabs(y - (a0 + b0 * x)) > limit)
+        {
+            continue;
+        }
+        sx += x;
+        sy += y;
+        n  += 1.0;
+    }
+    if(n < 2.0)
+    {
+        return FALSE;
+    }
+    double mx = sx / n, my = sy / n, Sxx = 0.0, Sxy = 0.0;
+    for(unsigned i = 0; i < sclkCount; i++)
+    {
+        const sclkPoint *q = &sclkWin[(sclkHead + SCLK_WINDOW_MAX - sclkCount + i) % SCLK_WINDOW_MAX];
+        double x = (double)(q->seq - o->seq);
+        double y = (double)(q->mono - o->mono);
+        if(limit >= 0.0 && fabs(y - (a0 + b0 * x)) > limit)
+        {
+            continue;
+        }
+        Sxx += (x - mx) * (x - mx);
+        Sxy += (x - mx) * (y - my);
+    }
+    if(Sxx <= 0.0)
+    {
+        return FALSE;
+    }
+    *b = Sxy / Sxx;
+    *a = my - *b * mx;
+
+    double ss = 0.0;
+    for(unsigned i = 0; i < sclkCount; i++)
+    {
+        const sclkPoint *q = &sclkWin[(sclkHead + SCLK_WINDOW_MAX - sclkCount + i) % SCLK_WINDOW_MAX];
+        double x = (double)(q->seq - o->seq);
+        double y = (double)(q->mono - o->mono);
+        if(limit >= 0.0 && fabs(y - (a0 + b0 * x)) > limit)
+        {
+            continue;
+        }
+        double r = y - (*a + *b * x);
+        ss += r * r;
+    }
+    *xm   = mx;
+    *sxx  = Sxx;
+    *rms  = sqrt(ss / n);
+    *used = (int)n;
+    return TRUE;
+}
+
+//---------------------------------------------------------------
+// sclk_init(pList *p)
+//---------------------------------------------------------------
+int sclk_init(pList *p)
+{
+    if(p->cmmClockWindow > SCLK_WINDOW_MAX)
+    {
+        p->cmmClockWindow = SCLK_WINDOW_MAX;
+    }
+    sclk_restart(p, 0);
+    return 0;
+}
+
+//---------------------------------------------------------------
+// sclk_stamp(pList *p, const magSample *s, magRecord *r)
+//
+// Adds s to the model and, once the fit holds, restamps r with the
+// fitted instant.  t_unc_ns becomes two standard errors of that
+// instant.  Records keep their bracket stamps outside CMM, while the
+// fit is still short, and when the primary sensor was not read.
+//---------------------------------------------------------------
+void sclk_stamp(pList *p, const magSample *s, magRecord *r)
+{
+    int64_t mono;
+
+    if(p->samplingMode != CMM || p->cmmClockWindow < SCLK_MIN_POINTS)
+    {
+        return;
+    }
+    if(s->cmmRun != sclkRun
+       || (sclkCount && s->seq <= sclkWin[(sclkHead + SCLK_WINDOW_MAX - 1) % SCLK_WINDOW_MAX].seq))
+    {
+        sclk_restart(p, s->cmmRun);
+    }
+    if(!acq_sampleInstant(s, 0, NULL, &mono, NULL))
+    {
+        return;
+    }
+
+    sclkWin[sclkHead].seq  = s->seq;
+    sclkWin[sclkHead].mono = mono;
+    sclkHead = (sclkHead + 1) % SCLK_WINDOW_MAX;
+    if(sclkCount < (unsigned)p->cmmClockWindow)
+    {
+        sclkCount++;
+    }
+    if(sclkCount < SCLK_MIN_POINTS)
+    {
+        return;
+    }
+
+    double a = 0.0, b = 0.0, xm, sxx, rms;
+    int used;
+    if(!sclk_fit(-1.0, &a, &b, &xm, &sxx, &rms, &used)
+       || !sclk_fit(2.5 * rms, &a, &b, &xm, &sxx, &rms, &used)
+       || used < SCLK_MIN_POINTS)
+    {
+        return;
+    }
+
+    const sclkPoint *o = &sclkWin[(sclkHead + SCLK_WINDOW_MAX - sclkCount) % SCLK_WINDOW_MAX];
+    double x   = (double)(s->seq - o->seq);
+    double fit = a + b * x;
+    double res = (double)(mono - o->mono) - fit;
+
+    // A run of points off the line means the index slipped; start over.
+    if(fabs(res) > 4.0 * rms + 0.25 * b)
+    {
+        if(++sclkOutliers >= SCLK_MAX_OUTLIERS)
+        {
+            fprintf(OUTPUT_ERROR, "{ \"lastStatus\": \"sensor_clock_reset\", \"seq\": %" PRIu64 ", \"offset_ns\": %.0f }\n",
+                    s->seq, res);
+            fflush(OUTPUT_ERROR);
+            sclk_restart(p, s->cmmRun);
+            return;
+        }
+    }
+    else
+    {
+        sclkOutliers = 0;
+    }
+
+    double nominal = (double)getCMMPeriodNs(p);
+    atomic_store(&p->sclkPeriodNs, b);
+    atomic_store(&p->sclkRatePpm, (nominal / b - 1.0) * 1e6);
+
+    const magStamp *st = &s->stamps[0];
+    int64_t fitMono = o->mono + (int64_t)llround(fit);
+    r->tNs    = fitMono + (st->drdyRealNs - st->drdyMonoNs);
+    r->tUncNs = (int64_t)ceil(2.0 * rms * sqrt(1.0 / used + (x - xm) * (x - xm) / sxx));
+    if(r->tUncNs < 1)
+    {
+        r->tUncNs = 1;
+    }
+}
@@ -0,0 +1,22 @@
+//=========================================================================
+// sensorclock.h
+//
+// Sensor clock model for CMM timestamps.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_SENSORCLOCK_H
+#define MAG_USB_SENSORCLOCK_H
+
+#include "main.h"
+
+#define SCLK_WINDOW_MAX     1024        // conversions the fit can span
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int  sclk_init(pList *p);
+void sclk_stamp(pList *p, const magSample *s, magRecord *r);
+
+#endif // MAG_USB_SENSORCLOCK_H
@@ -0,0 +1,160 @@
+//=========================================================================
+// temperature.c
+//
+// Low-rate MCP9808 temperature acquisition for mag-usb.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include "main.h"
+#include "i2c.h"
+#include "temperature.h"
+#include "timeutil.h"
+#include "trace.h"
+#include "MCP9808.h"
+
+//------------------------------------------
+//  mcp9808_decode_celsius()
+//------------------------------------------
+static double mcp9808_decode_celsius(uint8_t msb, uint8_t lsb)
+{
+    uint16_t raw = ((uint16_t)msb << 8) | lsb;
+    // First, clear alert flag bits (15, 14, 13)
+    raw &= 0x1FFF;  // Keep only bits 12-0
+
+    double c;
+    if (raw & 0x1000)
+    {
+        // Bit 12 (sign bit) is set - negative temperature
+        // For two's complement of a 13-bit signed value:
+        // Treat bits 12-0 as signed, or manually compute
+        c = -(double)(raw & 0x0FFF) / 16.0 - 256.0;
+    }
+    else
+    {
+        // Positive temperature
+        c = (double)(raw & 0x0FFF) / 16.0;
+    }
+    return c;
+}
+
+//------------------------------------------
+// mcp9808_conversion_ms()
+// Worst-case conversion time for a resolution register value.
+//------------------------------------------
+int mcp9808_conversion_ms(int resolution)
+{
+    switch(resolution)
+    {
+        case MCP9808_RES_0_5C:      return 30;
+        case MCP9808_RES_0_25C:     return 65;
+        case MCP9808_RES_0_125C:    return 130;
+        case MCP9808_RES_0_0625C:
+        default:                    return 250;
+    }
+}
+
+//------------------------------------------
+// read_interval_ns()
+// The sensor converts continuously, so reading more often than one
+// conversion time only returns the same value again.
+//------------------------------------------
+static int64_t read_interval_ns(const pList *p)
+{
+    int64_t interval = (int64_t)p->tempReadInterval * NSEC_PER_SEC;
+    int64_t tconv    = (int64_t)mcp9808_conversion_ms(p->tempResolution) * NSEC_PER_MSEC;
+    return (interval > tconv) ? interval : tconv;
+}
+
+//---------------------------------------------------------------
+// temp_init(pList *p)
+//
+// Programs the MCP9808 resolution register and schedules the first
+// read for when a conversion at that resolution has completed.
+// A missing or unresponsive sensor is not fatal: records simply
+// carry no valid temperature.
+//---------------------------------------------------------------
+int temp_init(pList *p)
+{
+    int rv = 0;
+
+    p->tempValid     = FALSE;
+    p->tempErrors    = 0;
+    p->tempFailures  = 0;
+    if(p->tempResolution < MCP9808_RES_0_5C || p->tempResolution > MCP9808_RES_0_0625C)
+    {
+        p->tempResolution = MCP9808_RES_0_0625C;
+    }
+
+    rv = i2c_write_temp(p, MCP9808_REG_RESOLUTION, (uint8_t)p->tempResolution);
+    if(rv < 1)
+    {
+        fprintf(OUTPUT_ERROR, "Unable to set MCP9808 resolution at 0x%02X: %s\n",
+                (unsigned)(p->remoteTempAddr & 0xFF), i2c_pololu_error_string(rv));
+    }
+    p->tempNextDueNs = mono_ns() + (int64_t)mcp9808_conversion_ms(p->tempResolution) * NSEC_PER_MSEC;
+    return rv;
+}
+
+//---------------------------------------------------------------
+// temp_service(pList *p)
+//
+// Reads the ambient temperature register if the next read is due.
+// Returns 1 if a new value was read, 0 if nothing was due, or a
+// negative value on a failed read.  Only the first failure of a run
+// is reported, so a disconnected sensor does not flood stderr from
+// the sampling loop.
+//---------------------------------------------------------------
+int temp_service(pList *p)
+{
+    uint8_t temp_buf[2] = {0xFF, 0xFF};
+    int64_t now = mono_ns();
+
+    if(now < p->tempNextDueNs)
+    {
+        return 0;
+    }
+    p->tempNextDueNs = now + read_interval_ns(p);
+
+    int64_t t0 = trc_now();
+    int rv = i2c_readbuf_temp(p, MCP9808_REG_AMBIENT_TEMP, temp_buf, 2);
+    trc_lap(TRC_TEMP, t0);
+    if(rv < 2)
+    {
+        p->tempErrors++;
+        if(p->tempFailures++ == 0)
+        {
+            fprintf(OUTPUT_ERROR, "Temperature read failed: %s\n", i2c_pololu_error_string(rv));
+            fflush(OUTPUT_ERROR);
+        }
+        return (rv < 0) ? rv : -1;
+    }
+    p->tempFailures = 0;
+    p->tempCelsius  = mcp9808_decode_celsius(temp_buf[0], temp_buf[1]);
+    p->tempReadNs   = now;
+    p->tempValid    = TRUE;
+    return 1;
+}
+
+//---------------------------------------------------------------
+// temp_latest(const pList *p, double *celsius, double *age_secs)
+//
+// Returns TRUE with the cached reading and its age in seconds, or
+// FALSE if no reading has succeeded yet.
+//---------------------------------------------------------------
+int temp_latest(const pList *p, double *celsius, double *age_secs)
+{
+    if(!p->tempValid)
+    {
+        return FALSE;
+    }
+    if(celsius)
+    {
+        *celsius = p->tempCelsius;
+    }
+    if(age_secs)
+    {
+        *age_secs = (double)(mono_ns() - p->tempReadNs) / (double)NSEC_PER_SEC;
+    }
+    return TRUE;
+}
@@ -0,0 +1,26 @@
+//=========================================================================
+// temperature.h
+//
+// Low-rate MCP9808 temperature acquisition for mag-usb.
+//
+// The temperature changes on a scale of minutes, so it is read on its
+// own schedule (pList.tempReadInterval) instead of once per magnetometer
+// sample.  Output records carry the most recent reading and its age.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_TEMPERATURE_H
+#define MAG_USB_TEMPERATURE_H
+
+#include "main.h"
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int  temp_init(pList *p);
+int  temp_service(pList *p);
+int  temp_latest(const pList *p, double *celsius, double *age_secs);
+int  mcp9808_conversion_ms(int resolution);
+
+#endif // MAG_USB_TEMPERATURE_H
@@ -0,0 +1,284 @@
+//=========================================================================
+// ticker.c
+//
+// Absolute-deadline tick source for the POLL loop, on a timerfd.
+//
+// Ticks are placed on a CLOCK_REALTIME grid (phase + k * period) but
+// the timer itself runs on CLOCK_MONOTONIC: each tick is armed as a
+// one-shot absolute monotonic deadline, the grid instant less the
+// realtime - monotonic offset as last seen.  Slewing moves the offset
+// a little from tick to tick and the grid follows it; the time from
+// each deadline to the wakeup is recorded as the wakeup latency, and
+// a wakeup more than a period late accounts for the ticks it passed.
+//
+// A step of the host clock (settimeofday, chrony's makestep, ...)
+// would otherwise either fire a burst of expirations on a realtime
+// timer or stall it until the clock caught up again.  Instead a second,
+// CLOCK_REALTIME timerfd armed with TFD_TIMER_CANCEL_ON_SET wakes the
+// wait as soon as the clock is set; the new offset is taken and the
+// ticker re-anchors on the next grid instant of the clock as it now
+// reads.  Nothing is counted as missed, and the size of the step is
+// handed to the caller with the next tick so the output can mark the
+// discontinuity.
+//
+// The wait also watches the shutdown eventfd (halt.c), so a stop
+// request ends it at once rather than at the next tick, however long
+// the period.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "main.h"
+#include "ticker.h"
+#include "timeutil.h"
+#include "halt.h"
+
+#define TICK_WATCH_SECS     (366LL * 86400LL)   // how far ahead the watch timer is parked
+
+//---------------------------------------------------------------
+// tick_offset()
+// CLOCK_REALTIME - CLOCK_MONOTONIC, now.
+//---------------------------------------------------------------
+static int64_t tick_offset(void)
+{
+    int64_t real, mono;
+
+    clock_pair_ns(&real, &mono);
+    return real - mono;
+}
+
+//---------------------------------------------------------------
+// tick_watchArm(clockWatch *w)
+// (Re)parks the watch timer far ahead; a clock set cancels it.
+//---------------------------------------------------------------
+static int tick_watchArm(clockWatch *w)
+{
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+
+    its.it_value.tv_sec = (time_t)(clock_ns(CLOCK_REALTIME) / NSEC_PER_SEC + TICK_WATCH_SECS);
+    return timerfd_settime(w->fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL);
+}
+
+//---------------------------------------------------------------
+// tick_watchInit(clockWatch *w)
+//
+// Without the watch, steps still land in the output timestamps, just
+// unmarked; the failure is reported and the caller carries on.
+//---------------------------------------------------------------
+int tick_watchInit(clockWatch *w)
+{
+    w->offsetNs = tick_offset();
+    w->fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+    if(w->fd < 0)
+    {
+        perror("timerfd_create (clock watch)");
+        return -1;
+    }
+    if(tick_watchArm(w) < 0)
+    {
+        perror("timerfd_settime (clock watch)");
+        close(w->fd);
+        w->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// tick_watchCheck(clockWatch *w, int64_t *stepNs)
+//
+// Returns TRUE, with the change in the realtime - monotonic offset,
+// if the clock has been set since the last check; otherwise refreshes
+// the offset, so slewing in between is not taken for part of a step.
+// The offset is read before the timer so a set in between is still
+// reported.
+//---------------------------------------------------------------
+int tick_watchCheck(clockWatch *w, int64_t *stepNs)
+{
+    uint64_t n;
+    int64_t  before = tick_offset();
+
+    if(w->fd < 0)
+    {
+        w->offsetNs = before;
+        return FALSE;
+    }
+    if(read(w->fd, &n, sizeof n) < 0 && errno == ECANCELED)
+    {
+        int64_t after = tick_offset();
+        *stepNs     = after - w->offsetNs;
+        w->offsetNs = after;
+        if(tick_watchArm(w) < 0)
+        {
+            perror("timerfd_settime (clock watch)");
+        }
+        return TRUE;
+    }
+    w->offsetNs = before;
+    return FALSE;
+}
+
+//---------------------------------------------------------------
+// tick_watchClose(clockWatch *w)
+//---------------------------------------------------------------
+void tick_watchClose(clockWatch *w)
+{
+    if(w->fd >= 0)
+    {
+        close(w->fd);
+        w->fd = -1;
+    }
+}
+
+//---------------------------------------------------------------
+// tick_arm(tickTimer *t)
+// Arms the timer for t->nextNs at the current offset.
+//---------------------------------------------------------------
+static int tick_arm(tickTimer *t)
+{
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+
+    t->nextMonoNs = t->nextNs - t->watch.offsetNs;
+    its.it_value.tv_sec  = (time_t)(t->nextMonoNs / NSEC_PER_SEC);
+    its.it_value.tv_nsec = (long)(t->nextMonoNs % NSEC_PER_SEC);
+    if(timerfd_settime(t->fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+    {
+        perror("timerfd_settime");
+        return -1;
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// tick_anchor(tickTimer *t)
+// Moves the next tick to the first grid instant after now.
+//---------------------------------------------------------------
+static int tick_anchor(tickTimer *t)
+{
+    int64_t now = mono_ns() + t->watch.offsetNs;
+
+    t->nextNs = ((now - t->phaseNs) / t->periodNs + 1) * t->periodNs + t->phaseNs;
+    return tick_arm(t);
+}
+
+//---------------------------------------------------------------
+// tick_init(tickTimer *t, int64_t firstNs, int64_t periodNs,
+//           latHist *wake)
+//
+// firstNs is the CLOCK_REALTIME instant of the first tick; it also
+// fixes the phase of the grid.
+//---------------------------------------------------------------
+int tick_init(tickTimer *t, int64_t firstNs, int64_t periodNs, latHist *wake)
+{
+    t->periodNs = periodNs;
+    t->phaseNs  = firstNs % periodNs;
+    t->nextNs   = firstNs;
+    t->stepNs   = 0;
+    t->wake     = wake;
+    tick_watchInit(&t->watch);
+    t->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if(t->fd < 0)
+    {
+        perror("timerfd_create");
+        tick_watchClose(&t->watch);
+        return -1;
+    }
+    if(tick_arm(t) < 0)
+    {
+        tick_close(t);
+        return -1;
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// tick_wait(tickTimer *t, int64_t *dueNs, uint64_t *missed,
+//           int64_t *stepNs)
+//
+// Blocks until the next tick.  Returns 0 with the CLOCK_REALTIME
+// instant the tick was due, the number of ticks that went by unserved
+// before it, and the host clock steps taken since the last tick (0 if
+// none), or -1 if interrupted, on error, or (errno ECANCELED) when a
+// stop has been requested.
+//---------------------------------------------------------------
+int tick_wait(tickTimer *t, int64_t *dueNs, uint64_t *missed, int64_t *stepNs)
+{
+    struct pollfd fds[3];
+    uint64_t n = 0;
+    int64_t  step;
+    int      ready = FALSE;
+
+    fds[0].fd     = t->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd     = t->watch.fd;        // poll() skips it if negative
+    fds[1].events = POLLIN;
+    fds[2].fd     = halt_fd();
+    fds[2].events = POLLIN;
+    for(;;)
+    {
+        if(tick_watchCheck(&t->watch, &step))
+        {
+            // Whatever the timer was doing belongs to the old clock.
+            t->stepNs += step;
+            if(tick_anchor(t) < 0)
+            {
+                return -1;
+            }
+        }
+        else if(ready)
+        {
+            break;
+        }
+        ready = FALSE;
+        if(halt_pending())
+        {
+            errno = ECANCELED;
+            return -1;
+        }
+        if(poll(fds, 3, -1) < 0)
+        {
+            return -1;
+        }
+        if((fds[0].revents & POLLIN) && read(t->fd, &n, sizeof n) == (ssize_t)sizeof n && n > 0)
+        {
+            ready = TRUE;
+        }
+    }
+
+    int64_t now  = mono_ns();
+    int64_t late = now - t->nextMonoNs;
+    int64_t k    = (late >= t->periodNs) ? late / t->periodNs : 0;
+
+    *missed   = (uint64_t)k;
+    *dueNs    = t->nextNs + k * t->periodNs;
+    *stepNs   = t->stepNs;
+    t->stepNs = 0;
+    if(t->wake)
+    {
+        lat_record(t->wake, late - k * t->periodNs);
+    }
+    t->nextNs = *dueNs + t->periodNs;
+    if(tick_arm(t) < 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// tick_close(tickTimer *t)
+//---------------------------------------------------------------
+void tick_close(tickTimer *t)
+{
+    if(t->fd >= 0)
+    {
+        close(t->fd);
+        t->fd = -1;
+    }
+    tick_watchClose(&t->watch);
+}
@@ -0,0 +1,49 @@
+//=========================================================================
+// ticker.h
+//
+// Absolute-deadline tick source for the POLL loop, on a timerfd.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_TICKER_H
+#define MAG_USB_TICKER_H
+
+#include <stdint.h>
+#include "latency.h"
+
+//------------------------------------------
+// Host clock step watch: a CLOCK_REALTIME timerfd armed with
+// TFD_TIMER_CANCEL_ON_SET, which becomes readable when the clock is
+// set, and the realtime - monotonic offset last seen.
+//------------------------------------------
+typedef struct
+{
+    int      fd;
+    int64_t  offsetNs;              // CLOCK_REALTIME - CLOCK_MONOTONIC
+} clockWatch;
+
+typedef struct
+{
+    int      fd;                    // CLOCK_MONOTONIC timerfd
+    int64_t  periodNs;
+    int64_t  phaseNs;               // tick instants are phaseNs + k * periodNs
+    int64_t  nextNs;                // CLOCK_REALTIME instant of the next tick
+    int64_t  nextMonoNs;            // the same on CLOCK_MONOTONIC, as armed
+    int64_t  stepNs;                // clock steps not yet handed out with a tick
+    clockWatch watch;
+    latHist  *wake;                 // wakeup latency, if not NULL
+} tickTimer;
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int  tick_init(tickTimer *t, int64_t firstNs, int64_t periodNs, latHist *wake);
+int  tick_wait(tickTimer *t, int64_t *dueNs, uint64_t *missed, int64_t *stepNs);
+void tick_close(tickTimer *t);
+
+int  tick_watchInit(clockWatch *w);
+int  tick_watchCheck(clockWatch *w, int64_t *stepNs);
+void tick_watchClose(clockWatch *w);
+
+#endif // MAG_USB_TICKER_H
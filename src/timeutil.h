@@ -0,0 +1,73 @@
+//=========================================================================
+// timeutil.h
+//
+// Small clock helpers shared by the acquisition and output paths.
+// Times are carried as signed 64-bit nanosecond counts so they can be
+// subtracted and averaged without timespec carry handling.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_TIMEUTIL_H
+#define MAG_USB_TIMEUTIL_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define NSEC_PER_USEC   1000LL
+#define NSEC_PER_MSEC   1000000LL
+#define NSEC_PER_SEC    1000000000LL
+
+//------------------------------------------
+// clock_ns()
+//------------------------------------------
+static inline int64_t clock_ns(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+//------------------------------------------
+// mono_ns()
+//------------------------------------------
+static inline int64_t mono_ns(void)
+{
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+//------------------------------------------
+// clock_pair_ns()
+// CLOCK_REALTIME and CLOCK_MONOTONIC for the same instant.  The
+// realtime read is bracketed by two monotonic reads and paired with
+// their midpoint, which keeps the skew between the two well under a
+// microsecond.
+//------------------------------------------
+static inline void clock_pair_ns(int64_t *real_ns, int64_t *mono)
+{
+    int64_t m0 = clock_ns(CLOCK_MONOTONIC);
+    int64_t r  = clock_ns(CLOCK_REALTIME);
+    int64_t m1 = clock_ns(CLOCK_MONOTONIC);
+    *real_ns = r;
+    *mono    = m0 + (m1 - m0) / 2;
+}
+
+//------------------------------------------
+// sleep_until_mono_ns()
+// Absolute CLOCK_MONOTONIC sleep, retried on EINTR.
+//------------------------------------------
+static inline void sleep_until_mono_ns(int64_t t)
+{
+    struct timespec ts;
+    ts.tv_sec  = (time_t)(t / NSEC_PER_SEC);
+    ts.tv_nsec = (long)(t % NSEC_PER_SEC);
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+    {
+        if(mono_ns() >= t)
+        {
+            break;
+        }
+    }
+}
+
+#endif // MAG_USB_TIMEUTIL_H
@@ -0,0 +1,156 @@
+//=========================================================================
+// trace.c
+//
+// Per-stage latency of every sample, from the POLL trigger to the last
+// sink write.
+//
+// When a record comes out late, the question is which stage took the
+// time: the trigger write, the conversion and DRDY wait, the XYZ read,
+// a temperature read, the wait in the ring, formatting, or one of the
+// sinks.  Each stage is bracketed with CLOCK_MONOTONIC reads (a vDSO
+// call, tens of ns) and its duration goes into a log-linear histogram
+// of its own, so the cost is a few clock reads and relaxed atomic adds
+// per sample and the tracing can stay on in production.  The stages
+// of the acquisition thread and of the output thread are recorded from
+// where they run; a sample carries only the instants that cross the
+// ring (see magSample.queuedMonoNs).
+//
+// The p50/p99/p99.9/max of every stage are reported on the "latency"
+// control command, every [trace] interval seconds if set, and at exit.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include "main.h"
+#include "trace.h"
+#include "timeutil.h"
+
+static const char *trcNames[TRC_STAGES] =
+{
+    "trigger", "drdy", "xyz", "temp", "queue", "format",
+    "console", "pipe", "websocket", "file", "flush", "total"
+};
+
+static latHdr  trcHist[TRC_STAGES];
+static int     trcEnabled = FALSE;
+static int64_t trcNextDumpNs;
+
+//---------------------------------------------------------------
+// trc_init(pList *p)
+//---------------------------------------------------------------
+int trc_init(pList *p)
+{
+    trcEnabled = p->trcEnable;
+    trc_reset();
+    trcNextDumpNs = mono_ns() + (int64_t)p->trcInterval * NSEC_PER_SEC;
+    return 0;
+}
+
+//---------------------------------------------------------------
+// trc_now()
+// The start of a stage: CLOCK_MONOTONIC, or 0 with tracing off.
+//---------------------------------------------------------------
+int64_t trc_now(void)
+{
+    return trcEnabled ? mono_ns() : 0;
+}
+
+//---------------------------------------------------------------
+// trc_lap(trcStage stage, int64_t startNs)
+//
+// Ends a stage begun at startNs (from trc_now(), or 0 if it was not
+// timed) and returns the end instant, so back-to-back stages take one
+// clock read each.
+//---------------------------------------------------------------
+int64_t trc_lap(trcStage stage, int64_t startNs)
+{
+    if(!trcEnabled)
+    {
+        return 0;
+    }
+    int64_t now = mono_ns();
+    if(startNs > 0)
+    {
+        lat_hdrRecord(&trcHist[stage], now - startNs);
+    }
+    return now;
+}
+
+//---------------------------------------------------------------
+// trc_record(trcStage stage, int64_t ns)
+// A duration measured by the caller, e.g. from a sample's own stamps.
+//---------------------------------------------------------------
+void trc_record(trcStage stage, int64_t ns)
+{
+    if(trcEnabled)
+    {
+        lat_hdrRecord(&trcHist[stage], ns);
+    }
+}
+
+//---------------------------------------------------------------
+// trc_reset()
+//---------------------------------------------------------------
+void trc_reset(void)
+{
+    for(int i = 0; i < TRC_STAGES; i++)
+    {
+        lat_hdrReset(&trcHist[i]);
+    }
+}
+
+//---------------------------------------------------------------
+// trc_format(char *buf, size_t len)
+//
+// JSON object with one lat_hdrFormat() object per stage that has
+// recorded anything.  Returns the length snprintf() would have written.
+//---------------------------------------------------------------
+int trc_format(char *buf, size_t len)
+{
+    const char *sep = "";
+    int used = snprintf(buf, len, "{");
+
+    for(int i = 0; i < TRC_STAGES && used >= 0; i++)
+    {
+        if(atomic_load_explicit(&trcHist[i].count, memory_order_relaxed) == 0)
+        {
+            continue;
+        }
+        used += snprintf(buf + ((size_t)used < len ? (size_t)used : len),
+                         (size_t)used < len ? len - (size_t)used : 0,
+                         "%s \"%s\": ", sep, trcNames[i]);
+        if(used >= 0)
+        {
+            used += lat_hdrFormat(&trcHist[i], buf + ((size_t)used < len ? (size_t)used : len),
+                                  (size_t)used < len ? len - (size_t)used : 0);
+        }
+        sep = ",";
+    }
+    if(used >= 0)
+    {
+        used += snprintf(buf + ((size_t)used < len ? (size_t)used : len),
+                         (size_t)used < len ? len - (size_t)used : 0, " }");
+    }
+    return used;
+}
+
+//---------------------------------------------------------------
+// trc_service(pList *p)
+//
+// Called by the output thread between drains; writes the periodic
+// dump when one is due.  The histograms are cumulative since start
+// (or the last "latency reset").
+//---------------------------------------------------------------
+void trc_service(pList *p)
+{
+    char stages[2048];
+
+    if(!trcEnabled || p->trcInterval <= 0 || mono_ns() < trcNextDumpNs)
+    {
+        return;
+    }
+    trcNextDumpNs = mono_ns() + (int64_t)p->trcInterval * NSEC_PER_SEC;
+    trc_format(stages, sizeof stages);
+    fprintf(OUTPUT_ERROR, "{ \"lastStatus\": \"latency\", \"stages\": %s }\n", stages);
+    fflush(OUTPUT_ERROR);
+}
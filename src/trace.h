@@ -0,0 +1,53 @@
+//=========================================================================
+// trace.h
+//
+// Per-stage latency of every sample, from the POLL trigger to the last
+// sink write.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_TRACE_H
+#define MAG_USB_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct tag_pList;
+typedef struct tag_pList pList;
+
+//------------------------------------------
+// Stages, in the order a sample goes through them.  Each is timed on
+// CLOCK_MONOTONIC and recorded on its own; a stage that did not run
+// for a sample (DRDY skipped under poll_pipeline, no temperature read
+// due, a sink the product does not use) records nothing.
+//------------------------------------------
+typedef enum
+{
+    TRC_TRIGGER = 0,                // POLL trigger batch write
+    TRC_DRDY,                       // trigger to DRDY seen (conversion and wait)
+    TRC_XYZ,                        // XYZ data read
+    TRC_TEMP,                       // MCP9808 read, when one is due
+    TRC_QUEUE,                      // ring push to pop
+    TRC_FORMAT,                     // JSON or binary record formatting
+    TRC_CONSOLE,                    // console write and fflush
+    TRC_PIPE,                       // data pipe write
+    TRC_WEBSOCKET,                  // WebSocket broadcast
+    TRC_FILE,                       // product file write (buffered)
+    TRC_FLUSH,                      // product file flush after a drain
+    TRC_TOTAL,                      // trigger (DRDY in CMM) to all products fed
+    TRC_STAGES
+} trcStage;
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int     trc_init(pList *p);
+int64_t trc_now(void);
+int64_t trc_lap(trcStage stage, int64_t startNs);
+void    trc_record(trcStage stage, int64_t ns);
+void    trc_reset(void);
+int     trc_format(char *buf, size_t len);
+void    trc_service(pList *p);
+
+#endif // MAG_USB_TRACE_H
@@ -0,0 +1,353 @@
+//=========================================================================
+// trigger.c
+//
+// Event trigger with pre-trigger history for burst capture.
+//
+// Every record with a valid primary vector goes into a fixed ring of
+// the last TRIGGER_HISTORY_LEN records, along with running per-axis
+// sums, so both detectors cost a couple of binary searches and a few
+// subtractions per sample:
+//
+//   |dB/dt|  the change of the primary vector over the last
+//            trigDbdtWindow seconds, divided by the time it took;
+//   step     the difference, on any axis, between the means of the
+//            last trigStepWindow seconds and the trigStepWindow
+//            seconds before them.
+//
+// A trigger opens an event file, writes the history back to trigPre
+// seconds before the triggering record, and then every record until
+// trigPost seconds have passed without a further trigger.  Normal
+// output is not affected.  Memory is fixed and nothing is allocated
+// per sample; the only system calls are the event file's open, write
+// and close.  Runs on the output thread.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <linux/limits.h>
+#include "main.h"
+#include "trigger.h"
+#include "magdata.h"
+#include "timeutil.h"
+#include "recfmt.h"
+
+#define TRIG_NONE   0
+#define TRIG_DBDT   1
+#define TRIG_STEP   2
+
+typedef struct
+{
+    magRecord rec;
+    double    cum[3];               // sum of (nT - trigRef) up to and including rec
+} trigEntry;
+
+static trigEntry trigHistory[TRIGGER_HISTORY_LEN];
+static uint64_t  trigHead;          // records ever stored
+static double    trigRef[3];        // keeps the running sums small
+static int       trigFd = -1;       // open event file
+static uint64_t  trigEventNo;
+static uint64_t  trigWritten;       // records in the open event file
+static uint64_t  trigLastSeq;
+static int64_t   trigPostUntilNs;
+
+#define ENTRY(i)    trigHistory[(i) & (TRIGGER_HISTORY_LEN - 1)]
+
+//---------------------------------------------------------------
+// trig_oldest()
+//---------------------------------------------------------------
+static uint64_t trig_oldest(void)
+{
+    return (trigHead > TRIGGER_HISTORY_LEN) ? trigHead - TRIGGER_HISTORY_LEN : 0;
+}
+
+//---------------------------------------------------------------
+// trig_findFrom(int64_t tNs)
+// Index of the oldest stored record at or after tNs.
+//---------------------------------------------------------------
+static uint64_t trig_findFrom(int64_t tNs)
+{
+    uint64_t lo = trig_oldest();
+    uint64_t hi = trigHead;
+
+    while(lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if(ENTRY(mid).rec.tNs < tNs)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+//---------------------------------------------------------------
+// trig_detect(const pList *p, double *value, int *axis)
+//
+// Runs both detectors on the newest stored record.  Returns TRIG_*
+// with the measured value and, for a step, the axis that crossed.
+//---------------------------------------------------------------
+static int trig_detect(const pList *p, double *value, int *axis)
+{
+    uint64_t last = trigHead - 1;
+    const trigEntry *e = &ENTRY(last);
+    int64_t now = e->rec.tNs;
+
+    *axis = -1;
+    if(p->trigDbdt > 0.0)
+    {
+        uint64_t j = trig_findFrom(now - (int64_t)(p->trigDbdtWindow * 1e9));
+        if(j < last)
+        {
+            const trigEntry *o = &ENTRY(j);
+            double dt = (double)(now - o->rec.tNs) / 1e9;
+            if(dt >= p->trigDbdtWindow / 2)
+            {
+                double dx = e->rec.nT[0][0] - o->rec.nT[0][0];
+                double dy = e->rec.nT[0][1] - o->rec.nT[0][1];
+                double dz = e->rec.nT[0][2] - o->rec.nT[0][2];
+                double rate = sqrt(dx * dx + dy * dy + dz * dz) / dt;
+                if(rate > p->trigDbdt)
+                {
+                    *value = rate;
+                    return TRIG_DBDT;
+                }
+            }
+        }
+    }
+    if(p->trigStep > 0.0)
+    {
+        int64_t w = (int64_t)(p->trigStepWindow * 1e9);
+        uint64_t a = trig_findFrom(now - 2 * w);
+        uint64_t m = trig_findFrom(now - w);
+
+        // Only with the full 2 * window of history, i.e. a record
+        // older than both windows is still stored.
+        if(a > trig_oldest() && a < m && m <= last)
+        {
+            for(int k = 0; k < 3; k++)
+            {
+                double before = (ENTRY(m - 1).cum[k] - ENTRY(a - 1).cum[k]) / (double)(m - a);
+                double after  = (e->cum[k] - ENTRY(m - 1).cum[k]) / (double)(last - m + 1);
+                if(fabs(after - before) > p->trigStep)
+                {
+                    *value = after - before;
+                    *axis  = k;
+                    return TRIG_STEP;
+                }
+            }
+        }
+    }
+    return TRIG_NONE;
+}
+
+//---------------------------------------------------------------
+// trig_write(const pList *p, const magRecord *r)
+//---------------------------------------------------------------
+static void trig_write(pList *p, const magRecord *r)
+{
+    char line[FMT_RECORD_MAX];
+    size_t len = fmt_record(p, r, FMT_TS_TEXT, line, sizeof line);
+
+    if(write(trigFd, line, len) != (ssize_t)len)
+    {
+        fprintf(OUTPUT_ERROR, "Event file write failed: %s\n", strerror(errno));
+    }
+    trigWritten++;
+    trigLastSeq = r->seq;
+}
+
+//---------------------------------------------------------------
+// trig_note(const char *line)
+// Event markers go to the event file and to stderr.
+//---------------------------------------------------------------
+static void trig_note(const char *line)
+{
+    size_t len = strlen(line);
+
+    if(trigFd >= 0 && write(trigFd, line, len) != (ssize_t)len)
+    {
+        fprintf(OUTPUT_ERROR, "Event file write failed: %s\n", strerror(errno));
+    }
+    fputs(line, OUTPUT_ERROR);
+    fflush(OUTPUT_ERROR);
+}
+
+//---------------------------------------------------------------
+// trig_open(pList *p, int reason, double value, int axis)
+//
+// Starts an event file and writes the pre-trigger history into it.
+//---------------------------------------------------------------
+static void trig_open(pList *p, int reason, double value, int axis)
+{
+    static const char *axisNames[3] = { "\"x\"", "\"y\"", "\"z\"" };
+    const magRecord *r = &ENTRY(trigHead - 1).rec;
+    const char *dir = p->trigDir ? p->trigDir : (p->log_output_path ? p->log_output_path : ".");
+    char path[PATH_MAX];
+    char stamp[32];
+    char line[PATH_MAX + 256];
+    struct tm utc;
+    time_t sec = (time_t)(r->tNs / NSEC_PER_SEC);
+
+    gmtime_r(&sec, &utc);
+    strftime(stamp, sizeof stamp, "%Y%m%dT%H%M%SZ", &utc);
+    snprintf(path, sizeof path, "%s/event-%s-%" PRIu64 ".jsonl", dir, stamp, r->seq);
+    trigFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(trigFd < 0)
+    {
+        fprintf(OUTPUT_ERROR, "Unable to create event file %s: %s\n", path, strerror(errno));
+        return;
+    }
+    trigEventNo = atomic_fetch_add(&p->trigEvents, 1) + 1;
+    trigWritten = 0;
+    trigPostUntilNs = r->tNs + (int64_t)(p->trigPost * 1e9);
+
+    snprintf(line, sizeof line,
+             "{ \"lastStatus\": \"trigger\", \"event\": %" PRIu64 ", \"seq\": %" PRIu64 ", \"t_ns\": %" PRId64
+             ", \"reason\": \"%s\", \"axis\": %s, \"value\": %.3f, \"threshold\": %.3f, \"file\": \"%s\" }\n",
+             trigEventNo, r->seq, r->tNs, (reason == TRIG_DBDT) ? "dbdt" : "step",
+             (axis >= 0) ? axisNames[axis] : "null", value,
+             (reason == TRIG_DBDT) ? p->trigDbdt : p->trigStep, path);
+    trig_note(line);
+
+    for(uint64_t i = trig_findFrom(r->tNs - (int64_t)(p->trigPre * 1e9)); i < trigHead; i++)
+    {
+        trig_write(p, &ENTRY(i).rec);
+    }
+}
+
+//---------------------------------------------------------------
+// trig_end(pList *p)
+//---------------------------------------------------------------
+static void trig_end(pList *p)
+{
+    char line[160];
+
+    (void)p;
+    snprintf(line, sizeof line,
+             "{ \"lastStatus\": \"trigger_end\", \"event\": %" PRIu64 ", \"last_seq\": %" PRIu64 ", \"records\": %" PRIu64 " }\n",
+             trigEventNo, trigLastSeq, trigWritten);
+    trig_note(line);
+    close(trigFd);
+    trigFd = -1;
+}
+
+//---------------------------------------------------------------
+// trig_restart(const magRecord *r)
+//
+// The history is searched by tNs, so it must not run backwards.
+// After a host clock step it starts again from r on the new clock;
+// an open event carries on, with its end moved by the step.
+//---------------------------------------------------------------
+static void trig_restart(const magRecord *r)
+{
+    if(trigFd >= 0)
+    {
+        trigPostUntilNs += r->clockStepNs;
+    }
+    trigHead = 0;
+}
+
+//---------------------------------------------------------------
+// trig_init(pList *p)
+//---------------------------------------------------------------
+int trig_init(pList *p)
+{
+    atomic_init(&p->trigEvents, 0);
+    trigHead = 0;
+    trigFd   = -1;
+    if(!p->trigEnable)
+    {
+        return 0;
+    }
+    if(p->trigDbdt <= 0.0 && p->trigStep <= 0.0)
+    {
+        fprintf(OUTPUT_ERROR, "Trigger enabled without a dbdt or step threshold\n");
+    }
+    if(p->samplingMode == CMM)
+    {
+        double span = (double)TRIGGER_HISTORY_LEN * (double)getCMMPeriodNs(p) / 1e9;
+        if(p->trigPre > span || 2 * p->trigStepWindow > span || p->trigDbdtWindow > span)
+        {
+            fprintf(OUTPUT_ERROR, "Trigger history holds %.1f s at the CMM rate; longer windows are cut short\n", span);
+        }
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------
+// trig_feed(pList *p, const magRecord *r)
+//---------------------------------------------------------------
+void trig_feed(pList *p, const magRecord *r)
+{
+    double value;
+    int axis;
+
+    if(!p->trigEnable)
+    {
+        return;
+    }
+    // A step can also come with a sample lost to a ring overflow, so
+    // a record older than the newest stored one restarts as well.
+    if(r->clockStepNs != 0 || (trigHead > 0 && r->tNs < ENTRY(trigHead - 1).rec.tNs))
+    {
+        trig_restart(r);
+    }
+    if(!(r->validMask & 1u))
+    {
+        // Nothing to detect on, but keep an open event complete.
+        if(trigFd >= 0)
+        {
+            trig_write(p, r);
+        }
+        return;
+    }
+
+    trigEntry *e = &ENTRY(trigHead);
+    e->rec = *r;
+    for(int k = 0; k < 3; k++)
+    {
+        if(trigHead == 0)
+        {
+            trigRef[k] = r->nT[0][k];
+        }
+        e->cum[k] = (trigHead ? ENTRY(trigHead - 1).cum[k] : 0.0) + (r->nT[0][k] - trigRef[k]);
+    }
+    trigHead++;
+
+    int reason = trig_detect(p, &value, &axis);
+    if(trigFd >= 0)
+    {
+        trig_write(p, r);
+        if(reason != TRIG_NONE)
+        {
+            trigPostUntilNs = r->tNs + (int64_t)(p->trigPost * 1e9);
+        }
+        else if(r->tNs > trigPostUntilNs)
+        {
+            trig_end(p);
+        }
+    }
+    else if(reason != TRIG_NONE)
+    {
+        trig_open(p, reason, value, axis);
+    }
+}
+
+//---------------------------------------------------------------
+// trig_close(pList *p)
+//---------------------------------------------------------------
+void trig_close(pList *p)
+{
+    if(trigFd >= 0)
+    {
+        trig_end(p);
+    }
+}
@@ -0,0 +1,23 @@
+//=========================================================================
+// trigger.h
+//
+// Event trigger with pre-trigger history for burst capture.
+//
+// Date:        October 18, 2026
+// License:     GPL 3.0
+//=========================================================================
+#ifndef MAG_USB_TRIGGER_H
+#define MAG_USB_TRIGGER_H
+
+#include "main.h"
+
+#define TRIGGER_HISTORY_LEN 4096        // records, power of two; ~27 s at 150 Hz
+
+//------------------------------------------
+// Prototypes
+//------------------------------------------
+int  trig_init(pList *p);
+void trig_feed(pList *p, const magRecord *r);
+void trig_close(pList *p);
+
+#endif // MAG_USB_TRIGGER_H
@@ -14,7 +14,7 @@
 
 namespace {
 constexpr uint32_t kRecvBufSize = 4096;
-constexpr uint32_t kMaxConns = 16;
+constexpr uint32_t kMaxConns = WS_MAX_CONNS;
 
 struct ConnState {
     bool connected = false;
@@ -118,12 +118,24 @@ void ws_server_poll(void) {
     g_server.poll(&g_handler);
 }
 
-void ws_server_broadcast(const char *payload, size_t payload_len) {
-    if (!g_running || payload == nullptr) {
-        return;
+// The sockets ws_server_poll() has work for when one is readable: each
+// open connection, then the listening socket while another can be
+// taken.  The set changes across ws_server_poll() and broadcasts.
+int ws_server_fds(int *fds, int max) {
+    if (!g_running || fds == nullptr || max <= 0) {
+        return 0;
     }
-    if (payload_len == 0) {
-        payload_len = strlen(payload);
+    return static_cast<int>(g_server.getFds(fds, static_cast<uint32_t>(max)));
+}
+
+static int broadcast(uint8_t opcode, const char *payload, size_t payload_len, int *failed) {
+    int sent = 0;
+    int lost = 0;
+    if (failed) {
+        *failed = 0;
+    }
+    if (!g_running || payload == nullptr) {
+        return 0;
     }
     for (auto it = g_connections.begin(); it != g_connections.end();) {
         Connection *conn = *it;
@@ -131,10 +143,31 @@ void ws_server_broadcast(const char *payload, size_t payload_len) {
             it = g_connections.erase(it);
             continue;
         }
-        conn->send(websocket::OPCODE_TEXT, reinterpret_cast<const uint8_t *>(payload),
+        conn->send(opcode, reinterpret_cast<const uint8_t *>(payload),
                    static_cast<uint32_t>(payload_len));
+        // A send error closes the connection inside the library.
+        if (conn->isConnected()) {
+            ++sent;
+        } else {
+            ++lost;
+        }
         ++it;
     }
+    if (failed) {
+        *failed = lost;
+    }
+    return sent;
+}
+
+int ws_server_broadcast(const char *payload, size_t payload_len, int *failed) {
+    if (payload != nullptr && payload_len == 0) {
+        payload_len = strlen(payload);
+    }
+    return broadcast(websocket::OPCODE_TEXT, payload, payload_len, failed);
+}
+
+int ws_server_broadcast_binary(const void *payload, size_t payload_len, int *failed) {
+    return broadcast(websocket::OPCODE_BINARY, static_cast<const char *>(payload), payload_len, failed);
 }
 
 const char *ws_server_last_error(void) {
@@ -10,6 +10,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#define WS_MAX_CONNS    16
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -17,7 +19,9 @@ extern "C" {
 int ws_server_init(const char *bind_addr, uint16_t port);
 void ws_server_shutdown(void);
 void ws_server_poll(void);
-void ws_server_broadcast(const char *payload, size_t payload_len);
+int ws_server_fds(int *fds, int max);
+int ws_server_broadcast(const char *payload, size_t payload_len, int *failed);
+int ws_server_broadcast_binary(const void *payload, size_t payload_len, int *failed);
 const char *ws_server_last_error(void);
 int ws_server_is_running(void);
 
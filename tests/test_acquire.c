@@ -0,0 +1,309 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "acquire.h"
+#include "halt.h"
+#include "i2c-pololu.h"
+#include "magdata.h"
+#include "rm3100.h"
+#include "timeutil.h"
+
+static int tests_failed = 0;
+#define ASSERT_TRUE(cond, msg)                                                                                         \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s\n", msg);                                                         \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+#define ASSERT_EQ_I64(a, b, msg)                                                                                       \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if ((int64_t)(a) != (int64_t)(b))                                                                              \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s (got %lld expected %lld)\n", msg, (long long)(a),              \
+                    (long long)(b));                                                                                   \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+static void on_timeout(int sig)
+{
+    (void)sig;
+    const char msg[] = "\nTEST TIMEOUT: tests did not progress. Failing gracefully.\n";
+    write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    _exit(124);
+}
+
+// main.c is not linked; the modules acquire.c pulls in only need these.
+void countsToNT(const pList *p, const int *gain, const int32_t *counts, double *xyz)
+{
+    (void)p;
+    for (int k = 0; k < 3; k++)
+    {
+        xyz[k] = (double)counts[k] / gain[k];
+    }
+}
+
+struct tm *getUTC()
+{
+    static struct tm utc;
+    time_t now = time(NULL);
+    return gmtime_r(&now, &utc);
+}
+
+// One RM3100 behind a Pololu adapter.  In CMM conversion k ends at
+// t0 + k * period; the result registers hold the latest one, with its
+// k as the X counts, and DRDY is set until it is read.
+typedef struct
+{
+    int            sock;
+    pthread_t      tid;
+    int64_t        periodNs;
+    uint8_t        reg;             // register pointer
+    uint8_t        cmm;             // last CMM register write
+    int64_t        t0;              // CMM started, CLOCK_MONOTONIC
+    int64_t        readK;           // last conversion read
+    volatile int   failStatus;      // fail this many STATUS reads
+    volatile int   failXyz;         // fail this many result reads
+    volatile int64_t muteUntilNs;   // DRDY stays clear until then
+} rm3100_mock;
+
+static int64_t mock_done(const rm3100_mock *m)
+{
+    return (m->cmm & CMMMODE_START) ? (mono_ns() - m->t0) / m->periodNs : 0;
+}
+
+static void mock_write(rm3100_mock *m, const uint8_t *data, size_t n)
+{
+    uint8_t status = ERROR_NONE;
+
+    m->reg = data[0];
+    if (n > 1 && m->reg == RM3100I2C_CMM)
+    {
+        if ((data[1] & CMMMODE_START) && !(m->cmm & CMMMODE_START))
+        {
+            m->t0    = mono_ns();
+            m->readK = 0;
+        }
+        m->cmm = data[1];
+    }
+    if (n == 1 && m->reg == RM3100I2C_STATUS && m->failStatus > 0)
+    {
+        m->failStatus--;
+        status = ERROR_ADDRESS_NACK;
+    }
+    write(m->sock, &status, 1);
+}
+
+static void mock_read(rm3100_mock *m, uint8_t size)
+{
+    uint8_t resp[1 + 255];
+    int64_t k = mock_done(m);
+
+    memset(resp, 0, sizeof resp);
+    if (m->reg == RM3100I2C_STATUS)
+    {
+        resp[1] = (k > m->readK && mono_ns() >= m->muteUntilNs) ? RM3100I2C_READMASK : 0;
+    }
+    else if (m->reg == RM3100I2C_XYZ && m->failXyz > 0)
+    {
+        m->failXyz--;
+        resp[0] = ERROR_ADDRESS_NACK;
+    }
+    else if (m->reg == RM3100I2C_XYZ)
+    {
+        resp[1] = (uint8_t)(k >> 16);
+        resp[2] = (uint8_t)(k >> 8);
+        resp[3] = (uint8_t)k;
+        m->readK = k;
+    }
+    write(m->sock, resp, 1u + size);
+}
+
+static void *mock_thread(void *arg)
+{
+    rm3100_mock *m = arg;
+    uint8_t buf[1024];
+    size_t  len = 0;
+
+    for (;;)
+    {
+        ssize_t rd = read(m->sock, buf + len, sizeof buf - len);
+        if (rd < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (rd <= 0)
+        {
+            break;
+        }
+        len += (size_t)rd;
+
+        size_t used = 0;
+        while (len - used >= 3)
+        {
+            uint8_t *c = buf + used;
+            if (c[0] == CMD_I2C_WRITE)
+            {
+                if (len - used < 3u + c[2])
+                {
+                    break;
+                }
+                mock_write(m, c + 3, c[2]);
+                used += 3u + c[2];
+            }
+            else if (c[0] == CMD_I2C_READ)
+            {
+                mock_read(m, c[2]);
+                used += 3;
+            }
+            else
+            {
+                used++;
+            }
+        }
+        memmove(buf, buf + used, len - used);
+        len -= used;
+    }
+    return NULL;
+}
+
+static pList              p;
+static i2c_pololu_adapter ad;
+static rm3100_mock        mock;
+
+static void open_sensor()
+{
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+
+    memset(&mock, 0, sizeof mock);
+    mock.sock = sv[1];
+    i2c_pololu_init(&ad);
+    ad.fd = sv[0];
+
+    p.adapter        = &ad;
+    p.numMags        = 1;
+    p.magAddr        = 0x20;
+    p.magAddrs[0]    = 0x20;
+    p.samplingMode   = CMM;
+    p.TMRCRate       = TMRC_VAL_18;                 // slow enough for a busy host
+    p.cc_x = p.cc_y = p.cc_z = 50;
+    p.x_gain = p.y_gain = p.z_gain = 20;
+    p.tempNextDueNs  = INT64_MAX;                   // no MCP9808
+    mock.periodNs    = getCMMPeriodNs(&p);
+    pthread_create(&mock.tid, NULL, mock_thread, &mock);
+}
+
+static void close_sensor()
+{
+    shutdown(mock.sock, SHUT_RDWR);
+    pthread_join(mock.tid, NULL);
+    close(mock.sock);
+    i2c_pololu_disconnect(&ad);
+}
+
+// Failed reads, a DRDY timeout and a late host in the middle of a CMM
+// stream: the seq of the first sample queued after each must still be
+// its conversion's.  Only the seqs around a fault are compared, so a
+// busy test host misplacing an ordinary tick cannot fail the test.
+static void test_cmm_seq()
+{
+    magSample s;
+    uint64_t  seq0 = 0, prevSeq = 0;
+    int64_t   prevK = 0;
+    int       samples = 0, failed = 0, checked = 0;
+    bool      fault = false;
+
+    acq_init(&p);
+    for (int i = 0; i < 60; i++)
+    {
+        switch (i)
+        {
+            case 10: mock.failStatus = 1; fault = true; break;
+            case 20: mock.failXyz = 1; fault = true; break;
+            case 30: mock.muteUntilNs = INT64_MAX; fault = true; break;    // until the DRDY wait times out
+            case 40: usleep((useconds_t)(3 * mock.periodNs / NSEC_PER_USEC)); fault = true; break;
+            default: break;
+        }
+        int rv = acq_cmmNext(&p, &s);
+        if (mock.muteUntilNs)
+        {
+            // Whatever converted while DRDY was stuck is gone, so the
+            // next DRDY is a fresh conversion's.
+            mock.readK       = mock_done(&mock);
+            mock.muteUntilNs = 0;
+        }
+        if (rv <= 0)
+        {
+            failed++;
+            continue;
+        }
+        int64_t k = s.xyz[0][0];
+        if (samples++ == 0)
+        {
+            seq0 = s.seq;
+        }
+        else
+        {
+            ASSERT_TRUE(s.seq > prevSeq, "seqs increase");
+            if (fault && s.seq - prevSeq != (uint64_t)(k - prevK))
+            {
+                fprintf(OUTPUT_ERROR, "ASSERT FAILED: conversion %lld queued as seq %llu, expected %llu\n",
+                        (long long)k, (unsigned long long)s.seq,
+                        (unsigned long long)(prevSeq + (uint64_t)(k - prevK)));
+                tests_failed++;
+            }
+            checked += fault;
+            fault = false;
+        }
+        prevSeq = s.seq;
+        prevK   = k;
+    }
+    ASSERT_TRUE(checked == 4, "a sample queued after every fault");
+    ASSERT_TRUE(failed >= 3, "failed read, failed data read and DRDY timeout returned no sample");
+    ASSERT_TRUE(p.drdyTimeouts == 1, "one DRDY timeout");
+    ASSERT_EQ_I64(p.sampleSeq, prevSeq + 1, "next seq follows the last sample");
+    ASSERT_EQ_I64(p.acqMisses, (int64_t)(p.sampleSeq - seq0) - samples, "every seq not queued is a miss");
+    ASSERT_TRUE(p.acqMisses >= 4, "the failed reads, the timeout and the late host lost conversions");
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_timeout;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGALRM, &sa, NULL);
+    alarm(30);
+
+    halt_init();
+    open_sensor();
+    test_cmm_seq();
+    close_sensor();
+    halt_close();
+    alarm(0);
+
+    if (tests_failed)
+    {
+        fprintf(OUTPUT_ERROR, "\nTESTS FAILED: %d\n", tests_failed);
+        return 1;
+    }
+    printf("All tests passed.\n");
+    return 0;
+}
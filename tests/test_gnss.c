@@ -0,0 +1,283 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "gnss.h"
+#include "halt.h"
+#include "timeutil.h"
+
+static int tests_failed = 0;
+#define ASSERT_TRUE(cond, msg)                                                                                         \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s\n", msg);                                                         \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+#define ASSERT_EQ_I64(a, b, msg)                                                                                       \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if ((int64_t)(a) != (int64_t)(b))                                                                              \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s (got %lld expected %lld)\n", msg, (long long)(a),              \
+                    (long long)(b));                                                                                   \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+static void on_timeout(int sig)
+{
+    (void)sig;
+    const char msg[] = "\nTEST TIMEOUT: tests did not progress. Failing gracefully.\n";
+    write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    _exit(124);
+}
+
+// 2026-10-18 00:00:00 UTC
+#define DAY_NS (1792281600LL * NSEC_PER_SEC)
+
+// Appends "$<body>*CS\r\n" to out.
+static size_t nmea(char *out, const char *body)
+{
+    unsigned sum = 0;
+    for (const char *c = body; *c; ++c)
+    {
+        sum ^= (unsigned char)*c;
+    }
+    return (size_t)sprintf(out, "$%s*%02X\r\n", body, sum);
+}
+
+// Copies bytes into the parser the way gnss_read() does and scans them.
+static int feed(gnssParser *g, const void *data, size_t n, int64_t monoNs)
+{
+    memcpy(g->buf + g->len, data, n);
+    return gnss_scan(g, n, monoNs);
+}
+
+static size_t ubx_timtp(uint8_t *out, uint32_t towMs, uint16_t week, uint8_t flags)
+{
+    uint8_t ck_a = 0, ck_b = 0;
+    uint8_t f[24] = { 0xB5, 0x62, 0x0D, 0x01, 16, 0 };
+    f[6]  = (uint8_t)towMs;
+    f[7]  = (uint8_t)(towMs >> 8);
+    f[8]  = (uint8_t)(towMs >> 16);
+    f[9]  = (uint8_t)(towMs >> 24);
+    f[18] = (uint8_t)week;
+    f[19] = (uint8_t)(week >> 8);
+    f[20] = flags;
+    for (int i = 2; i < 22; ++i)
+    {
+        ck_a = (uint8_t)(ck_a + f[i]);
+        ck_b = (uint8_t)(ck_b + ck_a);
+    }
+    f[22] = ck_a;
+    f[23] = ck_b;
+    memcpy(out, f, sizeof f);
+    return sizeof f;
+}
+
+static void test_nmea_split_reads()
+{
+    static gnssParser g;
+    char burst[512];
+    size_t n = 0;
+
+    gnss_reset(&g, 4, 0);
+    n += nmea(burst + n, "GPGGA,123456.00,4000.0000,N,10500.0000,W,1,08,1.0,1600.0,M,0.0,M,,");
+    n += nmea(burst + n, "GNRMC,123456.00,A,4000.0000,N,10500.0000,W,0.0,0.0,181026,,,A");
+    n += nmea(burst + n, "GPZDA,123456.00,18,10,2026,00,00");
+
+    // One byte at a time, all within the same burst.
+    int fixes = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        fixes += feed(&g, burst + i, 1, NSEC_PER_SEC + (int64_t)i * 1000);
+    }
+    ASSERT_EQ_I64(fixes, 1, "RMC and ZDA of one epoch make one fix");
+    ASSERT_EQ_I64(g.messages, 3, "every sentence checked");
+    ASSERT_EQ_I64(g.fixUtcNs, DAY_NS + (12 * 3600 + 34 * 60 + 56) * NSEC_PER_SEC, "RMC time and date");
+    ASSERT_EQ_I64(g.offsetNs, g.fixUtcNs - NSEC_PER_SEC, "burst start marks the epoch");
+    ASSERT_EQ_I64(g.len, 0, "nothing left over");
+}
+
+static void test_nmea_rejects()
+{
+    static gnssParser g;
+    char buf[256];
+    size_t n;
+
+    gnss_reset(&g, 4, 0);
+    n = nmea(buf, "GPZDA,000001.50,18,10,2026,00,00");
+    buf[n - 3] ^= 1;                                    // corrupt the checksum
+    ASSERT_EQ_I64(feed(&g, buf, n, NSEC_PER_SEC), 0, "bad checksum");
+    ASSERT_EQ_I64(g.rejected, 1, "bad checksum counted");
+
+    n = nmea(buf, "GPRMC,000002.00,V,,,,,,,181026,,,N");
+    ASSERT_EQ_I64(feed(&g, buf, n, 2 * NSEC_PER_SEC), 0, "RMC without a fix");
+    n = nmea(buf, "GPZDA,000002.00,18,10,2026,00,00");
+    ASSERT_EQ_I64(feed(&g, buf, n, 2 * NSEC_PER_SEC + 1000), 0, "ZDA untrusted after RMC V");
+
+    n = (size_t)sprintf(buf, "\x01\xff garbage ");
+    n += nmea(buf + n, "GPRMC,000003.25,A,,,,,,,181026,,,A");
+    ASSERT_EQ_I64(feed(&g, buf, n, 3 * NSEC_PER_SEC), 1, "RMC A after noise");
+    ASSERT_EQ_I64(g.fixUtcNs, DAY_NS + 3 * NSEC_PER_SEC + 250 * NSEC_PER_MSEC, "fractional seconds");
+}
+
+static void test_ubx_timtp()
+{
+    static gnssParser g;
+    uint8_t buf[64];
+    size_t n;
+    // GPS week 2441 starts on 2026-10-18; pulse at 00:00:10 UTC.
+    int64_t week0 = (315964800LL + 2441LL * 604800) * NSEC_PER_SEC;
+
+    gnss_reset(&g, 4, 0);
+    n = ubx_timtp(buf, 10000, 2441, 0x00);
+    ASSERT_EQ_I64(feed(&g, buf, n, NSEC_PER_SEC), 0, "GNSS time base refused");
+    buf[0] = '$';                                       // a stray sentence start in front
+    n = ubx_timtp(buf + 1, 10000, 2441, 0x03) + 1;
+    ASSERT_EQ_I64(feed(&g, buf, n, 2 * NSEC_PER_SEC), 1, "TIM-TP with the UTC time base");
+    ASSERT_EQ_I64(g.fixUtcNs, week0 + 9 * NSEC_PER_SEC, "burst refers to the pulse before");
+}
+
+static void test_estimate_takes_earliest()
+{
+    static gnssParser g;
+    static const int jitterMs[] = { 9, 3, 12, 5, 7 };
+    char buf[128];
+    size_t n;
+
+    gnss_reset(&g, 4, 40 * NSEC_PER_MSEC);
+    for (int k = 0; k < 5; ++k)
+    {
+        char body[96];
+        sprintf(body, "GPZDA,0000%02d.00,18,10,2026,00,00", k);
+        n = nmea(buf, body);
+        feed(&g, buf, n, (100 + k) * NSEC_PER_SEC + (40 + jitterMs[k]) * NSEC_PER_MSEC);
+    }
+    // UTC - monotonic without jitter is DAY_NS - 100 s; the window of
+    // four holds jitters 3, 12, 5, 7.
+    ASSERT_EQ_I64(g.fixes, 5, "every epoch taken");
+    ASSERT_EQ_I64(g.offsetNs, DAY_NS - 100 * NSEC_PER_SEC - 3 * NSEC_PER_MSEC, "least delayed burst wins");
+    ASSERT_EQ_I64(g.spreadNs, 9 * NSEC_PER_MSEC, "spread over the window");
+}
+
+typedef struct
+{
+    int fd;
+    int seconds;
+} replayer_t;
+
+// Plays a receiver: at LATENCY after every host second, a GGA, RMC and
+// ZDA burst naming that second, written in two pieces.
+#define LATENCY_MS 40
+static void *replayer_thread(void *arg)
+{
+    replayer_t *r = (replayer_t *)arg;
+    int64_t sec = clock_ns(CLOCK_REALTIME) / NSEC_PER_SEC + 1;
+
+    for (int k = 0; k < r->seconds; ++k, ++sec)
+    {
+        struct timespec at = { (time_t)sec, LATENCY_MS * NSEC_PER_MSEC };
+        clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &at, NULL);
+
+        time_t t = (time_t)sec;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        char body[128], burst[512];
+        size_t n = 0;
+        sprintf(body, "GPGGA,%02d%02d%02d.00,4000.0000,N,10500.0000,W,1,08,1.0,1600.0,M,0.0,M,,",
+                tm.tm_hour, tm.tm_min, tm.tm_sec);
+        n += nmea(burst + n, body);
+        sprintf(body, "GPRMC,%02d%02d%02d.00,A,4000.0000,N,10500.0000,W,0.0,0.0,%02d%02d%02d,,,A",
+                tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_mday, tm.tm_mon + 1, tm.tm_year % 100);
+        n += nmea(burst + n, body);
+        sprintf(body, "GPZDA,%02d%02d%02d.00,%02d,%02d,%04d,00,00",
+                tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900);
+        n += nmea(burst + n, body);
+        write(r->fd, burst, n / 2);
+        usleep(2000);
+        write(r->fd, burst + n / 2, n - n / 2);
+    }
+    return NULL;
+}
+
+static void test_pty_replay()
+{
+    static pList p;
+    pthread_t tid;
+    int64_t utc, real, mono;
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    ASSERT_TRUE(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0, "pty");
+    if (master < 0)
+    {
+        return;
+    }
+
+    p.gnssDevice    = ptsname(master);
+    p.gnssBaud      = 9600;
+    p.gnssLatencyMs = LATENCY_MS;
+    p.gnssWindow    = 8;
+    p.gnssMaxAge    = 3;
+    ASSERT_EQ_I64(gnss_init(&p), 0, "gnss_init on the pty");
+
+    replayer_t r = { master, 3 };
+    pthread_create(&tid, NULL, replayer_thread, &r);
+    pthread_join(tid, NULL);
+    usleep(100000);
+
+    clock_pair_ns(&real, &mono);
+    ASSERT_TRUE(gnss_utcAt(mono, &utc), "estimate from the replayed bursts");
+    // The host clock is the replayer's truth; scheduling on a loaded
+    // host adds a few ms.
+    ASSERT_TRUE(llabs(utc - real) < 20 * NSEC_PER_MSEC, "GNSS time matches the replayed clock");
+    ASSERT_TRUE(!gnss_utcAt(mono + 10 * NSEC_PER_SEC, &utc), "estimate expires after max_age");
+
+    char status[512];
+    gnss_format(status, sizeof status);
+    ASSERT_TRUE(strstr(status, "\"fixes\": 3") != NULL, "one fix per replayed second");
+
+    halt_request();
+    gnss_close(&p);
+    close(master);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_timeout;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGALRM, &sa, NULL);
+    alarm(30);
+    halt_init();
+
+    test_nmea_split_reads();
+    test_nmea_rejects();
+    test_ubx_timtp();
+    test_estimate_takes_earliest();
+    test_pty_replay();
+
+    alarm(0);
+    halt_close();
+
+    if (tests_failed)
+    {
+        fprintf(OUTPUT_ERROR, "\nTESTS FAILED: %d\n", tests_failed);
+        return 1;
+    }
+    printf("All tests passed.\n");
+    return 0;
+}
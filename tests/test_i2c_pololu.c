@@ -16,6 +16,7 @@ typedef struct
 {
     int sock; // mock device socket (peer of adapter->fd)
     volatile bool running;
+    pthread_t tid;
 } mock_ctx_t;
 
 static void* mock_thread(void* arg)
@@ -187,17 +188,45 @@ static void start_mock(mock_ctx_t* ctx, int sock)
 {
     ctx->sock = sock;
     ctx->running = true;
-    pthread_t tid;
-    pthread_create(&tid, NULL, mock_thread, ctx);
-    pthread_detach(tid);
+    pthread_create(&ctx->tid, NULL, mock_thread, ctx);
 }
 
+// Joined, not detached: a mock left running would read from whatever
+// the next test's socketpair() reuses its fd number for, and swallow
+// the commands meant for that test's mock.
 static void stop_mock(mock_ctx_t* ctx)
 {
     ctx->running = false;
-    // Closing the socket will break the loop
     if (ctx->sock >= 0)
+    {
+        // Ends the mock's blocking read() with EOF; the fd stays open
+        // until the thread is gone.
+        shutdown(ctx->sock, SHUT_RDWR);
+        pthread_join(ctx->tid, NULL);
         close(ctx->sock);
+        ctx->sock = -1;
+    }
+}
+
+// An adapter connected to a running mock over a socketpair, for the
+// batch tests.  close_mock() joins the mock thread before the next
+// test's socketpair can reuse its fds.
+static void open_mock(mock_ctx_t* mock, i2c_pololu_adapter* ad)
+{
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+
+    memset(mock, 0, sizeof(*mock));
+    start_mock(mock, sv[1]);
+
+    i2c_pololu_init(ad);
+    ad->fd = sv[0];
+}
+
+static void close_mock(mock_ctx_t* mock, i2c_pololu_adapter* ad)
+{
+    stop_mock(mock);
+    i2c_pololu_disconnect(ad);
 }
 
 static int tests_failed = 0;
@@ -292,6 +321,53 @@ static void test_write_read_sequences()
     i2c_pololu_disconnect(&ad);
 }
 
+static void test_read_then_write_batch()
+{
+    mock_ctx_t mock;
+    i2c_pololu_adapter ad;
+    open_mock(&mock, &ad);
+
+    // Pipelined POLL shape: 9-byte result read chained with a 1-byte trigger write
+    uint8_t rbuf[9] = {0};
+    uint8_t trig = 0x70;
+    int rc = i2c_pololu_read_then_write(&ad, 0x20, 0x24, rbuf, 9, 0x00, &trig, 1);
+    ASSERT_EQ_INT(rc, 9, "read_then_write returns read size");
+    uint8_t expected[9] = {0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8};
+    ASSERT_MEMEQ(rbuf, expected, 9, "read_then_write data matches");
+
+    // The adapter stays in sync: a following plain write still gets its own response
+    rc = i2c_pololu_write_to(&ad, 0x20, 0x00, &trig, 1);
+    ASSERT_EQ_INT(rc, 1, "write_to after batch returns size");
+
+    close_mock(&mock, &ad);
+}
+
+static void test_write_each_batch()
+{
+    mock_ctx_t mock;
+    i2c_pololu_adapter ad;
+    open_mock(&mock, &ad);
+
+    // Gradiometer trigger shape: the same POLL write to four sensors in one batch
+    const uint8_t addrs[4] = {0x20, 0x21, 0x22, 0x23};
+    int errors[4] = {-1, -1, -1, -1};
+    uint8_t trig = 0x70;
+    int rc = i2c_pololu_write_each(&ad, addrs, 4, 0x00, &trig, 1, errors);
+    ASSERT_EQ_INT(rc, 4, "write_each acknowledged by all targets");
+    for (int i = 0; i < 4; ++i)
+    {
+        ASSERT_EQ_INT(errors[i], 0, "write_each per-target status");
+    }
+
+    ASSERT_EQ_INT(i2c_pololu_write_each(&ad, addrs, 0, 0x00, &trig, 1, NULL), -ERROR_PROTOCOL, "write_each rejects empty batch");
+
+    // The adapter stays in sync: a following plain write still gets its own response
+    rc = i2c_pololu_write_to(&ad, 0x20, 0x00, &trig, 1);
+    ASSERT_EQ_INT(rc, 1, "write_to after batch returns size");
+
+    close_mock(&mock, &ad);
+}
+
 static void test_frequency_and_clear_bus()
 {
     int sv[2];
@@ -368,6 +444,8 @@ int main(void)
     test_init_and_connection_bits();
     test_error_string();
     test_write_read_sequences();
+    test_read_then_write_batch();
+    test_write_each_batch();
     test_frequency_and_clear_bus();
     test_device_info_and_scan();
 
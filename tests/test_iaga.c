@@ -0,0 +1,256 @@
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "iaga.h"
+#include "timeutil.h"
+
+static int tests_failed = 0;
+#define ASSERT_TRUE(cond, msg)                                                                                         \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s\n", msg);                                                         \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+#define ASSERT_EQ_INT(a, b, msg)                                                                                       \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if ((a) != (b))                                                                                                \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s (got %d expected %d)\n", msg, (int)(a), (int)(b));                \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+static void on_timeout(int sig)
+{
+    (void)sig;
+    const char msg[] = "\nTEST TIMEOUT: tests did not progress. Failing gracefully.\n";
+    write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    _exit(124);
+}
+
+// 2026-10-18 19:29:54 UTC
+#define T0_NS       (1792351794LL * NSEC_PER_SEC)
+#define MIN_NS      (60 * NSEC_PER_SEC)
+#define DAY_NS      (86400LL * NSEC_PER_SEC)
+#define DAY0_NS     (T0_NS - T0_NS % DAY_NS)
+#define HEADER_LINES 16
+
+static char   dir[32];
+static pList  p;
+
+// A 1-minute product as the output thread has it after a (re)start.
+static void fresh(outputProduct *op)
+{
+    memset(op, 0, sizeof *op);
+    snprintf(op->name, sizeof op->name, "iaga");
+    op->periodNs = MIN_NS;
+    op->reduce   = PRODUCT_AVERAGE;
+    op->filePath = dir;
+    ASSERT_EQ_INT(iaga_check(&p, op, NSEC_PER_SEC / 10), 0, "iaga_check 60 s");
+}
+
+// As products_close() does.
+static void shut(outputProduct *op)
+{
+    if (op->fp)
+    {
+        fclose(op->fp);
+        op->fp = NULL;
+    }
+}
+
+static int put(outputProduct *op, int64_t tNs, double x)
+{
+    magRecord r;
+    memset(&r, 0, sizeof r);
+    r.numMags   = 1;
+    r.validMask = 1;
+    r.tNs       = tNs;
+    r.nT[0][0]  = x;
+    r.nT[0][1]  = -1000.5;
+    r.nT[0][2]  = 45000.25;
+    return iaga_write(&p, op, &r);
+}
+
+static const char *path_of(int64_t dayNs)
+{
+    static char path[128];
+    time_t t = (time_t)(dayNs / NSEC_PER_SEC);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    snprintf(path, sizeof path, "%s/tst%04d%02d%02dvmin.min", dir, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+    return path;
+}
+
+// Checks the file of the day starting at dayNs: the header once, then
+// one IAGA_LINE_LEN line per minute from 00:00 with no gap, repeat or
+// partial line.  Returns the number of data lines, -1 if malformed;
+// the last one goes to last.
+static int scan(int64_t dayNs, char *last)
+{
+    FILE *f = fopen(path_of(dayNs), "r");
+    char  line[256];
+    int   headers = 0, n = 0, ok = 1;
+
+    if (!f)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof line, f))
+    {
+        if (line[0] == ' ' || strncmp(line, "DATE ", 5) == 0)
+        {
+            ok &= (n == 0);
+            headers++;
+            continue;
+        }
+        struct tm tm;
+        int ms;
+        memset(&tm, 0, sizeof tm);
+        ok &= (strlen(line) == IAGA_LINE_LEN);
+        ok &= (sscanf(line, "%4d-%2d-%2d %2d:%2d:%2d.%3d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour,
+                      &tm.tm_min, &tm.tm_sec, &ms) == 7);
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        ok &= ((int64_t)timegm(&tm) * NSEC_PER_SEC == dayNs + n * MIN_NS);
+        snprintf(last, 128, "%.127s", line);
+        n++;
+    }
+    fclose(f);
+    return (ok && headers == HEADER_LINES) ? n : -1;
+}
+
+static long file_size(const char *path)
+{
+    struct stat st;
+    return (stat(path, &st) == 0) ? (long)st.st_size : -1;
+}
+
+static void append(const char *path, const char *text)
+{
+    FILE *f = fopen(path, "a");
+    fputs(text, f);
+    fclose(f);
+}
+
+static void test_iaga_line()
+{
+    char   buf[IAGA_LINE_LEN + 1];
+    double xyz[3] = { 20614.21, -1034.77, 47805.93 };
+
+    ASSERT_EQ_INT(iaga_line(buf, DAY0_NS, xyz), IAGA_LINE_LEN, "line length");
+    ASSERT_TRUE(strcmp(buf, "2026-10-18 00:00:00.000 291     20614.21  -1034.77  47805.93  52071.33\n") == 0,
+                "data line, F computed");
+    iaga_line(buf, DAY0_NS + 61 * NSEC_PER_SEC, NULL);
+    ASSERT_TRUE(strcmp(buf, "2026-10-18 00:01:01.000 291     99999.00  99999.00  99999.00  99999.00\n") == 0,
+                "missing line");
+    xyz[0] = 1e8;
+    iaga_line(buf, DAY0_NS, xyz);
+    ASSERT_TRUE(strstr(buf, "99999.00  -1034.77  47805.93  99999.00\n") != NULL, "out of range values are missing");
+}
+
+static void test_iaga_files()
+{
+    outputProduct op;
+    char last[128];
+    const char *path = path_of(DAY0_NS);
+
+    // Create: the day is filled from 00:00 up to the first record.
+    fresh(&op);
+    ASSERT_EQ_INT(put(&op, T0_NS, 12345.678), 0, "first record written");
+    shut(&op);
+    ASSERT_EQ_INT(scan(DAY0_NS, last), 19 * 60 + 30, "created: 00:00 to 19:29");
+    ASSERT_TRUE(strncmp(last, "2026-10-18 19:29:00.000 291     12345.68  -1000.50  45000.25", 60) == 0, "created: data line");
+
+    // Resume: after a restart the file goes on from its last line.
+    fresh(&op);
+    ASSERT_EQ_INT(put(&op, T0_NS + 3 * MIN_NS, 1.0), 0, "resumed record written");
+    ASSERT_EQ_INT(put(&op, T0_NS, 1.0), -1, "earlier interval refused");
+    shut(&op);
+    ASSERT_EQ_INT(scan(DAY0_NS, last), 19 * 60 + 33, "resumed: gap filled, nothing repeated");
+
+    // Truncated tail: a crash mid-line leaves a partial line, which is
+    // cut off rather than followed by the day again from 00:00.
+    append(path, "2026-10-18 19:3");
+    fresh(&op);
+    ASSERT_EQ_INT(put(&op, T0_NS + 5 * MIN_NS, 2.0), 0, "record after a partial line written");
+    shut(&op);
+    ASSERT_EQ_INT(scan(DAY0_NS, last), 19 * 60 + 35, "partial line cut off");
+
+    // A last line that is none of ours: the file is left alone.
+    append(path, "not an IAGA-2002 line\n");
+    long size = file_size(path);
+    fresh(&op);
+    ASSERT_EQ_INT(put(&op, T0_NS + 6 * MIN_NS, 3.0), -1, "foreign file refused");
+    ASSERT_EQ_INT(put(&op, T0_NS + 7 * MIN_NS, 3.0), -1, "foreign file stays refused");
+    ASSERT_TRUE(op.fp == NULL && file_size(path) == size, "foreign file untouched");
+    ASSERT_EQ_INT(truncate(path, size - (long)strlen("not an IAGA-2002 line\n")), 0, "remove foreign line");
+
+    // Next day: the day's file is completed to 23:59 and a new one started.
+    fresh(&op);
+    ASSERT_EQ_INT(put(&op, T0_NS + 6 * MIN_NS, 4.0), 0, "record before midnight");
+    ASSERT_EQ_INT(put(&op, DAY0_NS + DAY_NS + MIN_NS, 5.0), 0, "record after midnight");
+    shut(&op);
+    ASSERT_EQ_INT(scan(DAY0_NS, last), 1440, "day completed");
+    ASSERT_TRUE(strncmp(last, "2026-10-18 23:59:00.000 291     99999.00", 40) == 0, "day ends at 23:59");
+    ASSERT_EQ_INT(scan(DAY0_NS + DAY_NS, last), 2, "next day started");
+
+    // A header cut short is written again.
+    append(path_of(DAY0_NS + 2 * DAY_NS), " Format                 IAGA-2002                                    |\n");
+    fresh(&op);
+    ASSERT_EQ_INT(put(&op, DAY0_NS + 2 * DAY_NS + 2 * MIN_NS, 6.0), 0, "record after a partial header");
+    shut(&op);
+    ASSERT_EQ_INT(scan(DAY0_NS + 2 * DAY_NS, last), 3, "header rewritten");
+
+    for (int d = 0; d < 3; d++)
+    {
+        unlink(path_of(DAY0_NS + d * DAY_NS));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_timeout;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGALRM, &sa, NULL);
+    alarm(30);
+
+    snprintf(dir, sizeof dir, "/tmp/iaga-testXXXXXX");
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    p.station_code = "tst";
+    p.station_name = "Test";
+    p.maintainer   = "Test";
+
+    test_iaga_line();
+    test_iaga_files();
+
+    rmdir(dir);
+    alarm(0);
+
+    if (tests_failed)
+    {
+        fprintf(OUTPUT_ERROR, "\nTESTS FAILED: %d\n", tests_failed);
+        return 1;
+    }
+    printf("All tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,197 @@
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "halt.h"
+#include "pps.h"
+#include "timeutil.h"
+
+static int tests_failed = 0;
+#define ASSERT_TRUE(cond, msg)                                                                                         \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s\n", msg);                                                         \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+#define ASSERT_EQ_I64(a, b, msg)                                                                                       \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if ((int64_t)(a) != (int64_t)(b))                                                                              \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s (got %lld expected %lld)\n", msg, (long long)(a),              \
+                    (long long)(b));                                                                                   \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+static void on_timeout(int sig)
+{
+    (void)sig;
+    const char msg[] = "\nTEST TIMEOUT: tests did not progress. Failing gracefully.\n";
+    write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    _exit(124);
+}
+
+#define SIM_OFFSET_US   250000
+#define MS_NS           NSEC_PER_MSEC
+
+// 2026-10-18 00:00:00 UTC
+#define DAY_NS (1792281600LL * NSEC_PER_SEC)
+
+static pList p;
+
+// An edge the host read at realNs, 3 s into CLOCK_MONOTONIC.
+static ppsEdge edge_at(int64_t realNs)
+{
+    ppsEdge e = { 1, realNs, 3 * NSEC_PER_SEC };
+    return e;
+}
+
+// Two sensors, the second not read on this tick.
+static magSample sample_at(int64_t trigMonoNs)
+{
+    magSample s;
+    memset(&s, 0, sizeof s);
+    s.numMags   = 2;
+    s.validMask = 1;
+    s.stamps[0].trigMonoNs = trigMonoNs;
+    s.stamps[0].drdyMonoNs = trigMonoNs + 7 * MS_NS;
+    s.stamps[0].trigRealNs = -1;
+    s.stamps[0].drdyRealNs = -1;
+    s.stamps[1].trigRealNs = -1;
+    s.stamps[1].drdyRealNs = -1;
+    return s;
+}
+
+static void test_discipline()
+{
+    static const struct
+    {
+        int64_t     offsetNs;       // host reading of the edge, from the second
+        int64_t     secondNs;       // the second it is taken for
+        const char *name;
+    } cases[] = {
+        { 0,                             DAY_NS,                 "on the second" },
+        { 499999999,                     DAY_NS,                 "host just under half a second late" },
+        { NSEC_PER_SEC / 2,              DAY_NS + NSEC_PER_SEC,  "exactly half a second rounds up" },
+        { 500000001,                     DAY_NS + NSEC_PER_SEC,  "host just over half a second late" },
+        { -499999999,                    DAY_NS,                 "host just under half a second early" },
+        { -500000001,                    DAY_NS - NSEC_PER_SEC,  "host just over half a second early" },
+    };
+
+    for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++)
+    {
+        ppsEdge   e = edge_at(DAY_NS + cases[i].offsetNs);
+        magSample s = sample_at(e.monoNs + 20 * MS_NS);
+
+        pps_discipline(&e, &s);
+        if (s.stamps[0].trigRealNs != cases[i].secondNs + 20 * MS_NS)
+        {
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s (trigger %lld ns off)\n", cases[i].name,
+                    (long long)(s.stamps[0].trigRealNs - cases[i].secondNs - 20 * MS_NS));
+            tests_failed++;
+        }
+        ASSERT_EQ_I64(s.stamps[0].drdyRealNs, cases[i].secondNs + 27 * MS_NS, cases[i].name);
+    }
+
+    // A trigger ahead of the edge lands before the second, and a sensor
+    // not read on the tick is left alone.
+    ppsEdge   e = edge_at(DAY_NS + 3 * MS_NS);
+    magSample s = sample_at(e.monoNs - 2 * MS_NS);
+    pps_discipline(&e, &s);
+    ASSERT_EQ_I64(s.stamps[0].trigRealNs, DAY_NS - 2 * MS_NS, "trigger before the edge");
+    ASSERT_TRUE(s.ppsValid, "sample marked disciplined");
+    ASSERT_EQ_I64(s.ppsOffsetNs, -2 * MS_NS, "offset of the primary trigger");
+    ASSERT_EQ_I64(s.stamps[1].trigRealNs, -1, "unread sensor untouched");
+
+    // Nothing read: nothing disciplined.
+    s = sample_at(e.monoNs);
+    s.validMask = 0;
+    pps_discipline(&e, &s);
+    ASSERT_TRUE(!s.ppsValid && s.stamps[0].trigRealNs == -1, "empty sample untouched");
+}
+
+static void test_sim_edges()
+{
+    ppsEdge e, prev;
+    int64_t now = clock_ns(CLOCK_MONOTONIC);
+
+    ASSERT_TRUE(pps_waitEdge(&p, now, now + 1500 * MS_NS, &prev), "first edge within 1.5 s");
+    ASSERT_EQ_I64(prev.realNs % NSEC_PER_SEC, SIM_OFFSET_US * NSEC_PER_USEC, "edge at the simulated offset");
+    for (int i = 0; i < 2; i++)
+    {
+        now = clock_ns(CLOCK_MONOTONIC);
+        ASSERT_TRUE(pps_waitEdge(&p, now, now + 1500 * MS_NS, &e), "next edge within 1.5 s");
+        ASSERT_EQ_I64(e.realNs - prev.realNs, NSEC_PER_SEC, "edges one host second apart");
+        ASSERT_TRUE(e.monoNs - prev.monoNs > NSEC_PER_SEC - 20 * MS_NS
+                    && e.monoNs - prev.monoNs < NSEC_PER_SEC + 20 * MS_NS, "edges one second apart on CLOCK_MONOTONIC");
+        ASSERT_TRUE(e.seq == prev.seq + 1, "edges numbered in order");
+        prev = e;
+    }
+
+    // An edge is returned once, and none is due for most of a second.
+    now = clock_ns(CLOCK_MONOTONIC);
+    ASSERT_TRUE(!pps_waitEdge(&p, 0, now + 100 * MS_NS, &e), "no edge twice, wait times out");
+    ASSERT_TRUE(pps_latest(&p, prev.monoNs, &e) && e.seq == prev.seq, "latest edge still there");
+    ASSERT_TRUE(!pps_latest(&p, prev.monoNs + 1, &e), "no edge since a later instant");
+    ASSERT_TRUE(atomic_load(&p.ppsEdges) >= 3, "edges counted");
+}
+
+static void test_sim_close()
+{
+    // Close mid-second, with the PPS thread asleep until the next edge:
+    // SIGUSR1 must cut the sleep short rather than wait it out.
+    ppsEdge e;
+    int64_t now = clock_ns(CLOCK_MONOTONIC);
+    ASSERT_TRUE(pps_waitEdge(&p, now, now + 1500 * MS_NS, &e), "edge before close");
+    usleep(100000);
+
+    int64_t t0 = clock_ns(CLOCK_MONOTONIC);
+    pps_close(&p);
+    int64_t took = clock_ns(CLOCK_MONOTONIC) - t0;
+    if (took > 100 * MS_NS)
+    {
+        fprintf(OUTPUT_ERROR, "ASSERT FAILED: pps_close took %lld ms\n", (long long)(took / MS_NS));
+        tests_failed++;
+    }
+    ASSERT_TRUE(!pps_waitEdge(&p, 0, clock_ns(CLOCK_MONOTONIC) + 10 * MS_NS, &e), "no edges after close");
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_timeout;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGALRM, &sa, NULL);
+    alarm(30);
+
+    test_discipline();
+
+    halt_init();
+    p.ppsSource      = pps_parseSource("sim");
+    p.ppsSimOffsetUs = SIM_OFFSET_US;
+    p.pollPeriodNs   = NSEC_PER_SEC;
+    ASSERT_TRUE(pps_init(&p) == 0 && p.ppsSource == PPS_SRC_SIM, "sim source started");
+    test_sim_edges();
+    test_sim_close();
+    halt_close();
+    alarm(0);
+
+    if (tests_failed)
+    {
+        fprintf(OUTPUT_ERROR, "\nTESTS FAILED: %d\n", tests_failed);
+        return 1;
+    }
+    printf("All tests passed.\n");
+    return 0;
+}
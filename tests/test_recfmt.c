@@ -0,0 +1,680 @@
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "magrec.h"
+#include "mseed.h"
+#include "pps.h"
+#include "recenc.h"
+#include "recfmt.h"
+#include "timeutil.h"
+
+static int tests_failed = 0;
+#define ASSERT_TRUE(cond, msg)                                                                                         \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s\n", msg);                                                         \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+#define ASSERT_EQ_STR(a, b, msg)                                                                                       \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (strcmp((a), (b)) != 0)                                                                                     \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s (got '%s' expected '%s')\n", msg, (a), (b));                      \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+static void on_timeout(int sig)
+{
+    (void)sig;
+    const char msg[] = "\nTEST TIMEOUT: tests did not progress. Failing gracefully.\n";
+    write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    _exit(124);
+}
+
+// 2026-10-18 19:29:54 UTC
+#define T0_NS (1792351794LL * NSEC_PER_SEC)
+
+static const char *ts(int64_t tNs, int format)
+{
+    static char buf[64];
+    *fmt_timestamp(buf, tNs, format) = '\0';
+    return buf;
+}
+
+static void test_timestamp_formats()
+{
+    ASSERT_EQ_STR(ts(T0_NS + 123456789, FMT_TS_TEXT), "\"18 Oct 2026 19:29:54\"", "text");
+    ASSERT_EQ_STR(ts(T0_NS + 123456789, FMT_TS_ISO_MS), "\"2026-10-18T19:29:54.123Z\"", "iso_ms");
+    ASSERT_EQ_STR(ts(T0_NS + 123456789, FMT_TS_ISO_US), "\"2026-10-18T19:29:54.123456Z\"", "iso_us");
+    ASSERT_EQ_STR(ts(T0_NS + 123456789, FMT_TS_EPOCH_NS), "1792351794123456789", "epoch_ns");
+    ASSERT_EQ_STR(ts(T0_NS + 999999999, FMT_TS_ISO_MS), "\"2026-10-18T19:29:54.999Z\"", "truncated, not rounded");
+    ASSERT_EQ_STR(ts(T0_NS + 7000, FMT_TS_ISO_US), "\"2026-10-18T19:29:54.000007Z\"", "leading zeros");
+}
+
+static void test_timestamp_cache_rollover()
+{
+    // Same second from the cache, then the next second and back.
+    ASSERT_EQ_STR(ts(T0_NS + 1, FMT_TS_TEXT), "\"18 Oct 2026 19:29:54\"", "cached second");
+    ASSERT_EQ_STR(ts(T0_NS + NSEC_PER_SEC, FMT_TS_TEXT), "\"18 Oct 2026 19:29:55\"", "rollover");
+    ASSERT_EQ_STR(ts(T0_NS + NSEC_PER_SEC, FMT_TS_ISO_MS), "\"2026-10-18T19:29:55.000Z\"", "iso after text");
+    ASSERT_EQ_STR(ts(T0_NS - 1, FMT_TS_ISO_MS), "\"2026-10-18T19:29:53.999Z\"", "clock going back");
+    ASSERT_EQ_STR(ts(-1, FMT_TS_ISO_US), "\"1969-12-31T23:59:59.999999Z\"", "before the epoch");
+    ASSERT_EQ_STR(ts(0, FMT_TS_ISO_US), "\"1970-01-01T00:00:00.000000Z\"", "the epoch itself");
+}
+
+static void test_binary_layout()
+{
+    magRecord r;
+    uint8_t buf[MAGREC_SIZE + 8];
+    magRec m;
+
+    memset(&r, 0, sizeof r);
+    r.seq         = 41;
+    r.count       = 1;
+    r.tNs         = T0_NS + 5;
+    r.tUncNs      = 7312000;
+    r.numMags     = 2;
+    r.validMask   = 0x1;
+    r.tempValid   = 1;
+    r.tempCelsius = 23.125;
+    r.ppsValid    = 1;
+    r.clockStepNs = -3;
+    for (int k = 0; k < 3; ++k)
+    {
+        r.cc[k]     = 200;
+        r.gain[k]   = 75;
+        r.xyz[0][k] = -1000000 + k;
+        r.xyz[1][k] = 55;
+        r.nT[0][k]  = 12345.678 + k;
+    }
+
+    memset(buf, 0xAA, sizeof buf);
+    ASSERT_TRUE(fmt_binary(&r, buf) == MAGREC_SIZE, "record size");
+    ASSERT_TRUE(buf[MAGREC_SIZE] == 0xAA, "nothing written past the record");
+    ASSERT_TRUE(memcmp(buf, "MREC", 4) == 0, "magic bytes");
+    ASSERT_TRUE(buf[4] == MAGREC_VERSION && buf[5] == 0, "version, little-endian");
+
+    memcpy(&m, buf, sizeof m);
+    ASSERT_TRUE(m.magic == MAGREC_MAGIC && m.size == MAGREC_SIZE, "header through magRec");
+    ASSERT_TRUE(m.seq == 41 && m.t_ns == T0_NS + 5 && m.t_unc_ns == 7312000 && m.count == 1, "times and seq");
+    ASSERT_TRUE(m.flags == (MAGREC_TEMP_VALID | MAGREC_PPS | MAGREC_CLOCK_STEP), "flags");
+    ASSERT_TRUE(m.num_mags == 2 && m.valid_mask == 0x1, "sensors");
+    ASSERT_TRUE(m.cc[2] == 200 && m.gain[0] == 75 && m.reserved == 0, "cycle counts and gains");
+    ASSERT_TRUE(m.rt == 23.125, "temperature");
+    ASSERT_TRUE(m.counts[0][0] == -1000000 && m.counts[0][2] == -999998, "raw counts");
+    ASSERT_TRUE(m.nT[0][1] == 12346.678, "nT");
+    ASSERT_TRUE(m.counts[1][0] == 0 && isnan(m.nT[1][0]), "sensor that missed the cycle");
+    ASSERT_TRUE(m.counts[3][0] == 0 && isnan(m.nT[3][2]), "unused slot");
+
+    r.averaged  = 1;
+    r.tempValid = 0;
+    fmt_binary(&r, buf);
+    memcpy(&m, buf, sizeof m);
+    ASSERT_TRUE(m.flags & MAGREC_AVERAGED, "averaged flag");
+    ASSERT_TRUE(m.counts[0][0] == 0 && m.nT[0][0] == 12345.678, "a mean has no counts");
+    ASSERT_TRUE(isnan(m.rt), "no temperature");
+}
+
+static uint64_t be(const uint8_t *b, int n)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        v = (v << 8) | b[i];
+    }
+    return v;
+}
+
+// Steps over one CBOR data item; NULL if it is malformed or runs past end.
+static const uint8_t *cbor_skip(const uint8_t *b, const uint8_t *end)
+{
+    if (!b || b >= end)
+    {
+        return NULL;
+    }
+    unsigned major = *b >> 5, ai = *b & 31;
+    uint64_t v;
+    b++;
+    if (ai < 24)
+    {
+        v = ai;
+    }
+    else if (ai <= 27)
+    {
+        int n = 1 << (ai - 24);
+        v = be(b, n);
+        b += n;
+    }
+    else
+    {
+        return NULL;
+    }
+    switch (major)
+    {
+        case 2:
+        case 3:
+            b += v;
+            break;
+        case 4:
+        case 5:
+            for (uint64_t i = 0; i < (major == 5 ? 2 * v : v); ++i)
+            {
+                b = cbor_skip(b, end);
+            }
+            break;
+        case 6:
+            b = cbor_skip(b, end);
+            break;
+        default:
+            break;
+    }
+    return (b && b <= end) ? b : NULL;
+}
+
+// The same for MessagePack, for the types the encoder writes.
+static const uint8_t *msgpack_skip(const uint8_t *b, const uint8_t *end)
+{
+    if (!b || b >= end)
+    {
+        return NULL;
+    }
+    uint8_t c = *b++;
+    uint64_t items = 0;
+    if (c <= 0x7f || c >= 0xe0 || c == 0xc0 || c == 0xc2 || c == 0xc3)
+    {
+        return b;
+    }
+    else if (c >= 0x80 && c <= 0x8f)
+    {
+        items = 2u * (c & 15);
+    }
+    else if (c >= 0x90 && c <= 0x9f)
+    {
+        items = c & 15;
+    }
+    else if (c >= 0xa0 && c <= 0xbf)
+    {
+        b += c & 31;
+    }
+    else if (c == 0xde || c == 0xdc)
+    {
+        items = be(b, 2) * (c == 0xde ? 2 : 1);
+        b += 2;
+    }
+    else if (c == 0xcc || c == 0xd0)
+    {
+        b += 1;
+    }
+    else if (c == 0xcd || c == 0xd1)
+    {
+        b += 2;
+    }
+    else if (c == 0xca || c == 0xce || c == 0xd2)
+    {
+        b += 4;
+    }
+    else if (c == 0xcb || c == 0xcf || c == 0xd3)
+    {
+        b += 8;
+    }
+    else if (c == 0xd7)
+    {
+        b += 9;
+    }
+    else if (c == 0xc7)
+    {
+        b += 2 + b[0];
+    }
+    else
+    {
+        return NULL;
+    }
+    for (uint64_t i = 0; i < items; ++i)
+    {
+        b = msgpack_skip(b, end);
+    }
+    return (b && b <= end) ? b : NULL;
+}
+
+static void fill_record(magRecord *r, int numMags)
+{
+    memset(r, 0, sizeof *r);
+    r->seq         = 41;
+    r->count       = 1;
+    r->tNs         = T0_NS + 123456789;
+    r->tUncNs      = 7312000;
+    r->numMags     = numMags;
+    r->validMask   = (1u << numMags) - 1;
+    r->tempValid   = 1;
+    r->tempCelsius = 23.125;
+    r->tempAge     = 1.5;
+    for (int i = 0; i < numMags; ++i)
+    {
+        r->nT[i][0] = 12345.678 + i;
+        r->nT[i][1] = -234.5 - i;
+        r->nT[i][2] = 987.001;
+    }
+}
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rng()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// A double of either sign, log-uniform from 1e-4 up to just under
+// FMT_FIXED_LIMIT.
+static double rng_double()
+{
+    double u = (double)(rng() >> 11) * 0x1p-53;
+    double v = pow(10.0, -4.0 + u * 15.9) * (1.0 + (double)(rng() >> 11) * 0x1p-53) / 2.0;
+    return (rng() & 1) ? -v : v;
+}
+
+static int fixed_matches(double v, int decimals)
+{
+    char got[FMT_FIXED_LEN + 1];
+    char want[64];
+
+    *fmt_fixed(got, v, decimals) = '\0';
+    snprintf(want, sizeof want, "%.*f", decimals, v);
+    if (strcmp(got, want) != 0)
+    {
+        fprintf(OUTPUT_ERROR, "fmt_fixed(%.17g, %d): got '%s' expected '%s'\n", v, decimals, got, want);
+        return 0;
+    }
+    return 1;
+}
+
+static void test_fixed_parity()
+{
+    static const double edge[] =
+    {
+        0.0, -0.0, 1.0, -1.0, 0.5, -0.5, 1.5, 2.5, -2.5, 0.05, 0.15, 0.25, 0.35, 1.005, 2.675, 9.9995, -9.9995,
+        0.0005, -0.0004, 0.00049999, 99.95, 999.9995, 99999.9995, 12345.678, -234.5, 987.001, 23.125, 1.45,
+        0.9999999, 9.9999995, 999999.9999995, 4503599627370495.5 / 8192.0, 123456789012.3456, -999999999999.9,
+        1e11 + 0.5, 1e11 - 0.0005, 0x1p-30, -0x1p-30,
+    };
+    int bad = 0;
+
+    // 1 (rt_age), 2 (rt) and 3 (nT) are what records print; the rest of
+    // 0..6 is what fmt_fixed() accepts.
+    for (int d = 0; d <= 6; ++d)
+    {
+        for (size_t i = 0; i < sizeof edge / sizeof edge[0]; ++i)
+        {
+            bad += !fixed_matches(edge[i], d);
+        }
+        for (int i = 0; i < 200000 && bad < 10; ++i)
+        {
+            double v = rng_double();
+            bad += !fixed_matches(v, d);
+
+            // Exact and near ties at this precision, where the rounding
+            // carries.
+            double k = floor(fabs(v) * pow(10.0, d) / 1e6);
+            double tie = (k + 0.5) / pow(10.0, d);
+            bad += !fixed_matches(tie, d);
+            bad += !fixed_matches(-tie, d);
+            bad += !fixed_matches(nextafter(tie, 0.0), d);
+            bad += !fixed_matches(nextafter(tie, INFINITY), d);
+            bad += !fixed_matches((k + 1.0) - 0.5 / pow(10.0, d), d);
+        }
+    }
+    ASSERT_TRUE(bad == 0, "fmt_fixed matches %.Nf");
+
+    char buf[FMT_FIXED_LEN + 1];
+    *fmt_fixed(buf, FMT_FIXED_LIMIT, 3) = '\0';
+    ASSERT_EQ_STR(buf, "null", "FMT_FIXED_LIMIT and above print as null");
+    *fmt_fixed(buf, NAN, 3) = '\0';
+    ASSERT_EQ_STR(buf, "null", "NaN prints as null");
+    *fmt_fixed(buf, -INFINITY, 3) = '\0';
+    ASSERT_EQ_STR(buf, "null", "infinity prints as null");
+}
+
+// The record as the printf-based formatter before fmt_record() wrote
+// it, field by field.
+static void ref_record(const pList *p, const magRecord *r, char *buf, size_t len)
+{
+    char      ts[32];
+    size_t    u = 0;
+    time_t    sec = (time_t)(r->tNs / NSEC_PER_SEC);
+    struct tm tm;
+
+    gmtime_r(&sec, &tm);
+    strftime(ts, sizeof ts, "%d %b %Y %H:%M:%S", &tm);
+    u += snprintf(buf + u, len - u, "{ \"ts\":\"%s\", \"seq\":%" PRIu64 ", \"t_ns\":%" PRId64 ", \"t_unc_ns\":%" PRId64,
+                  ts, r->seq, r->tNs, r->tUncNs);
+    if (r->averaged)
+    {
+        u += snprintf(buf + u, len - u, ", \"n\":%" PRIu32, r->count);
+    }
+    u += snprintf(buf + u, len - u, ", \"rt\":%.2f, \"rt_age\":%.1f", r->tempCelsius, r->tempAge);
+    u += snprintf(buf + u, len - u, ", \"x\":%.3f, \"y\":%.3f, \"z\":%.3f", r->nT[0][0], r->nT[0][1], r->nT[0][2]);
+    if (p->ppsSource != PPS_SRC_NONE)
+    {
+        u += snprintf(buf + u, len - u, ", \"pps_offset_ns\":%" PRId64, r->ppsOffsetNs);
+    }
+    if (r->numMags > 1)
+    {
+        u += snprintf(buf + u, len - u, ", \"mags\":[");
+        for (int i = 0; i < r->numMags; i++)
+        {
+            u += snprintf(buf + u, len - u, "%s[%.3f,%.3f,%.3f]", i ? "," : "", r->nT[i][0], r->nT[i][1], r->nT[i][2]);
+        }
+        u += snprintf(buf + u, len - u, "], \"grad\":[");
+        for (int i = 1; i < r->numMags; i++)
+        {
+            u += snprintf(buf + u, len - u, "%s[%.3f,%.3f,%.3f]", (i > 1) ? "," : "", r->nT[i][0] - r->nT[0][0],
+                          r->nT[i][1] - r->nT[0][1], r->nT[i][2] - r->nT[0][2]);
+        }
+        u += snprintf(buf + u, len - u, "]");
+    }
+    snprintf(buf + u, len - u, " }\n");
+}
+
+static void test_record_parity()
+{
+    static pList p;
+    magRecord r;
+    char got[FMT_RECORD_MAX], want[FMT_RECORD_MAX];
+    int bad = 0;
+
+    p.ppsSource = PPS_SRC_NONE + 1;
+    for (int i = 0; i < 20000 && bad < 10; ++i)
+    {
+        fill_record(&r, 1 + i % MAX_MAGS);
+        r.seq         = rng();
+        r.tNs         = (int64_t)(rng() >> 2);
+        r.tUncNs      = (int64_t)(rng() % 100000000);
+        r.averaged    = i & 1;
+        r.count       = (uint32_t)rng();
+        r.tempCelsius = fmod(rng_double(), 100.0);
+        r.tempAge     = fmod(fabs(rng_double()), 1000.0);
+        r.ppsValid    = 1;
+        r.ppsOffsetNs = (int64_t)rng() >> 40;
+        for (int m = 0; m < r.numMags; ++m)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                r.nT[m][k] = fmod(rng_double(), 1e6);
+            }
+        }
+        size_t n = fmt_record(&p, &r, FMT_TS_TEXT, got, sizeof got);
+        ref_record(&p, &r, want, sizeof want);
+        if (n != strlen(want) || strcmp(got, want) != 0)
+        {
+            fprintf(OUTPUT_ERROR, "fmt_record:\n  got  %s  want %s", got, want);
+            bad++;
+        }
+    }
+    ASSERT_TRUE(bad == 0, "fmt_record matches the printf formatter");
+}
+
+static void test_cbor_msgpack()
+{
+    static pList p;
+    magRecord r;
+    uint8_t buf[ENC_RECORD_MAX];
+    size_t n;
+    double d;
+
+    fill_record(&r, 1);
+    n = enc_record(&p, &r, ENC_CBOR, 64, buf, sizeof buf);
+    ASSERT_TRUE(n > 0 && cbor_skip(buf, buf + n) == buf + n, "CBOR record is one well-formed map");
+    ASSERT_TRUE(buf[0] == 0xa9, "CBOR map of 9 pairs");
+    ASSERT_TRUE(memcmp(buf + 1, "\x62ts\xc1\xfb", 5) == 0, "ts as tag 1 on a float64");
+    uint64_t bits = be(buf + 6, 8);
+    memcpy(&d, &bits, sizeof d);
+    ASSERT_TRUE(fabs(d - 1792351794.123456789) < 1e-6, "tag 1 epoch seconds");
+    ASSERT_TRUE(memcmp(buf + 14, "\x63seq\x18\x29", 6) == 0, "seq as a one-byte uint");
+    ASSERT_TRUE(enc_record(&p, &r, ENC_CBOR, 32, buf, sizeof buf) == n - 5 * 4, "float32 saves 4 bytes a value");
+    ASSERT_TRUE(enc_record(&p, &r, ENC_CBOR, 64, buf, ENC_RECORD_MAX - 1) == 0, "short buffer refused");
+
+    n = enc_record(&p, &r, ENC_MSGPACK, 64, buf, sizeof buf);
+    ASSERT_TRUE(n > 0 && msgpack_skip(buf, buf + n) == buf + n, "MessagePack record is one well-formed map");
+    ASSERT_TRUE(buf[0] == 0x89, "fixmap of 9 pairs");
+    ASSERT_TRUE(memcmp(buf + 1, "\xa2ts\xd7\xff", 5) == 0, "ts as timestamp 64");
+    uint64_t ts = be(buf + 6, 8);
+    ASSERT_TRUE((ts >> 34) == 123456789 && (ts & ((1ull << 34) - 1)) == 1792351794, "timestamp 64 fields");
+
+    // Everything on, at the extremes, must still fit.
+    p.ppsSource  = PPS_SRC_NONE + 1;
+    p.gnssDevice = "gnss";
+    p.cqAnnotate = 1;
+    p.arEnable   = 1;
+    fill_record(&r, MAX_MAGS);
+    r.averaged    = 1;
+    r.count       = UINT32_MAX;
+    r.seq         = UINT64_MAX;
+    r.tNs         = INT64_MIN;
+    r.tUncNs      = INT64_MIN;
+    r.ppsValid    = 1;
+    r.ppsOffsetNs = INT64_MIN;
+    r.gnssValid   = 1;
+    r.gnssHostNs  = INT64_MIN;
+    r.clockStepNs = INT64_MIN;
+    r.clock.valid = 1;
+    r.clock.estUs = UINT32_MAX;
+    r.clock.maxUs = UINT32_MAX;
+    for (int k = 0; k < 3; ++k)
+    {
+        r.cc[k]   = INT32_MIN;
+        r.gain[k] = INT32_MIN;
+    }
+    n = enc_record(&p, &r, ENC_CBOR, 64, buf, sizeof buf);
+    ASSERT_TRUE(n > 0 && cbor_skip(buf, buf + n) == buf + n, "largest CBOR record well-formed");
+    n = enc_record(&p, &r, ENC_MSGPACK, 64, buf, sizeof buf);
+    ASSERT_TRUE(n > 0 && msgpack_skip(buf, buf + n) == buf + n, "largest MessagePack record well-formed");
+    ASSERT_TRUE(buf[0] == 0xde && be(buf + 1, 2) == 18, "map 16 past 15 pairs");
+}
+
+static uint16_t get_be16(const uint8_t *b)
+{
+    return (uint16_t)((b[0] << 8) | b[1]);
+}
+
+static uint32_t get_be32(const uint8_t *b)
+{
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+static int32_t sext(uint32_t v, int bits)
+{
+    return (int32_t)(v << (32 - bits)) >> (32 - bits);
+}
+
+// Decodes the Steim-2 frames of one record into out; returns the
+// number of samples, or -1 if they do not add up to the header's count
+// and the reverse integration constant.
+static int steim2_decode(const uint8_t *rec, int32_t *out)
+{
+    const uint8_t *data = rec + get_be16(rec + 44);
+    int32_t x = 0;
+    int     n = 0;
+
+    for(int f = 0; f < rec[63]; f++)
+    {
+        const uint8_t *frame = data + 64 * f;
+        uint32_t ctl = get_be32(frame);
+        for(int w = 1; w < 16; w++)
+        {
+            uint32_t word = get_be32(frame + 4 * w);
+            uint32_t nib  = (ctl >> (30 - 2 * w)) & 3;
+            uint32_t dnib = word >> 30;
+            int      cnt  = 0, bits = 0;
+
+            if(nib == 1)
+            {
+                cnt = 4, bits = 8;
+            }
+            else if(nib == 2)
+            {
+                cnt = (int)dnib, bits = (dnib == 1) ? 30 : (dnib == 2) ? 15 : 10;
+            }
+            else if(nib == 3)
+            {
+                cnt = 5 + (int)dnib, bits = (dnib == 0) ? 6 : (dnib == 1) ? 5 : 4;
+            }
+            for(int i = 0; i < cnt; i++)
+            {
+                int32_t d = sext(word >> ((cnt - 1 - i) * bits), bits);
+                x = (n == 0) ? (int32_t)get_be32(data + 4) : x + d;
+                out[n++] = x;
+            }
+        }
+    }
+    return (n == get_be16(rec + 30) && x == (int32_t)get_be32(data + 8)) ? n : -1;
+}
+
+// Start time of a record from its fixed header and blockette 1001.
+static int64_t mseed_start(const uint8_t *rec)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof tm);
+    tm.tm_year = get_be16(rec + 20) - 1900;
+    tm.tm_mday = get_be16(rec + 22);
+    tm.tm_hour = rec[24];
+    tm.tm_min  = rec[25];
+    tm.tm_sec  = rec[26];
+    return (int64_t)timegm(&tm) * NSEC_PER_SEC + get_be16(rec + 28) * 100000LL + (int8_t)rec[61] * 1000LL;
+}
+
+static void test_mseed_steim2()
+{
+    static const int32_t amp[] = { 3, 7, 15, 31, 120, 500, 16000, 500000, 20000000 };
+    enum { N1 = 900, N2 = 40, N = N1 + N2 };
+    const int64_t period = NSEC_PER_SEC / 10;
+    const int64_t t0 = T0_NS + 12345678;
+    static int32_t in[3][N], out[3][N + 8];
+    static uint8_t rec[512];
+    int64_t tIn[N];
+    outputProduct op;
+    magRecord r;
+    uint32_t lcg = 12345;
+    int got[3] = { 0, 0, 0 };
+    int records = 0;
+
+    memset(&op, 0, sizeof op);
+    snprintf(op.name, sizeof op.name, "mseed");
+    op.mseedRecLen = 512;
+    mseed_setCode(op.mseedNet, sizeof op.mseedNet, "xx");
+    op.fp = tmpfile();
+    ASSERT_TRUE(op.fp && mseed_open(&op, "bou", period) == 0, "mseed_open");
+
+    memset(&r, 0, sizeof r);
+    r.numMags   = 1;
+    r.validMask = 1;
+    for(int i = 0; i < N; i++)
+    {
+        // A random walk through every Steim-2 difference width, then a
+        // gap of five samples.
+        tIn[i] = t0 + (i + (i >= N1 ? 5 : 0)) * period + (i % 3) * 1000;
+        for(int k = 0; k < 3; k++)
+        {
+            lcg = lcg * 1103515245u + 12345u;
+            int32_t a = amp[(i / 50 + k) % 9];
+            int32_t d = (int32_t)((lcg >> 8) % (uint32_t)(2 * a + 1)) - a;
+            in[k][i] = (i == 0) ? -7000 * (k + 1) : in[k][i - 1] + d;
+            r.xyz[0][k] = in[k][i];
+        }
+        r.tNs = tIn[i];
+        ASSERT_TRUE(mseed_write(&op, &r) == 0, "mseed_write");
+    }
+    ASSERT_TRUE(mseed_close(&op) == 0 && op.mseed == NULL, "mseed_close");
+
+    rewind(op.fp);
+    while(fread(rec, 1, sizeof rec, op.fp) == sizeof rec)
+    {
+        char seq[12];
+        int  k = rec[17] - 'X';
+
+        records++;
+        snprintf(seq, sizeof seq, "%06d", records);
+        ASSERT_TRUE(memcmp(rec, seq, 6) == 0 && rec[6] == 'D', "sequence number and quality");
+        ASSERT_TRUE(memcmp(rec + 8, "BOU    BF", 9) == 0 && memcmp(rec + 18, "XX", 2) == 0, "station, channel, network");
+        ASSERT_TRUE(k >= 0 && k < 3, "channel X, Y or Z");
+        ASSERT_TRUE(get_be16(rec + 32) == 10 && get_be16(rec + 34) == 1, "10 Hz");
+        ASSERT_TRUE(get_be16(rec + 48) == 1000 && rec[52] == 11 && rec[53] == 1 && rec[54] == 9, "blockette 1000");
+        ASSERT_TRUE(get_be16(rec + 56) == 1001 && rec[63] >= 1 && rec[63] <= 7, "blockette 1001");
+        if(k < 0 || k > 2)
+        {
+            break;
+        }
+        // Every record starts on its first sample's time, and none
+        // spans the gap.
+        ASSERT_TRUE(got[k] < N && llabs(mseed_start(rec) - tIn[got[k]]) < 1000, "record start time");
+        int n = steim2_decode(rec, out[k] + got[k]);
+        ASSERT_TRUE(n > 0, "Steim-2 frames add up");
+        ASSERT_TRUE(got[k] >= N1 || got[k] + n <= N1, "record ends at the gap");
+        got[k] += (n > 0) ? n : 0;
+    }
+    for(int k = 0; k < 3; k++)
+    {
+        ASSERT_TRUE(got[k] == N && memcmp(in[k], out[k], sizeof in[k]) == 0, "decoded samples match");
+    }
+    ASSERT_TRUE(records > 6, "several records per channel");
+    fclose(op.fp);
+
+    // 37.5 Hz as 75 / 2, in a 4096-byte record written at close.
+    memset(&op, 0, sizeof op);
+    op.fp = tmpfile();
+    ASSERT_TRUE(mseed_open(&op, NULL, (NSEC_PER_SEC / 600) << 4) == 0, "mseed_open 37.5 Hz");
+    r.tNs = t0;
+    mseed_write(&op, &r);
+    mseed_close(&op);
+    static uint8_t big[4096];
+    ASSERT_TRUE(ftell(op.fp) == 3 * 4096, "one 4096-byte record per channel");
+    rewind(op.fp);
+    ASSERT_TRUE(fread(big, 1, sizeof big, op.fp) == sizeof big, "read 4096-byte record");
+    ASSERT_TRUE(get_be16(big + 32) == 75 && (int16_t)get_be16(big + 34) == -2 && big[54] == 12, "rate 75 / 2, 4096 bytes");
+    ASSERT_TRUE(memcmp(big + 8, "XXX    BFX", 10) == 0 && get_be16(big + 30) == 1, "default station, one sample");
+    fclose(op.fp);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_timeout;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGALRM, &sa, NULL);
+    alarm(30);
+
+    test_timestamp_formats();
+    test_timestamp_cache_rollover();
+    test_binary_layout();
+    test_fixed_parity();
+    test_record_parity();
+    test_cbor_msgpack();
+    test_mseed_steim2();
+
+    alarm(0);
+
+    if (tests_failed)
+    {
+        fprintf(OUTPUT_ERROR, "\nTESTS FAILED: %d\n", tests_failed);
+        return 1;
+    }
+    printf("All tests passed.\n");
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "samplering.h"
+
+static int tests_failed = 0;
+#define ASSERT_TRUE(cond, msg)                                                                                         \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s\n", msg);                                                         \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+#define ASSERT_EQ_INT(a, b, msg)                                                                                       \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if ((a) != (b))                                                                                                \
+        {                                                                                                              \
+            fprintf(OUTPUT_ERROR, "ASSERT FAILED: %s (got %d expected %d)\n", msg, (int)(a), (int)(b));                \
+            tests_failed++;                                                                                            \
+        }                                                                                                              \
+    } while (0)
+
+static void on_timeout(int sig)
+{
+    (void)sig;
+    const char msg[] = "\nTEST TIMEOUT: tests did not progress. Failing gracefully.\n";
+    write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    _exit(124);
+}
+
+static void test_fifo_order_and_overflow()
+{
+    static sampleRing ring;
+    magSample s;
+
+    ASSERT_EQ_INT(ring_init(&ring), 0, "ring_init");
+    ASSERT_EQ_INT(ring_wait(&ring, 0), 0, "wait on empty ring times out");
+    ASSERT_TRUE(!ring_pop(&ring, &s), "pop on empty ring");
+
+    memset(&s, 0, sizeof s);
+    for (int i = 0; i < SAMPLE_RING_LEN; ++i)
+    {
+        s.seq = (uint64_t)i;
+        ASSERT_TRUE(ring_push(&ring, &s), "push while not full");
+    }
+    s.seq = 999;
+    ASSERT_TRUE(!ring_push(&ring, &s), "push into full ring is refused");
+    ASSERT_EQ_INT((int)ring_overflows(&ring), 1, "overflow counted");
+    ASSERT_EQ_INT(ring_wait(&ring, 0), 1, "wait reports queued samples");
+
+    for (int i = 0; i < SAMPLE_RING_LEN; ++i)
+    {
+        ASSERT_TRUE(ring_pop(&ring, &s), "pop while not empty");
+        ASSERT_EQ_INT((int)s.seq, i, "samples come out in push order");
+    }
+    ASSERT_TRUE(!ring_pop(&ring, &s), "ring drained");
+    ring_close(&ring);
+}
+
+typedef struct
+{
+    sampleRing *ring;
+    int count;
+} producer_ctx_t;
+
+static void* producer_thread(void* arg)
+{
+    producer_ctx_t *ctx = (producer_ctx_t *)arg;
+    magSample s;
+    memset(&s, 0, sizeof s);
+    for (int i = 0; i < ctx->count; ++i)
+    {
+        s.seq = (uint64_t)i;
+        while (!ring_push(ctx->ring, &s))
+        {
+            usleep(100);
+        }
+    }
+    return NULL;
+}
+
+static void test_threaded_handoff()
+{
+    static sampleRing ring;
+    magSample s;
+    pthread_t tid;
+
+    ASSERT_EQ_INT(ring_init(&ring), 0, "ring_init");
+    producer_ctx_t ctx = { &ring, 10000 };
+    pthread_create(&tid, NULL, producer_thread, &ctx);
+
+    uint64_t expect = 0;
+    bool in_order = true;
+    while (expect < (uint64_t)ctx.count)
+    {
+        if (ring_wait(&ring, 1000) <= 0)
+        {
+            break;
+        }
+        while (ring_pop(&ring, &s))
+        {
+            if (s.seq != expect)
+            {
+                in_order = false;
+            }
+            expect++;
+        }
+    }
+    pthread_join(tid, NULL);
+    ASSERT_EQ_INT((int)expect, ctx.count, "every sample handed over");
+    ASSERT_TRUE(in_order, "no sample reordered or duplicated");
+    ring_close(&ring);
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_timeout;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGALRM, &sa, NULL);
+    alarm(30);
+
+    test_fifo_order_and_overflow();
+    test_threaded_handoff();
+
+    alarm(0);
+
+    if (tests_failed)
+    {
+        fprintf(OUTPUT_ERROR, "\nTESTS FAILED: %d\n", tests_failed);
+        return 1;
+    }
+    printf("All tests passed.\n");
+    return 0;
+}
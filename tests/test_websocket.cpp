@@ -79,6 +79,13 @@ int main(void) {
         return 1;
     }
 
+    int fds[WS_MAX_CONNS + 1];
+    if (ws_server_fds(fds, WS_MAX_CONNS + 1) != 1) {
+        fprintf(stderr, "Expected only the listening socket before any client.\n");
+        ws_server_shutdown();
+        return 1;
+    }
+
     std::thread server_thread([&running]() {
         while (running.load()) {
             ws_server_poll();
@@ -100,7 +107,15 @@ int main(void) {
     poll_loop(client, handler, 50);
 
     const char *msg = "{ \"test\": true }";
-    ws_server_broadcast(msg, strlen(msg));
+    int failed = -1;
+    int sent = ws_server_broadcast(msg, strlen(msg), &failed);
+    if (sent != 1 || failed != 0) {
+        fprintf(stderr, "Broadcast reached %d client(s), %d failed.\n", sent, failed);
+        running.store(false);
+        server_thread.join();
+        ws_server_shutdown();
+        return 1;
+    }
 
     if (!poll_loop(client, handler, 200)) {
         fprintf(stderr, "Timed out waiting for WebSocket message.\n");
@@ -119,6 +134,13 @@ int main(void) {
 
     running.store(false);
     server_thread.join();
+    int nfds = ws_server_fds(fds, WS_MAX_CONNS + 1);
+    if (nfds != 2 || fds[1] == fds[0]) {
+        fprintf(stderr, "Expected the client and listening sockets, got %d fd(s).\n", nfds);
+        ws_server_shutdown();
+        return 1;
+    }
+
     ws_server_shutdown();
     return 0;
 }
@@ -44,6 +44,8 @@ public:
 
   bool isConnected() { return fd_ >= 0; }
 
+  int getFd() { return fd_; }
+
   bool connect(const char* server_ip, uint16_t server_port) {
     int fd = socket(AF_INET, SOCK_STREAM, 0);
     if (fd < 0) {
@@ -213,6 +215,8 @@ public:
 
   const char* getLastError() { return last_error_; };
 
+  int getFd() { return listenfd_; }
+
   ~SocketTcpServer() { close("destruct"); }
 
   bool accept2(TcpConnection& conn) {
@@ -544,6 +548,17 @@ public:
     return server_.init("", server_ip, server_port);
   }
 
+  // fds that poll() has work for when readable: each open connection, then the listening socket while a slot is
+  // free or held by a closed connection that poll() will release. Returns the number written to fds, at most max.
+  uint32_t getFds(int* fds, uint32_t max) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < conns_cnt_ && n < max; i++) {
+      if (conns_[i]->isConnected()) fds[n++] = conns_[i]->conn.getFd();
+    }
+    if (n < MaxConns && n < max && server_.getFd() >= 0) fds[n++] = server_.getFd();
+    return n;
+  }
+
   void poll(EventHandler* handler) {
     uint64_t now = getns();
     uint64_t new_expire = newconn_timeout_ ? now + newconn_timeout_ : std::numeric_limits<uint64_t>::max();
@@ -0,0 +1,118 @@
+// Record formatting cost, in ns per record.
+//
+//   recfmt-bench [records]
+//
+// Times fmt_record() on a single-sensor POLL record, in each timestamp
+// format, and on a 4-sensor gradiometer record, and the CBOR and
+// MessagePack encodings of the same records, next to one snprintf() of
+// the single-sensor JSON line as a baseline.  Sizes are bytes per
+// record.  Run it on the target (a Pi) for numbers that
+// mean anything.
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "recfmt.h"
+#include "recenc.h"
+#include "timeutil.h"
+
+static volatile size_t sink;
+
+static void fill(magRecord *r, int numMags, int i)
+{
+    memset(r, 0, sizeof *r);
+    r->seq         = 1000000 + (uint64_t)i;
+    r->tNs         = 1792281600LL * NSEC_PER_SEC + (int64_t)i * 1666667;
+    r->tUncNs      = 412000 + i % 977;
+    r->tempValid   = TRUE;
+    r->tempCelsius = 21.0 + (i % 400) * 0.0625;
+    r->tempAge     = (i % 300) * 0.1;
+    r->numMags     = numMags;
+    r->validMask   = (1u << numMags) - 1;
+    for (int m = 0; m < numMags; ++m)
+    {
+        r->nT[m][0] = 18234.123 + (i % 1013) * 13.333 + m;
+        r->nT[m][1] = -1432.987 - (i % 917) * 13.333 - m;
+        r->nT[m][2] = 51234.5 + (i % 1021) * 13.333 + m;
+    }
+}
+
+static size_t baseline(const magRecord *r, char *buf, size_t len)
+{
+    struct tm tm;
+    char ts[32];
+    time_t sec = (time_t)(r->tNs / NSEC_PER_SEC);
+    gmtime_r(&sec, &tm);
+    strftime(ts, sizeof ts, "%d %b %Y %T", &tm);
+    return (size_t)snprintf(buf, len,
+                            "{ \"ts\":\"%s\", \"seq\":%" PRIu64 ", \"t_ns\":%" PRId64 ", \"t_unc_ns\":%" PRId64
+                            ", \"rt\":%.2f, \"rt_age\":%.1f, \"x\":%.3f, \"y\":%.3f, \"z\":%.3f }\n",
+                            ts, r->seq, r->tNs, r->tUncNs, r->tempCelsius, r->tempAge,
+                            r->nT[0][0], r->nT[0][1], r->nT[0][2]);
+}
+
+#define BASELINE    0
+#define JSON        1
+#define CBOR        2
+#define MSGPACK     3
+
+// One record in mode; arg is the timestamp format for JSON and the
+// float width for CBOR and MessagePack.
+static size_t encode(const pList *p, const magRecord *r, int mode, int arg, char *buf, size_t len)
+{
+    switch (mode)
+    {
+        case BASELINE:
+            return baseline(r, buf, len);
+        case CBOR:
+            return enc_record(p, r, ENC_CBOR, arg, (uint8_t *)buf, len);
+        case MSGPACK:
+            return enc_record(p, r, ENC_MSGPACK, arg, (uint8_t *)buf, len);
+        default:
+            return fmt_record(p, r, arg, buf, len);
+    }
+}
+
+static void run(const char *name, const pList *p, int numMags, int mode, int arg, int n)
+{
+    static magRecord recs[1024];
+    char buf[FMT_RECORD_MAX];
+
+    for (int i = 0; i < 1024; ++i)
+    {
+        fill(&recs[i], numMags, i);
+    }
+    int64_t t0 = mono_ns();
+    for (int i = 0; i < n; ++i)
+    {
+        sink += encode(p, &recs[i & 1023], mode, arg, buf, sizeof buf);
+    }
+    int64_t t1 = mono_ns();
+    printf("%-32s %8.1f ns/record  (%zu bytes)\n", name, (double)(t1 - t0) / n,
+           encode(p, &recs[0], mode, arg, buf, sizeof buf));
+}
+
+int main(int argc, char **argv)
+{
+    static pList p;
+    int n = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+    if (n <= 0)
+    {
+        n = 1000000;
+    }
+    run("snprintf, 1 sensor", &p, 1, BASELINE, 0, n);
+    run("fmt_record, 1 sensor", &p, 1, JSON, FMT_TS_TEXT, n);
+    run("fmt_record, 1 sensor, iso_us", &p, 1, JSON, FMT_TS_ISO_US, n);
+    run("fmt_record, 1 sensor, epoch_ns", &p, 1, JSON, FMT_TS_EPOCH_NS, n);
+    run("cbor, 1 sensor", &p, 1, CBOR, 64, n);
+    run("cbor, 1 sensor, float32", &p, 1, CBOR, 32, n);
+    run("msgpack, 1 sensor", &p, 1, MSGPACK, 64, n);
+    run("msgpack, 1 sensor, float32", &p, 1, MSGPACK, 32, n);
+    run("fmt_record, 4 sensors", &p, 4, JSON, FMT_TS_TEXT, n);
+    run("cbor, 4 sensors", &p, 4, CBOR, 64, n);
+    run("msgpack, 4 sensors", &p, 4, MSGPACK, 64, n);
+    return 0;
+}